@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_core.h"
+#include "mpu6050_srv.h"
+
+#include <signal.h>		/* for sigaction() */
+#include <stdio.h>		/* for fprintf() */
+#include <stdlib.h>		/* for strtoul(), EXIT_SUCCESS, EXIT_FAILURE */
+#include <unistd.h>		/* for getopt() */
+
+/*
+ * mpu6050d - serve readings over a Unix domain socket
+ *
+ * Owns the device, samples it continuously and streams every reading to
+ * the clients of a struct mpu_srv, see mpu6050_srv.h for the protocol.
+ */
+#define MPU6050D_DEV	"/dev/i2c-1"
+#define MPU6050D_SOCK	"/run/mpu6050.sock"
+#define MPU6050D_POLL	100	/* client service rate (Hz)	*/
+#define MPU6050D_WAIT	1	/* first wait after a failed read (ms) */
+#define MPU6050D_WAIT_MAX 1000	/* longest wait between retries (ms) */
+#define MPU6050D_FAILS	20	/* consecutive failed reads, then exit */
+
+static volatile sig_atomic_t quit;
+
+static void mpu6050d_quit(int sig)
+{
+	(void)sig;
+	quit = 1;
+}
+
+static void mpu6050d_usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c] [-d device] [-s socket] [-r rate]\n"
+			"  -c  restore the calibration file instead of resetting\n"
+			"  -d  i2c device, default %s\n"
+			"  -s  socket path, default %s\n"
+			"  -r  sampling rate (Hz)\n", name, MPU6050D_DEV, MPU6050D_SOCK);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = MPU6050D_DEV;
+	const char *sock = MPU6050D_SOCK;
+	unsigned long rate = 0;
+	int mode = MPU6050_RESET;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "cd:s:r:h"))) {
+		switch (opt) {
+		case 'c': mode = MPU6050_RESTORE;		break;
+		case 'd': path = optarg;			break;
+		case 's': sock = optarg;			break;
+		case 'r': rate = strtoul(optarg, NULL, 10);	break;
+		default:
+			mpu6050d_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct sigaction sa = { .sa_handler = mpu6050d_quit };
+	sigaction(SIGINT,  &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	struct mpu_dev *dev = NULL;
+	if (mpu_init(path, &dev, mode) < 0) {
+		fprintf(stderr, "%s: cannot open %s\n", argv[0], path);
+		return EXIT_FAILURE;
+	}
+	if ((rate > 0) && (mpu_ctl_samplerate(dev, (unsigned int)rate) < 0)) {
+		fprintf(stderr, "%s: rate %lu Hz refused\n", argv[0], rate);
+		mpu_destroy(dev);
+		return EXIT_FAILURE;
+	}
+
+	struct mpu_srv srv;
+	if (mpu_srv_open(&srv, sock, dev) < 0) {
+		fprintf(stderr, "%s: cannot listen on %s\n", argv[0], sock);
+		mpu_destroy(dev);
+		return EXIT_FAILURE;
+	}
+
+	/* clients are served a hundred times a second, not every sample */
+	unsigned long long next = 0;
+	unsigned int fails = 0;
+	int wait = MPU6050D_WAIT;
+	int ret = EXIT_SUCCESS;
+	while (!quit) {
+		if (mpu_get_data(dev) < 0) { /* back off, serving clients meanwhile */
+			if (++fails >= MPU6050D_FAILS) {
+				fprintf(stderr, "%s: %u reads failed in a row, giving up\n", argv[0], fails);
+				ret = EXIT_FAILURE;
+				break;
+			}
+			mpu_srv_poll(&srv, wait);
+			wait = (2 * wait < MPU6050D_WAIT_MAX) ? 2 * wait : MPU6050D_WAIT_MAX;
+			continue;
+		}
+		fails = 0;
+		wait = MPU6050D_WAIT;
+		mpu_srv_push(&srv);
+		if (dev->samples >= next) {
+			mpu_srv_poll(&srv, 0);
+			unsigned long long every = (unsigned long long)(dev->sr / MPU6050D_POLL);
+			next = dev->samples + ((every > 0) ? every : 1);
+		}
+	}
+
+	fprintf(stderr, "%s: %llu frames sent in %llu calls, %llu dropped\n",
+		argv[0], srv.sent, srv.calls, srv.dropped);
+	mpu_srv_close(&srv);
+	mpu_destroy(dev);
+
+	return ret;
+}
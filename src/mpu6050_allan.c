@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_allan.h"
+
+#include <stdlib.h>		/* for calloc(), free() */
+#include <string.h>		/* for memset() */
+#include <tgmath.h>		/* for sqrt, log, fabs */
+
+#define ALLAN_HIST (MPU6050_ALLAN_RING + 1)
+
+/* integrated signal history for one octave */
+struct mpu_allan_lvl {
+	unsigned long long stride;	/* samples between stored values	*/
+	unsigned int span;		/* stored values per cluster		*/
+	unsigned int head;		/* next write position			*/
+	unsigned int fill;		/* stored values			*/
+	unsigned long long terms;	/* accumulated differences		*/
+	long double acc[MPU6050_ALLAN_AXES];		/* squared differences	*/
+	double hist[MPU6050_ALLAN_AXES][ALLAN_HIST];	/* integrated signal	*/
+};
+
+static void mpu_allan_push(struct mpu_allan *al, struct mpu_allan_lvl *l);
+static void mpu_allan_coef(struct mpu_allan *al, int axis);
+
+int mpu_allan_init(struct mpu_allan *al, double tau0)
+{
+	if (NULL == al) /* no object */
+		return -1;
+
+	if (!(tau0 > 0)) /* invalid sampling time */
+		return -1;
+
+	memset(al, 0, sizeof(*al));
+	if (NULL == (al->lvl = calloc(MPU6050_ALLAN_LEVELS, sizeof(struct mpu_allan_lvl))))
+		return -1;
+
+	al->tau0 = tau0;
+	for (int k = 0; k < MPU6050_ALLAN_LEVELS; k++) {
+		struct mpu_allan_lvl *l = &al->lvl[k];
+		unsigned long long m = 1ULL << k;
+		unsigned long long half = MPU6050_ALLAN_RING / 2;
+
+		l->stride = (m <= half) ? 1 : m / half;
+		l->span   = (unsigned int)(m / l->stride);
+		mpu_allan_push(al, l); /* integral starts at zero */
+	}
+
+	return 0;
+}
+
+int mpu_allan_free(struct mpu_allan *al)
+{
+	if (NULL == al) /* no object */
+		return -1;
+
+	free(al->lvl);
+	al->lvl = NULL;
+
+	return 0;
+}
+
+int mpu_allan_add(struct mpu_allan *al, const double *y)
+{
+	if ((NULL == al) || (NULL == al->lvl) || (NULL == y))
+		return -1;
+
+	if (0 == al->n) { /* Allan variance ignores constant offsets */
+		for (int a = 0; a < MPU6050_ALLAN_AXES; a++)
+			al->y0[a] = y[a];
+	}
+
+	al->n++;
+	for (int a = 0; a < MPU6050_ALLAN_AXES; a++)
+		al->theta[a] += y[a] - al->y0[a];
+
+	/* strides grow with the octave, stop at the first one not due */
+	for (int k = 0; k < MPU6050_ALLAN_LEVELS; k++) {
+		struct mpu_allan_lvl *l = &al->lvl[k];
+		if (al->n & (l->stride - 1))
+			break;
+		mpu_allan_push(al, l);
+	}
+
+	return 0;
+}
+
+/* store the integral, accumulate the second difference once a window fits */
+static void mpu_allan_push(struct mpu_allan *al, struct mpu_allan_lvl *l)
+{
+	unsigned int len = 2 * l->span + 1;
+	unsigned int now = l->head;
+
+	for (int a = 0; a < MPU6050_ALLAN_AXES; a++)
+		l->hist[a][now] = (double)al->theta[a];
+
+	l->head = (now + 1) % len;
+	if (l->fill < len)
+		l->fill++;
+	if (l->fill < len)
+		return;
+
+	unsigned int mid = (now + len - l->span) % len;
+	unsigned int old = (now + len - 2 * l->span) % len;
+	for (int a = 0; a < MPU6050_ALLAN_AXES; a++) {
+		double d = l->hist[a][now] - 2 * l->hist[a][mid] + l->hist[a][old];
+		l->acc[a] += (long double)d * d;
+	}
+	l->terms++;
+}
+
+int mpu_allan_eval(struct mpu_allan *al)
+{
+	if ((NULL == al) || (NULL == al->lvl))
+		return -1;
+
+	al->levels = 0;
+	for (int k = 0; k < MPU6050_ALLAN_LEVELS; k++) {
+		struct mpu_allan_lvl *l = &al->lvl[k];
+		if (0 == l->terms)
+			break;
+
+		/* cluster averages differ by d / m, AVAR = E[(d / m)^2] / 2 */
+		double m = (double)(1ULL << k);
+		al->tau[k] = m * al->tau0;
+		al->terms[k] = l->terms;
+		for (int a = 0; a < MPU6050_ALLAN_AXES; a++)
+			al->adev[a][k] = sqrt((double)(l->acc[a] / l->terms) / (2 * m * m));
+		al->levels++;
+	}
+
+	if (al->levels < 2) /* no slopes yet */
+		return -1;
+
+	for (int a = 0; a < MPU6050_ALLAN_AXES; a++)
+		mpu_allan_coef(al, a);
+
+	return 0;
+}
+
+/*
+ * Noise coefficients read off the log-log curve (IEEE Std 952):
+ * random walk where the slope is closest to -1/2, evaluated at tau = 1 s;
+ * bias instability at the floor, scaled by sqrt(2 ln 2 / pi);
+ * rate random walk where the slope is closest to +1/2, at tau = 3 s.
+ */
+static void mpu_allan_coef(struct mpu_allan *al, int a)
+{
+	const double *s = al->adev[a];
+	const double *t = al->tau;
+	int n = al->levels;
+
+	int kmin = 0;
+	for (int k = 1; k < n; k++) {
+		if (s[k] < s[kmin])
+			kmin = k;
+	}
+
+	double slope[MPU6050_ALLAN_LEVELS];
+	for (int k = 0; k < n; k++) {
+		int lo = (k > 0) ? k - 1 : k;
+		int hi = (k < n - 1) ? k + 1 : k;
+		if ((s[lo] > 0) && (s[hi] > 0))
+			slope[k] = log(s[hi] / s[lo]) / log(t[hi] / t[lo]);
+		else
+			slope[k] = 0;
+	}
+
+	int karw = 0;
+	for (int k = 1; k <= kmin; k++) {
+		if (fabs(slope[k] + 0.5) < fabs(slope[karw] + 0.5))
+			karw = k;
+	}
+	al->arw[a] = s[karw] * sqrt(t[karw]);
+	al->bi[a]  = s[kmin] / sqrt(2 * log(2.0) / M_PI);
+
+	int krrw = -1;
+	for (int k = kmin + 1; k < n; k++) {
+		if ((krrw < 0) || (fabs(slope[k] - 0.5) < fabs(slope[krrw] - 0.5)))
+			krrw = k;
+	}
+	al->rrw[a] = (krrw < 0) ? NAN : s[krrw] * sqrt(3 / t[krrw]);
+}
+
+int mpu_allan_run(struct mpu_dev *dev, struct mpu_allan *al, unsigned long long samples)
+{
+	if ((NULL == dev) || (NULL == al) || (NULL == al->lvl))
+		return -1;
+
+	if ((NULL == dev->Ax) || (NULL == dev->Gx) || (NULL == dev->Gy) || (NULL == dev->Gz))
+		return -1; /* accelerometer and gyroscope must be buffered */
+
+	for (unsigned long long i = 0; i < samples; i++) {
+		if (mpu_get_data(dev) < 0)
+			return -1;
+
+		double y[MPU6050_ALLAN_AXES] = {
+			*(dev->Ax), *(dev->Ay), *(dev->Az),
+			*(dev->Gx), *(dev->Gy), *(dev->Gz),
+		};
+		if (mpu_allan_add(al, y) < 0)
+			return -1;
+	}
+
+	return mpu_allan_eval(al);
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_ALLAN_H_
+#define _MPU6050_ALLAN_H_
+#include "mpu6050_core.h"
+
+/*
+ * Streaming overlapping Allan deviation
+ *
+ * Cluster times grow in octaves, tau = 2^k * tau0. Each octave keeps a
+ * bounded history of the integrated signal: short clusters are fully
+ * overlapped, long ones are evaluated at a stride of 2^k / (RING / 2)
+ * samples. Memory does not depend on record length, so hours of data
+ * stream through without being stored.
+ *
+ * Axes are, in order, Ax, Ay, Az (g) and Gx, Gy, Gz (degrees/s).
+ * Random walk coefficients are reported in units * sqrt(s), that is
+ * g/sqrt(s) for velocity and degrees/sqrt(s) for angle random walk.
+ */
+#define MPU6050_ALLAN_AXES	6
+#define MPU6050_ALLAN_LEVELS	24	/* tau up to 2^23 * tau0	*/
+#define MPU6050_ALLAN_RING	256	/* history per octave		*/
+
+struct mpu_allan_lvl;
+
+struct mpu_allan {
+	double	tau0;				/* sampling time (s)		*/
+	unsigned long long n;			/* samples accumulated		*/
+	int	levels;				/* octaves with results		*/
+	double	tau[MPU6050_ALLAN_LEVELS];	/* cluster time (s)		*/
+	unsigned long long terms[MPU6050_ALLAN_LEVELS]; /* averaged differences */
+	double	adev[MPU6050_ALLAN_AXES][MPU6050_ALLAN_LEVELS]; /* deviation	*/
+	double	arw[MPU6050_ALLAN_AXES];	/* random walk, slope -1/2	*/
+	double	bi[MPU6050_ALLAN_AXES];		/* bias instability, flat floor	*/
+	double	rrw[MPU6050_ALLAN_AXES];	/* rate random walk, slope +1/2	*/
+	double	y0[MPU6050_ALLAN_AXES];		/* first sample, keeps sums small */
+	long double theta[MPU6050_ALLAN_AXES];	/* integrated signal		*/
+	struct mpu_allan_lvl *lvl;		/* per octave history		*/
+};
+
+int mpu_allan_init	(struct mpu_allan *al, double tau0);
+int mpu_allan_free	(struct mpu_allan *al);
+int mpu_allan_add	(struct mpu_allan *al, const double *y);
+int mpu_allan_eval	(struct mpu_allan *al);
+int mpu_allan_run	(struct mpu_dev *dev, struct mpu_allan *al, unsigned long long samples);
+
+#endif /* _MPU6050_ALLAN_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_batch.h"
+#include "mpu6050_time.h"
+
+#include <math.h>		/* for floor() */
+#include <string.h>		/* for memset() */
+
+/* frames per drain between min and max, the worst reading within max_lat */
+int mpu_batch_init(struct mpu_batch *bp, double max_lat, unsigned int min, unsigned int max)
+{
+	if (NULL == bp) /* no object */
+		return -1;
+
+	if (!(max_lat > 0) || (0 == min) || (min > max)) /* invalid policy */
+		return -1;
+
+	memset(bp, 0, sizeof(*bp));
+	bp->max_lat = max_lat;
+	bp->min     = min;
+	bp->max     = max;
+	bp->frames  = min;
+
+	return 0;
+}
+
+/*
+ * Frames the next drain should wait for. The time since the previous
+ * drain ended is what the caller spent on the readings it returned.
+ */
+int mpu_batch_plan(struct mpu_batch *bp, const struct mpu_dev *dev, unsigned int *frames)
+{
+	if ((NULL == bp) || (NULL == dev) || (NULL == frames))
+		return -1;
+
+	int frame = 2 * dev->fifosensors;
+	if (0 == frame) /* nothing buffered */
+		return -1;
+
+	double now = mpu_clock();
+	if ((bp->t_end > 0) && (bp->last > 0)) {
+		double c = (now - bp->t_end) / bp->last;
+		bp->consume = (bp->consume > 0) ? bp->consume + MPU6050_BATCH_GAIN * (c - bp->consume) : c;
+	}
+
+	/* until a drain is timed, 9 clocks a byte at the nominal bus rate */
+	double b = bp->byte_time;
+	if (!(b > 0) && (dev->bus_hz > 0))
+		b = 9.0 / dev->bus_hz;
+
+	/* speculative reads leave the newest frame for the next drain */
+	double lat = dev->fifo_spec ? bp->max_lat - dev->st : bp->max_lat;
+	double m = (bp->consume > dev->st) ? bp->consume : dev->st;
+	double n = floor((lat + m - b * MPU6050_BATCH_HDR) / (b * frame + m));
+
+	double cap = floor((dev->fifomax + 1) / 2.0 / frame); /* overflow headroom */
+	n = (n > bp->max) ? bp->max : n;
+	n = (n > cap) ? cap : n;
+	n = (n < bp->min) ? bp->min : n;
+	n = (n < 1) ? 1 : n;
+
+	bp->frames = (unsigned int)n;
+	bp->drains++;
+	*frames = bp->frames;
+
+	return 0;
+}
+
+/* account a drain of frames that kept the bus busy for busy seconds */
+int mpu_batch_done(struct mpu_batch *bp, const struct mpu_dev *dev, unsigned int frames, double busy)
+{
+	if ((NULL == bp) || (NULL == dev))
+		return -1;
+
+	int frame = 2 * dev->fifosensors;
+	if ((0 == frame) || (0 == frames)) /* nothing read */
+		return -1;
+
+	double bt = busy / ((double)frames * frame + MPU6050_BATCH_HDR);
+	bp->byte_time = (bp->byte_time > 0) ? bp->byte_time + MPU6050_BATCH_GAIN * (bt - bp->byte_time) : bt;
+
+	double m = (bp->consume > dev->st) ? bp->consume : dev->st;
+	bp->lat = busy + (frames - 1) * m;
+	if (bp->lat > bp->max_lat)
+		bp->late++;
+
+	bp->drained += frames;
+	bp->last     = frames;
+	bp->t_end    = mpu_clock();
+
+	return 0;
+}
+
+/* forget the measurements, for instance after the sampling rate changed */
+int mpu_batch_reset(struct mpu_batch *bp)
+{
+	if (NULL == bp)
+		return -1;
+
+	bp->frames    = bp->min;
+	bp->byte_time = 0;
+	bp->consume   = 0;
+	bp->lat       = 0;
+	bp->t_end     = 0;
+	bp->last      = 0;
+	bp->drains    = 0;
+	bp->drained   = 0;
+	bp->late      = 0;
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_BATCH_H_
+#define _MPU6050_BATCH_H_
+#include "mpu6050_core.h"
+
+/*
+ * Adaptive fifo batching
+ *
+ * Attached with mpu_ctl_batch(), the policy decides how many frames
+ * mpu_get_data() lets the fifo gather before draining them in one go,
+ * and sleeps until they are there instead of polling the count. Larger
+ * batches cost fewer transactions per frame; the oldest frame of a
+ * batch waits for the newest, so the batch is the largest one whose
+ * worst reading still reaches the caller within max_lat:
+ *
+ *	xfer(frames) + (frames - 1) * max(st, consume) <= max_lat
+ *
+ * where xfer is the measured time of a drain, scaled to its length,
+ * and consume the measured time the caller takes per reading. Both are
+ * running averages, updated after every drain, so the batch follows
+ * bus contention and a slow or fast caller. It never leaves less than
+ * min nor more than max frames, nor more than half the fifo.
+ */
+#define MPU6050_BATCH_GAIN	0.125	/* running average weight	*/
+#define MPU6050_BATCH_HDR	8	/* bytes of overhead per drain	*/
+
+struct mpu_batch {
+	double	max_lat;	/* sample to caller, target (s)		*/
+	unsigned int min;	/* frames per drain, at least		*/
+	unsigned int max;	/* frames per drain, at most		*/
+	unsigned int frames;	/* current batch			*/
+	double	byte_time;	/* transfer time per byte (s)		*/
+	double	consume;	/* caller time per reading (s)		*/
+	double	lat;		/* worst latency of the last batch (s)	*/
+	double	t_end;		/* end of the last drain (s)		*/
+	unsigned int last;	/* frames it read			*/
+	unsigned long long drains;	/* drains planned		*/
+	unsigned long long drained;	/* frames they read		*/
+	unsigned long long late;	/* batches over max_lat		*/
+};
+
+int mpu_batch_init	(struct mpu_batch *bp, double max_lat, unsigned int min, unsigned int max);
+int mpu_batch_plan	(struct mpu_batch *bp, const struct mpu_dev *dev, unsigned int *frames);
+int mpu_batch_done	(struct mpu_batch *bp, const struct mpu_dev *dev, unsigned int frames, double busy);
+int mpu_batch_reset	(struct mpu_batch *bp);
+
+#endif /* _MPU6050_BATCH_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
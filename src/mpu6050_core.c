@@ -2,21 +2,71 @@
 /* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
 #include "mpu6050_core.h"
 #include "mpu6050_regs.h"
-
-#include <stdlib.h>		/* for malloc(), free(), exit() */
+#include "mpu6050_fusion.h"
+#include "mpu6050_decim.h"
+#include "mpu6050_log.h"
+#include "mpu6050_replay.h"
+#include "mpu6050_shm.h"
+#include "mpu6050_rt.h"
+#include "mpu6050_batch.h"
+#include "mpu6050_idle.h"
+#include "mpu6050_iio.h"
+#include "mpu6050_time.h"
+
+#include <stdlib.h>		/* for calloc(), free() */
 #include <stdint.h>		/* for uint8_t, uint16_t, etc */
+#include <stddef.h>		/* for offsetof() */
 #include <string.h>		/* for memcpy(), strlen() */
 #include <stdio.h>
 #include <tgmath.h>		/* for sin, cos, tan, atan2 etc */
 #include <fcntl.h>		/* for open() */
 #include <unistd.h>		/* for close(), write(), getopt(), size_t */
+#include <errno.h>		/* for EOPNOTSUPP */
 #include <sys/types.h>		/* for ssize_t */
 #include <sys/ioctl.h>		/* for ioctl() */
+#include <sys/timerfd.h>	/* for timerfd_create(), timerfd_settime() */
 #include <linux/i2c-dev.h>	/* for i2c_smbus_x */
 #include <linux/i2c-dev.h>	/* for i2c_smbus_x */
 #include <i2c/smbus.h> 		/* for i2c_smbus_x */
 #include <linux/i2c.h> 		/* for i2c_smbus_x */
 
+#ifndef MPU6050_TCB_LEN
+#define MPU6050_TCB_LEN 16	/* temperature bias table knots */
+#endif
+
+#define MPU6050_TCB_TMIN  -40.0	/* lowest operating temperature (C) */
+#define MPU6050_TCB_TRES    0.5	/* temperature binning resolution (C) */
+#define MPU6050_TCB_BINS  250	/* bins from -40C to +85C */
+#define MPU6050_TCB_SPAN    2.0	/* minimum temperature sweep for a fit (C) */
+
+#define MPU6050_FIFO_LEN 1024	/* device fifo capacity in bytes */
+#define MPU6050_OUT_WORDS   7	/* ACCEL_XOUT_H to GYRO_ZOUT_L */
+#define MPU6050_DRDY_POLL  16	/* data ready polls per sampling period */
+#define MPU6050_REGSET	 32	/* registers in one set write or read */
+#define MPU6050_AUX_POLL    4	/* slave 4 status polls per sampling period */
+#define MPU6050_AUX_WAIT    4	/* sampling periods a slave 4 transfer may take */
+
+/* i2c clocks: 9 per byte with its ack, about 3 for start, restart, stop */
+#define MPU6050_I2C_BYTE   9
+#define MPU6050_I2C_FRAME  3
+#define MPU6050_I2C_RD_HDR 3	/* address, register, address again */
+#define MPU6050_I2C_WR_HDR 2	/* address, register */
+
+/* DLPF_CFG characteristics, Register Map rev. 4.2, p. 13 */
+static const struct mpu_dlpf_spec {
+	unsigned int gor;	/* gyro output rate (Hz)	*/
+	double abdw, adly;	/* accel bandwidth (Hz), delay (ms) */
+	double gbdw, gdly;	/* gyro bandwidth (Hz), delay (ms)  */
+} mpu_dlpf_tab[7] = {
+	{ 8000, 260,  0.0, 256,  0.98 },
+	{ 1000, 184,  2.0, 188,  1.90 },
+	{ 1000,  94,  3.0,  98,  2.80 },
+	{ 1000,  44,  4.9,  42,  4.80 },
+	{ 1000,  21,  8.5,  20,  8.30 },
+	{ 1000,  10, 13.8,  10, 13.40 },
+	{ 1000,   5, 19.0,   5, 18.60 },
+};
+
 /* stores calibration related values for reference */
 struct mpu_cal {
 	mpu_data_t gra;		/* mean(sqrt(ax2,ay2,az2)[])		*/
@@ -44,6 +94,18 @@ struct mpu_cal {
 	long double zg_bias;	/* found ZG value bias */
 	long double AM_bias;	/* found AM value bias */
 	long double GM_bias;	/* found GM value bias */
+	mpu_data_t t_cal;	/* mean temperature during calibration */
+	bool tcb_en;		/* temperature compensated bias enabled */
+	mpu_data_t tcb_t0;	/* temperature at first table knot (C) */
+	mpu_data_t tcb_dt;	/* temperature step between knots (C) */
+	mpu_data_t tcb_idt;	/* inverse step, avoids per-sample division */
+	mpu_data_t tcb[6][MPU6050_TCB_LEN]; /* XA,YA,ZA,XG,YG,ZG bias at knots */
+	bool acc_en;		/* accelerometer affine correction enabled */
+	unsigned int acc_poses;	/* bitmask of recorded orientations */
+	mpu_data_t acc_pose[6][3]; /* mean reading (g) at each orientation */
+	mpu_data_t acc_mat[3][3]; /* scale and cross-axis matrix */
+	mpu_data_t acc_off[3];	/* offset (g) */
+	mpu_data_t acc_fus[3][3]; /* acc_mat fused with LSB sensitivity */
 };
 
 /* stores sensor data collection related values */
@@ -56,11 +118,32 @@ struct mpu_dat {
 	mpu_data_t var[32];	/* data variance	*/
 	mpu_data_t AM;		/* accel magnitude	*/
 	mpu_data_t GM;		/* gyro rate magnitude	*/
+	uint8_t fifo[MPU6050_FIFO_LEN]; /* frames drained in one burst */
+	int fifo_pos;		/* next frame in fifo[]	*/
+	int fifo_len;		/* bytes held in fifo[]	*/
+	bool gap;		/* frames were dropped	*/
+	bool gapped;		/* the last frame followed a gap */
+	bool params_dirty;	/* file not written, real-time mode */
+	double ts;		/* last frame time (s)	*/
+	double ts_gap;		/* first frame after a gap (s) */
+	double spec_t;		/* last fifo count, speculative reads (s) */
+	int spec_left;		/* bytes it counted past the frames read */
+	bool spec_reset;	/* fifo reset, the next frames follow a gap */
+	bool spec_split;	/* adapter ends a transaction at its first read */
+	int tfd;		/* sampling period timer, direct reads */
+	bool lp;		/* in the low-power profile		*/
+	mpu_data_t tcb[6];	/* temperature bias of the last full frame */
+	mpu_reg_t lp_regs[3];	/* USER_CTRL to PWR_MGMT_2 to return to	*/
+	unsigned long long io_xfers; /* i2c transactions	*/
+	unsigned long long io_bytes; /* payload bytes	*/
+	unsigned long long io_clks;  /* bus clocks, overhead included */
+	double io_busy;		/* time spent in transfers (s) */
+	double io_t0;		/* start of the measure window (s) */
 };
 
 /* Mirrors configuration register values and their meaning */
 struct mpu_cfg {
-	mpu_reg_t regs[16][2];	/* configuration register values */
+	mpu_reg_t regs[32][2];	/* configuration register values */
 	/* 32 configurations	 9 REGISTER locations */
 	bool sleep;		/* PWR_MGMGT_1 */
 	bool cycle;		/* PWR_MGMGT_1 */
@@ -91,9 +174,15 @@ struct mpu_cfg {
 	bool slv3_fifo_en;	/* I2C_MST_CTRL */
 	bool slv4_fifo_en;	/* I2C_MST_CTRL */
 	bool fsync_int_en;	/* INT_PIN_CFG	__not_supported__ */
+	bool ff_en;		/* INT_ENABLE */
+	bool mot_en;		/* INT_ENABLE */
+	bool zmot_en;		/* INT_ENABLE */
 	bool fifo_oflow_en;	/* INT_ENABLE */
 	bool i2c_mst_int_en;	/* INT_ENABLE */
 	bool data_rdy_en;	/* INT_ENABLE */
+	double aux_scl[4];	/* slave word scaling, 0 for raw */
+	int mag;		/* magnetometer model, MPU6050_MAG_* */
+	unsigned int mag_slv;	/* slave that reads it */
 };
 
 #ifndef MPU6050_ADDR
@@ -102,6 +191,26 @@ struct mpu_cfg {
 
 #define ARRAY_LEN(x) sizeof((x))/sizeof((x[0]))
 
+/*
+ * Leads the configuration file and the mpu_get_params() snapshot logs
+ * keep: struct mpu_cfg and struct mpu_cal follow as this build lays them
+ * out. Bump the version when either changes.
+ */
+#define MPU6050_PARAMS_VERSION	1
+struct mpu_params_hdr {
+	char	 magic[4];	/* "MPUP", no terminator		*/
+	uint32_t version;	/* MPU6050_PARAMS_VERSION		*/
+	uint32_t cfg_len;	/* sizeof(struct mpu_cfg)		*/
+	uint32_t cal_len;	/* sizeof(struct mpu_cal)		*/
+};
+
+static const struct mpu_params_hdr mpu_params_hdr = {
+	.magic   = { 'M', 'P', 'U', 'P' },
+	.version = MPU6050_PARAMS_VERSION,
+	.cfg_len = sizeof(struct mpu_cfg),
+	.cal_len = sizeof(struct mpu_cal),
+};
+
 /* The default values for configuration registers */
 const struct mpu_cfg mpu6050_defcfg = {
 	.regs =	{
@@ -111,15 +220,202 @@ const struct mpu_cfg mpu6050_defcfg = {
 		{ SMPLRT_DIV,   0x4F},	/* divisor = 80(1+79), rate = 100	*/
 		{ ACCEL_CONFIG, 0x00},	/* +-2g					*/
 		{ GYRO_CONFIG,  0x00},	/* +-250 deg/s				*/
+		{ FF_THR,       0x00}, { FF_DUR,    0x00},	/* no free fall	*/
+		{ MOT_THR,      0x00}, { MOT_DUR,   0x00},	/* no motion	*/
+		{ ZRMOT_THR,    0x00}, { ZRMOT_DUR, 0x00},	/* no zero motion */
+		{ MOT_DETECT_CTRL, 0x00}, /* no accel power on delay	*/
 		{ USER_CTRL,    0x60},	/* fifo enabled, aux i2c master mode	*/
 		{ FIFO_EN,  	0xF8},	/* temp, accel, gyro buffered		*/
 		{ INT_PIN_CFG,  0x00},	/* interrupts disabled			*/
 		{ INT_ENABLE,   0x00},	/* interrupts disabled			*/
+		{ I2C_MST_CTRL, 0x00},	/* no slave buffered, 348 kHz		*/
+		{ I2C_SLV0_ADDR, 0x00}, { I2C_SLV0_REG, 0x00}, { I2C_SLV0_CTRL, 0x00},
+		{ I2C_SLV1_ADDR, 0x00}, { I2C_SLV1_REG, 0x00}, { I2C_SLV1_CTRL, 0x00},
+		{ I2C_SLV2_ADDR, 0x00}, { I2C_SLV2_REG, 0x00}, { I2C_SLV2_CTRL, 0x00},
+		{ I2C_SLV3_ADDR, 0x00}, { I2C_SLV3_REG, 0x00}, { I2C_SLV3_CTRL, 0x00},
+		{ I2C_MST_DELAY_CTRL, 0x00}, /* slaves disabled		*/
 	}
 };
 
-/* this should be defined in time.h, but the linter complains */
-extern int nanosleep(const struct timespec *rqtp, struct timespec *rmtp);
+/* FIFO_EN bit of each auxiliary slave, SLV3 has its own in I2C_MST_CTRL */
+static const mpu_reg_t mpu_aux_fifo[MPU6050_AUX_SLAVES][2] = {
+	{ FIFO_EN,      SLV0_FIFO_EN_BIT },
+	{ FIFO_EN,      SLV1_FIFO_EN_BIT },
+	{ FIFO_EN,      SLV2_FIFO_EN_BIT },
+	{ I2C_MST_CTRL, SLV3_FIFO_EN_BIT },
+};
+
+/* magnetometers mpu_ctl_mag() sets up, indexed by MPU6050_MAG_* */
+static const struct mpu_mag_spec {
+	mpu_reg_t addr;		/* 7 bit i2c address		*/
+	mpu_reg_t id_reg, id;	/* identification register, value */
+	unsigned int n_init;	/* writes that start it		*/
+	mpu_reg_t init[3][2];	/* register, value		*/
+	mpu_reg_t reg;		/* first data register		*/
+	unsigned int len;	/* bytes read every sample	*/
+	unsigned int flags;	/* MPU6050_AUX_SWAP if little endian */
+	uint8_t	axis[3];	/* words holding X, Y, Z	*/
+	double	scale;		/* uT per LSB			*/
+} mpu_mag_tab[] = {
+	[MPU6050_MAG_NONE]     = { 0 },
+	/* 75 Hz continuous, +-1.3 Ga, 1090 LSB/Ga; X, Z, Y */
+	[MPU6050_MAG_HMC5883L] = { 0x1E, 0x0A, 'H', 3, { { 0x00, 0x18 }, { 0x01, 0x20 },
+				   { 0x02, 0x00 } },
+				   0x03, 6, 0, { 0, 2, 1 }, 100.0 / 1090 },
+	/* 200 Hz continuous, 512 oversampling, +-8 G, 3000 LSB/G */
+	[MPU6050_MAG_QMC5883L] = { 0x0D, 0x0D, 0xFF, 2, { { 0x0B, 0x01 }, { 0x09, 0x1D } },
+				   0x00, 6, MPU6050_AUX_SWAP, { 0, 1, 2 }, 100.0 / 3000 },
+	/* 100 Hz continuous, 16 bit; ST2 read along, it releases the data */
+	[MPU6050_MAG_AK8963]   = { 0x0C, 0x00, 0x48, 1, { { 0x0A, 0x16 } },
+				   0x03, 8, MPU6050_AUX_SWAP, { 0, 1, 2 }, 0.15 },
+};
+
+/*
+ * Register fields, Register Map rev. 4.2, in address order. Decoding a
+ * register image walks it once: flags land in their struct mpu_cfg
+ * bool, unsupported fields must read 0; multi-bit values are decoded
+ * by mpu_cfg_decode() into struct mpu_dev.
+ */
+static const struct mpu_field {
+	mpu_reg_t reg;		/* register address		*/
+	mpu_reg_t mask;		/* field bits			*/
+	uint8_t	shift;		/* lowest field bit		*/
+	bool	unsup;		/* not supported, must be 0	*/
+	uint16_t flag;		/* offsetof its struct mpu_cfg bool, 0 if none */
+	const char *name;	/* as in the register map	*/
+} mpu_fields[] = {
+#define FLD(reg, f)		{ reg, f##_BIT, __builtin_ctz(f##_BIT), false, 0, #f }
+#define FLD_CFG(reg, f, b)	{ reg, f##_BIT, __builtin_ctz(f##_BIT), false, offsetof(struct mpu_cfg, b), #f }
+#define FLD_UNSUP(reg, f, b)	{ reg, f##_BIT, __builtin_ctz(f##_BIT), true,  b, #f }
+	FLD(SELF_TEST_X, XA_TEST_42),
+	FLD(SELF_TEST_X, XG_TEST_40),
+	FLD(SELF_TEST_Y, YA_TEST_42),
+	FLD(SELF_TEST_Y, YG_TEST_40),
+	FLD(SELF_TEST_Z, ZA_TEST_42),
+	FLD(SELF_TEST_Z, ZG_TEST_40),
+	FLD(SELF_TEST_A, XA_TEST_10),
+	FLD(SELF_TEST_A, YA_TEST_10),
+	FLD(SELF_TEST_A, ZA_TEST_10),
+	{ SMPLRT_DIV, 0xFF, 0, false, 0, "SMPLRT_DIV" },
+	FLD_UNSUP(CONFIG, EXT_SYNC_SET, 0),
+	FLD(CONFIG, DLPF_CFG),
+	FLD_CFG(GYRO_CONFIG, XG_ST, xg_st),
+	FLD_CFG(GYRO_CONFIG, YG_ST, yg_st),
+	FLD_CFG(GYRO_CONFIG, ZG_ST, zg_st),
+	FLD(GYRO_CONFIG, FS_SEL),
+	FLD_CFG(ACCEL_CONFIG, XA_ST, xa_st),
+	FLD_CFG(ACCEL_CONFIG, YA_ST, ya_st),
+	FLD_CFG(ACCEL_CONFIG, ZA_ST, za_st),
+	FLD(ACCEL_CONFIG, AFS_SEL),
+	FLD(ACCEL_CONFIG, ACCEL_HPF),
+	{ FF_THR,    0xFF, 0, false, 0, "FF_THR" },
+	{ FF_DUR,    0xFF, 0, false, 0, "FF_DUR" },
+	{ MOT_THR,   0xFF, 0, false, 0, "MOT_THR" },
+	{ MOT_DUR,   0xFF, 0, false, 0, "MOT_DUR" },
+	{ ZRMOT_THR, 0xFF, 0, false, 0, "ZRMOT_THR" },
+	{ ZRMOT_DUR, 0xFF, 0, false, 0, "ZRMOT_DUR" },
+	FLD_CFG(FIFO_EN, TEMP_FIFO_EN,  temp_fifo_en),
+	FLD_CFG(FIFO_EN, XG_FIFO_EN,    xg_fifo_en),
+	FLD_CFG(FIFO_EN, YG_FIFO_EN,    yg_fifo_en),
+	FLD_CFG(FIFO_EN, ZG_FIFO_EN,    zg_fifo_en),
+	FLD_CFG(FIFO_EN, ACCEL_FIFO_EN, accel_fifo_en),
+	FLD_CFG(FIFO_EN, SLV2_FIFO_EN,  slv2_fifo_en),
+	FLD_CFG(FIFO_EN, SLV1_FIFO_EN,  slv1_fifo_en),
+	FLD_CFG(FIFO_EN, SLV0_FIFO_EN,  slv0_fifo_en),
+	FLD(I2C_MST_CTRL, MULT_MST_EN),
+	FLD(I2C_MST_CTRL, WAIT_FOR_ES),
+	FLD_CFG(I2C_MST_CTRL, SLV3_FIFO_EN, slv3_fifo_en),
+	FLD(I2C_MST_CTRL, I2C_MST_P_NSR),
+	FLD(I2C_MST_CTRL, I2C_MST_CLK),
+#define FLD_SLV(n)	FLD(I2C_SLV##n##_ADDR, I2C_SLV_RW),		\
+			FLD(I2C_SLV##n##_ADDR, I2C_SLV_ADDR),		\
+			FLD(I2C_SLV##n##_CTRL, I2C_SLV_EN),		\
+			FLD(I2C_SLV##n##_CTRL, I2C_SLV_BYTE_SW),	\
+			FLD_UNSUP(I2C_SLV##n##_CTRL, I2C_SLV_REG_DIS, 0), \
+			FLD(I2C_SLV##n##_CTRL, I2C_SLV_GRP),		\
+			FLD(I2C_SLV##n##_CTRL, I2C_SLV_LEN)
+	FLD_SLV(0),
+	FLD_SLV(1),
+	FLD_SLV(2),
+	FLD_SLV(3),
+#undef FLD_SLV
+	FLD(I2C_SLV4_ADDR, I2C_SLV_RW),
+	FLD(I2C_SLV4_ADDR, I2C_SLV_ADDR),
+	FLD(I2C_SLV4_CTRL, I2C_SLV4_EN),
+	FLD(I2C_SLV4_CTRL, I2C_SLV4_INT_EN),
+	FLD(I2C_SLV4_CTRL, I2C_SLV4_REG_DIS),
+	FLD(I2C_SLV4_CTRL, I2C_MST_DLY),
+	FLD(I2C_MAST_STATUS, PASS_THROUGH),
+	FLD(I2C_MAST_STATUS, I2C_SLV4_DONE),
+	FLD(I2C_MAST_STATUS, I2C_LOST_ARB),
+	FLD(I2C_MAST_STATUS, I2C_SLV4_NACK),
+	FLD(I2C_MAST_STATUS, I2C_SLV3_NACK),
+	FLD(I2C_MAST_STATUS, I2C_SLV2_NACK),
+	FLD(I2C_MAST_STATUS, I2C_SLV1_NACK),
+	FLD(I2C_MAST_STATUS, I2C_SLV0_NACK),
+	FLD(INT_PIN_CFG, INT_LEVEL),
+	FLD(INT_PIN_CFG, INT_OPEN),
+	FLD(INT_PIN_CFG, LATCH_INT),
+	FLD(INT_PIN_CFG, INT_RD_CLEAR),
+	FLD(INT_PIN_CFG, FSYNC_INT_LEVEL),
+	FLD_UNSUP(INT_PIN_CFG, FSYNC_INT_EN, offsetof(struct mpu_cfg, fsync_int_en)),
+	FLD(INT_PIN_CFG, I2C_BYPASS_EN),
+	FLD_CFG(INT_ENABLE, FF_EN, ff_en),
+	FLD_CFG(INT_ENABLE, MOT_EN, mot_en),
+	FLD_CFG(INT_ENABLE, ZMOT_EN, zmot_en),
+	FLD_CFG(INT_ENABLE, FIFO_OFLOW_EN, fifo_oflow_en),
+	FLD_UNSUP(INT_ENABLE, I2C_MST_INT_EN, offsetof(struct mpu_cfg, i2c_mst_int_en)),
+	FLD_CFG(INT_ENABLE, DATA_RDY_EN, data_rdy_en),
+	FLD(INT_STATUS, FF_INT),
+	FLD(INT_STATUS, MOT_INT),
+	FLD(INT_STATUS, ZMOT_INT),
+	FLD(INT_STATUS, FIFO_OFLOW_INT),
+	FLD(INT_STATUS, I2C_MST_INT),
+	FLD(INT_STATUS, DATA_RDY_INT),
+	FLD(MOT_DETECT_STATUS, MOT_XNEG),
+	FLD(MOT_DETECT_STATUS, MOT_XPOS),
+	FLD(MOT_DETECT_STATUS, MOT_YNEG),
+	FLD(MOT_DETECT_STATUS, MOT_YPOS),
+	FLD(MOT_DETECT_STATUS, MOT_ZNEG),
+	FLD(MOT_DETECT_STATUS, MOT_ZPOS),
+	FLD(MOT_DETECT_STATUS, MOT_ZRMOT),
+	FLD(I2C_MST_DELAY_CTRL, DELAY_ES_SHADOW),
+	FLD(I2C_MST_DELAY_CTRL, I2C_SLV4_DLY_EN),
+	FLD(I2C_MST_DELAY_CTRL, I2C_SLV3_DLY_EN),
+	FLD(I2C_MST_DELAY_CTRL, I2C_SLV2_DLY_EN),
+	FLD(I2C_MST_DELAY_CTRL, I2C_SLV1_DLY_EN),
+	FLD(I2C_MST_DELAY_CTRL, I2C_SLV0_DLY_EN),
+	FLD(SIGNAL_PATH_RESET, GYRO_RESET),
+	FLD(SIGNAL_PATH_RESET, ACCEL_RESET),
+	FLD(SIGNAL_PATH_RESET, TEMP_RESET),
+	FLD(MOT_DETECT_CTRL, ACCEL_ON_DELAY),
+	FLD(MOT_DETECT_CTRL, FF_COUNT),
+	FLD(MOT_DETECT_CTRL, MOT_COUNT),
+	FLD_CFG(USER_CTRL, FIFO_EN, fifo_en),
+	FLD_CFG(USER_CTRL, I2C_MST_EN, i2c_mst_en),
+	FLD_UNSUP(USER_CTRL, I2C_IF_DIS, offsetof(struct mpu_cfg, i2c_if_dis)),
+	FLD_UNSUP(USER_CTRL, FIFO_RESET, 0),
+	FLD_UNSUP(USER_CTRL, I2C_MST_RESET, 0),
+	FLD_UNSUP(USER_CTRL, SIG_COND_RESET, 0),
+	FLD_UNSUP(PWR_MGMT_1, DEVICE_RESET, 0),
+	FLD_CFG(PWR_MGMT_1, SLEEP, sleep),
+	FLD_CFG(PWR_MGMT_1, CYCLE, cycle),
+	FLD_CFG(PWR_MGMT_1, TEMP_DIS, temp_dis),
+	FLD(PWR_MGMT_1, CLKSEL),
+	FLD(PWR_MGMT_2, LP_WAKE_CTL),
+	FLD_CFG(PWR_MGMT_2, STDBY_XA, stdby_xa),
+	FLD_CFG(PWR_MGMT_2, STDBY_YA, stdby_ya),
+	FLD_CFG(PWR_MGMT_2, STDBY_ZA, stdby_za),
+	FLD_CFG(PWR_MGMT_2, STDBY_XG, stdby_xg),
+	FLD_CFG(PWR_MGMT_2, STDBY_YG, stdby_yg),
+	FLD_CFG(PWR_MGMT_2, STDBY_ZG, stdby_zg),
+#undef FLD
+#undef FLD_CFG
+#undef FLD_UNSUP
+};
+
+/* value of field f in the register image regs */
+#define MPU_FIELD(regs, reg, f)	(((regs)[reg] & f##_BIT) >> __builtin_ctz(f##_BIT))
 
 /* helpers - internal use only */
 #define MPUDEV_IS_NULL(dev)	((NULL == (dev)) ||      \
@@ -159,10 +455,28 @@ static int mpu_ctl_fifo_disable_temp(	  struct mpu_dev *dev);
 static int mpu_ctl_fifo_disable_accel(	  struct mpu_dev *dev);
 static int mpu_ctl_fifo_disable_gyro(	  struct mpu_dev *dev);
 static int mpu_ctl_fifo_data(		  struct mpu_dev *dev);
+static int mpu_ctl_fifo_drain(		  struct mpu_dev *dev);
+static int mpu_ctl_fifo_spec(		  struct mpu_dev *dev, unsigned int want);
+static int mpu_ctl_direct_read(		  struct mpu_dev *dev);
+static int mpu_ctl_direct_timer(	  struct mpu_dev *dev);
+static size_t mpu_direct_window(const struct mpu_dev *dev, mpu_reg_t *first, bool *on);
+static int mpu_ctl_decim_data(		  struct mpu_dev *dev);
+static inline void mpu_dat_squares(	  struct mpu_dev *dev);
+static int mpu_ctl_shm_publish(		  struct mpu_dev *dev);
 static int mpu_ctl_fifo_reset(		  struct mpu_dev *dev);
-static int mpu_fifo_data(		  struct mpu_dev *dev, int16_t *data);
 static int mpu_ctl_i2c_mst_reset(	  struct mpu_dev *dev);
+static int mpu_selftest_sample(		  struct mpu_dev *dev, long double *avg);
+static int mpu_selftest_restore(	  struct mpu_dev *dev, const mpu_reg_t *bkp, const mpu_reg_t *pwr,
+					  const struct mpu_cfg *cfg);
+static int mpu_selftest_eval(		  struct mpu_dev *dev, const long double *str, struct mpu_selftest_result *res);
+static int mpu_selftest_report(		  char *fname, const struct mpu_selftest_result *res);
 static inline void mpu_ctl_fix_axis(	  struct mpu_dev *dev);
+static int mpu_aux_set(struct mpu_dev *dev, unsigned int slv, mpu_reg_t addr, mpu_reg_t reg,
+		       unsigned int len, unsigned int flags, double scale, int mag);
+static int mpu_aux_xfer(struct mpu_dev *dev, mpu_reg_t addr, mpu_reg_t reg, mpu_reg_t *val, bool rd);
+static int mpu_ctl_idle_check(		  struct mpu_dev *dev);
+static int mpu_idle_rate(		  struct mpu_dev *dev, bool still);
+static int mpu_lp_switch(		  struct mpu_dev *dev, double hz);
 
 /* level 2 - internal structure management */
 static int mpu_dev_bind(const char *path, const mpu_reg_t address, struct mpu_dev *dev);
@@ -179,7 +493,17 @@ static int mpu_dev_parameters_restore(	  char *fn, struct mpu_dev *dev);
 static int mpu_ctl_calibration_reset(	  struct mpu_dev *dev);
 static int mpu_ctl_calibration_restore(	  struct mpu_dev *dev, struct mpu_cal *bkp);
 
+static int mpu_cal_tcb_fit(struct mpu_cal *cal, double (*sum)[6], unsigned long *cnt);
+static void mpu_cal_tcb_center(struct mpu_cal *cal, mpu_data_t t_ref);
+static inline void mpu_cal_tcb_eval(const struct mpu_cal *cal, mpu_data_t t, mpu_data_t *b);
+static int mpu_cal_acc_fit(struct mpu_cal *cal);
+static void mpu_cal_acc_fuse(struct mpu_dev *dev);
+
 static int mpu_cfg_set_CLKSEL(struct mpu_dev *dev, mpu_reg_t clksel);
+static int mpu_cfg_set_rate(struct mpu_dev *dev, mpu_reg_t div, mpu_reg_t dlpf);
+static int mpu_rate_plan(double hz, int dlpf, mpu_reg_t *div, mpu_reg_t *cfg);
+static double mpu_bus_load(const struct mpu_dev *dev, double sr);
+static double mpu_bus_cost(int frame, int mode, bool split, unsigned int batch, double *xfers, double *bytes);
 
 /* level 1 - configuration registers parsing */
 static int mpu_cfg_get_val(struct mpu_dev *dev, const mpu_reg_t reg, mpu_reg_t *val);
@@ -187,22 +511,24 @@ static int mpu_cfg_set_val(struct mpu_dev *dev, const mpu_reg_t reg, const mpu_r
 static int mpu_cfg_write(		  struct mpu_dev *dev);
 static int mpu_cfg_validate(		  struct mpu_dev *dev);
 static int mpu_cfg_parse(		  struct mpu_dev *dev);
-static int mpu_cfg_parse_PWR_MGMT(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_CONFIG(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_SMPLRT_DIV(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_ACCEL_CONFIG(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_GYRO_CONFIG(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_USER_CTRL(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_FIFO_EN(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_INT_ENABLE(	  struct mpu_dev *dev);
-static int mpu_cfg_parse_INT_PIN_CFG(	  struct mpu_dev *dev);
+static int mpu_cfg_put(		  struct mpu_dev *dev, const mpu_reg_t reg, const mpu_reg_t mask, const mpu_reg_t bits);
+static int mpu_cfg_decode(		  struct mpu_dev *dev, const mpu_reg_t *regs);
+static int mpu_aux_words(const mpu_reg_t *regs, double st);
 
 /* level 0  i2c bus communication */
 static int mpu_read_byte( struct mpu_dev * const dev, const mpu_reg_t reg, mpu_reg_t *val);
 static int mpu_read_word( struct mpu_dev * const dev, const mpu_reg_t reg, mpu_word_t *val);
-static int mpu_read_data( struct mpu_dev * const dev, const mpu_reg_t reg, int16_t *val);
 static int mpu_write_byte(struct mpu_dev * const dev, const mpu_reg_t reg, const mpu_reg_t val);
-static int mpu_write_word(struct mpu_dev * const dev, const mpu_reg_t reg, const mpu_word_t val);
+static int mpu_read_block( struct mpu_dev * const dev, const mpu_reg_t reg, const size_t len, mpu_reg_t *buf);
+static int mpu_write_block(struct mpu_dev * const dev, const mpu_reg_t reg, const size_t len, const mpu_reg_t *buf);
+static int mpu_read_fifo( struct mpu_dev * const dev, const size_t len, mpu_reg_t *buf);
+static int mpu_read_snapshot(struct mpu_dev * const dev, mpu_reg_t *regs);
+static int mpu_write_regs(struct mpu_dev * const dev, const mpu_reg_t (*regs)[2], const size_t n);
+static int mpu_check_regs(struct mpu_dev * const dev, const mpu_reg_t (*regs)[2], const size_t n);
+static int mpu_write_offsets(struct mpu_dev * const dev, const mpu_reg_t first, const uint16_t *w);
+static int mpu_read_offsets( struct mpu_dev * const dev, const mpu_reg_t first, int16_t *w);
+static size_t mpu_regs_sort(const mpu_reg_t (*regs)[2], const size_t n, mpu_reg_t (*set)[2]);
+static inline double mpu_bus_account(struct mpu_dev * const dev, double t0, int res, size_t hdr, size_t len);
 
 int mpu_init(const char * const restrict path, struct mpu_dev ** mpudev, const int mode)
 {
@@ -216,6 +542,11 @@ int mpu_init(const char * const restrict path, struct mpu_dev ** mpudev, const i
 	struct mpu_dev *dev = NULL;
 	if (mpu_dev_allocate(&dev) < 0) /* no memory allocated */
 		return -1;
+	*(dev->bus) = -1; /* nothing to close yet */
+	dev->dat->tfd = -1;
+	dev->bus_hz  = MPU6050_BUS_HZ;
+	dev->bus_max = MPU6050_BUS_MAX;
+	dev->dat->io_t0 = mpu_clock();
 
 	if (mpu_dev_bind(path, MPU6050_ADDR, dev) < 0) /* could't bind */
 		goto mpu_init_error;
@@ -239,10 +570,11 @@ int mpu_init(const char * const restrict path, struct mpu_dev ** mpudev, const i
 				goto mpu_init_error;
 			break;
 		case MPU6050_RESTORE:
-			mpu_dev_parameters_restore(MPU6050_CFGFILE, dev); /* read config from device */
+			if (mpu_dev_parameters_restore(MPU6050_CFGFILE, dev) < 0) /* no saved config */
+				goto mpu_init_error;
 			/* fill device structure */
 			if (mpu_cfg_parse(dev) < 0)
-				return -1;
+				goto mpu_init_error;
 			break;
 		default:
 			fprintf(stderr, "mode unrecognized\n");
@@ -262,13 +594,145 @@ int mpu_init(const char * const restrict path, struct mpu_dev ** mpudev, const i
 	return 0;
 
 mpu_init_error:
-	if (NULL != dev->bus ) {
-		if (close(*(dev->bus)) < 0) /* close failed */
-			exit(EXIT_FAILURE);
+	mpu_destroy(dev); /* closes the bus too */
+
+	return -1;
+}
+
+/*
+ * A device without a bus: configuration and calibration come from the
+ * log's parameter snapshot, frames from the replay. Controls that write
+ * registers fail.
+ */
+int mpu_init_replay(struct mpu_dev **mpudev, struct mpu_replay *rp)
+{
+	if ((NULL == mpudev) || (NULL != *mpudev)) /* device not empty */
+		return -1;
+
+	if ((NULL == rp) || (NULL == rp->hdr)) /* replay not open */
+		return -1;
+
+	const struct mpu_log_hdr *h = rp->hdr;
+	const uint8_t *params = rp->map + h->params_off;
+	if ((h->params_len != sizeof(mpu_params_hdr) + sizeof(struct mpu_cfg) + sizeof(struct mpu_cal)) ||
+	    memcmp(params, &mpu_params_hdr, sizeof(mpu_params_hdr)))
+		return -1; /* recorded by an incompatible build */
+	params += sizeof(mpu_params_hdr);
+
+	struct mpu_dev *dev = NULL;
+	if (mpu_dev_allocate(&dev) < 0) /* no memory allocated */
+		return -1;
+	*(dev->bus) = -1;
+	dev->dat->tfd = -1;
+	dev->bus_hz  = MPU6050_BUS_HZ;
+	dev->bus_max = MPU6050_BUS_MAX;
+	dev->dat->io_t0 = mpu_clock();
+
+	memcpy(dev->cfg, params, sizeof(struct mpu_cfg));
+	memcpy(dev->cal, params + sizeof(struct mpu_cfg), sizeof(struct mpu_cal));
+
+	if (mpu_dat_reset(dev) < 0) /* clean data pointers */
+		goto mpu_init_replay_error;
+
+	if (mpu_cfg_parse(dev) < 0) /* fill device structure */
+		goto mpu_init_replay_error;
+
+	if (mpu_dat_set(dev) < 0) /* assign data pointers */
+		goto mpu_init_replay_error;
+
+	if (dev->fifosensors != (int)rp->words) /* snapshot and frames disagree */
+		goto mpu_init_replay_error;
+
+	dev->rep = rp;
+	*mpudev = dev;
+	return 0;
+
+mpu_init_replay_error:
+	mpu_destroy(dev);
+
+	return -1;
+}
+
+/*
+ * A device on the kernel driver: frames and their time come from the
+ * IIO buffer, the configuration mirror is built from the scan elements,
+ * the range scales and the sampling frequency, calibration starts from
+ * the defaults. Controls that write registers fail.
+ */
+int mpu_init_iio(struct mpu_dev **mpudev, struct mpu_iio *io)
+{
+	if ((NULL == mpudev) || (NULL != *mpudev)) /* device not empty */
+		return -1;
+
+	if ((NULL == io) || (io->fd < 0)) /* buffer not open */
+		return -1;
+
+	struct mpu_dev *dev = NULL;
+	if (mpu_dev_allocate(&dev) < 0) /* no memory allocated */
+		return -1;
+	*(dev->bus) = -1;
+	dev->dat->tfd = -1;
+	dev->bus_hz  = MPU6050_BUS_HZ;
+	dev->bus_max = MPU6050_BUS_MAX;
+	dev->dat->io_t0 = mpu_clock();
+
+	memcpy(dev->cfg, &mpu6050_defcfg, sizeof(struct mpu_cfg));
+	if (mpu_cal_reset(dev) < 0)
+		goto mpu_init_iio_error;
+
+	mpu_reg_t fifo = 0;
+	if (io->mask & MPU6050_CH_ACCEL) fifo |= ACCEL_FIFO_EN_BIT;
+	if (io->mask & MPU6050_CH_TEMP)  fifo |= TEMP_FIFO_EN_BIT;
+	if (io->mask & MPU6050_CH_XG)    fifo |= XG_FIFO_EN_BIT;
+	if (io->mask & MPU6050_CH_YG)    fifo |= YG_FIFO_EN_BIT;
+	if (io->mask & MPU6050_CH_ZG)    fifo |= ZG_FIFO_EN_BIT;
+
+	/* the full scale range whose LSB is nearest the driver's scale */
+	static const double albs[4] = { 16384,  8192,  4096,  2048 };
+	static const double glbs[4] = { 131.0,  65.5,  32.8,  16.4 };
+	mpu_reg_t afs = 0, fs = 0;
+	for (mpu_reg_t i = 1; (io->accel_scale > 0) && (i < 4); i++) {
+		double lsb = MPU6050_IIO_G / io->accel_scale;
+		if (fabs(albs[i] - lsb) < fabs(albs[afs] - lsb))
+			afs = i;
+	}
+	for (mpu_reg_t i = 1; (io->anglvel_scale > 0) && (i < 4); i++) {
+		double lsb = (M_PI / 180) / io->anglvel_scale;
+		if (fabs(glbs[i] - lsb) < fabs(glbs[fs] - lsb))
+			fs = i;
+	}
+
+	if ((mpu_cfg_set_val(dev, FIFO_EN, fifo) < 0) ||
+	    (mpu_cfg_set_val(dev, ACCEL_CONFIG, (mpu_reg_t)(afs << 3)) < 0) ||
+	    (mpu_cfg_set_val(dev, GYRO_CONFIG, (mpu_reg_t)(fs << 3)) < 0))
+		goto mpu_init_iio_error;
+
+	if (io->sr > 0) { /* the driver picks its own filter, this is the nearest */
+		mpu_reg_t div, dlpf;
+		if ((mpu_rate_plan(io->sr, -1, &div, &dlpf) < 0) ||
+		    (mpu_cfg_set_val(dev, SMPLRT_DIV, div) < 0) ||
+		    (mpu_cfg_set_val(dev, CONFIG, dlpf) < 0))
+			goto mpu_init_iio_error;
 	}
 
-	if (mpu_destroy(dev) < 0) /* cleanup failed, check for bugs */
-		exit(EXIT_FAILURE);
+	if (mpu_dat_reset(dev) < 0) /* clean data pointers */
+		goto mpu_init_iio_error;
+
+	if (mpu_cfg_parse(dev) < 0) /* fill device structure */
+		goto mpu_init_iio_error;
+
+	if (mpu_dat_set(dev) < 0) /* assign data pointers */
+		goto mpu_init_iio_error;
+
+	if (dev->fifosensors != (int)io->words) /* mirror and scan disagree */
+		goto mpu_init_iio_error;
+
+	dev->iio = io;
+	*mpudev = dev;
+	return 0;
+
+mpu_init_iio_error:
+	mpu_destroy(dev);
 
 	return -1;
 }
@@ -278,8 +742,15 @@ int mpu_destroy(struct mpu_dev *dev)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	/* leave the device in the profile the configuration file holds */
+	if ((NULL != dev->idl) && dev->idl->idle)
+		mpu_idle_rate(dev, false);
+	mpu_lp_switch(dev, 0);
+
 	mpu_dat_reset(dev);
 	close(*(dev->bus));
+	if (dev->dat->tfd >= 0)
+		close(dev->dat->tfd);
 
 	free(dev->cal); dev->cal = NULL;
 	free(dev->dat); dev->dat = NULL;
@@ -355,86 +826,260 @@ static int mpu_cfg_set_CLKSEL(struct mpu_dev *dev, mpu_reg_t clksel)
 	return 0;
 }
 
-int mpu_ctl_dlpf(struct mpu_dev *dev, unsigned int dlpf)
+static int mpu_cfg_set_rate(struct mpu_dev *dev, mpu_reg_t div, mpu_reg_t dlpf)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	if (dlpf > 6) /* invalid dlpf_cfg value */
+	/* both registers in one pass, the rate never depends on a stale CONFIG */
+	if (mpu_cfg_put(dev, CONFIG, DLPF_CFG_BIT, dlpf) < 0)
 		return -1;
-
-	/* get device current DLPF_CFG value */
-	mpu_reg_t val;
-	if (mpu_read_byte(dev, CONFIG, &val) < 0)
+	if (mpu_cfg_set_val(dev, SMPLRT_DIV, div) < 0)
+		return -1;
+	if (NULL != dev->idl) /* set while idle, the rate stays */
+		dev->idl->slowed = false;
+	if (mpu_cfg_set(dev) < 0)
 		return -1;
+	if (mpu_dat_set(dev) < 0)
+		return -1;
+	if (mpu_ctl_fifo_flush(dev) < 0) /* frames at the old rate */
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Pick SMPLRT_DIV and DLPF_CFG for hz. Candidates are ranked by rate
+ * error, then bandwidth below the new Nyquist frequency with the least
+ * delay, then, when none keeps below it, the least bandwidth.
+ * A dlpf >= 0 pins DLPF_CFG and only the divider is searched.
+ */
+static int mpu_rate_plan(double hz, int dlpf, mpu_reg_t *div, mpu_reg_t *cfg)
+{
+	if (!(hz > 0)) /* no rate to plan */
+		return -1;
+
+	int lo = (dlpf < 0) ? 0 : dlpf;
+	int hi = (dlpf < 0) ? (int)(ARRAY_LEN(mpu_dlpf_tab)) - 1 : dlpf;
+	int best = -1;
+	double best_err = 0;
+	unsigned int best_div = 0;
+
+	for (int k = lo; k <= hi; k++) {
+		const struct mpu_dlpf_spec *c = &mpu_dlpf_tab[k];
+
+		/* rate is gor / (1 + div), the nearest is one of two dividers */
+		long d = lrint(floor(c->gor / hz)) - 1;
+		unsigned int dk = 0;
+		double ek = INFINITY;
+		for (long t = d; t <= d + 1; t++) {
+			long u = (t < 0) ? 0 : (t > 255) ? 255 : t;
+			double e = fabs(c->gor / (1.0 + u) - hz) / hz;
+			if (e < ek) {
+				ek = e;
+				dk = (unsigned int)u;
+			}
+		}
+
+		bool better = false;
+		if (best < 0 || ek < best_err - 1e-9) {
+			better = true;
+		} else if (ek <= best_err + 1e-9) {
+			const struct mpu_dlpf_spec *b = &mpu_dlpf_tab[best];
+			bool c_ok = c->gbdw <= c->gor / (2.0 * (1 + dk));
+			bool b_ok = b->gbdw <= b->gor / (2.0 * (1 + best_div));
+			if (c_ok != b_ok)
+				better = c_ok;
+			else
+				better = c_ok ? (c->gdly < b->gdly) : (c->gbdw < b->gbdw);
+		}
+		if (better) {
+			best = k;
+			best_err = ek;
+			best_div = dk;
+		}
+	}
+
+	*div = (mpu_reg_t)best_div;
+	*cfg = (mpu_reg_t)best;
 
-	/* break circular dependencies */
-	if((val & DLPF_CFG_BIT) == dlpf)
+	return 0;
+}
+
+/*
+ * Bus share at sampling rate sr for the buffered sensors, block reads
+ * one frame per drain: the worst case of a reader keeping up. Direct
+ * reads cost their register window once per sample.
+ */
+static double mpu_bus_load(const struct mpu_dev *dev, double sr)
+{
+	int frame = 2 * dev->fifosensors; /* the frame the registers give, raw[0] may lag it */
+	if ((0 == frame) || (0 == dev->bus_hz))
 		return 0;
 
-	unsigned int old_rate_hz = (unsigned int)dev->sr;
+	double xfers, bytes;
+	int mode = dev->fifo_spec ? MPU6050_BUS_SPEC : MPU6050_BUS_BLOCK;
+	if (MPU6050_DIRECT_OFF != dev->direct) {
+		mpu_reg_t first;
+		mode  = MPU6050_BUS_DIRECT;
+		frame = (int)mpu_direct_window(dev, &first, NULL);
+	}
+	return sr * mpu_bus_cost(frame, mode, dev->dat->spec_split, 1, &xfers, &bytes) / dev->bus_hz;
+}
+
+/*
+ * Bus clocks, transactions and payload bytes per frame. Byte mode reads
+ * FIFO_COUNT then pops each byte in its own transaction; block mode reads
+ * FIFO_COUNT once per batch frames, at I2C_SMBUS_BLOCK_MAX bytes per
+ * transaction; speculative mode reads the count and the batch in one
+ * combined transaction, or split in two when the adapter wants. Direct
+ * mode reads frame bytes, the register window, in one transaction per
+ * sample and has no batches.
+ */
+static double mpu_bus_cost(int frame, int mode, bool split, unsigned int batch, double *xfers, double *bytes)
+{
+	const double rd = MPU6050_I2C_BYTE * MPU6050_I2C_RD_HDR + MPU6050_I2C_FRAME;
+	double count = rd + MPU6050_I2C_BYTE * 2;
+
+	if (MPU6050_BUS_DIRECT == mode) {
+		*xfers = 1;
+		*bytes = frame;
+		return rd + MPU6050_I2C_BYTE * frame;
+	}
+
+	if (MPU6050_BUS_BYTE == mode) {
+		*xfers = 1 + frame;
+		*bytes = 2 + frame;
+		return count + frame * (rd + MPU6050_I2C_BYTE);
+	}
+
+	double data = (double)frame * batch;
+	if (MPU6050_BUS_SPEC == mode) {
+		*xfers = (split ? 2.0 : 1.0) / batch;
+		*bytes = (2 + data) / batch;
+		if (split)
+			return (count + rd + MPU6050_I2C_BYTE * data) / batch;
+		return (count + MPU6050_I2C_BYTE * (MPU6050_I2C_RD_HDR + data)) / batch;
+	}
+
+	double n = ceil(data / I2C_SMBUS_BLOCK_MAX);
+	*xfers = (1 + n) / batch;
+	*bytes = (2 + data) / batch;
+	return (count + n * rd + MPU6050_I2C_BYTE * data) / batch;
+}
 
-	if (mpu_cfg_get_val(dev, CONFIG, &val) < 0)
+int mpu_bus_model(struct mpu_dev *dev, struct mpu_busload *bl)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	val &= ~DLPF_CFG_BIT;	/* mask bits */
-	val |= dlpf;		/* set bits */
+	if ((NULL == bl) || ((MPU6050_BUS_BYTE != bl->mode) && (MPU6050_BUS_BLOCK != bl->mode) &&
+	    (MPU6050_BUS_SPEC != bl->mode) && (MPU6050_BUS_DIRECT != bl->mode)))
+		return -1;
 
-	if (mpu_cfg_set_val(dev, CONFIG, val) < 0)
+	unsigned int hz = bl->bus_hz ? bl->bus_hz : dev->bus_hz;
+	unsigned int batch = bl->batch ? bl->batch : 1;
+	int frame = 2 * dev->dat->raw[0];
+	if ((0 == hz) || (frame * batch > MPU6050_FIFO_LEN)) /* no clock or batch won't fit */
 		return -1;
-	if (mpu_cfg_set(dev) < 0)
+
+	if (MPU6050_BUS_DIRECT == bl->mode) { /* the register window, every sample */
+		mpu_reg_t first;
+		frame = frame ? (int)mpu_direct_window(dev, &first, NULL) : 0;
+		batch = 1;
+	}
+
+	double xfers = 0, bytes = 0;
+	double clks  = frame ? mpu_bus_cost(frame, bl->mode, dev->dat->spec_split, batch, &xfers, &bytes) : 0;
+	bl->bytes  = dev->sr * bytes;
+	bl->xfers  = dev->sr * xfers;
+	bl->clocks = dev->sr * clks;
+	bl->util   = bl->clocks / hz;
+
+	return 0;
+}
+
+/* traffic since the previous call, util is the time spent in transfers */
+int mpu_bus_measure(struct mpu_dev *dev, struct mpu_busload *bl)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
-	if (mpu_dat_set(dev) < 0)
+
+	if (NULL == bl) /* nowhere to report */
+		return -1;
+
+	struct mpu_dat *d = dev->dat;
+	double now = mpu_clock();
+	double span = now - d->io_t0;
+	if (!(span > 0)) /* empty window */
 		return -1;
 
-	dev->dlpf = dlpf;
+	bl->bus_hz = dev->bus_hz;
+	bl->mode   = dev->fifo_spec ? MPU6050_BUS_SPEC : MPU6050_BUS_BLOCK;
+	if (MPU6050_DIRECT_OFF != dev->direct)
+		bl->mode = MPU6050_BUS_DIRECT;
+	bl->batch  = 0;
+	bl->bytes  = d->io_bytes / span;
+	bl->xfers  = d->io_xfers / span;
+	bl->clocks = d->io_clks / span;
+	bl->util   = d->io_busy / span;
 
-	unsigned int new_rate_hz = (unsigned int)dev->sr;
-	if (old_rate_hz != new_rate_hz) {
-		if (mpu_ctl_samplerate(dev, old_rate_hz) < 0)
-			return -1;
-	}
+	d->io_xfers = d->io_bytes = d->io_clks = 0;
+	d->io_busy = 0;
+	d->io_t0 = now;
 
 	return 0;
 }
 
-int mpu_ctl_samplerate(struct mpu_dev *dev, unsigned int rate_hz)
+int mpu_ctl_dlpf(struct mpu_dev *dev, unsigned int dlpf)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	/* break circular dependencies */
-	unsigned int old_rate_hz = (unsigned int)dev->sr;
-	if( rate_hz == old_rate_hz) {
-		return 0;
-	}
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
 
-	switch (rate_hz) { 		/* base 8kHz  / 1kHz	*/
-		case 500: break;	/*	  40 	5	*/
-		case 250: break;	/*	  40 	5	*/
-		case 200: break;	/*	  40 	5	*/
-		case 100: break;	/*	  80 	10	*/
-		case  50: break;	/*	 160 	20	*/
-		default: return -1;	/* rate not supported	*/
-	}
+	if (dlpf > 6) /* invalid dlpf_cfg value */
+		return -1;
 
-	/* get DLPF_CFG value */
-	mpu_reg_t val;
-	if (mpu_read_byte(dev, CONFIG, &val) < 0)
+	if (dev->dat->lp) /* the profile sets the rate, leave it first */
 		return -1;
 
-	unsigned int fs_base = (val & DLPF_CFG_BIT) ? 1000 : 8000;
-	unsigned int divider = (fs_base / rate_hz);
-	val = (mpu_reg_t) (divider - 1); /* rate_hz = fs_base / (1 + SMPLRT_DIV) */
+	/* keep the sampling rate as close as the new gyro output rate allows */
+	mpu_reg_t div, cfg;
+	if (mpu_rate_plan(dev->sr, (int)dlpf, &div, &cfg) < 0)
+		return -1;
 
-	if (mpu_cfg_set_val(dev, SMPLRT_DIV, val) < 0)
+	double sr = mpu_dlpf_tab[cfg].gor / (1.0 + div);
+	if (mpu_bus_load(dev, sr) > dev->bus_max) /* bus can't sustain the rate */
 		return -1;
-	if (mpu_cfg_set(dev) < 0)
+
+	return mpu_cfg_set_rate(dev, div, cfg);
+}
+
+int mpu_ctl_samplerate(struct mpu_dev *dev, unsigned int rate_hz)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
-	if (mpu_dat_set(dev) < 0)
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
 		return -1;
 
-	return 0;
+	if ((rate_hz < MPU6050_RATE_MIN) || (rate_hz > MPU6050_RATE_MAX)) /* rate not supported */
+		return -1;
+
+	if (dev->dat->lp) /* the profile sets the rate, leave it first */
+		return -1;
+
+	mpu_reg_t div, cfg;
+	if (mpu_rate_plan(rate_hz, -1, &div, &cfg) < 0)
+		return -1;
+
+	double sr = mpu_dlpf_tab[cfg].gor / (1.0 + div);
+	if (mpu_bus_load(dev, sr) > dev->bus_max) /* bus can't sustain the rate */
+		return -1;
+
+	return mpu_cfg_set_rate(dev, div, cfg);
 }
 
 int mpu_ctl_accel_range(struct mpu_dev *dev, unsigned int range)
@@ -442,6 +1087,9 @@ int mpu_ctl_accel_range(struct mpu_dev *dev, unsigned int range)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
 	mpu_reg_t afs_sel = 0;
 	switch (range) {
 		case  2: afs_sel = AFS_SEL_0; break;
@@ -451,16 +1099,7 @@ int mpu_ctl_accel_range(struct mpu_dev *dev, unsigned int range)
 		default: return -1;	/* invalid range */
 	}
 
-	mpu_reg_t reg = ACCEL_CONFIG;
-	mpu_reg_t val;
-
-	if (mpu_read_byte(dev, reg, &val) < 0)
-		return -1;
-
-	val &= ~AFS_SEL_BIT;	/* mask bits */
-	val |= afs_sel;		/* set bits */
-
-	if (mpu_cfg_set_val(dev, reg, val) < 0)
+	if (mpu_cfg_put(dev, ACCEL_CONFIG, AFS_SEL_BIT, afs_sel) < 0)
 		return -1;
 
 	if (mpu_cfg_set(dev) < 0)
@@ -478,6 +1117,9 @@ int mpu_ctl_gyro_range(struct mpu_dev *dev, unsigned int range)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
 	mpu_reg_t fs_sel = 0;
 	switch (range) {
 		case  250: fs_sel = FS_SEL_0; break;
@@ -488,14 +1130,7 @@ int mpu_ctl_gyro_range(struct mpu_dev *dev, unsigned int range)
 			return -1;	/* invalid range */
 	}
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, GYRO_CONFIG, &val) < 0)
-		return -1;
-
-	val &= ~FS_SEL_BIT;	/* mask bits */
-	val |= fs_sel;		/* set bits */
-
-	if (mpu_cfg_set_val(dev, GYRO_CONFIG, val) < 0)
+	if (mpu_cfg_put(dev, GYRO_CONFIG, FS_SEL_BIT, fs_sel) < 0)
 		return -1;
 
 	if (mpu_cfg_set(dev) < 0)
@@ -513,6 +1148,12 @@ int mpu_ctl_clocksource(struct mpu_dev *dev, mpu_reg_t clksel)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if (dev->dat->lp) /* leave the low-power profile first */
+		return -1;
+
 	switch(clksel) {
 		case CLKSEL_0: break; /* Internal 8 Mhz oscillator */
 		case CLKSEL_1: break; /* PLL with X axis gyroscope */
@@ -522,6 +1163,10 @@ int mpu_ctl_clocksource(struct mpu_dev *dev, mpu_reg_t clksel)
 			return -1;
 	}
 
+	const bool stdby[4] = { false, dev->cfg->stdby_xg, dev->cfg->stdby_yg, dev->cfg->stdby_zg };
+	if (stdby[clksel]) /* a gyro in standby can't drive the PLL */
+		return -1;
+
 	mpu_reg_t val;
 	if (mpu_cfg_get_val(dev, PWR_MGMT_1, &val) < 0)
 		return -1;
@@ -540,388 +1185,713 @@ int mpu_ctl_clocksource(struct mpu_dev *dev, mpu_reg_t clksel)
 	return 0;
 }
 
-static int mpu_cfg_reset(struct mpu_dev *dev)
+/*
+ * Read the fifo count and the frames expected with it in a single bus
+ * transaction instead of two. Frames expected but not yet counted are
+ * read on the next call; a read that outruns the fifo resets it. A read
+ * followed by more messages is tried first on WHO_AM_I: adapters that
+ * refuse it, i2c-bcm2835 among them, get two transactions per drain.
+ */
+int mpu_ctl_speculative(struct mpu_dev *dev, bool enable)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	memcpy((void *)dev->cfg, (void *)&mpu6050_defcfg, sizeof(struct mpu_cfg));
-
-	if (mpu_cfg_set(dev) < 0) /* couldn't set config */
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
 		return -1;
 
+	if (enable) {
+		mpu_reg_t reg = WHO_AM_I, id[2];
+		struct i2c_msg msg[4] = {
+			{ .addr = dev->addr, .flags = 0,	.len = 1, .buf = &reg },
+			{ .addr = dev->addr, .flags = I2C_M_RD, .len = 1, .buf = &id[0] },
+			{ .addr = dev->addr, .flags = 0,	.len = 1, .buf = &reg },
+			{ .addr = dev->addr, .flags = I2C_M_RD, .len = 1, .buf = &id[1] },
+		};
+		struct i2c_rdwr_ioctl_data xfer = { .msgs = msg, .nmsgs = 4 };
+		double t0 = mpu_clock();
+		int res = ioctl(*(dev->bus), I2C_RDWR, &xfer);
+		mpu_bus_account(dev, t0, res, 2 * MPU6050_I2C_RD_HDR, 2);
+		if ((res < 0) && (EOPNOTSUPP != errno)) /* bus error */
+			return -1;
+		dev->dat->spec_split = (res < 0);
+	}
+
+	dev->fifo_spec = enable;
+	dev->dat->spec_t = mpu_clock(); /* fifo level unknown, expect little */
+	dev->dat->spec_left = 0;
+	dev->bus_load = mpu_bus_load(dev, dev->sr);
+
 	return 0;
 }
 
-static int mpu_cfg_set(struct mpu_dev *dev)
+/*
+ * Read the newest sample from the output registers instead of queueing
+ * it in the fifo, once per sampling period. MPU6050_DIRECT_DRDY waits
+ * for DATA_RDY_INT too, so a sample is never returned twice.
+ */
+int mpu_ctl_direct(struct mpu_dev *dev, int mode)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	/* write config to device registers */
-	if (mpu_cfg_write(dev) < 0)
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
 		return -1;
 
-	/* ensure device is configured */
-	if (mpu_cfg_validate(dev) < 0)
+	if ((mode < MPU6050_DIRECT_OFF) || (mode > MPU6050_DIRECT_DRDY)) /* unknown mode */
 		return -1;
 
-	/* fill device structure */
-	if (mpu_cfg_parse(dev) < 0)
+	if (dev->dat->lp) /* leave the low-power profile first */
 		return -1;
 
-	mpu_dev_parameters_save(MPU6050_CFGFILE, dev);
+	if ((MPU6050_DIRECT_OFF != mode) && (dev->cfg->slv0_fifo_en || dev->cfg->slv1_fifo_en ||
+	    dev->cfg->slv2_fifo_en || dev->cfg->slv3_fifo_en)) /* not in the output registers */
+		return -1;
+
+	if ((MPU6050_DIRECT_DRDY == mode) && (NULL != dev->idl)) /* its reads clear the motion status */
+		return -1;
+
+	mpu_reg_t fifo = (MPU6050_DIRECT_OFF == mode) ? FIFO_EN_BIT : 0;
+	mpu_reg_t drdy = (MPU6050_DIRECT_DRDY == mode) ? DATA_RDY_EN_BIT : 0;
+	if (mpu_cfg_put(dev, USER_CTRL, FIFO_EN_BIT, fifo) < 0)
+		return -1;
+	if (mpu_cfg_put(dev, INT_ENABLE, DATA_RDY_EN_BIT, drdy) < 0)
+		return -1;
+
+	if (mpu_cfg_set(dev) < 0)
+		return -1;
+	if (mpu_dat_set(dev) < 0)
+		return -1;
+	if (mpu_ctl_fifo_flush(dev) < 0) /* frames queued before */
+		return -1;
 
 	return 0;
 }
 
-static int mpu_cfg_write(struct mpu_dev *dev)
+/*
+ * Accelerometer-only low-power profile: the gyros in standby, the
+ * temperature sensor off, the device sleeping between accelerometer
+ * samples taken at the LP_WAKE_CTL rate at or above hz, read from the
+ * output registers. 0 returns to the full profile. The frame keeps its
+ * layout, the words of the sensors off hold no new data.
+ */
+int mpu_ctl_lowpower(struct mpu_dev *dev, double hz)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t reg; /* device register address */
-	mpu_reg_t val; /* device register value */
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
 
-	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
-		reg = dev->cfg->regs[i][0];
-		val = dev->cfg->regs[i][1];
+	if (!(hz >= 0) || (hz > MPU6050_LP_MAX)) /* no such wake rate */
+		return -1;
 
-		if (mpu_write_byte(dev, reg, val) < 0) /* write error */
-			return -1;
-	}
+	if ((hz > 0) && !dev->dat->lp && (dev->cfg->slv0_fifo_en || dev->cfg->slv1_fifo_en ||
+	    dev->cfg->slv2_fifo_en || dev->cfg->slv3_fifo_en)) /* not in the output registers */
+		return -1;
 
-	return 0;
+	if ((NULL != dev->idl) && dev->idl->lowpower) /* the policy switches it */
+		return -1;
+
+	return mpu_lp_switch(dev, hz);
 }
 
-static int mpu_cfg_validate(struct mpu_dev *dev)
+/*
+ * Into the low-power profile at hz, or back to the full profile with 0.
+ * USER_CTRL, PWR_MGMT_1 and PWR_MGMT_2 are contiguous: the switch is one
+ * block write, the way back resets the fifo along. No readback, no
+ * configuration file, which keeps the full profile; the time it took is
+ * accounted in dev->lp_switch.
+ */
+static int mpu_lp_switch(struct mpu_dev *dev, double hz)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t dev_val; /* device register value */
+	struct mpu_dat *d = dev->dat;
+	if (!(hz > 0) && !d->lp) /* in the full profile */
+		return 0;
 
-	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
-		mpu_reg_t reg 	  = dev->cfg->regs[i][0];
-		mpu_reg_t cfg_val = dev->cfg->regs[i][1];
+	double t0 = mpu_clock();
+	mpu_reg_t full[3];
+	if ((mpu_cfg_get_val(dev, USER_CTRL, &full[0]) < 0) || (mpu_cfg_get_val(dev, PWR_MGMT_1, &full[1]) < 0) ||
+	    (mpu_cfg_get_val(dev, PWR_MGMT_2, &full[2]) < 0))
+		return -1;
+	if (d->lp) /* switching wake rates, keep the profile to return to */
+		memcpy(full, d->lp_regs, sizeof(full));
+
+	mpu_reg_t set[3], out[3];
+	memcpy(set, full, sizeof(set));
+	if (hz > 0) { /* internal oscillator, the gyros it could lock to sleep */
+		static const double wake[4] = { 1.25, 5, 20, 40 };
+		mpu_reg_t k = 0;
+		while ((k < ARRAY_LEN(wake) - 1) && (wake[k] < hz))
+			k++;
+		set[0] &= ~FIFO_EN_BIT;
+		set[1]  = (set[1] & ~(SLEEP_BIT | CLKSEL_BIT)) | CYCLE_BIT | TEMP_DIS_BIT | CLKSEL_0;
+		set[2]  = (set[2] & ~LP_WAKE_CTL_BIT) | (mpu_reg_t)(k << __builtin_ctz(LP_WAKE_CTL_BIT)) |
+			  STDBY_XG_BIT | STDBY_YG_BIT | STDBY_ZG_BIT;
+	}
+	memcpy(out, set, sizeof(out));
+	if (!(hz > 0) && (set[0] & FIFO_EN_BIT)) /* frames of before the switch */
+		out[0] |= FIFO_RESET_BIT;
 
-		if (mpu_read_byte(dev, reg, &dev_val) < 0) /* read error */
-			return -1;
+	if ((mpu_cfg_set_val(dev, USER_CTRL, set[0]) < 0) || (mpu_cfg_set_val(dev, PWR_MGMT_1, set[1]) < 0) ||
+	    (mpu_cfg_set_val(dev, PWR_MGMT_2, set[2]) < 0))
+		return -1;
+	if (mpu_write_block(dev, USER_CTRL, ARRAY_LEN(out), out) < 0)
+		return -1;
+	if (hz > 0)
+		memcpy(d->lp_regs, full, sizeof(full));
+	d->lp = hz > 0;
 
-		if (cfg_val != dev_val) /* value mismatch */
-			return -1;
-	}
+	if (mpu_cfg_parse(dev) < 0)
+		return -1;
+	if (mpu_dat_set(dev) < 0)
+		return -1;
+	d->fifo_pos = d->fifo_len = 0; /* frames of the other profile */
+	d->gap = true;
+	d->spec_t = mpu_clock();
+	d->spec_left = 0;
+	d->spec_reset = false;
+	if ((NULL != dev->bat) && (mpu_batch_reset(dev->bat) < 0))
+		return -1;
+
+	dev->lp_switch = mpu_clock() - t0;
+	dev->lp_switch_max = (dev->lp_switch > dev->lp_switch_max) ? dev->lp_switch : dev->lp_switch_max;
+	dev->lp_switches++;
 
 	return 0;
 }
 
-static int mpu_cfg_get_val(struct mpu_dev *dev, const mpu_reg_t reg, mpu_reg_t *val)
+/*
+ * Buffer and power exactly the channels in mask: the others leave the
+ * fifo frame and go to standby, the temperature sensor is disabled. The
+ * fifo takes the accelerometer axes together, a frame holds all three
+ * when any is selected. A clock locked to a gyro put in standby moves
+ * to another gyro, or the internal oscillator. The larger frame must
+ * fit the bus budget at the current sampling rate.
+ */
+int mpu_ctl_channels(struct mpu_dev *dev, unsigned int mask)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	if (reg == 0) /* register 0 invalid */
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
 		return -1;
 
-	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
-		if (0 == dev->cfg->regs[i][0]) 	/* register 0 means unconfigured */
-			continue;
-		if (reg == dev->cfg->regs[i][0]) {/* seek register */
-			*val = dev->cfg->regs[i][1];
-			return 0;
-		}
-	}
+	if ((0 == (mask & MPU6050_CH_ALL)) || (mask & ~MPU6050_CH_ALL)) /* nothing or unknown */
+		return -1;
 
+	if (dev->dat->lp) /* leave the low-power profile first */
+		return -1;
 
-	return -1; /* reg not found */
+	static const struct {
+		unsigned int ch;
+		mpu_reg_t fifo, stdby;
+	} map[] = {
+		{ MPU6050_CH_XA,   ACCEL_FIFO_EN_BIT, STDBY_XA_BIT },
+		{ MPU6050_CH_YA,   ACCEL_FIFO_EN_BIT, STDBY_YA_BIT },
+		{ MPU6050_CH_ZA,   ACCEL_FIFO_EN_BIT, STDBY_ZA_BIT },
+		{ MPU6050_CH_XG,   XG_FIFO_EN_BIT,    STDBY_XG_BIT },
+		{ MPU6050_CH_YG,   YG_FIFO_EN_BIT,    STDBY_YG_BIT },
+		{ MPU6050_CH_ZG,   ZG_FIFO_EN_BIT,    STDBY_ZG_BIT },
+		{ MPU6050_CH_TEMP, TEMP_FIFO_EN_BIT,  0 },
+	};
+	mpu_reg_t fifo = 0, stdby = 0;
+	for (size_t i = 0; i < ARRAY_LEN(map); i++) {
+		if (mask & map[i].ch)
+			fifo  |= map[i].fifo;
+		else
+			stdby |= map[i].stdby;
+	}
+	mpu_reg_t temp = (mask & MPU6050_CH_TEMP) ? 0 : TEMP_DIS_BIT;
+
+	mpu_reg_t pwr;
+	if (mpu_cfg_get_val(dev, PWR_MGMT_1, &pwr) < 0)
+		return -1;
+	mpu_reg_t clksel = pwr & CLKSEL_BIT;
+	const unsigned int pll[4] = { 0, MPU6050_CH_XG, MPU6050_CH_YG, MPU6050_CH_ZG };
+	if ((clksel >= CLKSEL_1) && (clksel <= CLKSEL_3) && !(mask & pll[clksel])) {
+		if (mask & MPU6050_CH_XG)
+			clksel = CLKSEL_1;
+		else if (mask & MPU6050_CH_YG)
+			clksel = CLKSEL_2;
+		else if (mask & MPU6050_CH_ZG)
+			clksel = CLKSEL_3;
+		else
+			clksel = CLKSEL_0;
+	}
+
+	const mpu_reg_t sensors = ACCEL_FIFO_EN_BIT | TEMP_FIFO_EN_BIT |
+				  XG_FIFO_EN_BIT | YG_FIFO_EN_BIT | ZG_FIFO_EN_BIT;
+	const mpu_reg_t axes = STDBY_XA_BIT | STDBY_YA_BIT | STDBY_ZA_BIT |
+			       STDBY_XG_BIT | STDBY_YG_BIT | STDBY_ZG_BIT;
+	struct mpu_cfg bkp = *(dev->cfg);
+	if ((mpu_cfg_put(dev, FIFO_EN, sensors, fifo) < 0) ||
+	    (mpu_cfg_put(dev, PWR_MGMT_2, axes, stdby) < 0) ||
+	    (mpu_cfg_put(dev, PWR_MGMT_1, TEMP_DIS_BIT | CLKSEL_BIT, temp | clksel) < 0))
+		goto mpu_ctl_channels_error;
+
+	/* decode first, the frame it implies must fit the bus */
+	if ((mpu_cfg_parse(dev) < 0) || (dev->bus_load > dev->bus_max))
+		goto mpu_ctl_channels_error;
+
+	if ((mpu_cfg_set(dev) < 0) || (mpu_dat_reset(dev) < 0) || (mpu_dat_set(dev) < 0) ||
+	    (mpu_ctl_fifo_flush(dev) < 0)) /* frames of the old layout */
+		goto mpu_ctl_channels_restore;
+
+	return 0;
+
+mpu_ctl_channels_restore: /* the registers were written, back to the old ones */
+	*(dev->cfg) = bkp;
+	mpu_cfg_parse(dev);
+	if ((mpu_cfg_set(dev) < 0) || (mpu_dat_reset(dev) < 0) || (mpu_dat_set(dev) < 0))
+		return -1;
+	mpu_ctl_fifo_flush(dev); /* frames of the layout tried */
+
+	return -1;
+
+mpu_ctl_channels_error:
+	*(dev->cfg) = bkp;
+	mpu_cfg_parse(dev);
+
+	return -1;
 }
 
-static int mpu_cfg_set_val(struct mpu_dev *dev, const mpu_reg_t reg, const mpu_reg_t val)
+/*
+ * Have slave slv of the auxiliary i2c master read len bytes from reg of
+ * the chip at addr every sample, queued in the fifo after the gyro so
+ * they arrive in the frame of the sample they belong to. Words are big
+ * endian, MPU6050_AUX_SWAP swaps little endian ones; scale converts
+ * them, 0 leaves them raw. len 0 releases the slave.
+ */
+int mpu_ctl_aux(struct mpu_dev *dev, unsigned int slv, mpu_reg_t addr, mpu_reg_t reg,
+		unsigned int len, unsigned int flags, double scale)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	if (reg == 0) /* register 0 invalid */
+	return mpu_aux_set(dev, slv, addr, reg, len, flags, scale, MPU6050_MAG_NONE);
+}
+
+/* one byte to a register of an auxiliary chip, through slave 4 */
+int mpu_ctl_aux_write(struct mpu_dev *dev, mpu_reg_t addr, mpu_reg_t reg, mpu_reg_t val)
+{
+	return mpu_aux_xfer(dev, addr, reg, &val, false);
+}
+
+/* one byte from a register of an auxiliary chip, through slave 4 */
+int mpu_ctl_aux_read(struct mpu_dev *dev, mpu_reg_t addr, mpu_reg_t reg, mpu_reg_t *val)
+{
+	return mpu_aux_xfer(dev, addr, reg, val, true);
+}
+
+/*
+ * Identify and start a magnetometer on the auxiliary bus, then read it
+ * through slave slv into every frame; dev->Mx, My and Mz hold its axes
+ * in uT, in its own frame. MPU6050_MAG_NONE releases the slave it had.
+ */
+int mpu_ctl_mag(struct mpu_dev *dev, unsigned int slv, int model)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
-		if (0 == dev->cfg->regs[i][0]) 	/* register 0 means unconfigured */
-			continue;
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
 
-		if(reg == dev->cfg->regs[i][0]) { /* seek register */
-			dev->cfg->regs[i][1] = val;
+	if ((model < 0) || ((size_t)model >= ARRAY_LEN(mpu_mag_tab))) /* unknown model */
+		return -1;
+
+	if (MPU6050_MAG_NONE == model) {
+		if (MPU6050_MAG_NONE == dev->cfg->mag) /* nothing to release */
 			return 0;
-		}
+		return mpu_aux_set(dev, dev->cfg->mag_slv, 0, 0, 0, 0, 0, MPU6050_MAG_NONE);
 	}
 
-	return -1; /* reg not found */
+	const struct mpu_mag_spec *m = &mpu_mag_tab[model];
+	mpu_reg_t id;
+	if (mpu_ctl_aux_read(dev, m->addr, m->id_reg, &id) < 0) /* nothing answers */
+		return -1;
+	if (id != m->id) /* another chip */
+		return -1;
+	for (unsigned int i = 0; i < m->n_init; i++)
+		if (mpu_ctl_aux_write(dev, m->addr, m->init[i][0], m->init[i][1]) < 0)
+			return -1;
+
+	return mpu_aux_set(dev, slv, m->addr, m->reg, m->len, m->flags, m->scale, model);
 }
 
-static int mpu_cfg_parse_PWR_MGMT(struct mpu_dev *dev)
+/* slave slv reads len bytes of reg at addr, and is the magnetometer mag */
+static int mpu_aux_set(struct mpu_dev *dev, unsigned int slv, mpu_reg_t addr, mpu_reg_t reg,
+		       unsigned int len, unsigned int flags, double scale, int mag)
 {
-	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
 		return -1;
 
-	mpu_reg_t val1;
-	mpu_reg_t val2;
-
-	if (mpu_cfg_get_val(dev, PWR_MGMT_1, &val1) < 0)
+	if ((slv >= MPU6050_AUX_SLAVES) || (addr & ~I2C_SLV_ADDR_BIT) || (len > I2C_SLV_LEN_BIT) ||
+	    (len & 1) || (flags & ~MPU6050_AUX_SWAP) || !(scale >= 0)) /* not whole words */
 		return -1;
 
-	if (mpu_cfg_get_val(dev, PWR_MGMT_2, &val2) < 0)
+	if (len && (MPU6050_DIRECT_OFF != dev->direct)) /* not in the output registers */
 		return -1;
 
-	if (val1 & DEVICE_RESET_BIT) /* must not be set */
-		return -1;
+	mpu_reg_t ctrl = len ? I2C_SLV_EN_BIT | (mpu_reg_t)len : 0;
+	if (len && (flags & MPU6050_AUX_SWAP)) /* pairs start at reg */
+		ctrl |= I2C_SLV_BYTE_SW_BIT | ((reg & 1) ? I2C_SLV_GRP_BIT : 0);
+	mpu_reg_t base = I2C_SLV0_ADDR + 3 * slv;
+	mpu_reg_t fifo = mpu_aux_fifo[slv][1];
 
-	dev->cfg->sleep    = (val1 & SLEEP_BIT);
-	dev->cfg->cycle    = (val1 & CYCLE_BIT);
-	dev->cfg->temp_dis = (val1 & TEMP_DIS_BIT);
-	dev->cfg->stdby_xa = (val2 & STDBY_XA_BIT);
-	dev->cfg->stdby_ya = (val2 & STDBY_YA_BIT);
-	dev->cfg->stdby_za = (val2 & STDBY_ZA_BIT);
-	dev->cfg->stdby_xg = (val2 & STDBY_XG_BIT);
-	dev->cfg->stdby_yg = (val2 & STDBY_YG_BIT);
-	dev->cfg->stdby_zg = (val2 & STDBY_ZG_BIT);
+	struct mpu_cfg bkp = *(dev->cfg);
+	if ((mpu_cfg_set_val(dev, base, len ? I2C_SLV_RW_BIT | addr : 0) < 0) ||
+	    (mpu_cfg_set_val(dev, base + 1, len ? reg : 0) < 0) ||
+	    (mpu_cfg_set_val(dev, base + 2, ctrl) < 0) ||
+	    (mpu_cfg_put(dev, mpu_aux_fifo[slv][0], fifo, len ? fifo : 0) < 0))
+		goto mpu_aux_set_error;
 
-	double	wake_freq = 0;
-	int lp_wake_ctrl = (val2 & LP_WAKE_CTL_BIT) >> 6;
+	/* 400 kHz, data ready and the shadow registers wait for the slaves */
+	if (len && ((mpu_cfg_put(dev, USER_CTRL, I2C_MST_EN_BIT, I2C_MST_EN_BIT) < 0) ||
+		    (mpu_cfg_put(dev, INT_PIN_CFG, I2C_BYPASS_EN_BIT, 0) < 0) ||
+		    (mpu_cfg_put(dev, I2C_MST_CTRL, WAIT_FOR_ES_BIT | I2C_MST_CLK_BIT,
+				 WAIT_FOR_ES_BIT | I2C_MST_CLK_13) < 0) ||
+		    (mpu_cfg_put(dev, I2C_MST_DELAY_CTRL, DELAY_ES_SHADOW_BIT, DELAY_ES_SHADOW_BIT) < 0)))
+		goto mpu_aux_set_error;
 
-	if (!(dev->cfg->cycle)) {
-		wake_freq = 0;
-	} else {
-		switch(lp_wake_ctrl) {
-		case 0 : wake_freq = 1.2; break;
-		case 1 : wake_freq = 5;	  break;
-		case 2 : wake_freq = 20;  break;
-		case 3 : wake_freq = 40;  break;
-		}
+	dev->cfg->aux_scl[slv] = scale;
+	if (MPU6050_MAG_NONE != mag) {
+		dev->cfg->mag = mag;
+		dev->cfg->mag_slv = slv;
+	} else if (dev->cfg->mag_slv == slv) { /* slave taken over */
+		dev->cfg->mag = MPU6050_MAG_NONE;
 	}
-	dev->wake_freq	= wake_freq;
+
+	/* decode first, the frame it implies must fit the bus */
+	if ((mpu_cfg_parse(dev) < 0) || (dev->bus_load > dev->bus_max))
+		goto mpu_aux_set_error;
+
+	if (mpu_cfg_set(dev) < 0)
+		return -1;
+	if (mpu_dat_reset(dev) < 0)
+		return -1;
+	if (mpu_dat_set(dev) < 0)
+		return -1;
+	if (mpu_ctl_fifo_flush(dev) < 0) /* frames of the old layout */
+		return -1;
 
 	return 0;
+
+mpu_aux_set_error:
+	*(dev->cfg) = bkp;
+	mpu_cfg_parse(dev);
+
+	return -1;
 }
 
-static int mpu_cfg_parse_USER_CTRL(struct mpu_dev *dev)
+/*
+ * Single transfer of slave 4. The master runs once a sample, the status
+ * is polled MPU6050_AUX_POLL times a sampling period, for at most
+ * MPU6050_AUX_WAIT periods; a NACK means nothing answered at addr.
+ */
+static int mpu_aux_xfer(struct mpu_dev *dev, mpu_reg_t addr, mpu_reg_t reg, mpu_reg_t *val, bool rd)
 {
-	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+	if(MPUDEV_IS_NULL(dev) || (NULL == val)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, USER_CTRL, &val) < 0)
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if ((addr & ~I2C_SLV_ADDR_BIT) || !dev->cfg->i2c_mst_en || dev->cfg->sleep) /* master stopped */
 		return -1;
 
-	if (val & (FIFO_RESET_BIT | I2C_MST_RESET_BIT | SIG_COND_RESET_BIT | I2C_IF_DIS_BIT))
+	mpu_reg_t status;
+	if (mpu_read_byte(dev, I2C_MAST_STATUS, &status) < 0) /* clears what is left */
+		return -1;
+
+	mpu_reg_t buf[4] = { (rd ? I2C_SLV_RW_BIT : 0) | addr, reg, rd ? 0 : *val, I2C_SLV4_EN_BIT };
+	if (mpu_write_block(dev, I2C_SLV4_ADDR, sizeof(buf), buf) < 0)
+		return -1;
+
+	for (int i = 0; i < MPU6050_AUX_POLL * MPU6050_AUX_WAIT; i++) {
+		mpu_sleep(dev->st / MPU6050_AUX_POLL);
+		if (mpu_read_byte(dev, I2C_MAST_STATUS, &status) < 0)
+			return -1;
+		if (status & I2C_SLV4_NACK_BIT) /* nothing at addr */
+			break;
+		if (status & I2C_SLV4_DONE_BIT)
+			return rd ? mpu_read_byte(dev, I2C_SLV4_DI, val) : 0;
+	}
+	mpu_write_byte(dev, I2C_SLV4_CTRL, 0); /* give up the transfer */
+
+	return -1;
+}
+
+static int mpu_cfg_reset(struct mpu_dev *dev)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	dev->cfg->fifo_en    = (val & FIFO_EN_BIT);
-	dev->cfg->i2c_mst_en = (val & I2C_MST_EN_BIT);
-	dev->cfg->i2c_if_dis = (val & I2C_IF_DIS_BIT);
+	memcpy((void *)dev->cfg, (void *)&mpu6050_defcfg, sizeof(struct mpu_cfg));
+	dev->dat->lp = false; /* the defaults are the full profile */
+
+	if (mpu_cfg_set(dev) < 0) /* couldn't set config */
+		return -1;
 
 	return 0;
 }
 
-static int mpu_cfg_parse_FIFO_EN(struct mpu_dev *dev)
+static int mpu_cfg_set(struct mpu_dev *dev)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, FIFO_EN, &val) < 0)
+	/* write config to device registers */
+	if (mpu_cfg_write(dev) < 0)
 		return -1;
 
-	dev->cfg->temp_fifo_en  = (val & TEMP_FIFO_EN_BIT);
-	dev->cfg->xg_fifo_en    = (val & XG_FIFO_EN_BIT);
-	dev->cfg->yg_fifo_en    = (val & YG_FIFO_EN_BIT);
-	dev->cfg->zg_fifo_en    = (val & ZG_FIFO_EN_BIT);
-	dev->cfg->accel_fifo_en = (val & ACCEL_FIFO_EN_BIT);
-	dev->cfg->slv2_fifo_en  = (val & SLV2_FIFO_EN_BIT);
-	dev->cfg->slv1_fifo_en  = (val & SLV1_FIFO_EN_BIT);
-	dev->cfg->slv0_fifo_en  = (val & SLV0_FIFO_EN_BIT);
+	/* ensure device is configured */
+	if (mpu_cfg_validate(dev) < 0)
+		return -1;
 
-	mpu_word_t words = 0; /* sensors written to fifo at each sampling time */
-	if(dev->cfg->temp_fifo_en)	words += 1;
-	if(dev->cfg->xg_fifo_en)	words += 1;
-	if(dev->cfg->yg_fifo_en)	words += 1;
-	if(dev->cfg->zg_fifo_en)	words += 1;
-	if(dev->cfg->accel_fifo_en)	words += 3;
-	if(dev->cfg->slv2_fifo_en)	words += 1;
-	if(dev->cfg->slv1_fifo_en)	words += 1;
-	if(dev->cfg->slv0_fifo_en)	words += 1;
+	/* fill device structure */
+	if (mpu_cfg_parse(dev) < 0)
+		return -1;
 
-	/* CRUCIAL - raw[0] = buffered sensors  */
-	dev->dat->raw[0] = words;
-	dev->fifosensors = words;
-	dev->fifomax = 1023;
+	mpu_dev_parameters_save(MPU6050_CFGFILE, dev);
 
 	return 0;
 }
 
-static int mpu_cfg_parse_ACCEL_CONFIG(struct mpu_dev *dev)
+static int mpu_cfg_write(struct mpu_dev *dev)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, ACCEL_CONFIG, &val) < 0)
+	/* contiguous registers go out together, in address order */
+	if (mpu_write_regs(dev, (const mpu_reg_t (*)[2])dev->cfg->regs, ARRAY_LEN(dev->cfg->regs)) < 0)
 		return -1;
 
-	dev->cfg->xa_st = (val & XA_ST_BIT);
-	dev->cfg->ya_st = (val & YA_ST_BIT);
-	dev->cfg->za_st = (val & ZA_ST_BIT);
+	return 0;
+}
 
-	int afs_sel = (val & AFS_SEL_BIT) >> 3;
-	switch (afs_sel) {
-		case 0 : dev->afr =  2; dev->albs = 16384; break;
-		case 1 : dev->afr =  4; dev->albs =  8192; break;
-		case 2 : dev->afr =  8; dev->albs =  4096; break;
-		case 3 : dev->afr = 16; dev->albs =  2048; break;
-		default	:
-			return -1; /* invalid value */
-	}
+static int mpu_cfg_validate(struct mpu_dev *dev)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	/* read back in the runs they were written */
+	if (mpu_check_regs(dev, (const mpu_reg_t (*)[2])dev->cfg->regs, ARRAY_LEN(dev->cfg->regs)) < 0)
+		return -1;
 
 	return 0;
 }
 
-static int mpu_cfg_parse_GYRO_CONFIG(struct mpu_dev *dev)
+static int mpu_cfg_get_val(struct mpu_dev *dev, const mpu_reg_t reg, mpu_reg_t *val)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, GYRO_CONFIG, &val) < 0)
+	if (reg == 0) /* register 0 invalid */
 		return -1;
 
-	dev->cfg->xg_st = (val & XG_ST_BIT);
-	dev->cfg->yg_st = (val & YG_ST_BIT);
-	dev->cfg->zg_st = (val & ZG_ST_BIT);
-
-	int fs_sel = (val & FS_SEL_BIT) >> 3;
-	switch (fs_sel) {
-		case 0 : dev->gfr =  250; dev->glbs = 131.0; break;
-		case 1 : dev->gfr =  500; dev->glbs =  65.5; break;
-		case 2 : dev->gfr = 1000; dev->glbs =  32.8; break;
-		case 3 : dev->gfr = 2000; dev->glbs =  16.4; break;
-		default	:
-			return -1; /* invalid value */
+	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
+		if (0 == dev->cfg->regs[i][0]) 	/* register 0 means unconfigured */
+			continue;
+		if (reg == dev->cfg->regs[i][0]) {/* seek register */
+			*val = dev->cfg->regs[i][1];
+			return 0;
+		}
 	}
 
-	return 0;
+
+	return -1; /* reg not found */
 }
 
-static int mpu_cfg_parse_CONFIG(struct mpu_dev *dev)
+static int mpu_cfg_set_val(struct mpu_dev *dev, const mpu_reg_t reg, const mpu_reg_t val)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, CONFIG, &val) < 0)
+	if (reg == 0) /* register 0 invalid */
 		return -1;
 
-	/* ignore EXT_SYNC_SET to avoid complicating senors readings */
-	if (val & EXT_SYNC_SET_BIT) { /* EXT_SYNC_SET not supported */
-	       return -1;
-	}
+	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
+		if (0 == dev->cfg->regs[i][0]) 	/* register 0 means unconfigured */
+			continue;
 
-	int dlpf_cfg = (uint8_t)(val & DLPF_CFG_BIT);
-	switch (dlpf_cfg) {
-		case 0 : dev->abdw = 260; dev->adly =  0;
-		         dev->gbdw = 256; dev->gdly =  0.98;
-		         dev->gor  = 8000;
-		         break;
-		case 1 : dev->abdw = 184; dev->adly =  2.0;
-		         dev->gbdw = 188; dev->gdly =  1.90;
-		         dev->gor  = 1000;
-		         break;
-		case 2 : dev->abdw =  94; dev->adly =  3.0;
-		         dev->gbdw =  98; dev->gdly =  2.80;
-		         dev->gor  =  1000;
-		         break;
-		case 3 : dev->abdw =  44; dev->adly =  4.9;
-		         dev->gbdw =  42; dev->gdly =  4.8;
-		         dev->gor  =  1000;
-		         break;
-		case 4 : dev->abdw =  21; dev->adly =  8.5;
-		         dev->gbdw =  20; dev->gdly =  8.3;
-		         dev->gor  =  1000;
-		         break;
-		case 5 : dev->abdw =  10; dev->adly = 13.8;
-		         dev->gbdw =  10; dev->gdly = 13.4;
-		         dev->gor  =  1000;
-		         break;
-		case 6 : dev->abdw =   5; dev->adly = 19.0;
-		         dev->gbdw =   5; dev->gdly = 18.6;
-		         dev->gor  = 1000;
-		         break;
-		case 7 :
-			return -1; /* error: reserved value */
-		default :
-			return -1; /* error: invalid value */
+		if(reg == dev->cfg->regs[i][0]) { /* seek register */
+			dev->cfg->regs[i][1] = val;
+			return 0;
+		}
 	}
 
-	return 0;
+	return -1; /* reg not found */
 }
 
-static int mpu_cfg_parse_SMPLRT_DIV(struct mpu_dev *dev)
+/*
+ * Set the fields under mask of reg to bits, in the configuration mirror
+ * only. mask must be made of whole supported fields of mpu_fields[], the
+ * table mpu_cfg_decode() reads them back with.
+ */
+static int mpu_cfg_put(struct mpu_dev *dev, const mpu_reg_t reg, const mpu_reg_t mask, const mpu_reg_t bits)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	if (dev->gor == 0) /* must have gyro output rate */
+	if (bits & ~mask) /* outside the field */
 		return -1;
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, SMPLRT_DIV, &val) < 0)
+	mpu_reg_t known = 0;
+	for (size_t i = 0; i < ARRAY_LEN(mpu_fields); i++) {
+		const struct mpu_field *f = &mpu_fields[i];
+		if ((f->reg != reg) || !(f->mask & mask))
+			continue;
+		if (f->unsup || ((f->mask & mask) != f->mask)) /* unsupported or part of a field */
+			return -1;
+		known |= f->mask;
+	}
+	if (mask & ~known) /* no such field */
 		return -1;
 
-	 /* all guaranteed to be greater than zero */
-	double gyro_output_rate	  = (double)dev->gor;
-	double samplerate_divisor = (double)(val + 1);
-	double sampling_rate	  = gyro_output_rate / samplerate_divisor;
-	double sampling_time	  = 1 / sampling_rate;
+	mpu_reg_t val;
+	if (mpu_cfg_get_val(dev, reg, &val) < 0)
+		return -1;
 
-	dev->sr   = sampling_rate;
-	dev->st	  = sampling_time;
-	dev->dly.tv_sec = lrint(sampling_time);
-	dev->dly.tv_nsec = 1000000000 * lrint(sampling_time - dev->dly.tv_sec);
+	val &= ~mask;	/* mask bits */
+	val |= bits;	/* set bits */
 
-	return 0;
+	return mpu_cfg_set_val(dev, reg, val);
 }
 
-static int mpu_cfg_parse_INT_PIN_CFG(struct mpu_dev *dev)
+/*
+ * Decode a register image, regs[MPU6050_REGDUMP_LEN] indexed by address,
+ * into the configuration flags and the derived device fields. Nothing
+ * is changed when the image holds an unsupported setting.
+ */
+static int mpu_cfg_decode(struct mpu_dev *dev, const mpu_reg_t *regs)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, INT_PIN_CFG, &val) < 0)
+	for (size_t i = 0; i < ARRAY_LEN(mpu_fields); i++) {
+		const struct mpu_field *f = &mpu_fields[i];
+		if (f->unsup && (regs[f->reg] & f->mask)) /* must not be set */
+			return -1;
+	}
+
+	unsigned int dlpf_cfg = MPU_FIELD(regs, CONFIG, DLPF_CFG);
+	if (dlpf_cfg >= ARRAY_LEN(mpu_dlpf_tab)) /* reserved value */
 		return -1;
 
-	if (val & FSYNC_INT_EN_BIT) /* FSYNC_INT_EN not supported */
+	double st = (regs[SMPLRT_DIV] + 1) / (double)mpu_dlpf_tab[dlpf_cfg].gor;
+	int aux = mpu_aux_words(regs, st);
+	if (aux < 0) /* slaves the frame can't carry */
 		return -1;
 
-	if (val & FSYNC_INT_EN_BIT) { dev->cfg->fsync_int_en = true; }
+	for (size_t i = 0; i < ARRAY_LEN(mpu_fields); i++) {
+		const struct mpu_field *f = &mpu_fields[i];
+		if (f->flag)
+			*(bool *)((uint8_t *)dev->cfg + f->flag) = regs[f->reg] & f->mask;
+	}
+
+	const struct mpu_cfg *c = dev->cfg;
+	unsigned int ch = 0; /* powered and buffered */
+	if (c->accel_fifo_en && !c->stdby_xa)	ch |= MPU6050_CH_XA;
+	if (c->accel_fifo_en && !c->stdby_ya)	ch |= MPU6050_CH_YA;
+	if (c->accel_fifo_en && !c->stdby_za)	ch |= MPU6050_CH_ZA;
+	if (c->xg_fifo_en && !c->stdby_xg)	ch |= MPU6050_CH_XG;
+	if (c->yg_fifo_en && !c->stdby_yg)	ch |= MPU6050_CH_YG;
+	if (c->zg_fifo_en && !c->stdby_zg)	ch |= MPU6050_CH_ZG;
+	if (c->temp_fifo_en && !c->temp_dis)	ch |= MPU6050_CH_TEMP;
+	dev->channels = ch;
+
+	if (dev->cfg->fifo_en)
+		dev->direct = MPU6050_DIRECT_OFF;
+	else
+		dev->direct = dev->cfg->data_rdy_en ? MPU6050_DIRECT_DRDY : MPU6050_DIRECT_TIMER;
+
+	static const double wake[4] = { 1.25, 5, 20, 40 };
+	dev->wake_freq = dev->cfg->cycle ? wake[MPU_FIELD(regs, PWR_MGMT_2, LP_WAKE_CTL)] : 0;
+	dev->aolpm = dev->cfg->cycle && dev->cfg->stdby_xg && dev->cfg->stdby_yg && dev->cfg->stdby_zg;
+
+	mpu_word_t words = 0; /* sensors written to fifo at each sampling time */
+	if(dev->cfg->temp_fifo_en)	words += 1;
+	if(dev->cfg->xg_fifo_en)	words += 1;
+	if(dev->cfg->yg_fifo_en)	words += 1;
+	if(dev->cfg->zg_fifo_en)	words += 1;
+	if(dev->cfg->accel_fifo_en)	words += 3;
+	words += aux;
+
+	/* CRUCIAL - raw[0] = buffered sensors  */
+	dev->dat->raw[0] = words;
+	dev->fifosensors = words;
+	dev->fifomax = 1023;
+
+	static const double afr[4]  = {     2,     4,     8,    16 };
+	static const double albs[4] = { 16384,  8192,  4096,  2048 };
+	static const double gfr[4]  = {   250,   500,  1000,  2000 };
+	static const double glbs[4] = { 131.0,  65.5,  32.8,  16.4 };
+	unsigned int afs_sel = MPU_FIELD(regs, ACCEL_CONFIG, AFS_SEL);
+	unsigned int fs_sel  = MPU_FIELD(regs, GYRO_CONFIG, FS_SEL);
+	dev->afr = afr[afs_sel]; dev->albs = albs[afs_sel];
+	dev->gfr = gfr[fs_sel];  dev->glbs = glbs[fs_sel];
+
+	const struct mpu_dlpf_spec *spec = &mpu_dlpf_tab[dlpf_cfg];
+	dev->abdw = spec->abdw; dev->adly = spec->adly;
+	dev->gbdw = spec->gbdw; dev->gdly = spec->gdly;
+	dev->gor  = spec->gor;
+	dev->dlpf = dlpf_cfg;
+
+	 /* all guaranteed to be greater than zero, cycling samples once a wake */
+	double sampling_rate = (double)dev->gor / (double)(regs[SMPLRT_DIV] + 1);
+	if (dev->cfg->cycle)
+		sampling_rate = dev->wake_freq;
+	double sampling_time = 1 / sampling_rate;
+
+	dev->sr   = sampling_rate;
+	dev->st	  = sampling_time;
+	dev->dly.tv_sec = (time_t)sampling_time;
+	dev->dly.tv_nsec = lrint(1e9 * (sampling_time - dev->dly.tv_sec));
+	dev->bus_load = mpu_bus_load(dev, sampling_rate);
 
 	return 0;
 }
 
-static int mpu_cfg_parse_INT_ENABLE(struct mpu_dev *dev)
+/*
+ * Words the auxiliary slaves add to a frame of the register image regs,
+ * -1 if it can't carry them. The master reads every enabled slave once
+ * a sample, in slave order, into EXT_SENS_DATA; the fifo queues those
+ * of buffered slaves after the gyro. Buffered slaves must read whole
+ * words, and all of them must be read within the sampling time st.
+ */
+static int mpu_aux_words(const mpu_reg_t *regs, double st)
 {
-	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
-		return -1;
-
-	mpu_reg_t val;
-	if (mpu_cfg_get_val(dev, INT_ENABLE, &val) < 0)
+	/* I2C_MST_CLK, Register Map rev. 4.2, p. 20 */
+	static const double mst_khz[16] = {
+		348, 333, 320, 308, 296, 286, 276, 267, 258, 500, 471, 444, 421, 400, 381, 364
+	};
+	bool mst = regs[USER_CTRL] & I2C_MST_EN_BIT;
+	unsigned int bytes = 0, clks = 0;
+	int words = 0;
+	for (int i = 0; i < MPU6050_AUX_SLAVES; i++) {
+		mpu_reg_t ctrl = regs[I2C_SLV0_CTRL + 3 * i];
+		bool rd = regs[I2C_SLV0_ADDR + 3 * i] & I2C_SLV_RW_BIT;
+		unsigned int len = (mst && (ctrl & I2C_SLV_EN_BIT)) ? ctrl & I2C_SLV_LEN_BIT : 0;
+		if (regs[mpu_aux_fifo[i][0]] & mpu_aux_fifo[i][1]) {
+			if (!rd || (0 == len) || (len & 1)) /* no whole words read */
+				return -1;
+			words += len / 2;
+		}
+		if (0 == len)
+			continue;
+		bytes += rd ? len : 0;
+		clks  += (MPU6050_I2C_RD_HDR + len) * MPU6050_I2C_BYTE + MPU6050_I2C_FRAME;
+	}
+	if (bytes > MPU6050_AUX_BYTES) /* past EXT_SENS_DATA_23 */
 		return -1;
-
-	dev->cfg->fifo_oflow_en = (val & FIFO_OFLOW_EN_BIT);
-	dev->cfg->i2c_mst_en	= (val & I2C_MST_INT_EN_BIT);
-	dev->cfg->data_rdy_en   = (val & DATA_RDY_EN_BIT);
-
-	if (dev->cfg->i2c_mst_en) /* I2C_MST_EN not supported */
+	if (clks / (1e3 * mst_khz[MPU_FIELD(regs, I2C_MST_CTRL, I2C_MST_CLK)]) > st) /* slower than sampling */
 		return -1;
 
-	return 0;
+	return words;
 }
 
 static int mpu_dat_set(struct mpu_dev *dev)
@@ -929,6 +1899,13 @@ static int mpu_dat_set(struct mpu_dev *dev)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	/* buffered frames were laid out and scaled for the old config */
+	dev->dat->fifo_pos = dev->dat->fifo_len = 0;
+	dev->dat->gap = true;
+
+	if (mpu_ctl_direct_timer(dev) < 0) /* period changed or direct reads off */
+		return -1;
+
 	/* Associate data with meaningful names */
 	int count = 0;
 	if (dev->cfg->accel_fifo_en) {
@@ -964,11 +1941,13 @@ static int mpu_dat_set(struct mpu_dev *dev)
 		dev->Azd = &dev->cal->dri[count];
 		dev->Azm = &dev->dat->mea[count];
 		dev->Azv = &dev->dat->var[count];
+		mpu_cal_acc_fuse(dev);
 	}
 	if (dev->cfg->temp_fifo_en)	{
 		count++;
 		dev->dat->scl[count] = 1/340.0;
-		dev->dat->dat[count][0] = 0;
+		if (!dev->dat->lp) /* held from the last full frame */
+			dev->dat->dat[count][0] = 0;
 		dev->t  = &dev->dat->dat[count][0];
 		dev->to = &dev->cal->off[count];
 		dev->tg = &dev->cal->gai[count];
@@ -981,7 +1960,8 @@ static int mpu_dat_set(struct mpu_dev *dev)
 		dev->dat->GM = 0;
 		dev->GM  = &dev->dat->GM;
 		dev->dat->scl[count] = 1.0/(double)dev->glbs;
-		dev->dat->dat[count][0] = 0;
+		if (!dev->dat->lp)
+			dev->dat->dat[count][0] = 0;
 		dev->Gx  = &dev->dat->dat[count][0];
 		dev->Gx2 = &dev->dat->squ[count];
 		dev->Gxo = &dev->cal->off[count];
@@ -995,7 +1975,8 @@ static int mpu_dat_set(struct mpu_dev *dev)
 		dev->dat->GM = 0;
 		dev->GM  = &dev->dat->GM;
 		dev->dat->scl[count] = 1.0/(double)dev->glbs;
-		dev->dat->dat[count][0] = 0;
+		if (!dev->dat->lp)
+			dev->dat->dat[count][0] = 0;
 		dev->Gy  = &dev->dat->dat[count][0];
 		dev->Gy2 = &dev->dat->squ[count];
 		dev->Gyo = &dev->cal->off[count];
@@ -1009,7 +1990,8 @@ static int mpu_dat_set(struct mpu_dev *dev)
 		dev->dat->GM = 0;
 		dev->GM  = &dev->dat->GM;
 		dev->dat->scl[count] = 1.0/(double)dev->glbs;
-		dev->dat->dat[count][0] = 0;
+		if (!dev->dat->lp)
+			dev->dat->dat[count][0] = 0;
 		dev->Gz  = &dev->dat->dat[count][0];
 		dev->Gz2 = &dev->dat->squ[count];
 		dev->Gzo = &dev->cal->off[count];
@@ -1018,35 +2000,35 @@ static int mpu_dat_set(struct mpu_dev *dev)
 		dev->Gzm = &dev->dat->mea[count];
 		dev->Gzv = &dev->dat->var[count];
 	}
-	/* don't know if the ordering is correct */
-	if (dev->cfg->slv0_fifo_en) {
-		count++;
-		dev->dat->scl[count] = 1/dev->albs;
-		dev->dat->dat[count][0] = 0;
-		dev->slv0_dat = &dev->dat->dat[count][0];
-	}
-	if (dev->cfg->slv1_fifo_en) {
-		count++;
-		dev->dat->scl[count] = 1/dev->albs;
-		dev->dat->dat[count][0] = 0;
-		dev->slv1_dat = &dev->dat->dat[count][0];
-	}
-	if (dev->cfg->slv2_fifo_en) {
-		count++;
-		dev->dat->scl[count] = 1/dev->albs;
-		dev->dat->dat[count][0] = 0;
-		dev->slv2_dat = &dev->dat->dat[count][0];
-	}
-	if (dev->cfg->slv3_fifo_en) {
-		count++;
-		dev->dat->scl[count] = 1/dev->albs;
-		dev->slv3_dat = &dev->dat->dat[count][0];
+	/* external sensor data follows the gyro, buffered slaves in order */
+	mpu_data_t **slv[MPU6050_AUX_SLAVES] = {
+		&dev->slv0_dat, &dev->slv1_dat, &dev->slv2_dat, &dev->slv3_dat
+	};
+	const bool buffered[MPU6050_AUX_SLAVES] = {
+		dev->cfg->slv0_fifo_en, dev->cfg->slv1_fifo_en,
+		dev->cfg->slv2_fifo_en, dev->cfg->slv3_fifo_en
+	};
+	unsigned int n[MPU6050_AUX_SLAVES] = { 0 }; /* words of each */
+	for (int i = 0; i < MPU6050_AUX_SLAVES; i++) {
+		mpu_reg_t ctrl;
+		if (!buffered[i] || (mpu_cfg_get_val(dev, I2C_SLV0_CTRL + 3 * i, &ctrl) < 0))
+			continue;
+		n[i] = (ctrl & I2C_SLV_LEN_BIT) / 2;
+		*slv[i] = &dev->dat->dat[count + 1][0];
+		for (unsigned int k = 0; k < n[i]; k++) {
+			count++;
+			dev->dat->scl[count] = (dev->cfg->aux_scl[i] > 0) ? dev->cfg->aux_scl[i] : 1;
+			dev->dat->dat[count][0] = 0;
+		}
 	}
-	if (dev->cfg->slv4_fifo_en) {
-		count++;
-		dev->dat->scl[count] = 1/dev->albs;
-		dev->dat->dat[count][0] = 0;
-		dev->slv4_dat = &dev->dat->dat[count][0];
+	if (MPU6050_MAG_NONE != dev->cfg->mag) {
+		const uint8_t *axis = mpu_mag_tab[dev->cfg->mag].axis;
+		unsigned int i = dev->cfg->mag_slv;
+		if ((i < MPU6050_AUX_SLAVES) && (axis[0] < n[i]) && (axis[1] < n[i]) && (axis[2] < n[i])) {
+			dev->Mx = &MPU6050_AUX_WORD(*slv[i], axis[0]);
+			dev->My = &MPU6050_AUX_WORD(*slv[i], axis[1]);
+			dev->Mz = &MPU6050_AUX_WORD(*slv[i], axis[2]);
+		}
 	}
 
 	return 0;
@@ -1074,35 +2056,34 @@ static int mpu_dat_reset(struct mpu_dev *dev)
 	dev->Gz = dev->Gz2 = dev->Gzo = dev->Gzg = dev->Gzm = dev->Gzv = dev->Gzd = NULL;
 	dev->t = 	  dev->to =  dev->tg =  dev->tm =  dev->tv =  dev->td = NULL;
 	dev->slv0_dat = dev->slv1_dat = dev->slv2_dat = dev->slv3_dat = dev->slv4_dat = NULL;
+	dev->Mx = dev->My = dev->Mz = NULL;
 
 	return 0;
 }
 
+/* decode the configuration mirror, every default register must be in it */
 static int mpu_cfg_parse(struct mpu_dev *dev)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	if (mpu_cfg_parse_PWR_MGMT(dev) < 0)
-	        return -1;
-	if (mpu_cfg_parse_FIFO_EN(dev) < 0)
-	        return -1;
-	if (mpu_cfg_parse_ACCEL_CONFIG(dev) < 0)
-	        return -1;
-	if (mpu_cfg_parse_GYRO_CONFIG(dev) < 0)
-	        return -1;
-	if (mpu_cfg_parse_CONFIG(dev) < 0)
-	        return -1;
-	if (mpu_cfg_parse_SMPLRT_DIV(dev) < 0)
-	       return -1;
-	if (mpu_cfg_parse_USER_CTRL(dev) < 0)
-	       return -1;
-	if (mpu_cfg_parse_INT_PIN_CFG(dev) < 0)
-	        return -1;
-	if (mpu_cfg_parse_INT_ENABLE(dev) < 0)
-	         return -1;
+	mpu_reg_t regs[MPU6050_REGDUMP_LEN] = { 0 };
+	bool have[MPU6050_REGDUMP_LEN] = { false };
+	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
+		mpu_reg_t reg = dev->cfg->regs[i][0];
+		if ((0 == reg) || (reg >= MPU6050_REGDUMP_LEN)) /* unconfigured */
+			continue;
+		regs[reg] = dev->cfg->regs[i][1];
+		have[reg] = true;
+	}
 
-	return 0;
+	for (size_t i = 0; i < ARRAY_LEN(mpu6050_defcfg.regs); i++) {
+		mpu_reg_t reg = mpu6050_defcfg.regs[i][0];
+		if ((0 != reg) && !have[reg]) /* register missing */
+			return -1;
+	}
+
+	return mpu_cfg_decode(dev, regs);
 }
 
 static int mpu_cal_reset(struct mpu_dev *dev)
@@ -1135,6 +2116,20 @@ static int mpu_cal_reset(struct mpu_dev *dev)
 	dev->cal->yg_bias = 0.0L;
 	dev->cal->zg_bias = 0.0L;
 	dev->cal->samples = 1000;
+	dev->cal->t_cal = NAN;		/* no calibration temperature yet */
+	dev->cal->tcb_en = false;
+	dev->cal->tcb_t0 = 0;
+	dev->cal->tcb_dt = 0;
+	dev->cal->tcb_idt = 0;
+	memset(dev->cal->tcb, 0, sizeof(dev->cal->tcb));
+	dev->cal->acc_en = false;
+	dev->cal->acc_poses = 0;
+	memset(dev->cal->acc_pose, 0, sizeof(dev->cal->acc_pose));
+	memset(dev->cal->acc_mat, 0, sizeof(dev->cal->acc_mat));
+	memset(dev->cal->acc_off, 0, sizeof(dev->cal->acc_off));
+	memset(dev->cal->acc_fus, 0, sizeof(dev->cal->acc_fus));
+	for (int i = 0; i < 3; i++)
+		dev->cal->acc_mat[i][i] = 1; /* identity */
 
 	return 0;
 }
@@ -1199,8 +2194,7 @@ static int mpu_dev_bind(const char *path, const mpu_reg_t address, struct mpu_de
 	return 0;
 
 dev_bind_exit:
-	if ((close(fd)) < 0) /* cleanup or exit */
-		exit(EXIT_FAILURE);
+	close(fd);
 
 	return -1;
 }
@@ -1211,138 +2205,826 @@ int mpu_get_data(struct mpu_dev *dev)
 	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	mpu_ctl_fifo_data(dev);
+	if (NULL != dev->dec) {
+		if (mpu_ctl_decim_data(dev) < 0)
+			return -1;
+	} else if (mpu_ctl_fifo_data(dev) < 0) {
+		return -1;
+	}
 	mpu_ctl_fix_axis(dev);
 
+	struct mpu_fusion *fus = dev->fus; /* no gyroscopes in low power, the attitude holds */
+	if ((NULL != fus) && !dev->dat->lp && (NULL != dev->Ax) && (NULL != dev->Gx) && (NULL != dev->Gy) && (NULL != dev->Gz)) {
+		/* filters expect specific force, undo mpu_ctl_fix_axis() */
+		const float a[3] = { -*(dev->Ax), -*(dev->Ay), -*(dev->Az) };
+		const float g[3] = {  *(dev->Gx),  *(dev->Gy),  *(dev->Gz) };
+		if (mpu_fusion_update(fus, a, g, (float)dev->dt) < 0)
+			return -1;
+	}
+
+	if ((NULL != dev->shm) && (mpu_ctl_shm_publish(dev) < 0))
+		return -1;
+
+	if (NULL != dev->rt)
+		mpu_rt_account(dev->rt, dev);
+
 	return 0;
 }
 
-
-static int mpu_ctl_fifo_data(struct mpu_dev *dev)
+int mpu_ctl_fusion(struct mpu_dev *dev, struct mpu_fusion *fus)
 {
 	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	int len = 1 + dev->dat->raw[0];
-	if (1 == len) {
-		return 0;
-	}
+	if ((NULL != fus) && ((NULL == dev->Ax) || (NULL == dev->Gx) || (NULL == dev->Gy) || (NULL == dev->Gz)))
+		return -1; /* accelerometer and gyroscope must be buffered */
 
-	if (mpu_ctl_fifo_count(dev) < 0)
+	dev->fus = fus; /* NULL detaches */
+
+	return 0;
+}
+
+int mpu_ctl_log(struct mpu_dev *dev, struct mpu_log *log)
+{
+	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	if (dev->fifocnt > dev->fifomax) { /* buffer overflow */
-		mpu_ctl_fifo_flush(dev);
+	if ((NULL != log) && (NULL == log->ring)) /* not open */
+		return -1;
+
+	dev->log = log; /* NULL detaches */
+
+	return 0;
+}
+
+int mpu_ctl_shm(struct mpu_dev *dev, struct mpu_shm *shm)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	if ((NULL != shm) && ((NULL == shm->hdr) || !shm->owner)) /* not a publisher */
+		return -1;
+
+	dev->shm = shm; /* NULL detaches */
+
+	return 0;
+}
+
+/*
+ * Real-time mode, see mpu6050_rt.h: while rt is attached parameters are
+ * kept in memory, detaching writes the file if they changed.
+ */
+int mpu_ctl_rt(struct mpu_dev *dev, struct mpu_rt *rt)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	dev->rt = rt; /* NULL detaches */
+	if ((NULL == rt) && dev->dat->params_dirty) {
+		if (mpu_dev_parameters_save(MPU6050_CFGFILE, dev) < 0) /* still dirty */
+			return -1;
+		dev->dat->params_dirty = false;
+	}
+
+	return 0;
+}
+
+/* drain as many frames as bp allows at once, NULL drains what is there */
+int mpu_ctl_batch(struct mpu_dev *dev, struct mpu_batch *bp)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	if ((NULL != bp) && ((0 == bp->min) || (bp->min > bp->max))) /* uninitialized */
+		return -1;
+
+	if ((NULL != bp) && (mpu_batch_reset(bp) < 0))
+		return -1;
+
+	dev->bat = bp; /* NULL detaches */
+
+	return 0;
+}
+
+/*
+ * Motion gated acquisition, see mpu6050_idle.h. Attaching programs the
+ * motion engine with the thresholds of ip; NULL detaches, returning to
+ * the rate left when the unit went still, and turns the engine off.
+ */
+int mpu_ctl_idle(struct mpu_dev *dev, struct mpu_idle *ip)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if (MPU6050_DIRECT_DRDY == dev->direct) /* its reads clear the motion status */
+		return -1;
+
+	mpu_reg_t thr[6] = { 0 };
+	if ((NULL != ip) && (!(ip->check > 0) || !(ip->rearm >= 0) || (mpu_idle_regs(ip, thr) < 0))) /* uninitialized */
+		return -1;
+
+	if ((NULL != ip) && ip->lowpower && (!(ip->idle_hz > 0) || (ip->idle_hz > MPU6050_LP_MAX) ||
+	    dev->dat->lp)) /* no wake rate, or cycling already */
+		return -1;
+
+	if (NULL != dev->idl) { /* the policy attached wakes first */
+		if (dev->idl->idle && (mpu_idle_rate(dev, false) < 0))
+			return -1;
+		mpu_idle_switch(dev->idl, false);
+		dev->idl = NULL;
+	}
+
+	static const mpu_reg_t reg[6] = { FF_THR, FF_DUR, MOT_THR, MOT_DUR, ZRMOT_THR, ZRMOT_DUR };
+	mpu_reg_t en = 0, hpf = ACCEL_HPF_0;
+	if (NULL != ip) { /* 5 Hz high-pass, gravity never counts as motion */
+		en  = MOT_EN_BIT | ZMOT_EN_BIT | ((ip->ff_thr > 0) ? FF_EN_BIT : 0);
+		hpf = ACCEL_HPF_1;
+	}
+
+	struct mpu_cfg bkp = *(dev->cfg);
+	for (size_t i = 0; i < ARRAY_LEN(reg); i++)
+		if (mpu_cfg_set_val(dev, reg[i], thr[i]) < 0)
+			goto mpu_ctl_idle_error;
+	if ((mpu_cfg_put(dev, ACCEL_CONFIG, ACCEL_HPF_BIT, hpf) < 0) ||
+	    (mpu_cfg_put(dev, INT_ENABLE, FF_EN_BIT | MOT_EN_BIT | ZMOT_EN_BIT, en) < 0))
+		goto mpu_ctl_idle_error;
+
+	if (mpu_cfg_set(dev) < 0)
+		goto mpu_ctl_idle_restore;
+
+	if (NULL != ip) {
+		mpu_reg_t status;
+		if (mpu_read_byte(dev, INT_STATUS, &status) < 0) /* events of the past */
+			goto mpu_ctl_idle_restore;
+		if (mpu_idle_reset(ip) < 0)
+			goto mpu_ctl_idle_restore;
+	}
+	dev->idl = ip;
+
+	return 0;
+
+mpu_ctl_idle_restore: /* the registers were written, back to the old ones */
+	*(dev->cfg) = bkp;
+	mpu_cfg_parse(dev);
+	mpu_cfg_set(dev);
+
+	return -1;
+
+mpu_ctl_idle_error:
+	*(dev->cfg) = bkp;
+	mpu_cfg_parse(dev);
+
+	return -1;
+}
+
+/*
+ * Read the motion status when the policy wants it and switch the rate
+ * when the unit went still or moved again. With no idle rate a still
+ * unit is waited for here, the fifo left alone. A zero motion edge that
+ * never came is replaced by the level after ip->rearm.
+ */
+static int mpu_ctl_idle_check(struct mpu_dev *dev)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	struct mpu_idle *ip = dev->idl;
+	for (;;) {
+		int due = mpu_idle_due(ip);
+		if (due <= 0)
+			return due;
+
+		mpu_reg_t status, detect = 0;
+		if (mpu_read_byte(dev, INT_STATUS, &status) < 0)
+			return -1;
+		int rearm = mpu_idle_rearm(ip, status);
+		if (rearm < 0)
+			return -1;
+		if (rearm) /* the edge was lost, its level stands for it */
+			status |= ZMOT_INT_BIT;
+		if ((status & ZMOT_INT_BIT) && (mpu_read_byte(dev, MOT_DETECT_STATUS, &detect) < 0))
+			return -1;
+
+		int still = mpu_idle_still(ip, status, detect);
+		if (still < 0)
+			return -1;
+		if ((still != ip->idle) && ((mpu_idle_rate(dev, still) < 0) || (mpu_idle_switch(ip, still) < 0)))
+			return -1;
+
+		if (!ip->idle || (ip->idle_hz > 0))
+			return 0;
+
+		mpu_sleep(ip->check);
+		ip->t_poll = 0; /* the status is due again */
+	}
+}
+
+/*
+ * Going still, drop to the idle rate; moving again, return to the rate
+ * left, unless another was set meanwhile. Only SMPLRT_DIV and CONFIG are
+ * written, in one transfer, the configuration file keeps the rate left.
+ */
+static int mpu_idle_rate(struct mpu_dev *dev, bool still)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	struct mpu_idle *ip = dev->idl;
+	if (ip->lowpower) /* the accelerometer cycles while still */
+		return mpu_lp_switch(dev, still ? ip->idle_hz : 0);
+	if (0 == ip->idle_hz) /* frames queued while still are stale */
+		return still ? 0 : mpu_ctl_fifo_flush(dev);
+
+	mpu_reg_t div, cfg, dlpf;
+	if ((mpu_cfg_get_val(dev, SMPLRT_DIV, &div) < 0) || (mpu_cfg_get_val(dev, CONFIG, &cfg) < 0))
+		return -1;
+	dlpf = cfg & DLPF_CFG_BIT;
+
+	if (still) {
+		ip->slowed = false;
+		ip->div    = div;
+		ip->dlpf   = dlpf;
+		if (mpu_rate_plan(ip->idle_hz, -1, &div, &dlpf) < 0)
+			return -1;
+		if (mpu_dlpf_tab[dlpf].gor / (1.0 + div) >= dev->sr) /* no slower than now */
+			return 0;
+		ip->idle_div  = div;
+		ip->idle_dlpf = dlpf;
 	} else {
-		while (dev->fifocnt < len) { /* buffer underflow */
-			nanosleep(&(dev->dly), NULL);
-			mpu_ctl_fifo_count(dev);
-		}
+		bool kept = ip->slowed && (div == ip->idle_div) && (dlpf == ip->idle_dlpf);
+		ip->slowed = false;
+		if (!kept) /* rate set while idle */
+			return mpu_ctl_fifo_flush(dev);
+		div  = ip->div;
+		dlpf = ip->dlpf;
 	}
 
-	for (int i = 1; i < len; i++) {
-		if (mpu_fifo_data(dev, &dev->dat->raw[i]) < 0)
+	mpu_reg_t buf[2] = { div, (mpu_reg_t)((cfg & ~DLPF_CFG_BIT) | dlpf) };
+	if ((mpu_cfg_set_val(dev, SMPLRT_DIV, buf[0]) < 0) || (mpu_cfg_set_val(dev, CONFIG, buf[1]) < 0))
+		return -1;
+	if (mpu_write_block(dev, SMPLRT_DIV, 2, buf) < 0) /* CONFIG follows SMPLRT_DIV */
+		return -1;
+	if (mpu_cfg_parse(dev) < 0)
+		return -1;
+	if (mpu_dat_set(dev) < 0)
+		return -1;
+	if (mpu_ctl_fifo_flush(dev) < 0) /* frames at the old rate */
+		return -1;
+	if ((NULL != dev->bat) && (mpu_batch_reset(dev->bat) < 0))
+		return -1;
+	ip->slowed = still;
+
+	return 0;
+}
+
+/* cfg and cal, as the calibration file stores them; NULL buf sizes it */
+int mpu_get_params(struct mpu_dev *dev, void *buf, size_t *len)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	if (NULL == len) /* nowhere to report */
+		return -1;
+
+	size_t need = sizeof(mpu_params_hdr) + sizeof(struct mpu_cfg) + sizeof(struct mpu_cal);
+	if (NULL != buf) {
+		if (*len < need) /* too small */
 			return -1;
+		uint8_t *p = buf;
+		memcpy(p, &mpu_params_hdr, sizeof(mpu_params_hdr));
+		memcpy(p + sizeof(mpu_params_hdr), dev->cfg, sizeof(struct mpu_cfg));
+		memcpy(p + sizeof(mpu_params_hdr) + sizeof(struct mpu_cfg), dev->cal, sizeof(struct mpu_cal));
+	}
+	*len = need;
+
+	return 0;
+}
+
+/* config register value as last written, no bus access */
+int mpu_get_reg(struct mpu_dev *dev, mpu_reg_t reg, mpu_reg_t *val)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	if (NULL == val) /* nowhere to report */
+		return -1;
+
+	return mpu_cfg_get_val(dev, reg, val);
+}
+
+int mpu_ctl_decimator(struct mpu_dev *dev, struct mpu_decim *dec)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	if ((NULL != dec) && ((NULL == dec->h) || (dev->dat->raw[0] > (int)dec->channels)))
+		return -1; /* uninitialized or too few channels */
+
+	if ((NULL != dec) && (mpu_decim_reset(dec) < 0))
+		return -1;
+
+	dev->dec = dec; /* NULL detaches */
+
+	return 0;
+}
+
+
+static int mpu_ctl_fifo_data(struct mpu_dev *dev)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	int words = dev->dat->raw[0];
+	if (0 == words) {
+		return 0;
+	}
+
+	double ts;
+	if (NULL != dev->rep) { /* recorded frames keep their recorded time */
+		dev->dat->gapped = dev->rep->gap;
+		if (dev->rep->gap) /* seeked, dt restarts */
+			dev->dat->ts = 0;
+		if (mpu_replay_next(dev->rep, &dev->dat->raw[1], words, &ts) < 0)
+			return -1;
+	} else if (NULL != dev->iio) { /* the driver stamps every scan */
+		dev->dat->gapped = false;
+		if (mpu_iio_next(dev->iio, &dev->dat->raw[1], words, &ts) < 0)
+			return -1;
+	} else {
+		if (dev->dat->fifo_pos >= dev->dat->fifo_len) { /* host buffer empty */
+			if ((NULL != dev->idl) && (mpu_ctl_idle_check(dev) < 0))
+				return -1;
+			int res = dev->direct ? mpu_ctl_direct_read(dev) : mpu_ctl_fifo_drain(dev);
+			if (res < 0)
+				return -1;
+		}
+
+		const uint8_t *p = &dev->dat->fifo[dev->dat->fifo_pos];
+		dev->dat->fifo_pos += 2 * words;
+		for (int i = 1; i <= words; i++, p += 2)
+			dev->dat->raw[i] = (int16_t)((uint16_t)p[0] << 8 | p[1]);
+
+		/* frames are st apart, after a gap the host clock places them */
+		ts = dev->dat->gap ? dev->dat->ts_gap : dev->dat->ts + dev->st;
+		dev->dat->gapped = dev->dat->gap;
+	}
+	int lo = 1, hi = 0; /* temperature and gyro words, off in low power, hold */
+	if (dev->dat->lp) {
+		lo = 1 + 3 * dev->cfg->accel_fifo_en;
+		hi = lo - 1 + dev->cfg->temp_fifo_en + dev->cfg->xg_fifo_en + dev->cfg->yg_fifo_en + dev->cfg->zg_fifo_en;
+	}
+	for (int i = 1; i <= words; i++) {
+		if ((i >= lo) && (i <= hi))
+			continue;
 		dev->dat->dat[i][0] = dev->dat->raw[i] * dev->dat->scl[i];
 		dev->dat->dat[i][1] = dev->dat->dat[i][0];
 	}
-	if (dev->cfg->temp_fifo_en) {
-		*(dev->t) += 36.53;
+
+	dev->dt = ((dev->dat->ts > 0) && (ts > dev->dat->ts)) ? ts - dev->dat->ts : dev->st;
+	dev->ts = dev->dat->ts = ts;
+	dev->dat->gap = false;
+
+	if (NULL != dev->log) /* drops are counted by the log, never stall */
+		mpu_log_frame(dev->log, &dev->dat->raw[1], words, ts);
+
+	mpu_data_t *tcb = dev->dat->tcb; /* temperature dependent bias, held in low power */
+	if (!dev->dat->lp) {
+		memset(tcb, 0, sizeof(dev->dat->tcb));
+		if (dev->cfg->temp_fifo_en) {
+			*(dev->t) += 36.53;
+			if (dev->cal->tcb_en)
+				mpu_cal_tcb_eval(dev->cal, *(dev->t), tcb);
+		}
+	}
+	if (dev->cfg->accel_fifo_en && dev->cal->acc_en) {
+		/* fused sensitivity, scale, cross-axis and offset - raw[1..3] */
+		const int16_t *r = &dev->dat->raw[1];
+		const mpu_data_t (*m)[3] = (const mpu_data_t (*)[3])dev->cal->acc_fus;
+		const mpu_data_t *o = dev->cal->acc_off;
+		*(dev->Ax) = m[0][0]*r[0] + m[0][1]*r[1] + m[0][2]*r[2] + o[0] - tcb[0];
+		*(dev->Ay) = m[1][0]*r[0] + m[1][1]*r[1] + m[1][2]*r[2] + o[1] - tcb[1];
+		*(dev->Az) = m[2][0]*r[0] + m[2][1]*r[1] + m[2][2]*r[2] + o[2] - tcb[2];
+	} else if (dev->cfg->accel_fifo_en) {
+		*(dev->Ax) -= (mpu_data_t)dev->cal->xa_bias + tcb[0];
+		*(dev->Ay) -= (mpu_data_t)dev->cal->ya_bias + tcb[1];
+		*(dev->Az) -= (mpu_data_t)dev->cal->za_bias + tcb[2];
 	}
+	if (dev->cfg->xg_fifo_en && !dev->dat->lp)
+		*(dev->Gx) -= (mpu_data_t)dev->cal->xg_bias + tcb[3];
+	if (dev->cfg->yg_fifo_en && !dev->dat->lp)
+		*(dev->Gy) -= (mpu_data_t)dev->cal->yg_bias + tcb[4];
+	if (dev->cfg->zg_fifo_en && !dev->dat->lp)
+		*(dev->Gz) -= (mpu_data_t)dev->cal->zg_bias + tcb[5];
+	mpu_dat_squares(dev);
+	dev->samples++;
+
+	return 0;
+}
+
+static inline void mpu_dat_squares(struct mpu_dev *dev)
+{
 	if (dev->cfg->accel_fifo_en) {
-		*(dev->Ax) -= (mpu_data_t)dev->cal->xa_bias;
-		*(dev->Ay) -= (mpu_data_t)dev->cal->ya_bias;
-		*(dev->Az) -= (mpu_data_t)dev->cal->za_bias;
 		*(dev->Ax2) = (mpu_data_t)*(dev->Ax) * *(dev->Ax);
 		*(dev->Ay2) = (mpu_data_t)*(dev->Ay) * *(dev->Ay);
 		*(dev->Az2) = (mpu_data_t)*(dev->Az) * *(dev->Az);
 		*(dev->AM) = (mpu_data_t)sqrt(*(dev->Ax2) + *(dev->Ay2) + *(dev->Az2));
 	}
-	if (dev->cfg->xg_fifo_en && dev->cfg->yg_fifo_en && dev->cfg->zg_fifo_en) {
-		*(dev->Gx) -= (mpu_data_t)dev->cal->xg_bias;
-		*(dev->Gy) -= (mpu_data_t)dev->cal->yg_bias;
-		*(dev->Gz) -= (mpu_data_t)dev->cal->zg_bias;
-		*(dev->Gx2) = *(dev->Gx) * *(dev->Gx);
-		*(dev->Gy2) = *(dev->Gy) * *(dev->Gy);
-		*(dev->Gz2) = *(dev->Gz) * *(dev->Gz);
-		*(dev->GM) = (mpu_data_t)sqrt(*(dev->Gx2) + *(dev->Gy2) + *(dev->Gz2));
+	if (NULL != dev->GM) { /* the magnitude of the axes buffered */
+		mpu_data_t m = 0;
+		if (dev->cfg->xg_fifo_en) {
+			*(dev->Gx2) = *(dev->Gx) * *(dev->Gx);
+			m += *(dev->Gx2);
+		}
+		if (dev->cfg->yg_fifo_en) {
+			*(dev->Gy2) = *(dev->Gy) * *(dev->Gy);
+			m += *(dev->Gy2);
+		}
+		if (dev->cfg->zg_fifo_en) {
+			*(dev->Gz2) = *(dev->Gz) * *(dev->Gz);
+			m += *(dev->Gz2);
+		}
+		*(dev->GM) = (mpu_data_t)sqrt(m);
 	}
-	dev->samples++;
+}
+
+/* the reading as mpu_get_data() leaves it, for other processes */
+static int mpu_ctl_shm_publish(struct mpu_dev *dev)
+{
+	struct mpu_shm_frame f = {
+		.samples = dev->samples,
+		.ts	 = dev->ts,
+		.dt	 = dev->dt,
+		.words	 = (uint32_t)dev->dat->raw[0],
+		.q	 = { 1, 0, 0, 0 },
+	};
+	if (NULL != dev->fus)
+		memcpy(f.q, dev->fus->q, sizeof(f.q));
+	for (unsigned int i = 0; i < f.words; i++) {
+		f.raw[i] = dev->dat->raw[1 + i];
+		f.val[i] = dev->dat->dat[1 + i][0];
+	}
+
+	return mpu_shm_publish(dev->shm, &f);
+}
+
+/* convert frames until the decimator yields one, then report that instead */
+static int mpu_ctl_decim_data(struct mpu_dev *dev)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	struct mpu_decim *dec = dev->dec;
+	int words = dev->dat->raw[0];
+	if (words > (int)dec->channels) /* config changed after attaching */
+		return -1;
+
+	/* the frames an output still needs go through the filter together */
+	float x[MPU6050_DECIM_BATCH * MPU6050_DECIM_LANES] = { 0 };
+	float y[MPU6050_DECIM_LANES];
+	double dt = 0;
+	size_t n = 0;
+	while (0 == n) {
+		unsigned int m = 0;
+		unsigned int need = dec->factor - dec->phase;
+		need = (need > MPU6050_DECIM_BATCH) ? MPU6050_DECIM_BATCH : need;
+		while (m < need) {
+			if (mpu_ctl_fifo_data(dev) < 0)
+				return -1;
+			float *f = &x[m * dec->channels];
+			for (int i = 0; i < words; i++)
+				f[i] = (float)dev->dat->dat[1 + i][0];
+			if (dev->dat->gapped) { /* no history from before the gap */
+				if (mpu_decim_prime(dec, f) < 0)
+					return -1;
+				memmove(x, f, dec->channels * sizeof(float));
+				m = 0;
+				dt = 0;
+				need = (dec->factor > MPU6050_DECIM_BATCH) ? MPU6050_DECIM_BATCH : dec->factor;
+			}
+			dt += dev->dt;
+			m++;
+		}
+		if (mpu_decim_run(dec, x, m, y, &n) < 0)
+			return -1;
+	}
+	for (int i = 0; i < words; i++)
+		dev->dat->dat[1 + i][0] = dev->dat->dat[1 + i][1] = y[i];
+	mpu_dat_squares(dev);
+	dev->dt = dt;
 
 	return 0;
 }
 
-static int mpu_ctl_fifo_count(struct mpu_dev *dev)
+/*
+ * Read every complete frame the fifo holds in as few block transfers as
+ * possible; mpu_ctl_fifo_data() then decodes them from memory one by one.
+ */
+static int mpu_ctl_fifo_drain(struct mpu_dev *dev)
 {
 	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	uint16_t tem = 0;
-	if (mpu_read_word(dev, FIFO_COUNT_H, &tem) < 0)
+	int frame = 2 * dev->dat->raw[0];
+	if (0 == frame) /* nothing buffered */
 		return -1;
 
-	uint16_t buf = (tem << 8) | (tem >> 8);
-	dev->fifocnt = buf;
+	if (dev->dat->spec_reset) { /* frames were dropped with the fifo */
+		dev->dat->gap = true;
+		dev->dat->spec_reset = false;
+	}
+
+	unsigned int want = 1; /* frames to wait for */
+	if ((NULL != dev->bat) && (mpu_batch_plan(dev->bat, dev, &want) < 0))
+		return -1;
+	double busy = dev->dat->io_busy;
+
+	if (dev->fifo_spec) {
+		if (mpu_ctl_fifo_spec(dev, want) < 0)
+			return -1;
+		if (dev->dat->fifo_len > 0)
+			goto mpu_ctl_fifo_drain_done;
+	}
+
+	if (mpu_ctl_fifo_count(dev) < 0)
+		return -1;
+
+	if (dev->fifocnt > dev->fifomax) { /* buffer overflow */
+		if (mpu_ctl_fifo_flush(dev) < 0)
+			return -1;
+		dev->fifocnt = 0;
+	}
+	while (dev->fifocnt < (int)want * frame) { /* buffer underflow */
+		int missing = want - dev->fifocnt / frame;
+		if (missing > 1) { /* sleep until the batch is complete */
+			mpu_sleep(missing * dev->st);
+		} else {
+			nanosleep(&(dev->dly), NULL);
+		}
+		if (mpu_ctl_fifo_count(dev) < 0)
+			return -1;
+	}
+
+	int len = (dev->fifocnt < MPU6050_FIFO_LEN) ? dev->fifocnt : MPU6050_FIFO_LEN;
+	if ((NULL != dev->bat) && (len > (int)dev->bat->max * frame))
+		len = dev->bat->max * frame;
+	len -= len % frame; /* a partial frame stays in the fifo */
+	if (mpu_read_fifo(dev, len, dev->dat->fifo) < 0)
+		return -1;
+	dev->dat->fifo_pos = 0;
+	dev->dat->fifo_len = len;
+
+	if (dev->dat->gap) /* the newest frame read was sampled about now */
+		dev->dat->ts_gap = mpu_clock() - ((dev->fifocnt - len) / frame + len / frame - 1) * dev->st;
+
+mpu_ctl_fifo_drain_done:
+	if (NULL != dev->bat)
+		mpu_batch_done(dev->bat, dev, dev->dat->fifo_len / frame, dev->dat->io_busy - busy);
 
 	return 0;
 }
 
-static int mpu_ctl_fifo_flush(struct mpu_dev *dev)
+/*
+ * FIFO_COUNT and the frames expected by now in one I2C_RDWR transaction.
+ * The expectation, from the count of the previous read and the sampling
+ * rate, stays a frame behind so the read never outruns the fifo; if it
+ * does, the frames counted are kept and the fifo reset to realign them.
+ * Adapters that allow a read only as the last message get the count and
+ * the frames in two transactions, back to back, and no more than counted.
+ * Leaves the host buffer empty when there is nothing to read this way.
+ */
+static int mpu_ctl_fifo_spec(struct mpu_dev *dev, unsigned int want)
 {
 	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	uint8_t dat = 0;
-       	mpu_ctl_fifo_count(dev);
-	for (int i = 0; i < dev->fifocnt; i++) {
-		if (mpu_read_byte(dev, FIFO_R_W, &dat) < 0)
+	struct mpu_dat *d = dev->dat;
+	int frame = 2 * d->raw[0];
+
+	double t0 = mpu_clock();
+	double due = (double)d->spec_left / frame + (t0 - d->spec_t) * dev->sr - 1;
+	if (due < want) { /* sleep until the frames wanted are expected */
+		mpu_sleep((want - due) * dev->st);
+		t0 = mpu_clock();
+		due = want;
+	}
+	if ((NULL != dev->bat) && (due > dev->bat->max))
+		due = dev->bat->max;
+	int len = (due < MPU6050_FIFO_LEN / frame) ? (int)due * frame : MPU6050_FIFO_LEN - MPU6050_FIFO_LEN % frame;
+
+	mpu_reg_t reg[2] = { FIFO_COUNT_H, FIFO_R_W };
+	uint8_t cnt[2] = { 0 };
+	struct i2c_msg msg[4] = {
+		{ .addr = dev->addr, .flags = 0,	.len = 1,		.buf = &reg[0] },
+		{ .addr = dev->addr, .flags = I2C_M_RD, .len = 2,		.buf = cnt },
+		{ .addr = dev->addr, .flags = 0,	.len = 1,		.buf = &reg[1] },
+		{ .addr = dev->addr, .flags = I2C_M_RD, .len = (__u16)len,	.buf = d->fifo },
+	};
+	struct i2c_rdwr_ioctl_data xfer = { .msgs = msg, .nmsgs = d->spec_split ? 2 : 4 };
+
+	int res = ioctl(*(dev->bus), I2C_RDWR, &xfer);
+	double t = mpu_bus_account(dev, t0, res, xfer.nmsgs / 2 * MPU6050_I2C_RD_HDR, d->spec_split ? 2 : 2 + len);
+
+	d->fifo_pos = d->fifo_len = 0;
+	if (res < 0) /* bus error */
+		return -1;
+
+	dev->fifocnt = (cnt[0] << 8) | cnt[1];
+	d->spec_t = t0;
+	if (dev->fifocnt > dev->fifomax) /* overflow, the count path flushes */
+		return 0;
+
+	if (d->spec_split) { /* counted first, read no more than that */
+		if (len > dev->fifocnt - dev->fifocnt % frame)
+			len = dev->fifocnt - dev->fifocnt % frame;
+		if (len > 0) {
+			msg[3].len = (__u16)len;
+			xfer.msgs  = &msg[2];
+			res = ioctl(*(dev->bus), I2C_RDWR, &xfer);
+			mpu_bus_account(dev, t, res, MPU6050_I2C_RD_HDR, len);
+			if (res < 0)
+				return -1;
+		}
+		d->spec_left = dev->fifocnt - len;
+	} else if (len > dev->fifocnt) { /* read past the frames counted */
+		dev->spec_miss++;
+		len = dev->fifocnt - dev->fifocnt % frame;
+		mpu_reg_t val;
+		if (mpu_cfg_get_val(dev, USER_CTRL, &val) < 0)
+			return -1;
+		if (mpu_write_byte(dev, USER_CTRL, val | FIFO_RESET_BIT) < 0)
 			return -1;
+		d->spec_t = mpu_clock();
+		d->spec_left = 0;
+		d->spec_reset = true;
+	} else {
+		d->spec_left = dev->fifocnt - len;
 	}
-	dev->samples = 0;
+	d->fifo_len = len;
+
+	if (d->gap && (len > 0)) /* the newest frame counted was sampled about now */
+		d->ts_gap = t0 - (len / frame - 1 + d->spec_left / frame) * dev->st;
 
 	return 0;
 }
 
-static int mpu_fifo_data(struct mpu_dev *dev, int16_t *data)
+/*
+ * The newest sample in one block read of the output registers, once the
+ * sampling period timer expires; it lands in the host buffer as a fifo
+ * frame would. Gated by data ready the read starts at INT_STATUS, which
+ * clears on read, and is repeated until the device updated the sample;
+ * the timer then moves to expire just after the next update.
+ */
+static int mpu_ctl_direct_read(struct mpu_dev *dev)
 {
 	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	/* HIC SUNT DRACONES */
-	uint16_t dh;  /* unsigned for bit fiddling data high */
-	uint16_t dl;  /* unsigned for bit fiddling data low  */
-	uint8_t buf;
-	if (mpu_read_byte(dev, FIFO_R_W, &buf) < 0)
+	struct mpu_dat *d = dev->dat;
+	uint64_t ticks;
+	if (read(d->tfd, &ticks, sizeof(ticks)) < 0) /* timer not armed */
+		return -1;
+
+	mpu_reg_t first;
+	bool on[MPU6050_OUT_WORDS];
+	size_t len = mpu_direct_window(dev, &first, on);
+	mpu_reg_t buf[1 + 2 * MPU6050_OUT_WORDS];
+	if (0 == len) /* nothing buffered */
 		return -1;
-	dh = (uint16_t)(buf & 0x00FF) << 8;
 
-	if (mpu_read_byte(dev, FIFO_R_W, &buf) < 0)
+	double t0 = mpu_clock();
+	double t  = t0;
+	unsigned int polls = 0;
+	for (;;) {
+		if (mpu_read_block(dev, first, len, buf) < 0)
+			return -1;
+		if (!dev->cfg->data_rdy_en || (buf[0] & DATA_RDY_INT_BIT))
+			break;
+		dev->direct_stale++;
+		polls++;
+		if (mpu_clock() - t0 > 2 * dev->st) /* device stopped sampling */
+			return -1;
+		mpu_sleep(dev->st / MPU6050_DRDY_POLL);
+		t = mpu_clock();
+	}
+
+	if (polls > 0) { /* expired early, follow the device clock */
+		double next = t + dev->st;
+		struct itimerspec its = { .it_interval = dev->dly, .it_value = { .tv_sec = (time_t)next } };
+		its.it_value.tv_nsec = lrint(1e9 * (next - its.it_value.tv_sec));
+		if (timerfd_settime(d->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+			return -1;
+	}
+
+	/* the output registers are in fifo frame order, keep the buffered ones */
+	int n = 0;
+	for (int i = 0; i < MPU6050_OUT_WORDS; i++) {
+		int at = ACCEL_XOUT_H + 2 * i - first;
+		if (!on[i])
+			continue;
+		d->fifo[n++] = buf[at];
+		d->fifo[n++] = buf[at + 1];
+	}
+	if (n != 2 * d->raw[0]) /* sensors the registers don't hold */
 		return -1;
-	dl = (uint16_t)(buf & 0x00FF);
-	*data = (uint16_t)(dh | dl);
+
+	d->fifo_pos = 0;
+	d->fifo_len = n;
+	d->gap	    = true; /* placed by the host clock, not st after the last */
+	d->ts_gap   = t;
 
 	return 0;
 }
 
-static int mpu_read_data(struct mpu_dev * const dev, const mpu_reg_t reg, int16_t *val)
+/*
+ * Output registers a direct read covers, from the first buffered sensor
+ * to the last, INT_STATUS ahead of them when gated by data ready. Its
+ * length in bytes, 0 if no sensor is buffered; on, if given, marks the
+ * buffered words: accel x, y, z, temp, gyro x, y, z.
+ */
+static size_t mpu_direct_window(const struct mpu_dev *dev, mpu_reg_t *first, bool *on)
+{
+	const struct mpu_cfg *c = dev->cfg;
+	const bool w[MPU6050_OUT_WORDS] = {
+		c->accel_fifo_en, c->accel_fifo_en, c->accel_fifo_en, c->temp_fifo_en,
+		c->xg_fifo_en, c->yg_fifo_en, c->zg_fifo_en,
+	};
+	if (NULL != on)
+		memcpy(on, w, sizeof(w));
+
+	int lo = MPU6050_OUT_WORDS, hi = -1;
+	for (int i = 0; i < MPU6050_OUT_WORDS; i++) {
+		if (w[i]) {
+			lo = (i < lo) ? i : lo;
+			hi = i;
+		}
+	}
+	if (hi < 0)
+		return 0;
+
+	*first = c->data_rdy_en ? INT_STATUS : ACCEL_XOUT_H + 2 * lo;
+	return ACCEL_XOUT_H + 2 * hi + 2 - *first;
+}
+
+/* arm the timer direct reads wait on at the sampling period, or close it */
+static int mpu_ctl_direct_timer(struct mpu_dev *dev)
 {
 	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	uint16_t dh;  /* unsigned for bit fiddling data high */
-	uint16_t dl;  /* unsigned for bit fiddling data low  */
-	uint8_t buf;
+	struct mpu_dat *d = dev->dat;
+	if ((MPU6050_DIRECT_OFF == dev->direct) || (*(dev->bus) < 0)) {
+		if (d->tfd >= 0)
+			close(d->tfd);
+		d->tfd = -1;
+		return 0;
+	}
+
+	if ((d->tfd < 0) && ((d->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0))
+		return -1;
+
+	struct itimerspec its = { .it_interval = dev->dly, .it_value = dev->dly };
+	if (timerfd_settime(d->tfd, 0, &its, NULL) < 0)
+		return -1;
 
-	if (mpu_read_byte(dev, reg, &buf) < 0)
+	return 0;
+}
+
+static int mpu_ctl_fifo_count(struct mpu_dev *dev)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	uint16_t tem = 0;
+	if (mpu_read_word(dev, FIFO_COUNT_H, &tem) < 0)
 		return -1;
 
-	dh = (uint16_t)(buf & 0x00FF) << 8;
+	uint16_t buf = (tem << 8) | (tem >> 8);
+	dev->fifocnt = buf;
+
+	return 0;
+}
 
-	if (mpu_read_byte(dev, reg+1, &buf) < 0)
+static int mpu_ctl_fifo_flush(struct mpu_dev *dev)
+{
+	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
-	dl = (uint16_t)(buf & 0x00FF);
-	*val = (uint16_t)(dh | dl);
+	if (mpu_ctl_fifo_count(dev) < 0)
+		return -1;
+
+	/* whatever is left in the host buffer goes too */
+	size_t len = (dev->fifocnt < MPU6050_FIFO_LEN) ? dev->fifocnt : MPU6050_FIFO_LEN;
+	if (mpu_read_fifo(dev, len, dev->dat->fifo) < 0)
+		return -1;
+	dev->dat->fifo_pos = dev->dat->fifo_len = 0;
+	dev->dat->gap = true;
+	dev->dat->spec_t = mpu_clock();
+	dev->dat->spec_left = 0;
+	dev->dat->spec_reset = false;
+	dev->samples = 0;
 
 	return 0;
 }
@@ -1352,12 +3034,24 @@ int mpu_ctl_selftest(struct mpu_dev *dev, char *fname)
 	if (MPUDEV_IS_NULL(dev))
 		return -1;
 
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if (NULL != dev->rt) /* writes a report */
+		return -1;
+
+	if (dev->dat->lp) /* gyroscopes in standby, leave the low-power profile first */
+		return -1;
+
+	if ((NULL != dev->idl) || (NULL != dev->bat)) /* would replan the rate or drains mid phase */
+		return -1;
+
 	/* prepare the device for self-test */
-	struct mpu_cfg *cfg_old = calloc(1, sizeof(struct mpu_cfg));
-	memcpy((void *)cfg_old,  (void *)dev->cfg, sizeof(struct mpu_cfg));
+	struct mpu_cfg cfg_old = *(dev->cfg);
 
 	mpu_ctl_dlpf(dev,0);
 	mpu_ctl_samplerate(dev, 100);
+	mpu_ctl_channels(dev, MPU6050_CH_ALL); /* no axis in standby */
 	mpu_ctl_clocksource(dev, 3);
 	mpu_ctl_accel_range(dev, 8);
 	mpu_ctl_gyro_range(dev, 250);
@@ -1414,61 +3108,21 @@ int mpu_ctl_selftest(struct mpu_dev *dev, char *fname)
 	}
 	mpu_ctl_fifo_disable_gyro(dev);
 
-	long double xa_str = fabsl(xa_st_on - xa_st_off)/(long double)samples;
-	long double ya_str = fabsl(ya_st_on - ya_st_off)/(long double)samples;
-	long double za_str = fabsl(za_st_on - za_st_off)/(long double)samples;
-	long double xg_str = fabsl(xg_st_on - xg_st_off)/(long double)samples;
-	long double yg_str = fabsl(yg_st_on - yg_st_off)/(long double)samples;
-	long double zg_str = fabsl(zg_st_on - zg_st_off)/(long double)samples;
-
-	/* get self-test registers */
-	uint8_t stx = 0;
-	uint8_t sty = 0;
-	uint8_t stz = 0;
-	uint8_t sta = 0;
-	mpu_read_byte(dev, SELF_TEST_X, &stx);
-	mpu_read_byte(dev, SELF_TEST_Y, &sty);
-	mpu_read_byte(dev, SELF_TEST_Z, &stz);
-	mpu_read_byte(dev, SELF_TEST_A, &sta);
-	uint8_t xa_st = ((stx & XA_TEST_42_BIT) >> 3) | ((sta & XA_TEST_10_BIT) >> 4);
-	uint8_t ya_st = ((sty & YA_TEST_42_BIT) >> 3) | ((sta & YA_TEST_10_BIT) >> 2);
-	uint8_t za_st = ((stz & ZA_TEST_42_BIT) >> 3) |  (sta & ZA_TEST_10_BIT);
-	uint8_t xg_st =  (stx & XG_TEST_40_BIT);
-	uint8_t yg_st =  (sty & YG_TEST_40_BIT);
-	uint8_t zg_st =  (stz & ZG_TEST_40_BIT);
-
-	/* ACCEL get factory trim values - datasheet formula for +-8g */
-	long double ft_xa = 4096.0L * 0.34L * pow(0.92L/0.34L, ((long double)(xa_st -1)/14.0L));
-	long double ft_ya = 4096.0L * 0.34L * pow(0.92L/0.34L, ((long double)(ya_st -1)/14.0L));
-	long double ft_za = 4096.0L * 0.34L * pow(0.92L/0.34L, ((long double)(za_st -1)/14.0L));
-	/* GYRO get factory trim values - datasheet fomula for +-250 dps */
-	long double ft_xg =  25.0L * 131.0L * pow(1046L, (long double)(xg_st -1));
-	long double ft_yg = -25.0L * 131.0L * pow(1046L, (long double)(yg_st -1));
-	long double ft_zg =  25.0L * 131.0L * pow(1046L, (long double)(zg_st -1));
-
-	long double shift_xa = (xa_str - ft_xa)/ft_xa;
-	long double shift_ya = (ya_str - ft_ya)/ft_ya;
-	long double shift_za = (za_str - ft_za)/ft_za;
-	long double shift_xg = (xg_str - ft_xg)/ft_xg;
-	long double shift_yg = (yg_str - ft_yg)/ft_yg;
-	long double shift_zg = (zg_str - ft_zg)/ft_zg;
-
-	FILE *fp;
-	if (NULL == (fp = fopen(fname, "w+"))) {
-		fprintf(stderr, "Couldn't open \"%s\" for self-test results! - logging to stderr.\n", fname);
-	} else {
-		fprintf(fp, "Self-test results: Xa = %Lf%% shift from factory trim (%4s)\n", fabsl(shift_xa), fabsl(shift_xa) < 14.0L ? "PASS" : "FAIL");
-		fprintf(fp, "Self-test resutls: Ya = %Lf%% shift from factory trim (%4s)\n", fabsl(shift_ya), fabsl(shift_ya) < 14.0L ? "PASS" : "FAIL");
-		fprintf(fp, "Self-test resutls: Za = %Lf%% shift from factory trim (%4s)\n", fabsl(shift_za), fabsl(shift_za) < 14.0L ? "PASS" : "FAIL");
-		fprintf(fp, "Self-test resutls: Xg = %Lf%% shift from factory trim (%4s)\n", fabsl(shift_xg), fabsl(shift_xg) < 14.0L ? "PASS" : "FAIL");
-		fprintf(fp, "Self-test resutls: Yg = %Lf%% shift from factory trim (%4s)\n", fabsl(shift_yg), fabsl(shift_yg) < 14.0L ? "PASS" : "FAIL");
-		fprintf(fp, "Self-test resutls: Zg = %Lf%% shift from factory trim (%4s)\n", fabsl(shift_zg), fabsl(shift_zg) < 14.0L ? "PASS" : "FAIL");
+	/* responses in LSB at +-8g and +-250dps */
+	long double str[6] = {
+		(xa_st_on - xa_st_off) * dev->albs / (long double)samples,
+		(ya_st_on - ya_st_off) * dev->albs / (long double)samples,
+		(za_st_on - za_st_off) * dev->albs / (long double)samples,
+		(xg_st_on - xg_st_off) * dev->glbs / (long double)samples,
+		(yg_st_on - yg_st_off) * dev->glbs / (long double)samples,
+		(zg_st_on - zg_st_off) * dev->glbs / (long double)samples,
 	};
+	struct mpu_selftest_result res;
+	mpu_selftest_eval(dev, str, &res);
+	mpu_selftest_report(fname, &res);
 
 	/* restore old config */
-	memcpy((void *)dev->cfg, (void *)cfg_old, sizeof(struct mpu_cfg));
-	free(cfg_old);
-	cfg_old = NULL;
+	*(dev->cfg) = cfg_old;
 
 	mpu_cfg_set(dev);
 	mpu_dat_set(dev);
@@ -1478,6 +3132,226 @@ int mpu_ctl_selftest(struct mpu_dev *dev, char *fname)
 }
 
 
+/*
+ * Fast self-test
+ *
+ * Registers SMPLRT_DIV (0x19) through FIFO_EN (0x23) are contiguous, so the
+ * whole self-test setup is snapshotted with one block read, applied with
+ * one block write and restored with another; PWR_MGMT_1 and PWR_MGMT_2
+ * are a second block, the axes in standby woken for the test. Accelerometer
+ * and gyroscope self-test run together, both buffered in the same FIFO
+ * frame, and only the in-memory configuration is reparsed - nothing is
+ * validated or saved.
+ */
+#define MPU6050_ST_FIRST	SMPLRT_DIV
+#define MPU6050_ST_LEN		(FIFO_EN - SMPLRT_DIV + 1)
+#define MPU6050_ST_STDBY	(STDBY_XA_BIT | STDBY_YA_BIT | STDBY_ZA_BIT | \
+				 STDBY_XG_BIT | STDBY_YG_BIT | STDBY_ZG_BIT)
+#define MPU6050_ST_SAMPLES	100		/* samples per phase	 */
+#define MPU6050_ST_SETTLE	25000000L	/* settling time (ns)	 */
+
+static const mpu_reg_t mpu_st_regs[] = {
+	SMPLRT_DIV, CONFIG, GYRO_CONFIG, ACCEL_CONFIG, FIFO_EN
+};
+
+int mpu_ctl_selftest_fast(struct mpu_dev *dev, char *fname)
+{
+	if (MPUDEV_IS_NULL(dev))
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if (NULL != dev->rt) /* writes a report */
+		return -1;
+
+	struct mpu_selftest_result res;
+	if (mpu_ctl_selftest_result(dev, &res) < 0)
+		return -1;
+
+	if (mpu_selftest_report(fname, &res) < 0)
+		return -1;
+
+	return res.passed ? 0 : 1; /* a bad part, the bus answered */
+}
+
+int mpu_ctl_selftest_result(struct mpu_dev *dev, struct mpu_selftest_result *res)
+{
+	if (MPUDEV_IS_NULL(dev) || (NULL == res))
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if (dev->dat->lp) /* gyroscopes in standby, leave the low-power profile first */
+		return -1;
+
+	if ((NULL != dev->idl) || (NULL != dev->bat)) /* would replan the rate or drains mid phase */
+		return -1;
+
+	/* snapshot device and mirror */
+	mpu_reg_t bkp[MPU6050_ST_LEN], pwr[2];
+	if (mpu_read_block(dev, MPU6050_ST_FIRST, MPU6050_ST_LEN, bkp) < 0)
+		return -1;
+	if (mpu_read_block(dev, PWR_MGMT_1, ARRAY_LEN(pwr), pwr) < 0)
+		return -1;
+	struct mpu_cfg cfg_old;
+	memcpy(&cfg_old, dev->cfg, sizeof(struct mpu_cfg));
+
+	/* 1kHz, DLPF 94Hz, +-250dps, +-8g, both self-tests on, accel and gyro buffered */
+	mpu_reg_t st[MPU6050_ST_LEN];
+	memcpy(st, bkp, sizeof(st));
+	st[SMPLRT_DIV   - MPU6050_ST_FIRST] = 0x00;
+	st[CONFIG       - MPU6050_ST_FIRST] = DLPF_CFG_2;
+	st[GYRO_CONFIG  - MPU6050_ST_FIRST] = XG_ST_BIT | YG_ST_BIT | ZG_ST_BIT | FS_SEL_0;
+	st[ACCEL_CONFIG - MPU6050_ST_FIRST] = XA_ST_BIT | YA_ST_BIT | ZA_ST_BIT | AFS_SEL_2;
+	st[FIFO_EN      - MPU6050_ST_FIRST] = ACCEL_FIFO_EN_BIT | XG_FIFO_EN_BIT | YG_FIFO_EN_BIT | ZG_FIFO_EN_BIT;
+
+	long double on[6]  = { 0 };
+	long double off[6] = { 0 };
+	long double str[6];
+
+	if (mpu_write_block(dev, MPU6050_ST_FIRST, MPU6050_ST_LEN, st) < 0)
+		goto selftest_fast_restore;
+	for (size_t i = 0; i < ARRAY_LEN(mpu_st_regs); i++) {
+		mpu_reg_t reg = mpu_st_regs[i];
+		if (mpu_cfg_set_val(dev, reg, st[reg - MPU6050_ST_FIRST]) < 0)
+			goto selftest_fast_restore;
+	}
+	if (pwr[1] & MPU6050_ST_STDBY) { /* channels in standby, wake every axis */
+		mpu_reg_t wake = pwr[1] & ~MPU6050_ST_STDBY;
+		if ((mpu_write_byte(dev, PWR_MGMT_2, wake) < 0) || (mpu_cfg_set_val(dev, PWR_MGMT_2, wake) < 0))
+			goto selftest_fast_restore;
+	}
+	if ((mpu_cfg_parse(dev) < 0) || (mpu_dat_reset(dev) < 0) || (mpu_dat_set(dev) < 0))
+		goto selftest_fast_restore;
+	if (mpu_selftest_sample(dev, on) < 0)
+		goto selftest_fast_restore;
+
+	/* self-tests off, only GYRO_CONFIG and ACCEL_CONFIG change */
+	st[GYRO_CONFIG  - MPU6050_ST_FIRST] = FS_SEL_0;
+	st[ACCEL_CONFIG - MPU6050_ST_FIRST] = AFS_SEL_2;
+	if (mpu_write_block(dev, GYRO_CONFIG, 2, &st[GYRO_CONFIG - MPU6050_ST_FIRST]) < 0)
+		goto selftest_fast_restore;
+	if (mpu_selftest_sample(dev, off) < 0)
+		goto selftest_fast_restore;
+
+	for (int k = 0; k < 6; k++)
+		str[k] = on[k] - off[k];
+	if (mpu_selftest_eval(dev, str, res) < 0)
+		goto selftest_fast_restore;
+
+	return mpu_selftest_restore(dev, bkp, pwr, &cfg_old);
+
+selftest_fast_restore:
+	mpu_selftest_restore(dev, bkp, pwr, &cfg_old);
+	return -1;
+}
+
+/* let the self-test response settle, average raw accel and gyro words */
+static int mpu_selftest_sample(struct mpu_dev *dev, long double *avg)
+{
+	mpu_sleep(MPU6050_ST_SETTLE * 1e-9);
+	if (mpu_ctl_fifo_flush(dev) < 0)
+		return -1;
+
+	for (int i = 0; i < MPU6050_ST_SAMPLES; i++) {
+		if (mpu_ctl_fifo_data(dev) < 0)
+			return -1;
+		for (int k = 0; k < 6; k++)
+			avg[k] += dev->dat->raw[1 + k]; /* accel first, then gyro */
+	}
+	for (int k = 0; k < 6; k++)
+		avg[k] /= MPU6050_ST_SAMPLES;
+
+	return 0;
+}
+
+static int mpu_selftest_restore(struct mpu_dev *dev, const mpu_reg_t *bkp, const mpu_reg_t *pwr,
+				const struct mpu_cfg *cfg)
+{
+	int ret = 0;
+	if (mpu_write_block(dev, MPU6050_ST_FIRST, MPU6050_ST_LEN, bkp) < 0)
+		ret = -1;
+	if (mpu_write_block(dev, PWR_MGMT_1, 2, pwr) < 0)
+		ret = -1;
+
+	memcpy(dev->cfg, cfg, sizeof(struct mpu_cfg));
+	if ((mpu_cfg_parse(dev) < 0) || (mpu_dat_reset(dev) < 0) || (mpu_dat_set(dev) < 0))
+		ret = -1;
+	if (mpu_ctl_fifo_flush(dev) < 0)
+		ret = -1;
+
+	return ret;
+}
+
+/*
+ * Compare self-test responses, in LSB at +-8g and +-250dps, with the
+ * factory trim (Register Map rev. 4.2, p. 10-11).
+ * Order is XA, YA, ZA, XG, YG, ZG.
+ */
+static int mpu_selftest_eval(struct mpu_dev *dev, const long double *str, struct mpu_selftest_result *res)
+{
+	mpu_reg_t st[4]; /* SELF_TEST_X, SELF_TEST_Y, SELF_TEST_Z, SELF_TEST_A */
+	if (mpu_read_block(dev, SELF_TEST_X, sizeof(st), st) < 0)
+		return -1;
+
+	int test[6] = {
+		((st[0] & XA_TEST_42_BIT) >> 3) | ((st[3] & XA_TEST_10_BIT) >> 4),
+		((st[1] & YA_TEST_42_BIT) >> 3) | ((st[3] & YA_TEST_10_BIT) >> 2),
+		((st[2] & ZA_TEST_42_BIT) >> 3) |  (st[3] & ZA_TEST_10_BIT),
+		(st[0] & XG_TEST_40_BIT),
+		(st[1] & YG_TEST_40_BIT),
+		(st[2] & ZG_TEST_40_BIT),
+	};
+
+	long double ft[6];
+	for (int k = 0; k < 3; k++)
+		ft[k] = test[k] ? 4096.0L * 0.34L * powl(0.92L/0.34L, (test[k] - 1) / 30.0L) : 0;
+	for (int k = 3; k < 6; k++)
+		ft[k] = test[k] ? 25.0L * 131.0L * powl(1.046L, test[k] - 1) : 0;
+	ft[4] = -ft[4]; /* Y gyro trim is negative */
+
+	res->passed = true;
+	for (int k = 0; k < 6; k++) {
+		res->str[k]   = str[k];
+		res->ft[k]    = ft[k];
+		res->shift[k] = (ft[k] != 0) ? 100 * (str[k] - ft[k]) / ft[k] : INFINITY;
+		res->pass[k]  = fabs(res->shift[k]) < 14.0;
+		res->passed  &= res->pass[k];
+	}
+
+	dev->str_xa = str[0]; dev->ft_xa = ft[0];
+	dev->str_ya = str[1]; dev->ft_ya = ft[1];
+	dev->str_za = str[2]; dev->ft_za = ft[2];
+	dev->str_xg = str[3]; dev->ft_xg = ft[3];
+	dev->str_yg = str[4]; dev->ft_yg = ft[4];
+	dev->str_zg = str[5]; dev->ft_zg = ft[5];
+
+	return 0;
+}
+
+static int mpu_selftest_report(char *fname, const struct mpu_selftest_result *res)
+{
+	static const char *axis[6] = { "Xa", "Ya", "Za", "Xg", "Yg", "Zg" };
+
+	FILE *fp = stdout; /* no file asked for */
+	if ((NULL != fname) && (NULL == (fp = fopen(fname, "w+")))) {
+		fprintf(stderr, "Couldn't open \"%s\" for self-test results! - logging to stderr.\n", fname);
+		fp = stderr;
+	}
+
+	for (int k = 0; k < 6; k++) {
+		fprintf(fp, "Self-test results: %s = %lf%% shift from factory trim (%4s)\n",
+			axis[k], fabs(res->shift[k]), res->pass[k] ? "PASS" : "FAIL");
+	}
+
+	if ((fp != stderr) && (fp != stdout))
+		fclose(fp);
+
+	return 0;
+}
+
 static int __attribute__((unused)) mpu_ctl_fifo_reset(struct mpu_dev *dev)
 {
 	if (MPUDEV_IS_NULL(dev))
@@ -1828,6 +3702,9 @@ int mpu_ctl_reset(struct mpu_dev *dev)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
 	if (mpu_write_byte(dev, PWR_MGMT_1,DEVICE_RESET_BIT) < 0)
 		return -1;
 
@@ -1853,12 +3730,17 @@ static int mpu_ctl_calibration_reset(struct mpu_dev *dev)
 
 	mpu_ctl_reset(dev); /* clear the OFFS_USRH registers */
 
-	mpu_read_data(dev, XA_OFFS_USRH, &dev->cal->xa_orig);
-	mpu_read_data(dev, YA_OFFS_USRH, &dev->cal->ya_orig);
-	mpu_read_data(dev, ZA_OFFS_USRH, &dev->cal->za_orig);
-	mpu_read_data(dev, XG_OFFS_USRH, &dev->cal->xg_orig);
-	mpu_read_data(dev, YG_OFFS_USRH, &dev->cal->yg_orig);
-	mpu_read_data(dev, ZG_OFFS_USRH, &dev->cal->zg_orig);
+	int16_t orig[3];
+	if (0 == mpu_read_offsets(dev, XA_OFFS_USRH, orig)) {
+		dev->cal->xa_orig = orig[0];
+		dev->cal->ya_orig = orig[1];
+		dev->cal->za_orig = orig[2];
+	}
+	if (0 == mpu_read_offsets(dev, XG_OFFS_USRH, orig)) {
+		dev->cal->xg_orig = orig[0];
+		dev->cal->yg_orig = orig[1];
+		dev->cal->zg_orig = orig[2];
+	}
 	dev->cal->xa_cust = 0;
 	dev->cal->ya_cust = 0;
 	dev->cal->za_cust = 0;
@@ -1913,15 +3795,36 @@ int mpu_ctl_calibrate(struct mpu_dev *dev)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	/* prepare the device for calibration */
-	struct mpu_cfg *cfg_old = calloc(1, sizeof(struct mpu_cfg));
-	memcpy((void *)cfg_old,  (void *)dev->cfg, sizeof(struct mpu_cfg));
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
 
-	mpu_ctl_calibration_reset(dev); /* clear OFFS_USRH registers and calibration data */
-	mpu_ctl_dlpf(dev, 5);
-	mpu_ctl_accel_range(dev, 16);
-	mpu_ctl_gyro_range(dev, 1000);
-	mpu_ctl_fifo_flush(dev);
+	/* every offset register is fitted, every axis must be buffered */
+	if (!(dev->cfg->accel_fifo_en && dev->cfg->xg_fifo_en && dev->cfg->yg_fifo_en && dev->cfg->zg_fifo_en))
+		return -1;
+
+	if (dev->dat->lp) /* gyroscopes in standby, leave the low-power profile first */
+		return -1;
+
+	if ((NULL != dev->idl) || (NULL != dev->bat)) /* would replan the rate or drains mid pass */
+		return -1;
+
+	/* prepare the device for calibration */
+	struct mpu_cfg cfg_old = *(dev->cfg);
+
+	/* temperature compensation is relative to the biases found here */
+	bool tcb_en = dev->cal->tcb_en;
+	dev->cal->tcb_en = false;
+
+	/* offset registers change, six-position solution no longer holds */
+	dev->cal->acc_en = false;
+	dev->cal->acc_poses = 0;
+
+	if ((mpu_ctl_calibration_reset(dev) < 0) || /* clear OFFS_USRH registers and calibration data */
+	    (mpu_ctl_dlpf(dev, 5) < 0) ||
+	    (mpu_ctl_accel_range(dev, 16) < 0) ||
+	    (mpu_ctl_gyro_range(dev, 1000) < 0) ||
+	    (mpu_ctl_fifo_flush(dev) < 0))
+		goto mpu_ctl_calibrate_error;
 	dev->cal->samples = 1000;
 
 	long double xa_bias = 0;
@@ -1933,7 +3836,8 @@ int mpu_ctl_calibrate(struct mpu_dev *dev)
 	long double AM_bias = 0;
 	long double GM_bias = 0;
 	for (int i = 0; i < dev->cal->samples; i++) {
-		mpu_ctl_fifo_data(dev);
+		if (mpu_ctl_fifo_data(dev) < 0)
+			goto mpu_ctl_calibrate_error;
 		xa_bias += *(dev->Ax);
 		ya_bias += *(dev->Ay);
 		za_bias += *(dev->Az);
@@ -1958,115 +3862,477 @@ int mpu_ctl_calibrate(struct mpu_dev *dev)
 	dev->cal->xa_cust = (dev->cal->xa_orig - (int16_t)((xa_bias) * a_factor));
 	dev->cal->ya_cust = (dev->cal->ya_orig - (int16_t)((ya_bias) * a_factor));
 	dev->cal->za_cust = (dev->cal->za_orig - (int16_t)((za_bias) * a_factor));
-	mpu_write_byte(dev, XA_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->xa_cust)>>8)&0xFF));
-	mpu_write_byte(dev, XA_OFFS_USRL,(uint8_t)((((uint16_t)dev->cal->xa_cust)    &0xFE) | (dev->cal->xa_orig & 0x1)));
-	mpu_write_byte(dev, YA_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->ya_cust)>>8)&0xFF));
-	mpu_write_byte(dev, YA_OFFS_USRL,(uint8_t)((((uint16_t)dev->cal->ya_cust)    &0xFE) | (dev->cal->ya_orig & 0x1)));
-	mpu_write_byte(dev, ZA_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->za_cust)>>8)&0xFF));
-	mpu_write_byte(dev, ZA_OFFS_USRL,(uint8_t)((((uint16_t)dev->cal->za_cust)    &0xFE) | (dev->cal->za_orig & 0x1)));
+	/* bit 0 of each accelerometer offset is reserved, keep the factory one */
+	const uint16_t a_offs[3] = {
+		((uint16_t)dev->cal->xa_cust & 0xFFFE) | (dev->cal->xa_orig & 0x1),
+		((uint16_t)dev->cal->ya_cust & 0xFFFE) | (dev->cal->ya_orig & 0x1),
+		((uint16_t)dev->cal->za_cust & 0xFFFE) | (dev->cal->za_orig & 0x1),
+	};
+	if (mpu_write_offsets(dev, XA_OFFS_USRH, a_offs) < 0)
+		goto mpu_ctl_calibrate_error;
+
+	dev->cal->xg_cust = (dev->cal->xg_orig - (int16_t)(xg_bias * dev->glbs));
+	dev->cal->yg_cust = (dev->cal->yg_orig - (int16_t)(yg_bias * dev->glbs));
+	dev->cal->zg_cust = (dev->cal->zg_orig - (int16_t)(zg_bias * dev->glbs));
+	const uint16_t g_offs[3] = {
+		(uint16_t)dev->cal->xg_cust, (uint16_t)dev->cal->yg_cust, (uint16_t)dev->cal->zg_cust,
+	};
+	if (mpu_write_offsets(dev, XG_OFFS_USRH, g_offs) < 0)
+		goto mpu_ctl_calibrate_error;
+
+	/* second pass - fine */
+	xa_bias = 0;
+	ya_bias = 0;
+	za_bias = 0;
+	AM_bias = 0;
+	xg_bias = 0;
+	yg_bias = 0;
+	zg_bias = 0;
+	GM_bias = 0;
+	/* store register values */
+	if (mpu_ctl_fifo_flush(dev) < 0)
+		goto mpu_ctl_calibrate_error;
+	for (int i = 0; i <  dev->cal->samples; i++) {
+		if (mpu_ctl_fifo_data(dev) < 0)
+			goto mpu_ctl_calibrate_error;
+		xa_bias += *(dev->Ax);
+		ya_bias += *(dev->Ay);
+		za_bias += *(dev->Az);
+		AM_bias += *(dev->AM);
+		xg_bias += *(dev->Gx);
+		yg_bias += *(dev->Gy);
+		zg_bias += *(dev->Gz);
+		GM_bias += *(dev->GM);
+	}
+	xg_bias /= dev->cal->samples;
+	yg_bias /= dev->cal->samples;
+	zg_bias /= dev->cal->samples;
+	int16_t orig[3];
+	if (0 == mpu_read_offsets(dev, XG_OFFS_USRH, orig)) {
+		dev->cal->xg_orig = orig[0];
+		dev->cal->yg_orig = orig[1];
+		dev->cal->zg_orig = orig[2];
+	}
+	dev->cal->xg_cust = (dev->cal->xg_orig - (int16_t)(xg_bias * dev->glbs));
+	dev->cal->yg_cust = (dev->cal->yg_orig - (int16_t)(yg_bias * dev->glbs));
+	dev->cal->zg_cust = (dev->cal->zg_orig - (int16_t)(zg_bias * dev->glbs));
+	const uint16_t g_fine[3] = {
+		(uint16_t)dev->cal->xg_cust, (uint16_t)dev->cal->yg_cust, (uint16_t)dev->cal->zg_cust,
+	};
+	if (mpu_write_offsets(dev, XG_OFFS_USRH, g_fine) < 0)
+		goto mpu_ctl_calibrate_error;
+
+	xa_bias = 0;
+	ya_bias = 0;
+	za_bias = 0;
+	AM_bias = 0;
+	xg_bias = 0;
+	yg_bias = 0;
+	zg_bias = 0;
+	GM_bias = 0;
+	long double t_cal = 0;
+	for (int i = 0; i < dev->cal->samples; i++) {
+		if (mpu_ctl_fifo_data(dev) < 0)
+			goto mpu_ctl_calibrate_error;
+		xa_bias += *(dev->Ax);
+		ya_bias += *(dev->Ay);
+		za_bias += *(dev->Az);
+		AM_bias += *(dev->AM);
+		xg_bias += *(dev->Gx);
+		yg_bias += *(dev->Gy);
+		zg_bias += *(dev->Gz);
+		GM_bias += *(dev->GM);
+		if (dev->cfg->temp_fifo_en)
+			t_cal += *(dev->t);
+	}
+	/* take the average difference */
+	xa_bias /= dev->cal->samples;
+	ya_bias /= dev->cal->samples;
+	za_bias /= dev->cal->samples;
+	AM_bias /= dev->cal->samples;
+	xg_bias /= dev->cal->samples;
+	yg_bias /= dev->cal->samples;
+	zg_bias /= dev->cal->samples;
+	GM_bias /= dev->cal->samples;
+
+	/* remove gravity */
+	AM_bias -= 1;
+	za_bias -= 1;
+	dev->cal->xa_bias = xa_bias;
+	dev->cal->ya_bias = ya_bias;
+	dev->cal->za_bias = za_bias;
+	dev->cal->xg_bias = xg_bias;
+	dev->cal->yg_bias = yg_bias;
+	dev->cal->zg_bias = zg_bias;
+	dev->cal->AM_bias = AM_bias;
+	dev->cal->GM_bias = GM_bias;
+	dev->cal->t_cal = dev->cfg->temp_fifo_en ? t_cal / dev->cal->samples : NAN;
+	dev->cal->tcb_en = tcb_en;
+	if (tcb_en) /* keep the table anchored at the new calibration point */
+		mpu_cal_tcb_center(dev->cal, NAN);
+
+	/* restore old config */
+	*(dev->cfg) = cfg_old;
+
+	if ((mpu_cfg_set(dev) < 0) || (mpu_dat_set(dev) < 0))
+		return -1;
+	mpu_dev_parameters_save(MPU6050_CFGFILE, dev);
+	if (mpu_ctl_fifo_flush(dev) < 0)
+		return -1;
+
+	return 0;
+
+mpu_ctl_calibrate_error: /* back to the ranges and rate it had */
+	*(dev->cfg) = cfg_old;
+	dev->cal->tcb_en = tcb_en;
+	mpu_cfg_parse(dev);
+	if ((mpu_cfg_set(dev) < 0) || (mpu_dat_set(dev) < 0))
+		return -1;
+	mpu_ctl_fifo_flush(dev);
+
+	return -1;
+}
+
+int mpu_ctl_calibrate_temp(struct mpu_dev *dev, unsigned long samples)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if (0 == samples) /* nothing to fit */
+		return -1;
+
+	/* every compensated axis and the temperature must be buffered */
+	if (!(dev->cfg->temp_fifo_en && dev->cfg->accel_fifo_en &&
+	      dev->cfg->xg_fifo_en && dev->cfg->yg_fifo_en && dev->cfg->zg_fifo_en))
+		return -1;
+
+	if (dev->dat->lp) /* sensors in standby, leave the low-power profile first */
+		return -1;
+
+	/* record residuals against the scalar biases only */
+	bool tcb_en = dev->cal->tcb_en;
+	dev->cal->tcb_en = false;
+
+	double sum[MPU6050_TCB_BINS][6];
+	unsigned long cnt[MPU6050_TCB_BINS];
+	memset(sum, 0, sizeof(sum));
+	memset(cnt, 0, sizeof(cnt));
+
+	if (mpu_ctl_fifo_flush(dev) < 0)
+		goto calibrate_temp_error;
+
+	for (unsigned long i = 0; i < samples; i++) {
+		if (mpu_ctl_fifo_data(dev) < 0)
+			goto calibrate_temp_error;
+
+		long bin = lrint((*(dev->t) - MPU6050_TCB_TMIN) / MPU6050_TCB_TRES);
+		if (bin < 0) 			 bin = 0;
+		if (bin > MPU6050_TCB_BINS - 1) bin = MPU6050_TCB_BINS - 1;
+
+		sum[bin][0] += *(dev->Ax);
+		sum[bin][1] += *(dev->Ay);
+		sum[bin][2] += *(dev->Az);
+		sum[bin][3] += *(dev->Gx);
+		sum[bin][4] += *(dev->Gy);
+		sum[bin][5] += *(dev->Gz);
+		cnt[bin]++;
+	}
+
+	if (mpu_cal_tcb_fit(dev->cal, sum, cnt) < 0) /* not enough sweep */
+		goto calibrate_temp_error;
+
+	dev->cal->tcb_en = true;
+	mpu_dev_parameters_save(MPU6050_CFGFILE, dev);
+
+	return 0;
+
+calibrate_temp_error:
+	dev->cal->tcb_en = tcb_en;
+	return -1;
+}
+
+int mpu_ctl_tempcomp(struct mpu_dev *dev, bool enable)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* the configuration file is the bus device's */
+		return -1;
+
+	if (enable && !(dev->cal->tcb_dt > 0)) /* no table fitted yet */
+		return -1;
+
+	dev->cal->tcb_en = enable;
+	mpu_dev_parameters_save(MPU6050_CFGFILE, dev);
+
+	return 0;
+}
+
+/*
+ * Least-squares piecewise-linear fit of the binned residuals.
+ *
+ * The knots are evenly spaced over the observed temperature span, so that
+ * evaluation needs no search. Each bin mean contributes to its two
+ * neighbouring knots through the hat basis, giving a tridiagonal system. A
+ * small first-difference penalty keeps knots without data level with their
+ * neighbours instead of dragging them to zero.
+ */
+static int mpu_cal_tcb_fit(struct mpu_cal *cal, double (*sum)[6], unsigned long *cnt)
+{
+	int lo = -1;
+	int hi = -1;
+	double wsum = 0;
+	double tsum = 0;
+	for (int b = 0; b < MPU6050_TCB_BINS; b++) {
+		if (0 == cnt[b])
+			continue;
+		if (lo < 0)
+			lo = b;
+		hi = b;
+		wsum += cnt[b];
+		tsum += cnt[b] * (MPU6050_TCB_TMIN + b * MPU6050_TCB_TRES);
+	}
+	if ((lo < 0) || ((hi - lo) * MPU6050_TCB_TRES < MPU6050_TCB_SPAN))
+		return -1; /* temperature did not sweep enough */
+
+	const int n = MPU6050_TCB_LEN;
+	double t0 = MPU6050_TCB_TMIN + lo * MPU6050_TCB_TRES;
+	double dt = (hi - lo) * MPU6050_TCB_TRES / (n - 1);
+
+	double d[MPU6050_TCB_LEN] = { 0 };	/* main diagonal */
+	double e[MPU6050_TCB_LEN] = { 0 };	/* upper diagonal */
+	double r[6][MPU6050_TCB_LEN];		/* right-hand sides */
+	memset(r, 0, sizeof(r));
+
+	for (int b = lo; b <= hi; b++) {
+		if (0 == cnt[b])
+			continue;
+		double x = (b - lo) * MPU6050_TCB_TRES / dt;
+		int i = (int)x;
+		if (i > n - 2)
+			i = n - 2;
+		double f = x - i;
+		double w = cnt[b];
+		d[i]   += w * (1 - f) * (1 - f);
+		d[i+1] += w * f * f;
+		e[i]   += w * f * (1 - f);
+		for (int k = 0; k < 6; k++) {
+			double y = sum[b][k] / cnt[b];
+			r[k][i]   += w * (1 - f) * y;
+			r[k][i+1] += w * f * y;
+		}
+	}
+
+	double lambda = 1e-6 * wsum;
+	for (int i = 0; i < n - 1; i++) {
+		d[i]   += lambda;
+		d[i+1] += lambda;
+		e[i]   -= lambda;
+	}
+
+	/* Thomas algorithm, the matrix is shared by all six axes */
+	double c[MPU6050_TCB_LEN];
+	double m[MPU6050_TCB_LEN];
+	m[0] = d[0];
+	c[0] = e[0] / m[0];
+	for (int i = 1; i < n; i++) {
+		m[i] = d[i] - e[i-1] * c[i-1];
+		c[i] = e[i] / m[i];
+	}
+	for (int k = 0; k < 6; k++) {
+		r[k][0] /= m[0];
+		for (int i = 1; i < n; i++)
+			r[k][i] = (r[k][i] - e[i-1] * r[k][i-1]) / m[i];
+		for (int i = n - 2; i >= 0; i--)
+			r[k][i] -= c[i] * r[k][i+1];
+		for (int i = 0; i < n; i++)
+			cal->tcb[k][i] = r[k][i];
+	}
+
+	cal->tcb_t0  = t0;
+	cal->tcb_dt  = dt;
+	cal->tcb_idt = 1 / dt;
+
+	/* anchor at the calibration temperature, or at the mean if unknown */
+	mpu_cal_tcb_center(cal, tsum / wsum);
+
+	return 0;
+}
+
+int mpu_ctl_calibrate_pose(struct mpu_dev *dev, unsigned int pose)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no bus */
+		return -1;
+
+	if (pose > MPU6050_POSE_ZDOWN) /* invalid orientation */
+		return -1;
 
-	dev->cal->xg_cust = (dev->cal->xg_orig - (int16_t)(xg_bias * dev->glbs));
-	dev->cal->yg_cust = (dev->cal->yg_orig - (int16_t)(yg_bias * dev->glbs));
-	dev->cal->zg_cust = (dev->cal->zg_orig - (int16_t)(zg_bias * dev->glbs));
-	mpu_write_byte(dev, XG_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->xg_cust)>>8)&0xFF));
-	mpu_write_byte(dev, XG_OFFS_USRL,(uint8_t)((uint16_t)dev->cal->xg_cust)&0xFF);
-	mpu_write_byte(dev, YG_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->yg_cust)>>8)&0xFF));
-	mpu_write_byte(dev, YG_OFFS_USRL,(uint8_t)((uint16_t)dev->cal->yg_cust)&0xFF);
-	mpu_write_byte(dev, ZG_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->zg_cust)>>8)&0xFF));
-	mpu_write_byte(dev, ZG_OFFS_USRL,(uint8_t)((uint16_t)dev->cal->zg_cust)&0xFF);
+	if (!dev->cfg->accel_fifo_en) /* accelerometer not buffered */
+		return -1;
 
-	/* second pass - fine */
-	xa_bias = 0;
-	ya_bias = 0;
-	za_bias = 0;
-	AM_bias = 0;
-	xg_bias = 0;
-	yg_bias = 0;
-	zg_bias = 0;
-	GM_bias = 0;
-	/* store register values */
-	mpu_ctl_fifo_flush(dev);
-	for (int i = 0; i <  dev->cal->samples; i++) {
-		mpu_ctl_fifo_data(dev);
-		xa_bias += *(dev->Ax);
-		ya_bias += *(dev->Ay);
-		za_bias += *(dev->Az);
-		AM_bias += *(dev->AM);
-		xg_bias += *(dev->Gx);
-		yg_bias += *(dev->Gy);
-		zg_bias += *(dev->Gz);
-		GM_bias += *(dev->GM);
-	}
-	xg_bias /= dev->cal->samples;
-	yg_bias /= dev->cal->samples;
-	zg_bias /= dev->cal->samples;
-	mpu_read_data(dev, XG_OFFS_USRH, &dev->cal->xg_orig);
-	mpu_read_data(dev, YG_OFFS_USRH, &dev->cal->yg_orig);
-	mpu_read_data(dev, ZG_OFFS_USRH, &dev->cal->zg_orig);
-	dev->cal->xg_cust = (dev->cal->xg_orig - (int16_t)(xg_bias * dev->glbs));
-	dev->cal->yg_cust = (dev->cal->yg_orig - (int16_t)(yg_bias * dev->glbs));
-	dev->cal->zg_cust = (dev->cal->zg_orig - (int16_t)(zg_bias * dev->glbs));
-	mpu_write_byte(dev, XG_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->xg_cust)>>8)&0xFF));
-	mpu_write_byte(dev, XG_OFFS_USRL,(uint8_t)((uint16_t)dev->cal->xg_cust)&0xFF);
-	mpu_write_byte(dev, YG_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->yg_cust)>>8)&0xFF));
-	mpu_write_byte(dev, YG_OFFS_USRL,(uint8_t)((uint16_t)dev->cal->yg_cust)&0xFF);
-	mpu_write_byte(dev, ZG_OFFS_USRH,(uint8_t)((((uint16_t)dev->cal->zg_cust)>>8)&0xFF));
-	mpu_write_byte(dev, ZG_OFFS_USRL,(uint8_t)((uint16_t)dev->cal->zg_cust)&0xFF);
+	if (mpu_ctl_fifo_flush(dev) < 0)
+		return -1;
 
-	xa_bias = 0;
-	ya_bias = 0;
-	za_bias = 0;
-	AM_bias = 0;
-	xg_bias = 0;
-	yg_bias = 0;
-	zg_bias = 0;
-	GM_bias = 0;
+	/* average raw words, independent of any correction in place */
+	long double sum[3] = { 0 };
 	for (int i = 0; i < dev->cal->samples; i++) {
-		mpu_ctl_fifo_data(dev);
-		xa_bias += *(dev->Ax);
-		ya_bias += *(dev->Ay);
-		za_bias += *(dev->Az);
-		AM_bias += *(dev->AM);
-		xg_bias += *(dev->Gx);
-		yg_bias += *(dev->Gy);
-		zg_bias += *(dev->Gz);
-		GM_bias += *(dev->GM);
+		if (mpu_ctl_fifo_data(dev) < 0)
+			return -1;
+		sum[0] += dev->dat->raw[1];
+		sum[1] += dev->dat->raw[2];
+		sum[2] += dev->dat->raw[3];
 	}
-	/* take the average difference */
-	xa_bias /= dev->cal->samples;
-	ya_bias /= dev->cal->samples;
-	za_bias /= dev->cal->samples;
-	AM_bias /= dev->cal->samples;
-	xg_bias /= dev->cal->samples;
-	yg_bias /= dev->cal->samples;
-	zg_bias /= dev->cal->samples;
-	GM_bias /= dev->cal->samples;
+	for (int k = 0; k < 3; k++)
+		dev->cal->acc_pose[pose][k] = sum[k] / (dev->cal->samples * dev->albs);
 
-	/* remove gravity */
-	AM_bias -= 1;
-	za_bias -= 1;
-	dev->cal->xa_bias = xa_bias;
-	dev->cal->ya_bias = ya_bias;
-	dev->cal->za_bias = za_bias;
-	dev->cal->xg_bias = xg_bias;
-	dev->cal->yg_bias = yg_bias;
-	dev->cal->zg_bias = zg_bias;
-	dev->cal->AM_bias = AM_bias;
-	dev->cal->GM_bias = GM_bias;
+	dev->cal->acc_poses |= (1u << pose);
 
-	/* restore old config */
-	memcpy((void *)dev->cfg, (void *)cfg_old, sizeof(struct mpu_cfg));
-	free(cfg_old);
-	cfg_old = NULL;
+	return 0;
+}
 
-	mpu_cfg_set(dev);
-	mpu_dat_set(dev);
+int mpu_ctl_calibrate_accel(struct mpu_dev *dev)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* the configuration file is the bus device's */
+		return -1;
+
+	if (mpu_cal_acc_fit(dev->cal) < 0) /* not enough orientations */
+		return -1;
+
+	dev->cal->acc_en = true;
+	mpu_cal_acc_fuse(dev);
 	mpu_dev_parameters_save(MPU6050_CFGFILE, dev);
-	mpu_ctl_fifo_flush(dev);
 
 	return 0;
 }
 
+/*
+ * Least-squares affine fit of the recorded orientations.
+ *
+ * Each orientation k has a mean reading m_k and an expected reading e_k of
+ * 1 g along the axis pointing up. Every output row i solves
+ *	min sum_k (M_i . m_k + o_i - e_ki)^2
+ * sharing the 4x4 normal matrix of the regressors [m_k 1], so a single
+ * factorization serves the three rows. Four non-coplanar orientations are
+ * the minimum, all six average out the noise.
+ */
+static int mpu_cal_acc_fit(struct mpu_cal *cal)
+{
+	double a[4][4] = { { 0 } };
+	double b[4][3] = { { 0 } };
+	int poses = 0;
+
+	for (int k = 0; k < 6; k++) {
+		if (!(cal->acc_poses & (1u << k)))
+			continue;
+		poses++;
+
+		double x[4] = { cal->acc_pose[k][0], cal->acc_pose[k][1], cal->acc_pose[k][2], 1 };
+		double e[3] = { 0, 0, 0 };
+		e[k / 2] = (k % 2) ? -1 : 1; /* MPU6050_POSE_XUP, MPU6050_POSE_XDOWN, ... */
+
+		for (int i = 0; i < 4; i++) {
+			for (int j = 0; j < 4; j++)
+				a[i][j] += x[i] * x[j];
+			for (int j = 0; j < 3; j++)
+				b[i][j] += x[i] * e[j];
+		}
+	}
+	if (poses < 4) /* underdetermined */
+		return -1;
+
+	/* Gauss-Jordan elimination with partial pivoting */
+	for (int c = 0; c < 4; c++) {
+		int p = c;
+		for (int r = c + 1; r < 4; r++) {
+			if (fabs(a[r][c]) > fabs(a[p][c]))
+				p = r;
+		}
+		if (fabs(a[p][c]) < 1e-9) /* coplanar orientations */
+			return -1;
+		for (int j = 0; j < 4; j++) {
+			double t = a[c][j]; a[c][j] = a[p][j]; a[p][j] = t;
+		}
+		for (int j = 0; j < 3; j++) {
+			double t = b[c][j]; b[c][j] = b[p][j]; b[p][j] = t;
+		}
+		for (int r = 0; r < 4; r++) {
+			if (r == c)
+				continue;
+			double f = a[r][c] / a[c][c];
+			for (int j = 0; j < 4; j++)
+				a[r][j] -= f * a[c][j];
+			for (int j = 0; j < 3; j++)
+				b[r][j] -= f * b[c][j];
+		}
+	}
+
+	/* b[j][i] / a[j][j] is the coefficient of regressor j in output row i */
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++)
+			cal->acc_mat[i][j] = b[j][i] / a[j][j];
+		cal->acc_off[i] = b[3][i] / a[3][3];
+	}
+
+	return 0;
+}
+
+/* fold the LSB sensitivity into the matrix so the kernel works on raw words */
+static void mpu_cal_acc_fuse(struct mpu_dev *dev)
+{
+	if (!(dev->albs > 0)) /* range not parsed yet */
+		return;
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++)
+			dev->cal->acc_fus[i][j] = dev->cal->acc_mat[i][j] / dev->albs;
+	}
+}
+
+/* make the table vanish where the scalar biases were measured */
+static void mpu_cal_tcb_center(struct mpu_cal *cal, mpu_data_t t_ref)
+{
+	if (!(cal->tcb_dt > 0)) /* no table */
+		return;
+
+	mpu_data_t t = isnan(cal->t_cal) ? t_ref : cal->t_cal;
+	if (isnan(t)) /* no reference */
+		return;
+
+	mpu_data_t b[6];
+	mpu_cal_tcb_eval(cal, t, b);
+	for (int k = 0; k < 6; k++) {
+		for (int i = 0; i < MPU6050_TCB_LEN; i++)
+			cal->tcb[k][i] -= b[k];
+	}
+}
+
+/* per sample table lookup - constant time, clamped outside the fitted span */
+static inline void mpu_cal_tcb_eval(const struct mpu_cal *cal, mpu_data_t t, mpu_data_t *b)
+{
+	mpu_data_t x = (t - cal->tcb_t0) * cal->tcb_idt;
+	if (x < 0)
+		x = 0;
+	if (x > MPU6050_TCB_LEN - 1)
+		x = MPU6050_TCB_LEN - 1;
+
+	int i = (int)x;
+	if (i > MPU6050_TCB_LEN - 2)
+		i = MPU6050_TCB_LEN - 2;
+
+	mpu_data_t f = x - i;
+	for (int k = 0; k < 6; k++)
+		b[k] = cal->tcb[k][i] + f * (cal->tcb[k][i+1] - cal->tcb[k][i]);
+}
+
 static inline void mpu_ctl_fix_axis(struct mpu_dev *dev)
 {
 	if (dev->cfg->accel_fifo_en) {
@@ -2086,14 +4352,33 @@ static int mpu_dev_parameters_save(char *fn, struct mpu_dev *dev)
 		return -1;
 	}
 
+	if (NULL != dev->rt) { /* written when real-time mode ends */
+		dev->dat->params_dirty = true;
+		return 0;
+	}
+
+	struct mpu_cfg cfg = *(dev->cfg);
+	bool slowed = (NULL != dev->idl) && dev->idl->slowed;
+	for (size_t i = 0; i < ARRAY_LEN(cfg.regs); i++) { /* the profile to return to */
+		mpu_reg_t reg = cfg.regs[i][0];
+		if (slowed && (SMPLRT_DIV == reg))
+			cfg.regs[i][1] = dev->idl->div;
+		if (slowed && (CONFIG == reg))
+			cfg.regs[i][1] = (cfg.regs[i][1] & ~DLPF_CFG_BIT) | dev->idl->dlpf;
+		if (dev->dat->lp && (reg >= USER_CTRL) && (reg <= PWR_MGMT_2))
+			cfg.regs[i][1] = dev->dat->lp_regs[reg - USER_CTRL];
+	}
+
 	FILE *dmp;
 	if (NULL ==  (dmp = fopen(fn, "w+"))) {
 		fprintf(stderr, "Unable to open file \"%s\"\n", fn);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
-	fwrite(dev->cfg, sizeof(*(dev->cfg)), 1, dmp);
-	fwrite(dev->cal, sizeof(*(dev->cal)), 1, dmp);
-	fclose(dmp);
+	size_t n = fwrite(&mpu_params_hdr, sizeof(mpu_params_hdr), 1, dmp);
+	n += fwrite(&cfg, sizeof(cfg), 1, dmp);
+	n += fwrite(dev->cal, sizeof(*(dev->cal)), 1, dmp);
+	if ((fclose(dmp) < 0) || (3 != n))
+		return -1;
 	return 0;
 }
 
@@ -2110,11 +4395,19 @@ static int mpu_dev_parameters_restore(char *fn, struct mpu_dev *dev)
 	FILE * fp;
 	if (NULL ==  (fp = fopen(fn, "r"))) {
 		fprintf(stderr, "Unable to open file \"%s\"\n", fn);
-		exit(EXIT_FAILURE);
+		return -1;
+	}
+	struct mpu_params_hdr hdr;
+	if ((1 != fread(&hdr, sizeof(hdr), 1, fp)) || memcmp(&hdr, &mpu_params_hdr, sizeof(hdr))) {
+		fprintf(stderr, "\"%s\" is from another version, reset the device\n", fn);
+		fclose(fp);
+		return -1;
 	}
-	fread(dev->cfg, sizeof(*(dev->cfg)), 1, fp);
-	fread(dev->cal, sizeof(*(dev->cal)), 1, fp);
+	size_t n = fread(dev->cfg, sizeof(*(dev->cfg)), 1, fp);
+	n += fread(dev->cal, sizeof(*(dev->cal)), 1, fp);
 	fclose(fp);
+	if (2 != n) /* short file */
+		return -1;
 
 	mpu_ctl_fifo_flush(dev);
 	return 0;
@@ -2142,32 +4435,11 @@ static int __attribute__((unused)) mpu_diagnose(struct mpu_dev *dev)
 	printf("%-20s %6.0lf %s\n","Gyro bandwidth"	, dev->gbdw		,"(Hz)");
 	printf("%-20s %6.0lf %s\n","Gyro delay"		, dev->gdly		,"(ms)");
 	printf("----------------------------------------\n");
-	printf("%-20s %d\n","SLEEP BIT"		, dev->cfg->sleep);
-	printf("%-20s %d\n","CYCLE BIT"		, dev->cfg->cycle);
-	printf("%-20s %d\n","TEMP_DIS BIT"	, dev->cfg->temp_dis);
-	printf("%-20s %d\n","STDBY_XA BIT"	, dev->cfg->stdby_xa);
-	printf("%-20s %d\n","STDBY_YA BIT"	, dev->cfg->stdby_ya);
-	printf("%-20s %d\n","STDBY_ZA BIT"	, dev->cfg->stdby_za);
-	printf("%-20s %d\n","STDBY_XG BIT"	, dev->cfg->stdby_xg);
-	printf("%-20s %d\n","STDBY_YG BIT"	, dev->cfg->stdby_yg);
-	printf("%-20s %d\n","STDBY_ZG BIT"	, dev->cfg->stdby_zg);
-	printf("%-20s %d\n","I2C_MST_EN BIT"	, dev->cfg->i2c_mst_en);
-	printf("%-20s %d\n","I2C_IF_DIS BIT"	, dev->cfg->i2c_if_dis);
-	printf("%-20s %d\n","FIFO_EN BIT"	, dev->cfg->fifo_en);
-	printf("%-20s %d\n","TEMP_FIFO_EN BIT"	, dev->cfg->temp_fifo_en);
-	printf("%-20s %d\n","FIFO Accel BIT"	, dev->cfg->accel_fifo_en);
-	printf("%-20s %d\n","FIFO Gyro X BIT"	, dev->cfg->xg_fifo_en);
-	printf("%-20s %d\n","FIFO Gyro Y BIT"	, dev->cfg->yg_fifo_en);
-	printf("%-20s %d\n","FIFO Gyro Z BIT"	, dev->cfg->zg_fifo_en);
-	printf("%-20s %d\n","FIFO SLV0"		, dev->cfg->slv0_fifo_en);
-	printf("%-20s %d\n","FIFO SLV1"		, dev->cfg->slv1_fifo_en);
-	printf("%-20s %d\n","FIFO SLV2"		, dev->cfg->slv2_fifo_en);
-	printf("%-20s %d\n","FIFO SLV3"		, dev->cfg->slv3_fifo_en);
-	printf("%-20s %d\n","FIFO SLV4"		, dev->cfg->slv4_fifo_en);
-	printf("%-20s %d\n","FSYNC_INT_EN BIT"	, dev->cfg->fsync_int_en);
-	printf("%-20s %d\n","FIFO_OFLOW_EN BIT"	, dev->cfg->fifo_oflow_en);
-	printf("%-20s %d\n","I2C_MST_INT_EN BIT", dev->cfg->i2c_mst_int_en);
-	printf("%-20s %d\n","DATA_RDY_EN BIT"	, dev->cfg->data_rdy_en);
+	for (size_t i = 0; i < ARRAY_LEN(mpu_fields); i++) {
+		const struct mpu_field *f = &mpu_fields[i];
+		if (f->flag)
+			printf("%-20s %d\n", f->name, *(const bool *)((const uint8_t *)dev->cfg + f->flag));
+	}
 	printf("%-20s %d\n","raw[0]"		, dev->dat->raw[0]);
 	printf("----------------------------------------\n");
 	printf("ADDRESSES:\n");
@@ -2200,8 +4472,6 @@ static int __attribute__((unused)) mpu_diagnose(struct mpu_dev *dev)
 	return 0;
 }
 
-uint8_t mpu_regvalues[128];
-
 char mpu_regnames[ 128 ][ 32 ] = {
 [ AUX_VDDIO ]		= "AUX_VDDIO",
 [ XA_OFFS_USRH ] 	= "XA_OFFS_USRH",
@@ -2223,7 +4493,7 @@ char mpu_regnames[ 128 ][ 32 ] = {
 [ SELF_TEST_A ]		= "SELF_TEST_A",
 [ SMPLRT_DIV ]		= "SMPLRT_DIV",
 [ CONFIG ]		= "CONFIG",
-[ GYRO_CONFIG ]		= "GYRO_CONFIF",
+[ GYRO_CONFIG ]		= "GYRO_CONFIG",
 [ ACCEL_CONFIG ]	= "ACCEL_CONFIG",
 [ FF_THR ]		= "FF_THR",
 [ FF_DUR ]		= "FF_DUR",
@@ -2259,7 +4529,7 @@ char mpu_regnames[ 128 ][ 32 ] = {
 [ ACCEL_XOUT_L ] 	= "ACCEL_XOUT_L",
 [ ACCEL_YOUT_H ] 	= "ACCEL_YOUT_H",
 [ ACCEL_YOUT_L ] 	= "ACCEL_YOUT_L",
-[ ACCEL_ZOUT_H ] 	= "ACCEL_ZOUT_H ",
+[ ACCEL_ZOUT_H ] 	= "ACCEL_ZOUT_H",
 [ ACCEL_ZOUT_L ] 	= "ACCEL_ZOUT_L",
 [ TEMP_OUT_H ] 		= "TEMP_OUT_H",
 [ TEMP_OUT_L ] 		= "TEMP_OUT_L",
@@ -2297,7 +4567,7 @@ char mpu_regnames[ 128 ][ 32 ] = {
 [ I2C_SLV0_DO ]		= "I2C_SLV0_DO",
 [ I2C_SLV1_DO ]		= "I2C_SLV1_DO",
 [ I2C_SLV2_DO ]		= "I2C_SLV2_DO",
-[ I2C_SLV3_DO ]		= "I2C_SLV0_DO",
+[ I2C_SLV3_DO ]		= "I2C_SLV3_DO",
 [ I2C_MST_DELAY_CTRL ]	= "I2C_MST_DELAY_CTRL",
 [ SIGNAL_PATH_RESET ]	= "SIGNAL_PATH_RESET",
 [ MOT_DETECT_CTRL ]	= "MOT_DETECT_CTRL",
@@ -2320,11 +4590,18 @@ int mpu_ctl_dump(struct mpu_dev *dev, char *fn)
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	if (NULL != dev->rt) /* no file i/o in real-time mode */
+		return -1;
+
 	if(NULL == fn) {
 		fprintf(stderr, "%s failed: NULL filename\n", __func__);
 		return -1;
 	}
 
+	struct mpu_regdump dump;
+	if (mpu_ctl_regdump(dev, &dump) < 0)
+		return -1;
+
 	FILE *fp;
 	if (NULL == (fp = fopen(fn, "w+"))) {
 		fprintf(stderr, "%s failed: Unable to open file \"%s\"\n", __func__, fn);
@@ -2332,29 +4609,86 @@ int mpu_ctl_dump(struct mpu_dev *dev, char *fn)
 	}
 
 	fprintf(fp, "MPU REGISTER DUMP\n");
-	fprintf(fp,"%8s %8s %20s %4s", "reg(hex)", "reg(dec)", "name", "val");
-
-	uint8_t regs[128][3];
-	for (int i = 0; i < 128; i++) {
-		regs[i][0] = i;
-		regs[i][1] = mpu_read_byte(dev, i, &regs[i][0]);
-		fprintf(fp, " %2x     %3d    %-20s %2x\n",
-			regs[i][0],
-			regs[i][0],
+	fprintf(fp, "%8s %8s %-20s %4s %s\n", "reg(hex)", "reg(dec)", "name", "val", "fields");
+	size_t f = 0; /* mpu_fields[] is in address order */
+	for (int i = 0; i < MPU6050_REGDUMP_LEN; i++) {
+		fprintf(fp, "    %02x      %3d    %-20s %02x",
+			i,
+			i,
 			mpu_regnames[i],
-			regs[i][1]);
+			dump.regs[i]);
+		for (; (f < ARRAY_LEN(mpu_fields)) && (mpu_fields[f].reg == i); f++)
+			fprintf(fp, " %s=%u", mpu_fields[f].name,
+				(unsigned int)((dump.regs[i] & mpu_fields[f].mask) >> mpu_fields[f].shift));
+		fprintf(fp, "\n");
 	}
 	fflush(fp);
 	fclose(fp);
 	return 0;
 }
 
+int mpu_ctl_regdump(struct mpu_dev *dev, struct mpu_regdump *dump)
+{
+	if(MPUDEV_IS_NULL(dev) || (NULL == dump)) /* incomplete or uninitialized object */
+		return -1;
+
+	if (mpu_read_snapshot(dev, dump->regs) < 0)
+		return -1;
+	if (mpu_read_byte(dev, WHO_AM_I, &dump->regs[WHO_AM_I]) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Adopt the configuration the device is running: a snapshot of the
+ * registers, decoded into the configuration and the derived fields,
+ * then saved like any other setting. An unsupported setting leaves the
+ * previous configuration in place.
+ */
+int mpu_ctl_readback(struct mpu_dev *dev)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	if ((NULL != dev->rep) || (NULL != dev->iio)) /* replay and iio have no registers */
+		return -1;
+
+	/* around the clear-on-read status, short of FIFO_R_W */
+	mpu_reg_t regs[MPU6050_REGDUMP_LEN];
+	if (mpu_read_snapshot(dev, regs) < 0)
+		return -1;
+
+	struct mpu_cfg bkp = *(dev->cfg);
+	for (size_t i = 0; i < ARRAY_LEN(dev->cfg->regs); i++) {
+		mpu_reg_t reg = dev->cfg->regs[i][0];
+		if ((0 != reg) && (reg < FIFO_R_W))
+			dev->cfg->regs[i][1] = regs[reg];
+	}
+
+	if (mpu_cfg_decode(dev, regs) < 0) { /* not a setting we support */
+		*(dev->cfg) = bkp;
+		return -1;
+	}
+
+	if ((mpu_dat_reset(dev) < 0) || (mpu_dat_set(dev) < 0))
+		return -1;
+	if (mpu_dev_parameters_save(MPU6050_CFGFILE, dev) < 0)
+		return -1;
+	if (mpu_ctl_fifo_flush(dev) < 0) /* frames may have another layout */
+		return -1;
+
+	return 0;
+}
+
 static int mpu_read_byte(struct mpu_dev * const dev, const mpu_reg_t reg, mpu_reg_t *val)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	double t0 = mpu_clock();
 	__s32 res = i2c_smbus_read_byte_data(*(dev->bus), reg);
+	mpu_bus_account(dev, t0, res, MPU6050_I2C_RD_HDR, 1);
 
 	if (res < 0) /* read failed - bus error */
 		return -1;
@@ -2369,7 +4703,9 @@ static int mpu_write_byte(struct mpu_dev * const dev, const mpu_reg_t reg, const
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	double t0 = mpu_clock();
 	__s32 res = i2c_smbus_write_byte_data(*(dev->bus), reg, val);
+	mpu_bus_account(dev, t0, res, MPU6050_I2C_WR_HDR, 1);
 
 	if (res < 0) /* read failed - bus error */
 		return -1;
@@ -2383,7 +4719,9 @@ static int mpu_read_word(struct mpu_dev * const dev, const mpu_reg_t reg, mpu_wo
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	double t0 = mpu_clock();
 	__s32 res = i2c_smbus_read_word_data(*(dev->bus), reg);
+	mpu_bus_account(dev, t0, res, MPU6050_I2C_RD_HDR, 2);
 
 	if (res < 0) /* write byte failed - bus error */
 		return -1;
@@ -2393,16 +4731,191 @@ static int mpu_read_word(struct mpu_dev * const dev, const mpu_reg_t reg, mpu_wo
 
 }
 
-static int __attribute__((unused)) mpu_write_word(struct mpu_dev * const dev, const mpu_reg_t reg, const mpu_word_t val)
+static int mpu_read_block(struct mpu_dev * const dev, const mpu_reg_t reg, const size_t len, mpu_reg_t *buf)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	/* auto-increment read, at most I2C_SMBUS_BLOCK_MAX bytes per transfer */
+	double t = mpu_clock();
+	for (size_t i = 0; i < len; i += I2C_SMBUS_BLOCK_MAX) {
+		size_t n = (len - i < I2C_SMBUS_BLOCK_MAX) ? len - i : I2C_SMBUS_BLOCK_MAX;
+		__s32 res = i2c_smbus_read_i2c_block_data(*(dev->bus), reg + i, n, buf + i);
+		t = mpu_bus_account(dev, t, res, MPU6050_I2C_RD_HDR, n);
+
+		if (res != (__s32)n) /* read block failed - bus error */
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Registers 0x00 up to FIFO_R_W into regs, MPU6050_REGDUMP_LEN long.
+ * INT_STATUS and MOT_DETECT_STATUS clear when read, a snapshot would eat
+ * the data ready and motion edges others wait on: the reads go around
+ * them and they hold 0, as FIFO_R_W does.
+ */
+static int mpu_read_snapshot(struct mpu_dev * const dev, mpu_reg_t *regs)
+{
+	memset(regs, 0, MPU6050_REGDUMP_LEN);
+
+	if (mpu_read_block(dev, 0x00, INT_STATUS, regs) < 0)
+		return -1;
+	if (mpu_read_block(dev, INT_STATUS + 1, MOT_DETECT_STATUS - INT_STATUS - 1, &regs[INT_STATUS + 1]) < 0)
+		return -1;
+	if (mpu_read_block(dev, MOT_DETECT_STATUS + 1, FIFO_R_W - MOT_DETECT_STATUS - 1, &regs[MOT_DETECT_STATUS + 1]) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int mpu_write_block(struct mpu_dev * const dev, const mpu_reg_t reg, const size_t len, const mpu_reg_t *buf)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	/* auto-increment write, at most I2C_SMBUS_BLOCK_MAX bytes per transfer */
+	double t = mpu_clock();
+	for (size_t i = 0; i < len; i += I2C_SMBUS_BLOCK_MAX) {
+		size_t n = (len - i < I2C_SMBUS_BLOCK_MAX) ? len - i : I2C_SMBUS_BLOCK_MAX;
+		__s32 res = i2c_smbus_write_i2c_block_data(*(dev->bus), reg + i, n, buf + i);
+		t = mpu_bus_account(dev, t, res, MPU6050_I2C_WR_HDR, n);
+
+		if (res < 0) /* write block failed - bus error */
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Register sets: the (address, value) pairs of a table, in address order
+ * and cut into runs of contiguous registers, go out or come back one
+ * auto-increment transfer per run. Address 0 marks an unused entry.
+ */
+static int mpu_write_regs(struct mpu_dev * const dev, const mpu_reg_t (*regs)[2], const size_t n)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
+		return -1;
+
+	mpu_reg_t set[MPU6050_REGSET][2];
+	if (n > MPU6050_REGSET) /* set too large */
+		return -1;
+	size_t m = mpu_regs_sort(regs, n, set);
+
+	for (size_t i = 0, len; i < m; i += len) {
+		mpu_reg_t buf[MPU6050_REGSET];
+		for (len = 0; (i + len < m) && (set[i + len][0] == set[i][0] + len); len++)
+			buf[len] = set[i + len][1];
+		if (mpu_write_block(dev, set[i][0], len, buf) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* read a set back, -1 if any register holds another value */
+static int mpu_check_regs(struct mpu_dev * const dev, const mpu_reg_t (*regs)[2], const size_t n)
 {
 	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
-	__s32 res = i2c_smbus_write_word_data(*(dev->bus), reg, val);
+	mpu_reg_t set[MPU6050_REGSET][2];
+	if (n > MPU6050_REGSET) /* set too large */
+		return -1;
+	size_t m = mpu_regs_sort(regs, n, set);
+
+	for (size_t i = 0, len; i < m; i += len) {
+		mpu_reg_t buf[MPU6050_REGSET];
+		for (len = 1; (i + len < m) && (set[i + len][0] == set[i][0] + len); len++)
+			;
+		if (mpu_read_block(dev, set[i][0], len, buf) < 0)
+			return -1;
+		for (size_t k = 0; k < len; k++)
+			if (buf[k] != set[i + k][1]) /* value mismatch */
+				return -1;
+	}
+
+	return 0;
+}
+
+/* insertion sort by address, unused entries dropped; returns the count */
+static size_t mpu_regs_sort(const mpu_reg_t (*regs)[2], const size_t n, mpu_reg_t (*set)[2])
+{
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (0 == regs[i][0]) /* unused */
+			continue;
+		size_t j = m++;
+		for (; (j > 0) && (set[j - 1][0] > regs[i][0]); j--) {
+			set[j][0] = set[j - 1][0];
+			set[j][1] = set[j - 1][1];
+		}
+		set[j][0] = regs[i][0];
+		set[j][1] = regs[i][1];
+	}
+
+	return m;
+}
+
+/* three big-endian offset registers, XA_OFFS_USRH or XG_OFFS_USRH on */
+static int mpu_write_offsets(struct mpu_dev * const dev, const mpu_reg_t first, const uint16_t *w)
+{
+	mpu_reg_t buf[6];
+	for (int i = 0; i < 3; i++) {
+		buf[2 * i]     = (mpu_reg_t)(w[i] >> 8);
+		buf[2 * i + 1] = (mpu_reg_t)(w[i] & 0xFF);
+	}
+
+	return mpu_write_block(dev, first, sizeof(buf), buf);
+}
+
+static int mpu_read_offsets(struct mpu_dev * const dev, const mpu_reg_t first, int16_t *w)
+{
+	mpu_reg_t buf[6];
+	if (mpu_read_block(dev, first, sizeof(buf), buf) < 0)
+		return -1;
+	for (int i = 0; i < 3; i++)
+		w[i] = (int16_t)((buf[2 * i] << 8) | buf[2 * i + 1]);
+
+	return 0;
+}
 
-	if (res < 0) /* write word failed - bus error */
+/* FIFO_R_W does not auto-increment, every byte read pops the fifo */
+static int mpu_read_fifo(struct mpu_dev * const dev, const size_t len, mpu_reg_t *buf)
+{
+	if(MPUDEV_IS_NULL(dev)) /* incomplete or uninitialized object */
 		return -1;
 
+	double t = mpu_clock();
+	for (size_t i = 0; i < len; i += I2C_SMBUS_BLOCK_MAX) {
+		size_t n = (len - i < I2C_SMBUS_BLOCK_MAX) ? len - i : I2C_SMBUS_BLOCK_MAX;
+		__s32 res = i2c_smbus_read_i2c_block_data(*(dev->bus), FIFO_R_W, n, buf + i);
+		t = mpu_bus_account(dev, t, res, MPU6050_I2C_RD_HDR, n);
+
+		if (res != (__s32)n) /* read block failed - bus error */
+			return -1;
+	}
+
 	return 0;
+}
+
+/*
+ * Books a transfer started at t0 and returns its end, the start of the
+ * next one in a run: one clock read per transfer. Failed transfers are
+ * not counted, their caller bails out.
+ */
+static inline double mpu_bus_account(struct mpu_dev * const dev, double t0, int res, size_t hdr, size_t len)
+{
+	if (res < 0) /* bus error, nothing moved */
+		return t0;
+
+	double t1 = mpu_clock();
+	dev->dat->io_busy  += t1 - t0;
+	dev->dat->io_xfers += 1;
+	dev->dat->io_bytes += len;
+	dev->dat->io_clks  += MPU6050_I2C_BYTE * (hdr + len) + MPU6050_I2C_FRAME;
 
+	return t1;
 }
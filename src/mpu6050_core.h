@@ -36,6 +36,18 @@ struct mpu_cfg;
 struct mpu_cal;
 struct mpu_dat;
 struct mpu_dev;
+struct mpu_selftest_result;
+struct mpu_regdump;
+struct mpu_fusion;
+struct mpu_decim;
+struct mpu_busload;
+struct mpu_log;
+struct mpu_replay;
+struct mpu_shm;
+struct mpu_rt;
+struct mpu_batch;
+struct mpu_idle;
+struct mpu_iio;
 
 /*
  * MUST Enable device tree for i2c-1 inside /boot/config.txt
@@ -48,45 +60,176 @@ struct mpu_dev;
  * 	Accelerometer		- enable/disable, range setting
  * 	Gyroscope 	  	- enable/disable, range setting
  * 	Temperature sensor	- enable/disable
- * 	Sampling rate control 	- 50,100,200, 250, 500 Hz
+ * 	Channel selection	- axes buffered and powered, the rest in standby
+ * 	Auxiliary i2c master	- slave chips read into the frame, magnetometers
+ * 	Sampling rate control 	- 4 Hz to 8 kHz, SMPLRT_DIV and DLPF planned
  * 	Digital Low Pass filter	- refer to datasheet
- * 	Self-tests		- refer to datasheet, write report to file
- * 	Register dump		- write register values to file
+ * 	Self-tests		- refer to datasheet, result or report to file
+ * 	Register dump		- write register values and fields to file
+ * 	Register readback	- adopt the running configuration, one block read
  * 	Calibration		- device must stay leveled and static
+ * 	Temperature compensation - bias drift table, device must stay static
+ * 	Six-position calibration - accel scale, cross-axis and offset
+ * 	Noise characterization	- Allan deviation, see mpu6050_allan.h
+ * 	Orientation fusion	- Madgwick, Mahony, complementary, see mpu6050_fusion.h
+ * 	Software decimation	- polyphase FIR, see mpu6050_decim.h
+ * 	Bus load		- predicted and measured i2c utilization
+ * 	Speculative reads	- fifo count and frames in one transaction
+ * 	Adaptive batching	- fewest transactions within a latency target
+ * 	Latest sample		- output registers read directly, no fifo
+ * 	Motion gating		- low rate or no draining while still
+ * 	Low-power profile	- accelerometer only, cycling at 1.25 to 40 Hz
+ * 	Recording		- binary log of raw frames, see mpu6050_log.h
+ * 	Replay			- recorded frames through mpu_get_data()
+ * 	Kernel driver		- IIO buffer of inv_mpu6050, see mpu6050_iio.h
+ * 	Publication		- readings shared with other processes
+ * 	Streaming server	- readings served over a Unix domain socket
+ * 	Real-time mode		- pinned, locked, no allocation or file i/o
  *
  * Unsupported features
  * 	eDMP (embedded Digital Motion Proccessor) - proprietary blob
- * 	Low-power modes		- not our use case
+ * 	Low-power modes		- but the accelerometer-only cycle
  * 	External interrupts	- not our use case
  * 	External clock sources	- not our use case
- * 	Secondary i2c bus	- not our use case
  *
  * Return value for all function calls:
  * 	On success, return 0.
  * 	On failure, return -1;
+ * 	except mpu_ctl_selftest_fast(), 1 for a part that fails the test.
  */
 #define MPU6050_RESET 0
 #define MPU6050_RESTORE 1
 
+/* orientations for mpu_ctl_calibrate_pose(), axis pointing up */
+#define MPU6050_POSE_XUP	0
+#define MPU6050_POSE_XDOWN	1
+#define MPU6050_POSE_YUP	2
+#define MPU6050_POSE_YDOWN	3
+#define MPU6050_POSE_ZUP	4
+#define MPU6050_POSE_ZDOWN	5
+
 #ifndef MPU6050_CFGFILE
 #define MPU6050_CFGFILE "mpu6050_cfg.bin"
 #endif
 
+#define MPU6050_RATE_MIN	4	/* 1 kHz / (1 + 255), rounded up	*/
+#define MPU6050_RATE_MAX	8000	/* gyro output rate, DLPF off	*/
+
+#ifndef MPU6050_BUS_HZ
+#define MPU6050_BUS_HZ		400000	/* i2c clock, see dtparam	*/
+#endif
+#ifndef MPU6050_BUS_MAX
+#define MPU6050_BUS_MAX		0.8	/* bus share the sensor may use	*/
+#endif
+
+/* transfer modes for mpu_bus_model() */
+#define MPU6050_BUS_BYTE	0	/* one transaction per fifo byte */
+#define MPU6050_BUS_BLOCK	1	/* 32 byte block transactions	*/
+#define MPU6050_BUS_SPEC	2	/* count and frames in one transaction */
+#define MPU6050_BUS_DIRECT	3	/* output registers, once per sample */
+
+/* channels for mpu_ctl_channels(), buffered and powered */
+#define MPU6050_CH_XA		0x01u	/* accelerometer x axis		*/
+#define MPU6050_CH_YA		0x02u	/* accelerometer y axis		*/
+#define MPU6050_CH_ZA		0x04u	/* accelerometer z axis		*/
+#define MPU6050_CH_XG		0x08u	/* gyroscope x axis		*/
+#define MPU6050_CH_YG		0x10u	/* gyroscope y axis		*/
+#define MPU6050_CH_ZG		0x20u	/* gyroscope z axis		*/
+#define MPU6050_CH_TEMP		0x40u	/* temperature sensor		*/
+#define MPU6050_CH_ACCEL	0x07u	/* every accelerometer axis	*/
+#define MPU6050_CH_GYRO		0x38u	/* every gyroscope axis		*/
+#define MPU6050_CH_ALL		0x7Fu	/* everything, the default	*/
+
+/* sample sources for mpu_ctl_direct() */
+#define MPU6050_DIRECT_OFF	0	/* frames queued in the fifo	*/
+#define MPU6050_DIRECT_TIMER	1	/* newest sample, every period	*/
+#define MPU6050_DIRECT_DRDY	2	/* newest sample, once updated	*/
+
+/* wake rates of mpu_ctl_lowpower(), LP_WAKE_CTL */
+#define MPU6050_LP_MAX		40	/* Hz, from 1.25		*/
+
+/* auxiliary i2c slaves, mpu_ctl_aux() */
+#define MPU6050_AUX_SLAVES	4	/* SLV0 to SLV3, read every sample */
+#define MPU6050_AUX_BYTES	24	/* EXT_SENS_DATA_00 to _23	*/
+#define MPU6050_AUX_SWAP	0x01u	/* little endian words		*/
+#define MPU6050_AUX_WORD(p, k)	((p)[2 * (k)])	/* word k of slv0_dat...	*/
+
+/* magnetometers for mpu_ctl_mag() */
+#define MPU6050_MAG_NONE	0	/* release the slave		*/
+#define MPU6050_MAG_HMC5883L	1	/* Honeywell, at 0x1E		*/
+#define MPU6050_MAG_QMC5883L	2	/* QST, at 0x0D			*/
+#define MPU6050_MAG_AK8963	3	/* AKM, at 0x0C			*/
+
 int mpu_init(	const char * const path,
 		struct mpu_dev **mpudev,
 		const int mode);
 
+int mpu_init_replay	(struct mpu_dev **mpudev, struct mpu_replay *rp);
+int mpu_init_iio	(struct mpu_dev **mpudev, struct mpu_iio *io);
 int mpu_destroy		(struct mpu_dev *dev);
 int mpu_get_data	(struct mpu_dev *dev);
 int mpu_ctl_calibrate	(struct mpu_dev *dev);
+int mpu_ctl_calibrate_temp(struct mpu_dev *dev, unsigned long samples);
+int mpu_ctl_tempcomp	(struct mpu_dev *dev, bool enable);
+int mpu_ctl_calibrate_pose(struct mpu_dev *dev, unsigned int pose);
+int mpu_ctl_calibrate_accel(struct mpu_dev *dev);
 int mpu_ctl_reset	(struct mpu_dev *dev);
 int mpu_ctl_dump	(struct mpu_dev *dev, char *filename);
 int mpu_ctl_selftest	(struct mpu_dev *dev, char *filename);
+int mpu_ctl_selftest_fast(struct mpu_dev *dev, char *filename); /* 1 for a failed part */
+int mpu_ctl_selftest_result(struct mpu_dev *dev, struct mpu_selftest_result *res);
+int mpu_ctl_regdump	(struct mpu_dev *dev, struct mpu_regdump *dump);
+int mpu_ctl_readback	(struct mpu_dev *dev);
 int mpu_ctl_samplerate	(struct mpu_dev *dev, unsigned int hertz);
 int mpu_ctl_dlpf	(struct mpu_dev *dev, unsigned int dlpf);
 int mpu_ctl_accel_range	(struct mpu_dev *dev, unsigned int range);
 int mpu_ctl_gyro_range	(struct mpu_dev *dev, unsigned int range);
 int mpu_ctl_clocksource	(struct mpu_dev *dev, mpu_reg_t clksel);
+int mpu_ctl_speculative	(struct mpu_dev *dev, bool enable);
+int mpu_ctl_direct	(struct mpu_dev *dev, int mode);
+int mpu_ctl_channels	(struct mpu_dev *dev, unsigned int mask);
+int mpu_ctl_lowpower	(struct mpu_dev *dev, double hz);
+int mpu_ctl_aux		(struct mpu_dev *dev, unsigned int slv, mpu_reg_t addr, mpu_reg_t reg,
+			 unsigned int len, unsigned int flags, double scale);
+int mpu_ctl_aux_write	(struct mpu_dev *dev, mpu_reg_t addr, mpu_reg_t reg, mpu_reg_t val);
+int mpu_ctl_aux_read	(struct mpu_dev *dev, mpu_reg_t addr, mpu_reg_t reg, mpu_reg_t *val);
+int mpu_ctl_mag		(struct mpu_dev *dev, unsigned int slv, int model);
+int mpu_ctl_fusion	(struct mpu_dev *dev, struct mpu_fusion *fus);
+int mpu_ctl_decimator	(struct mpu_dev *dev, struct mpu_decim *dec);
+int mpu_bus_model	(struct mpu_dev *dev, struct mpu_busload *bl);
+int mpu_bus_measure	(struct mpu_dev *dev, struct mpu_busload *bl);
+int mpu_ctl_log		(struct mpu_dev *dev, struct mpu_log *log);
+int mpu_ctl_shm		(struct mpu_dev *dev, struct mpu_shm *shm);
+int mpu_ctl_rt		(struct mpu_dev *dev, struct mpu_rt *rt);
+int mpu_ctl_batch	(struct mpu_dev *dev, struct mpu_batch *bp);
+int mpu_ctl_idle	(struct mpu_dev *dev, struct mpu_idle *ip);
+int mpu_get_params	(struct mpu_dev *dev, void *buf, size_t *len);
+int mpu_get_reg		(struct mpu_dev *dev, mpu_reg_t reg, mpu_reg_t *val);
+
+/* self-test outcome, axes ordered XA, YA, ZA, XG, YG, ZG */
+struct mpu_selftest_result {
+	double	str[6];		/* self-test response (LSB)		*/
+	double	ft[6];		/* factory trim (LSB)			*/
+	double	shift[6];	/* change from factory trim (%)		*/
+	bool	pass[6];	/* within 14% of factory trim		*/
+	bool	passed;		/* every axis passed			*/
+};
+
+/* register snapshot 0x00 to WHO_AM_I; FIFO_R_W, INT_STATUS and MOT_DETECT_STATUS are not read and hold 0 */
+#define MPU6050_REGDUMP_LEN 0x76
+struct mpu_regdump {
+	mpu_reg_t regs[MPU6050_REGDUMP_LEN];
+};
+
+struct mpu_busload {
+	unsigned int bus_hz;	/* i2c clock (Hz), 0 for dev->bus_hz */
+	int	mode;		/* MPU6050_BUS_BYTE, _BLOCK, _SPEC or _DIRECT */
+	unsigned int batch;	/* frames per fifo drain, 0 for 1 */
+	double	bytes;		/* payload bytes per second */
+	double	xfers;		/* transactions per second */
+	double	clocks;		/* bus clocks per second, overhead included */
+	double	util;		/* share of the bus [0-1] */
+};
 
 struct mpu_dev {
 	/* basic interface setting */
@@ -101,10 +244,14 @@ struct mpu_dev {
 	/* readable config - result of special handlers */
 	bool	aolpm;		/* accelerometer-only low power mode */
 	double	wake_freq;	/* low-power cycling freq */
+	unsigned long long lp_switches;	/* low-power profile switches	*/
+	double	lp_switch;	/* time the last one took (s)		*/
+	double	lp_switch_max;	/* the longest (s)			*/
 	double	clock_freq;	/* determined by CLKSEL */
 	int	clksel;		/* clock source selection (CLKSEL) */
 	int	dlpf;		/* Digital Lowpass filter setting */
 	int	fifosensors;	/* number of sensors buffered */
+	unsigned int channels;	/* buffered and powered, MPU6050_CH_* */
 	int	fifomax;	/* fifo buffer capacity in bytes */
 	int	fifocnt;	/* bytes available in fifo */
 	unsigned int gor;	/* gyro output rate (Hz) */
@@ -130,8 +277,26 @@ struct mpu_dev {
 	double glbs;		/* gyroscope least bit sensitivity */
 	double gbdw;		/* gyroscope bandwidth in Hertz (Hz) */
 	double gdly;		/* gyroscope delay in miliseconds (ms) */
+	unsigned int bus_hz;	/* i2c clock frequency (Hz) */
+	double bus_max;		/* bus utilization budget [0-1] */
+	double bus_load;	/* predicted bus utilization [0-1] */
+	bool	fifo_spec;	/* fifo count and data read together */
+	unsigned long long spec_miss;	/* speculative reads past the fifo */
+	int	direct;		/* output register reads, MPU6050_DIRECT_* */
+	unsigned long long direct_stale; /* direct reads before data ready */
 	/* readable data */
 	unsigned long long samples;	/* sample counter			*/
+	double	ts;			/* sample time, CLOCK_MONOTONIC (s)	*/
+	double	dt;			/* time since previous sample (s)	*/
+	struct	mpu_fusion *fus;	/* attitude filter, NULL if none	*/
+	struct	mpu_decim *dec;		/* decimator, NULL if none	*/
+	struct	mpu_log *log;		/* raw frame recorder, NULL if none */
+	struct	mpu_replay *rep;	/* frame source, NULL for the bus	*/
+	struct	mpu_iio *iio;		/* kernel driver, NULL for the bus	*/
+	struct	mpu_shm *shm;		/* publisher, NULL if none	*/
+	struct	mpu_rt *rt;		/* real-time mode, NULL if off	*/
+	struct	mpu_batch *bat;		/* batching policy, NULL if none	*/
+	struct	mpu_idle *idl;		/* motion gating, NULL if none	*/
 	mpu_data_t	*AM;
 	mpu_data_t	*GM;
 	mpu_data_t	*Ax, *Ax2, *Axo, *Axg, *Axm, *Axv, *Axd;
@@ -142,6 +307,7 @@ struct mpu_dev {
 	mpu_data_t	*Gz, *Gz2, *Gzo, *Gzg, *Gzm, *Gzv, *Gzd;
 	mpu_data_t	*t, 	    *to,  *tg,  *tm,  *tv,  *td;
 	mpu_data_t	*slv0_dat, *slv1_dat, *slv2_dat, *slv3_dat, *slv4_dat;
+	mpu_data_t	*Mx, *My, *Mz;		/* magnetometer (uT)		*/
 };
 
 #endif /* _MPU6050_H_ */
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_decim.h"
+
+#include <stdlib.h>		/* for calloc(), free() */
+#include <string.h>		/* for memset(), memcpy() */
+#include <tgmath.h>		/* for sin, cos */
+
+static inline void mpu_decim_push(struct mpu_decim *d, const float *x);
+static inline void mpu_decim_dot( const struct mpu_decim *d, float *y);
+
+int mpu_decim_init(struct mpu_decim *d, unsigned int channels, unsigned int factor,
+		   unsigned int taps, double cutoff)
+{
+	if (NULL == d) /* no object */
+		return -1;
+
+	if ((0 == channels) || (channels > MPU6050_DECIM_LANES)) /* too many channels */
+		return -1;
+
+	if ((0 == factor) || (0 == taps) || (taps > MPU6050_DECIM_TAPS))
+		return -1;
+
+	if (!((cutoff > 0) && (cutoff <= 1))) /* past the output Nyquist */
+		return -1;
+
+	memset(d, 0, sizeof(*d));
+	d->h    = calloc(taps, sizeof(float));
+	d->hist = calloc(2 * taps * MPU6050_DECIM_LANES, sizeof(float));
+	if ((NULL == d->h) || (NULL == d->hist)) {
+		mpu_decim_free(d);
+		return -1;
+	}
+
+	d->channels = channels;
+	d->factor   = factor;
+	d->taps     = taps;
+	d->cutoff   = cutoff;
+	d->delay    = (taps - 1) / 2.0;
+
+	/* Blackman windowed sinc, cutoff in cycles per input sample */
+	double fc = cutoff / (2.0 * factor);
+	double sum = 0;
+	double *h = calloc(taps, sizeof(double));
+	if (NULL == h) {
+		mpu_decim_free(d);
+		return -1;
+	}
+	for (unsigned int n = 0; n < taps; n++) {
+		double x = n - d->delay;
+		double s = (0 == x) ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+		double w = (1 == taps) ? 1 : 0.42 - 0.5 * cos(2 * M_PI * n / (taps - 1))
+					   + 0.08 * cos(4 * M_PI * n / (taps - 1));
+		h[n] = s * w;
+		sum += h[n];
+	}
+	for (unsigned int n = 0; n < taps; n++) /* unity gain at DC */
+		d->h[n] = (float)(h[n] / sum);
+	free(h);
+
+	return 0;
+}
+
+int mpu_decim_free(struct mpu_decim *d)
+{
+	if (NULL == d) /* no object */
+		return -1;
+
+	free(d->h);
+	free(d->hist);
+	d->h = d->hist = NULL;
+
+	return 0;
+}
+
+/* forget the history, the next output needs taps fresh inputs to settle */
+int mpu_decim_reset(struct mpu_decim *d)
+{
+	if ((NULL == d) || (NULL == d->hist))
+		return -1;
+
+	memset(d->hist, 0, 2 * d->taps * MPU6050_DECIM_LANES * sizeof(float));
+	d->head  = 0;
+	d->phase = 0;
+
+	return 0;
+}
+
+/* history filled with the frame in, as if it had held since forever */
+int mpu_decim_prime(struct mpu_decim *d, const float *in)
+{
+	if ((NULL == d) || (NULL == d->hist) || (NULL == in))
+		return -1;
+
+	for (unsigned int i = 0; i < d->taps; i++)
+		mpu_decim_push(d, in);
+	d->phase = 0;
+
+	return 0;
+}
+
+/*
+ * Feed n frames of channels values, store one output frame every factor
+ * inputs in out, nout receives the count. out must hold n / factor + 1
+ * frames.
+ */
+int mpu_decim_run(struct mpu_decim *d, const float *in, size_t n, float *out, size_t *nout)
+{
+	if ((NULL == d) || (NULL == d->h) || (NULL == in) || (NULL == out) || (NULL == nout))
+		return -1;
+
+	size_t k = 0;
+	for (size_t i = 0; i < n; i++, in += d->channels) {
+		mpu_decim_push(d, in);
+		if (++d->phase < d->factor) /* no output at this instant */
+			continue;
+		d->phase = 0;
+
+		float y[MPU6050_DECIM_LANES];
+		mpu_decim_dot(d, y);
+		memcpy(out + k * d->channels, y, d->channels * sizeof(float));
+		k++;
+	}
+	*nout = k;
+
+	return 0;
+}
+
+/* each frame is written twice, taps apart, so the window never wraps */
+static inline void mpu_decim_push(struct mpu_decim *d, const float *x)
+{
+	float *a = d->hist + d->head * MPU6050_DECIM_LANES;
+	float *b = a + d->taps * MPU6050_DECIM_LANES;
+
+	for (unsigned int c = 0; c < d->channels; c++)
+		a[c] = b[c] = x[c];
+
+	d->head = (d->head + 1 == d->taps) ? 0 : d->head + 1;
+}
+
+/* the window runs oldest to newest from head, h is symmetric */
+static inline void mpu_decim_dot(const struct mpu_decim *d, float *y)
+{
+	const float *x = d->hist + d->head * MPU6050_DECIM_LANES;
+	float acc[MPU6050_DECIM_LANES] = { 0 };
+
+	for (unsigned int k = 0; k < d->taps; k++, x += MPU6050_DECIM_LANES) {
+		float hk = d->h[k];
+		for (int c = 0; c < MPU6050_DECIM_LANES; c++)
+			acc[c] += hk * x[c];
+	}
+	memcpy(y, acc, sizeof(acc));
+}
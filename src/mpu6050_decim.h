@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_DECIM_H_
+#define _MPU6050_DECIM_H_
+#include "mpu6050_core.h"
+
+#include <stddef.h>		/* for size_t */
+
+/*
+ * Polyphase FIR decimator
+ *
+ * Sample at the raw gyroscope output rate, 1 kHz or 8 kHz with the DLPF
+ * off, and decimate in software: a linear phase windowed-sinc lowpass
+ * is evaluated only at the output instants, one every factor inputs.
+ * Frames are stored interleaved, channels padded to LANES floats, so
+ * the multiply-accumulate runs across channels in one vector.
+ *
+ * Group delay is (taps - 1) / 2 input samples, the same at every
+ * frequency. Wide passbands at 8 kHz need short filters, 31 taps delay
+ * under 2 ms; narrow passbands need long ones, size taps accordingly.
+ */
+#define MPU6050_DECIM_LANES	8	/* channels per frame, padded	*/
+#define MPU6050_DECIM_TAPS	512	/* longest filter		*/
+#define MPU6050_DECIM_BATCH	64	/* frames filtered per call, device */
+
+struct mpu_decim {
+	unsigned int channels;	/* values per input frame		*/
+	unsigned int factor;	/* inputs per output			*/
+	unsigned int taps;	/* filter length			*/
+	double	cutoff;		/* -6 dB point, fraction of output Nyquist */
+	double	delay;		/* group delay in input samples		*/
+	unsigned int phase;	/* inputs since the last output		*/
+	unsigned int head;	/* oldest frame in the history		*/
+	float	*h;		/* coefficients, unity DC gain		*/
+	float	*hist;		/* twice taps frames, always contiguous	*/
+};
+
+int mpu_decim_init	(struct mpu_decim *d, unsigned int channels, unsigned int factor,
+			 unsigned int taps, double cutoff);
+int mpu_decim_free	(struct mpu_decim *d);
+int mpu_decim_reset	(struct mpu_decim *d);
+int mpu_decim_prime	(struct mpu_decim *d, const float *in);
+int mpu_decim_run	(struct mpu_decim *d, const float *in, size_t n, float *out, size_t *nout);
+
+#endif /* _MPU6050_DECIM_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
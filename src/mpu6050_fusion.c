@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_fusion.h"
+
+#include <string.h>		/* for memset() */
+#include <math.h>		/* for sqrtf, atan2f, asinf etc */
+
+#define FUSION_D2R	0.017453292519943295f	/* degrees to radians	*/
+#define FUSION_R2D	57.29577951308232f	/* radians to degrees	*/
+#define FUSION_PI	3.14159265358979323846f
+
+static inline void mpu_fusion_seed(struct mpu_fusion *f, const float *a);
+static inline void mpu_fusion_quat(float *q, float roll, float pitch, float yaw);
+static inline void mpu_fusion_step(struct mpu_fusion *f, const float *acc, const float *gyr, float dt);
+static inline void mpu_fusion_complementary(struct mpu_fusion *f, const float *a, const float *g, float dt);
+static inline void mpu_fusion_mahony(	  struct mpu_fusion *f, const float *a, const float *g, float dt);
+static inline void mpu_fusion_madgwick(	  struct mpu_fusion *f, const float *a, const float *g, float dt);
+
+int mpu_fusion_init(struct mpu_fusion *f, int filter, float gain, float ki)
+{
+	if (NULL == f) /* no object */
+		return -1;
+
+	switch (filter) {
+		case MPU6050_FUSION_COMPLEMENTARY:
+			if (!((gain >= 0) && (gain < 1))) /* alpha out of range */
+				return -1;
+			break;
+		case MPU6050_FUSION_MAHONY:
+		case MPU6050_FUSION_MADGWICK:
+			if (!((gain >= 0) && (ki >= 0))) /* negative feedback */
+				return -1;
+			break;
+		default:
+			return -1;
+	}
+
+	memset(f, 0, sizeof(*f));
+	f->filter = filter;
+	f->gain   = gain;
+	f->ki     = ki;
+	f->q[0]   = 1;
+
+	return 0;
+}
+
+int mpu_fusion_update(struct mpu_fusion *f, const float *acc, const float *gyr, float dt)
+{
+	if ((NULL == f) || (NULL == acc) || (NULL == gyr))
+		return -1;
+
+	mpu_fusion_step(f, acc, gyr, dt);
+
+	return mpu_fusion_euler(f);
+}
+
+/* Euler angles are only computed for the last frame, q[] receives every one */
+int mpu_fusion_batch(struct mpu_fusion *f, const float (*acc)[3], const float (*gyr)[3],
+		     const float *dt, size_t n, float (*q)[4])
+{
+	if ((NULL == f) || (NULL == acc) || (NULL == gyr) || (NULL == dt))
+		return -1;
+
+	for (size_t i = 0; i < n; i++) {
+		mpu_fusion_step(f, acc[i], gyr[i], dt[i]);
+		if (NULL != q)
+			memcpy(q[i], f->q, sizeof(f->q));
+	}
+
+	return mpu_fusion_euler(f);
+}
+
+/* aerospace sequence, yaw then pitch then roll */
+int mpu_fusion_euler(struct mpu_fusion *f)
+{
+	if (NULL == f) /* no object */
+		return -1;
+
+	const float *q = f->q;
+	float s = 2 * (q[0] * q[2] - q[3] * q[1]);
+	s = (s > 1) ? 1 : (s < -1) ? -1 : s; /* rounding past the poles */
+
+	f->roll  = FUSION_R2D * atan2f(2 * (q[0] * q[1] + q[2] * q[3]),
+				       1 - 2 * (q[1] * q[1] + q[2] * q[2]));
+	f->pitch = FUSION_R2D * asinf(s);
+	f->yaw   = FUSION_R2D * atan2f(2 * (q[0] * q[3] + q[1] * q[2]),
+				       1 - 2 * (q[2] * q[2] + q[3] * q[3]));
+
+	return 0;
+}
+
+static inline void mpu_fusion_step(struct mpu_fusion *f, const float *acc, const float *gyr, float dt)
+{
+	if (!f->init) { /* start from gravity, not from the identity */
+		mpu_fusion_seed(f, acc);
+		if (!f->init)
+			return;
+	}
+
+	const float g[3] = { FUSION_D2R * gyr[0], FUSION_D2R * gyr[1], FUSION_D2R * gyr[2] };
+	switch (f->filter) {
+		case MPU6050_FUSION_COMPLEMENTARY:
+			mpu_fusion_complementary(f, acc, g, dt);
+			break;
+		case MPU6050_FUSION_MAHONY:
+			mpu_fusion_mahony(f, acc, g, dt);
+			break;
+		case MPU6050_FUSION_MADGWICK:
+			mpu_fusion_madgwick(f, acc, g, dt);
+			break;
+	}
+	f->frames++;
+}
+
+static inline void mpu_fusion_seed(struct mpu_fusion *f, const float *a)
+{
+	if ((0 == a[0]) && (0 == a[1]) && (0 == a[2])) /* free fall, no reference */
+		return;
+
+	f->roll  = FUSION_R2D * atan2f(a[1], a[2]);
+	f->pitch = FUSION_R2D * atan2f(-a[0], sqrtf(a[1] * a[1] + a[2] * a[2]));
+	f->yaw   = 0;
+	mpu_fusion_quat(f->q, FUSION_D2R * f->roll, FUSION_D2R * f->pitch, 0);
+	f->init  = true;
+}
+
+static inline void mpu_fusion_quat(float *q, float roll, float pitch, float yaw)
+{
+	float cr = cosf(roll / 2),  sr = sinf(roll / 2);
+	float cp = cosf(pitch / 2), sp = sinf(pitch / 2);
+	float cy = cosf(yaw / 2),   sy = sinf(yaw / 2);
+
+	q[0] = cr * cp * cy + sr * sp * sy;
+	q[1] = sr * cp * cy - cr * sp * sy;
+	q[2] = cr * sp * cy + sr * cp * sy;
+	q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+/*
+ * Body rates integrated as Euler rates, roll and pitch pulled toward
+ * the accelerometer tilt by 1 - alpha each frame, yaw gyro only.
+ */
+static inline void mpu_fusion_complementary(struct mpu_fusion *f, const float *a, const float *g, float dt)
+{
+	float r = FUSION_D2R * f->roll;
+	float p = FUSION_D2R * f->pitch;
+	float y = FUSION_D2R * f->yaw;
+	float sr = sinf(r), cr = cosf(r);
+	float cp = cosf(p);
+	cp = (fabsf(cp) < 1e-3f) ? copysignf(1e-3f, cp) : cp; /* gimbal lock */
+	float tp = sinf(p) / cp;
+
+	r += dt * (g[0] + (sr * g[1] + cr * g[2]) * tp);
+	p += dt * (cr * g[1] - sr * g[2]);
+	y += dt * (sr * g[1] + cr * g[2]) / cp;
+
+	if ((0 != a[0]) || (0 != a[1]) || (0 != a[2])) {
+		float w = 1 - f->gain;
+		float dr = atan2f(a[1], a[2]) - r;
+		float dp = atan2f(-a[0], sqrtf(a[1] * a[1] + a[2] * a[2])) - p;
+		dr -= 2 * FUSION_PI * floorf((dr + FUSION_PI) / (2 * FUSION_PI)); /* shortest way */
+		r += w * dr;
+		p += w * dp;
+	}
+	y -= 2 * FUSION_PI * floorf((y + FUSION_PI) / (2 * FUSION_PI));
+	r -= 2 * FUSION_PI * floorf((r + FUSION_PI) / (2 * FUSION_PI));
+
+	f->roll  = FUSION_R2D * r;
+	f->pitch = FUSION_R2D * p;
+	f->yaw   = FUSION_R2D * y;
+	mpu_fusion_quat(f->q, r, p, y);
+}
+
+/* Mahony et al., Nonlinear Complementary Filters on SO(3), 2008 */
+static inline void mpu_fusion_mahony(struct mpu_fusion *f, const float *a, const float *g, float dt)
+{
+	float *q = f->q;
+	float gx = g[0], gy = g[1], gz = g[2];
+	float n = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+
+	if (n > 0) {
+		float in = 1 / sqrtf(n);
+		float ax = a[0] * in, ay = a[1] * in, az = a[2] * in;
+
+		/* estimated gravity direction, halved */
+		float vx = q[1] * q[3] - q[0] * q[2];
+		float vy = q[0] * q[1] + q[2] * q[3];
+		float vz = q[0] * q[0] - 0.5f + q[3] * q[3];
+
+		/* error is the cross product of measured and estimated */
+		float ex = ay * vz - az * vy;
+		float ey = az * vx - ax * vz;
+		float ez = ax * vy - ay * vx;
+
+		if (f->ki > 0) {
+			f->e_int[0] += 2 * f->ki * ex * dt;
+			f->e_int[1] += 2 * f->ki * ey * dt;
+			f->e_int[2] += 2 * f->ki * ez * dt;
+			gx += f->e_int[0];
+			gy += f->e_int[1];
+			gz += f->e_int[2];
+		}
+		gx += 2 * f->gain * ex;
+		gy += 2 * f->gain * ey;
+		gz += 2 * f->gain * ez;
+	}
+
+	gx *= 0.5f * dt;
+	gy *= 0.5f * dt;
+	gz *= 0.5f * dt;
+	float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+	q[0] += -q1 * gx - q2 * gy - q3 * gz;
+	q[1] +=  q0 * gx + q2 * gz - q3 * gy;
+	q[2] +=  q0 * gy - q1 * gz + q3 * gx;
+	q[3] +=  q0 * gz + q1 * gy - q2 * gx;
+
+	float in = 1 / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	for (int i = 0; i < 4; i++)
+		q[i] *= in;
+}
+
+/* Madgwick, An efficient orientation filter for IMUs and MARG arrays, 2010 */
+static inline void mpu_fusion_madgwick(struct mpu_fusion *f, const float *a, const float *g, float dt)
+{
+	float *q = f->q;
+	float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+	/* rate of change from the gyroscope */
+	float d0 = 0.5f * (-q1 * g[0] - q2 * g[1] - q3 * g[2]);
+	float d1 = 0.5f * ( q0 * g[0] + q2 * g[2] - q3 * g[1]);
+	float d2 = 0.5f * ( q0 * g[1] - q1 * g[2] + q3 * g[0]);
+	float d3 = 0.5f * ( q0 * g[2] + q1 * g[1] - q2 * g[0]);
+
+	float n = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+	if (n > 0) {
+		float in = 1 / sqrtf(n);
+		float ax = a[0] * in, ay = a[1] * in, az = a[2] * in;
+
+		float _2q0 = 2 * q0, _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3;
+		float _4q0 = 4 * q0, _4q1 = 4 * q1, _4q2 = 4 * q2;
+		float _8q1 = 8 * q1, _8q2 = 8 * q2;
+		float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+		/* gradient of the gravity objective function */
+		float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+		float s1 = _4q1 * q3q3 - _2q3 * ax + 4 * q0q0 * q1 - _2q0 * ay - _4q1
+			 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+		float s2 = 4 * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2
+			 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+		float s3 = 4 * q1q1 * q3 - _2q1 * ax + 4 * q2q2 * q3 - _2q2 * ay;
+
+		float sn = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+		if (sn > 0) {
+			float is = f->gain / sqrtf(sn);
+			d0 -= is * s0;
+			d1 -= is * s1;
+			d2 -= is * s2;
+			d3 -= is * s3;
+		}
+	}
+
+	q0 += d0 * dt;
+	q1 += d1 * dt;
+	q2 += d2 * dt;
+	q3 += d3 * dt;
+
+	float in = 1 / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	q[0] = q0 * in;
+	q[1] = q1 * in;
+	q[2] = q2 * in;
+	q[3] = q3 * in;
+}
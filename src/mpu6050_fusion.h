@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_FUSION_H_
+#define _MPU6050_FUSION_H_
+#include "mpu6050_core.h"
+
+#include <stddef.h>		/* for size_t */
+
+/*
+ * Attitude estimation from accelerometer and gyroscope
+ *
+ * The state is a plain struct, no memory is allocated: declare it,
+ * initialize it and feed it frames. Gyroscope rates are in degrees/s,
+ * as reported by the library; accelerometer units are irrelevant,
+ * only the direction of the specific force is used. Without a
+ * magnetometer yaw is the integrated heading and drifts.
+ *
+ * Filters and the meaning of gain and ki:
+ * COMPLEMENTARY - gain is the gyroscope weight alpha in [0,1), ki unused
+ * MAHONY	 - gain is the proportional gain Kp, ki the integral gain
+ * MADGWICK	 - gain is the gradient descent step beta, ki unused
+ */
+#define MPU6050_FUSION_COMPLEMENTARY	0
+#define MPU6050_FUSION_MAHONY		1
+#define MPU6050_FUSION_MADGWICK		2
+
+struct mpu_fusion {
+	int	filter;		/* MPU6050_FUSION_x			*/
+	float	gain;		/* alpha, Kp or beta			*/
+	float	ki;		/* Mahony integral gain			*/
+	float	q[4];		/* attitude quaternion w, x, y, z	*/
+	float	roll;		/* rotation about X (degrees)		*/
+	float	pitch;		/* rotation about Y (degrees)		*/
+	float	yaw;		/* rotation about Z (degrees)		*/
+	float	e_int[3];	/* Mahony integral feedback (rad/s)	*/
+	bool	init;		/* attitude seeded from gravity		*/
+	unsigned long long frames; /* frames fused			*/
+};
+
+int mpu_fusion_init	(struct mpu_fusion *f, int filter, float gain, float ki);
+int mpu_fusion_update	(struct mpu_fusion *f, const float *acc, const float *gyr, float dt);
+int mpu_fusion_batch	(struct mpu_fusion *f, const float (*acc)[3], const float (*gyr)[3],
+			 const float *dt, size_t n, float (*q)[4]);
+int mpu_fusion_euler	(struct mpu_fusion *f);
+
+#endif /* _MPU6050_FUSION_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_idle.h"
+#include "mpu6050_regs.h"
+#include "mpu6050_time.h"
+
+#include <math.h>		/* for lrint() */
+#include <string.h>		/* for memset() */
+
+static int mpu_idle_lsb(double val, double lsb, mpu_reg_t *reg);
+
+/* still below zmot_thr for zmot_dur, moving above mot_thr, idle at idle_hz */
+int mpu_idle_init(struct mpu_idle *ip, double mot_thr, double zmot_thr, double zmot_dur, double idle_hz)
+{
+	if (NULL == ip)
+		return -1;
+
+	if (!(idle_hz >= 0)) /* invalid rate */
+		return -1;
+
+	memset(ip, 0, sizeof(*ip));
+	ip->mot_thr  = mot_thr;
+	ip->mot_dur  = MPU6050_IDLE_MOT_DUR;
+	ip->zmot_thr = zmot_thr;
+	ip->zmot_dur = zmot_dur;
+	ip->ff_dur   = MPU6050_IDLE_FF_DUR;
+	ip->idle_hz  = idle_hz;
+	ip->check    = MPU6050_IDLE_CHECK;
+	ip->rearm    = MPU6050_IDLE_REARM;
+
+	mpu_reg_t regs[6];
+	if (mpu_idle_regs(ip, regs) < 0) /* out of the register ranges */
+		return -1;
+
+	return 0;
+}
+
+/*
+ * FF_THR, FF_DUR, MOT_THR, MOT_DUR, ZRMOT_THR and ZRMOT_DUR, in address
+ * order, for the policy; -1 if a value is outside its register.
+ */
+int mpu_idle_regs(const struct mpu_idle *ip, mpu_reg_t *regs)
+{
+	if ((NULL == ip) || (NULL == regs))
+		return -1;
+
+	regs[0] = regs[1] = 0; /* free fall off */
+	if ((ip->ff_thr > 0) && ((mpu_idle_lsb(ip->ff_thr, MPU6050_IDLE_THR_LSB, &regs[0]) < 0) ||
+	    (mpu_idle_lsb(ip->ff_dur, MPU6050_IDLE_DUR_LSB, &regs[1]) < 0)))
+		return -1;
+	if (mpu_idle_lsb(ip->mot_thr, MPU6050_IDLE_THR_LSB, &regs[2]) < 0)
+		return -1;
+	if (mpu_idle_lsb(ip->mot_dur, MPU6050_IDLE_DUR_LSB, &regs[3]) < 0)
+		return -1;
+	if (mpu_idle_lsb(ip->zmot_thr, MPU6050_IDLE_THR_LSB, &regs[4]) < 0)
+		return -1;
+	if (mpu_idle_lsb(ip->zmot_dur, MPU6050_IDLE_ZDUR_LSB, &regs[5]) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* 1 if the status should be read now, at every drain while idle, else 0 */
+int mpu_idle_due(struct mpu_idle *ip)
+{
+	if (NULL == ip)
+		return -1;
+
+	double now = mpu_clock();
+	if (!ip->idle && (now - ip->t_poll < ip->check))
+		return 0;
+
+	ip->t_poll = now;
+	ip->polls++;
+
+	return 1;
+}
+
+/*
+ * 1 if still, 0 if moving, once INT_STATUS reported status and, when
+ * it holds ZMOT_INT, MOT_DETECT_STATUS detect. Zero motion both starts
+ * and ends with ZMOT_INT, MOT_ZRMOT tells which; while moving, motion is
+ * ignored, it may predate the stillness reported along. Any motion or
+ * free fall wakes an idle unit.
+ */
+int mpu_idle_still(const struct mpu_idle *ip, mpu_reg_t status, mpu_reg_t detect)
+{
+	if (NULL == ip)
+		return -1;
+
+	bool zmot = status & ZMOT_INT_BIT;
+	bool zero = detect & MOT_ZRMOT_BIT;
+	if (!ip->idle)
+		return zmot && zero;
+
+	if (status & (MOT_INT_BIT | FF_INT_BIT))
+		return 0;
+
+	return !zmot || zero;
+}
+
+/*
+ * 1 if MOT_DETECT_STATUS should be read for its level, no zero motion
+ * edge in status for rearm seconds, else 0.
+ */
+int mpu_idle_rearm(struct mpu_idle *ip, mpu_reg_t status)
+{
+	if (NULL == ip)
+		return -1;
+
+	double now = mpu_clock();
+	if (status & ZMOT_INT_BIT) { /* the edge came */
+		ip->t_edge = now;
+		return 0;
+	}
+	if (!(ip->rearm > 0) || (now - ip->t_edge < ip->rearm))
+		return 0;
+
+	ip->t_edge = now;
+	ip->rearms++;
+
+	return 1;
+}
+
+/* account a switch to still, or back to moving */
+int mpu_idle_switch(struct mpu_idle *ip, bool still)
+{
+	if (NULL == ip)
+		return -1;
+
+	if (still == ip->idle) /* no switch */
+		return 0;
+
+	double now = mpu_clock();
+	if (still) {
+		ip->enters++;
+		ip->t_enter = now;
+	} else {
+		ip->exits++;
+		ip->idle_time += now - ip->t_enter;
+	}
+	ip->idle   = still;
+	ip->t_poll = now;
+
+	return 0;
+}
+
+/* back to moving, statistics cleared; the rate is the caller's business */
+int mpu_idle_reset(struct mpu_idle *ip)
+{
+	if (NULL == ip)
+		return -1;
+
+	ip->idle      = false;
+	ip->slowed    = false;
+	ip->t_poll    = 0;
+	ip->t_edge    = mpu_clock();
+	ip->t_enter   = 0;
+	ip->idle_time = 0;
+	ip->polls     = 0;
+	ip->enters    = 0;
+	ip->exits     = 0;
+	ip->rearms    = 0;
+
+	return 0;
+}
+
+/* val in units of lsb, 1 to 255 */
+static int mpu_idle_lsb(double val, double lsb, mpu_reg_t *reg)
+{
+	if (!(val > 0) || !(val / lsb < 255.5)) /* outside the register */
+		return -1;
+
+	long n = lrint(val / lsb);
+	if (n < 1)
+		return -1;
+
+	*reg = (mpu_reg_t)n;
+
+	return 0;
+}
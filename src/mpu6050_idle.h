@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_IDLE_H_
+#define _MPU6050_IDLE_H_
+#include "mpu6050_core.h"
+
+/*
+ * Motion gated acquisition
+ *
+ * Attached with mpu_ctl_idle(), the policy programs the motion engine of
+ * the sensor: motion above mot_thr for mot_dur, zero motion below
+ * zmot_thr for zmot_dur and, when ff_thr is set, free fall below ff_thr
+ * for ff_dur, all on the high-passed accelerometer. mpu_get_data() reads
+ * INT_STATUS every check seconds while the unit moves; once it reports
+ * zero motion the sampling rate drops to idle_hz, with a DLPF setting
+ * matching it, and the status is read at every drain until motion or
+ * free fall brings the previous rate back. An idle_hz of 0 leaves the
+ * fifo alone instead: mpu_get_data() sleeps, reading the status every
+ * check seconds, and returns the first frame sampled after the wake.
+ *
+ * With lowpower set, a still unit goes to the accelerometer-only
+ * profile of mpu_ctl_lowpower() instead, cycling at idle_hz.
+ *
+ * Zero motion is an edge: should its interrupt be lost, the unit would
+ * stay in the state it had. Without one for rearm seconds the level in
+ * MOT_DETECT_STATUS is read instead and stands for it.
+ *
+ * Every switch flushes the fifo, the first reading after it follows a
+ * gap. The rate the device returns to is the one the configuration file
+ * keeps while idle; a rate set while idle stays after the wake.
+ */
+#define MPU6050_IDLE_CHECK	0.1	/* status read while moving (s)	*/
+#define MPU6050_IDLE_MOT_DUR	0.002	/* motion, above mot_thr for (s)*/
+#define MPU6050_IDLE_FF_DUR	0.010	/* free fall, below ff_thr for (s) */
+#define MPU6050_IDLE_REARM	10.0	/* no zero motion edge for (s)	*/
+
+/* thresholds 2 mg a LSB, durations 1 ms a LSB, zero motion 64 ms a LSB */
+#define MPU6050_IDLE_THR_LSB	0.002
+#define MPU6050_IDLE_DUR_LSB	0.001
+#define MPU6050_IDLE_ZDUR_LSB	0.064
+
+struct mpu_idle {
+	double	mot_thr;	/* motion, above (g)			*/
+	double	mot_dur;	/* for at least (s)			*/
+	double	zmot_thr;	/* zero motion, below (g)		*/
+	double	zmot_dur;	/* for at least (s)			*/
+	double	ff_thr;		/* free fall, below (g), 0 if not	*/
+	double	ff_dur;		/* for at least (s)			*/
+	double	idle_hz;	/* rate while still, 0 stops draining	*/
+	double	check;		/* status read while moving (s)		*/
+	double	rearm;		/* zero motion level read after (s), 0 never */
+	bool	lowpower;	/* still in the low-power profile, idle_hz its wake rate */
+	bool	idle;		/* still, at the idle rate		*/
+	bool	slowed;		/* the rate was changed for it		*/
+	mpu_reg_t div, dlpf;	/* SMPLRT_DIV and DLPF_CFG to return to	*/
+	mpu_reg_t idle_div, idle_dlpf;	/* and those set while idle	*/
+	double	t_poll;		/* last status read (s)			*/
+	double	t_edge;		/* last zero motion edge or level (s)	*/
+	double	t_enter;	/* last switch to idle (s)		*/
+	double	idle_time;	/* spent idle before it (s)		*/
+	unsigned long long polls;	/* status reads			*/
+	unsigned long long enters;	/* switches to idle		*/
+	unsigned long long exits;	/* wakes			*/
+	unsigned long long rearms;	/* level reads for lost edges	*/
+};
+
+int mpu_idle_init	(struct mpu_idle *ip, double mot_thr, double zmot_thr, double zmot_dur, double idle_hz);
+int mpu_idle_regs	(const struct mpu_idle *ip, mpu_reg_t *regs);
+int mpu_idle_due	(struct mpu_idle *ip);
+int mpu_idle_still	(const struct mpu_idle *ip, mpu_reg_t status, mpu_reg_t detect);
+int mpu_idle_rearm	(struct mpu_idle *ip, mpu_reg_t status);
+int mpu_idle_switch	(struct mpu_idle *ip, bool still);
+int mpu_idle_reset	(struct mpu_idle *ip);
+
+#endif /* _MPU6050_IDLE_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_iio.h"
+#include "mpu6050_time.h"
+
+#include <stdio.h>		/* for snprintf(), fopen(), fgets() */
+#include <stdlib.h>		/* for malloc(), free(), strtod() */
+#include <string.h>		/* for memset(), memmove(), strrchr(), strcspn() */
+#include <errno.h>		/* for EINTR */
+#include <fcntl.h>		/* for open() */
+#include <unistd.h>		/* for read(), close() */
+
+/* scan elements, in frame order, and the MPU6050_CH_* enabling each */
+static const char *const mpu_iio_names[MPU6050_IIO_CHANS] = {
+	"accel_x", "accel_y", "accel_z", "temp", "anglvel_x", "anglvel_y", "anglvel_z", "timestamp"
+};
+static const unsigned int mpu_iio_mask[MPU6050_IIO_CHANS] = {
+	MPU6050_CH_ACCEL, MPU6050_CH_ACCEL, MPU6050_CH_ACCEL, MPU6050_CH_TEMP,
+	MPU6050_CH_XG, MPU6050_CH_YG, MPU6050_CH_ZG, 0
+};
+
+static int mpu_iio_get(const struct mpu_iio *io, const char *name, char *val, size_t len);
+static int mpu_iio_put(const struct mpu_iio *io, const char *name, const char *val);
+static int mpu_iio_type(struct mpu_iio_chan *c, const char *type);
+static int mpu_iio_layout(struct mpu_iio *io);
+static int64_t mpu_iio_value(const struct mpu_iio_chan *c, const uint8_t *p);
+
+/*
+ * Buffered capture of the channels in mask from the device at sys, read
+ * from chr, /dev/ and the name of sys when NULL; a read() returns once
+ * watermark scans are queued. Accelerometer axes come together, as in
+ * the fifo.
+ */
+int mpu_iio_open(struct mpu_iio *io, const char *sys, const char *chr, unsigned int mask,
+		 unsigned int watermark)
+{
+	if ((NULL == io) || (NULL == sys))
+		return -1;
+
+	if ((0 == (mask & MPU6050_CH_ALL)) || (mask & ~MPU6050_CH_ALL)) /* nothing or unknown */
+		return -1;
+
+	if ((0 == watermark) || (watermark > MPU6050_IIO_SCANS)) /* more than a read() takes */
+		return -1;
+
+	memset(io, 0, sizeof(*io));
+	io->fd = -1;
+	if (snprintf(io->sys, sizeof(io->sys), "%s", sys) >= (int)sizeof(io->sys))
+		return -1;
+	if (mask & MPU6050_CH_ACCEL)
+		mask |= MPU6050_CH_ACCEL;
+	io->mask = mask;
+	io->watermark = watermark;
+
+	char val[64];
+	if ((mpu_iio_get(io, "name", val, sizeof(val)) < 0) || strncmp(val, "mpu", 3))
+		return -1; /* not an InvenSense motion device */
+
+	if (mpu_iio_put(io, "buffer/enable", "0") < 0) /* scan elements are fixed while enabled */
+		return -1;
+
+	/* timestamps on the clock the library keeps, none on older kernels */
+	bool stamp = (mpu_iio_put(io, "current_timestamp_clock", "monotonic") == 0);
+
+	char name[64];
+	for (int i = 0; i < MPU6050_IIO_CHANS; i++) {
+		struct mpu_iio_chan *c = &io->ch[i];
+		bool want = (i < MPU6050_IIO_CHANS - 1) ? (mask & mpu_iio_mask[i]) : stamp;
+
+		c->index = -1;
+		snprintf(name, sizeof(name), "scan_elements/in_%s_en", mpu_iio_names[i]);
+		if (mpu_iio_put(io, name, want ? "1" : "0") < 0) {
+			if (want && (i < MPU6050_IIO_CHANS - 1)) /* the driver lacks it */
+				goto iio_open_error;
+			continue;
+		}
+		if (!want)
+			continue;
+
+		snprintf(name, sizeof(name), "scan_elements/in_%s_index", mpu_iio_names[i]);
+		if (mpu_iio_get(io, name, val, sizeof(val)) < 0)
+			goto iio_open_error;
+		c->index = atoi(val);
+		snprintf(name, sizeof(name), "scan_elements/in_%s_type", mpu_iio_names[i]);
+		if ((mpu_iio_get(io, name, val, sizeof(val)) < 0) || (mpu_iio_type(c, val) < 0))
+			goto iio_open_error;
+		if ((i < MPU6050_IIO_CHANS - 1) && (c->bits > 16)) /* not a fifo word */
+			goto iio_open_error;
+		io->words += (i < MPU6050_IIO_CHANS - 1);
+	}
+	if (mpu_iio_layout(io) < 0)
+		goto iio_open_error;
+
+	if ((mask & MPU6050_CH_ACCEL) && (mpu_iio_get(io, "in_accel_scale", val, sizeof(val)) == 0))
+		io->accel_scale = strtod(val, NULL);
+	if ((mask & MPU6050_CH_GYRO) && (mpu_iio_get(io, "in_anglvel_scale", val, sizeof(val)) == 0))
+		io->anglvel_scale = strtod(val, NULL);
+	if (mpu_iio_get(io, "sampling_frequency", val, sizeof(val)) == 0)
+		io->sr = strtod(val, NULL);
+
+	unsigned int length = (2 * MPU6050_IIO_SCANS > MPU6050_IIO_LENGTH) ? 2 * MPU6050_IIO_SCANS : MPU6050_IIO_LENGTH;
+	snprintf(val, sizeof(val), "%u", length);
+	if (mpu_iio_put(io, "buffer/length", val) < 0)
+		goto iio_open_error;
+	snprintf(val, sizeof(val), "%u", watermark);
+	mpu_iio_put(io, "buffer/watermark", val); /* before 4.7 a read() returns what is queued */
+
+	io->buf = malloc((size_t)io->scan * MPU6050_IIO_SCANS);
+	if (NULL == io->buf)
+		goto iio_open_error;
+
+	if (mpu_iio_put(io, "buffer/enable", "1") < 0)
+		goto iio_open_error;
+
+	char path[MPU6050_IIO_PATH + 8];
+	if (NULL == chr) {
+		const char *base = strrchr(io->sys, '/');
+		snprintf(path, sizeof(path), "/dev/%s", (NULL == base) ? io->sys : base + 1);
+		chr = path;
+	}
+	io->fd = open(chr, O_RDONLY);
+	if (io->fd < 0)
+		goto iio_open_error;
+
+	return 0;
+
+iio_open_error:
+	mpu_iio_put(io, "buffer/enable", "0");
+	free(io->buf);
+	io->buf = NULL;
+
+	return -1;
+}
+
+int mpu_iio_close(struct mpu_iio *io)
+{
+	if ((NULL == io) || (io->fd < 0))
+		return -1;
+
+	int ret = close(io->fd);
+	if (mpu_iio_put(io, "buffer/enable", "0") < 0)
+		ret = -1;
+	free(io->buf);
+	memset(io, 0, sizeof(*io));
+	io->fd = -1;
+
+	return ret;
+}
+
+/*
+ * The next scan: words frame words into raw and its time, in seconds,
+ * into ts. A read() takes every queued scan the buffer holds, a partial
+ * scan waits in it for the rest.
+ */
+int mpu_iio_next(struct mpu_iio *io, int16_t *raw, unsigned int words, double *ts)
+{
+	if ((NULL == io) || (NULL == raw) || (NULL == ts) || (io->fd < 0))
+		return -1;
+
+	if (words != io->words) /* frame and scan disagree */
+		return -1;
+
+	while (io->len - io->pos < io->scan) {
+		size_t rest = io->len - io->pos;
+		memmove(io->buf, io->buf + io->pos, rest);
+		io->pos = 0;
+		io->len = rest;
+
+		ssize_t n = read(io->fd, io->buf + rest, (size_t)io->scan * MPU6050_IIO_SCANS - rest);
+		if ((n < 0) && (EINTR == errno))
+			continue;
+		if (n <= 0) /* buffer disabled or device gone */
+			return -1;
+		io->len += (size_t)n;
+		io->reads++;
+	}
+
+	const uint8_t *p = io->buf + io->pos;
+	unsigned int w = 0;
+	for (int i = 0; i < MPU6050_IIO_CHANS - 1; i++) {
+		if (io->ch[i].index >= 0)
+			raw[w++] = (int16_t)mpu_iio_value(&io->ch[i], p + io->ch[i].off);
+	}
+
+	const struct mpu_iio_chan *t = &io->ch[MPU6050_IIO_CHANS - 1];
+	*ts = (t->index >= 0) ? mpu_iio_value(t, p + t->off) * 1e-9 : mpu_clock();
+
+	io->pos += io->scan;
+	io->scans++;
+
+	return 0;
+}
+
+/* first line of the attribute name, newline stripped */
+static int mpu_iio_get(const struct mpu_iio *io, const char *name, char *val, size_t len)
+{
+	char path[MPU6050_IIO_PATH + 64];
+	snprintf(path, sizeof(path), "%s/%s", io->sys, name);
+
+	FILE *fp = fopen(path, "r");
+	if (NULL == fp) /* no such attribute */
+		return -1;
+
+	char *s = fgets(val, (int)len, fp);
+	fclose(fp);
+	if (NULL == s)
+		return -1;
+	val[strcspn(val, "\n")] = '\0';
+
+	return 0;
+}
+
+static int mpu_iio_put(const struct mpu_iio *io, const char *name, const char *val)
+{
+	char path[MPU6050_IIO_PATH + 64];
+	snprintf(path, sizeof(path), "%s/%s", io->sys, name);
+
+	int fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0) /* no such attribute */
+		return -1;
+
+	size_t len = strlen(val);
+	ssize_t n = write(fd, val, len);
+	if ((close(fd) < 0) || (n != (ssize_t)len)) /* sysfs reports refusals on close too */
+		return -1;
+
+	return 0;
+}
+
+/* [be|le]:[s|u]bits/storagebits[Xrepeat]>>shift */
+static int mpu_iio_type(struct mpu_iio_chan *c, const char *type)
+{
+	char endian[3], sign;
+	unsigned int bits, storage, shift;
+	if (sscanf(type, "%2[bel]:%c%u/%u>>%u", endian, &sign, &bits, &storage, &shift) != 5)
+		return -1;
+
+	if (((storage != 8) && (storage != 16) && (storage != 32) && (storage != 64)) ||
+	    (0 == bits) || (bits + shift > storage) || ((sign != 's') && (sign != 'u')))
+		return -1;
+
+	c->be    = (0 == strcmp(endian, "be"));
+	c->sign  = ('s' == sign);
+	c->bits  = bits;
+	c->bytes = storage / 8;
+	c->shift = shift;
+
+	return 0;
+}
+
+/* elements follow in scan_index order, each aligned to its own size */
+static int mpu_iio_layout(struct mpu_iio *io)
+{
+	unsigned int off = 0, align = 1;
+	int last = -1;
+	for (;;) {
+		struct mpu_iio_chan *next = NULL;
+		for (int i = 0; i < MPU6050_IIO_CHANS; i++) {
+			struct mpu_iio_chan *c = &io->ch[i];
+			if ((c->index > last) && ((NULL == next) || (c->index < next->index)))
+				next = c;
+		}
+		if (NULL == next)
+			break;
+
+		off = (off + next->bytes - 1) / next->bytes * next->bytes;
+		next->off = off;
+		off += next->bytes;
+		align = (next->bytes > align) ? next->bytes : align;
+		last = next->index;
+	}
+	if ((0 == off) || (0 == io->words)) /* empty scan */
+		return -1;
+
+	io->scan = (off + align - 1) / align * align;
+
+	return 0;
+}
+
+static int64_t mpu_iio_value(const struct mpu_iio_chan *c, const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (unsigned int i = 0; i < c->bytes; i++)
+		v = (v << 8) | p[c->be ? i : c->bytes - 1 - i];
+
+	v >>= c->shift;
+	if (c->bits < 64) {
+		v &= (UINT64_C(1) << c->bits) - 1;
+		if (c->sign && (v >> (c->bits - 1)))
+			v |= ~UINT64_C(0) << c->bits;
+	}
+
+	return (int64_t)v;
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_IIO_H_
+#define _MPU6050_IIO_H_
+#include "mpu6050_core.h"
+
+#include <stddef.h>		/* for size_t */
+
+/*
+ * Linux IIO backend
+ *
+ * The mainline inv_mpu6050 driver drains the fifo in the kernel, stamps
+ * every scan from the interrupt and queues the scans in a buffer read
+ * from /dev/iio:deviceN. mpu_iio_open() enables, in the sysfs directory
+ * of the device, the scan elements of the channels asked for and the
+ * timestamp, on CLOCK_MONOTONIC, parses their index and type into the
+ * scan layout, sets the buffer length and watermark and enables it.
+ *
+ * mpu_init_iio() builds a device on it: mpu_get_data(), the decimator,
+ * fusion and the log hooks run on kernel scans with their timestamps,
+ * many scans per read(), the driver waking the reader once watermark
+ * scans are queued. Ranges and rate come from the sysfs attributes;
+ * controls that write registers fail, there is no bus.
+ */
+#define MPU6050_IIO_SCANS	64	/* scans per read() at most	*/
+#define MPU6050_IIO_LENGTH	1024	/* kernel buffer, scans		*/
+#define MPU6050_IIO_PATH	256	/* sysfs directory, bytes	*/
+#define MPU6050_IIO_CHANS	8	/* frame words, then timestamp	*/
+#define MPU6050_IIO_G		9.80665	/* m/s^2, accel scale unit	*/
+
+struct mpu_iio_chan {
+	int	index;		/* scan_index, -1 if not in the scan	*/
+	unsigned int off;	/* byte offset in a scan		*/
+	unsigned int bytes;	/* storage bytes			*/
+	unsigned int bits;	/* significant bits			*/
+	unsigned int shift;	/* right shift				*/
+	bool	be;		/* big endian				*/
+	bool	sign;		/* two's complement			*/
+};
+
+struct mpu_iio {
+	char	sys[MPU6050_IIO_PATH];	/* /sys/bus/iio/devices/iio:deviceN */
+	int	fd;		/* buffer character device		*/
+	unsigned int mask;	/* MPU6050_CH_* in a scan		*/
+	unsigned int words;	/* frame words in a scan		*/
+	struct	mpu_iio_chan ch[MPU6050_IIO_CHANS]; /* accel x, y, z, temp, anglvel x, y, z, timestamp */
+	unsigned int scan;	/* bytes per scan			*/
+	unsigned int watermark;	/* scans a read() waits for		*/
+	double	accel_scale;	/* m/s^2 per LSB, 0 if not read		*/
+	double	anglvel_scale;	/* rad/s per LSB, 0 if not read		*/
+	double	sr;		/* sampling_frequency (Hz)		*/
+	uint8_t	*buf;		/* scans of the last read()		*/
+	size_t	len;		/* bytes held in buf			*/
+	size_t	pos;		/* next scan in buf			*/
+	unsigned long long reads;	/* read() calls			*/
+	unsigned long long scans;	/* scans returned		*/
+};
+
+int mpu_iio_open	(struct mpu_iio *io, const char *sys, const char *chr, unsigned int mask,
+			 unsigned int watermark);
+int mpu_iio_close	(struct mpu_iio *io);
+int mpu_iio_next	(struct mpu_iio *io, int16_t *raw, unsigned int words, double *ts);
+
+#endif /* _MPU6050_IIO_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
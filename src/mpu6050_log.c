@@ -0,0 +1,528 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#define _GNU_SOURCE		/* for O_DIRECT */
+#include "mpu6050_log.h"
+#include "mpu6050_regs.h"
+
+#include <stdlib.h>		/* for calloc(), posix_memalign(), free() */
+#include <string.h>		/* for memset(), memcpy() */
+#include <errno.h>		/* for errno */
+#include <fcntl.h>		/* for open(), fcntl() */
+#include <unistd.h>		/* for pwrite(), close() */
+#include <pthread.h>		/* for pthread_create() etc */
+#include <tgmath.h>		/* for llround */
+
+#define LOG_ROUND(x) (((x) + MPU6050_LOG_BLK - 1) / MPU6050_LOG_BLK * MPU6050_LOG_BLK)
+#define LOG_ROOM (MPU6050_LOG_BLK - sizeof(struct mpu_log_blk))
+
+/* the producer fills head, the writer empties count blocks from tail */
+struct mpu_log_ring {
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	uint8_t		*buf;		/* MPU6050_LOG_RING aligned blocks	*/
+	unsigned int	head;		/* block being filled			*/
+	unsigned int	tail;		/* next block to write			*/
+	unsigned int	count;		/* blocks waiting for the writer	*/
+	bool		filling;	/* head holds frames			*/
+	bool		stop;		/* writer drains and exits		*/
+	off_t		off;		/* file offset of the next block	*/
+	uint32_t	seq;		/* next block number			*/
+	uint64_t	last_ns;	/* time of the last frame, as decoded	*/
+	bool		pack;		/* MPU6050_LOG_PACK			*/
+	unsigned int	staged;		/* frames waiting to be packed		*/
+	uint64_t	stage_ns;	/* time of the first staged frame	*/
+	uint16_t	step[MPU6050_LOG_GROUP];
+	int16_t		stage[MPU6050_LOG_GROUP][MPU6050_LOG_WORDS];
+	int16_t		prev[MPU6050_LOG_WORDS]; /* last frame in the block	*/
+};
+
+static void *mpu_log_writer(void *arg);
+static int mpu_log_pwrite(int fd, const uint8_t *buf, size_t len, off_t off);
+static struct mpu_log_blk *mpu_log_acquire(struct mpu_log_ring *r);
+static void mpu_log_submit(struct mpu_log_ring *r);
+static void mpu_log_seal(struct mpu_log *log);
+static int mpu_log_start(struct mpu_log *log, const int16_t *raw, unsigned int words, uint64_t ns);
+static int mpu_log_pack(struct mpu_log *log);
+static size_t mpu_log_pack_group(uint8_t *out, size_t room, struct mpu_log_ring *r,
+				 unsigned int first, unsigned int words);
+static inline unsigned int mpu_log_width(uint32_t v);
+
+int mpu_log_open(struct mpu_log *log, const char *path, struct mpu_dev *dev, int flags)
+{
+	if ((NULL == log) || (NULL == path) || (NULL == dev))
+		return -1;
+
+	memset(log, 0, sizeof(*log));
+	log->fd = -1;
+
+	size_t plen = 0;
+	if (mpu_get_params(dev, NULL, &plen) < 0)
+		return -1;
+
+	uint8_t *hb = NULL;
+	size_t data_off = MPU6050_LOG_BLK + LOG_ROUND(plen);
+	struct mpu_log_ring *r = calloc(1, sizeof(*r));
+	if ((NULL == r) ||
+	    posix_memalign((void **)&r->buf, MPU6050_LOG_BLK, MPU6050_LOG_RING * MPU6050_LOG_BLK) ||
+	    posix_memalign((void **)&hb, MPU6050_LOG_BLK, data_off))
+		goto log_open_error;
+
+	/* device description, then the parameter snapshot */
+	memset(hb, 0, data_off);
+	struct mpu_log_hdr *h = (struct mpu_log_hdr *)hb;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	memcpy(h->magic, MPU6050_LOG_MAGIC, sizeof(h->magic));
+	h->version    = MPU6050_LOG_VERSION;
+	h->blk_len    = MPU6050_LOG_BLK;
+	h->data_off   = data_off;
+	h->params_off = MPU6050_LOG_BLK;
+	h->params_len = plen;
+	h->words      = (uint32_t)dev->fifosensors;
+	h->t0_ns      = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	h->sr         = dev->sr;
+	h->albs       = dev->albs;
+	h->glbs       = dev->glbs;
+	if ((mpu_get_reg(dev, FIFO_EN, &h->fifo_en) < 0) ||
+	    (mpu_get_params(dev, hb + h->params_off, &plen) < 0))
+		goto log_open_error;
+
+	int fd = -1;
+	if (flags & MPU6050_LOG_DIRECT) {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+		log->direct = (fd >= 0);
+	}
+	if ((fd < 0) && ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0))
+		goto log_open_error;
+	log->fd = fd;
+
+	int res = mpu_log_pwrite(fd, hb, data_off, 0);
+	if ((res < 0) && log->direct && (EINVAL == errno)) {
+		/* accepted at open, refused at write: fall back to the page cache */
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+		log->direct = false;
+		res = mpu_log_pwrite(fd, hb, data_off, 0);
+	}
+	if (res < 0)
+		goto log_open_error;
+	free(hb);
+	hb = NULL;
+
+	r->off = data_off;
+	r->pack = (flags & MPU6050_LOG_PACK);
+	log->ring = r;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	if (pthread_create(&r->thread, NULL, mpu_log_writer, log)) {
+		pthread_mutex_destroy(&r->lock);
+		pthread_cond_destroy(&r->cond);
+		log->ring = NULL;
+		goto log_open_error;
+	}
+
+	return 0;
+
+log_open_error:
+	if (log->fd >= 0)
+		close(log->fd);
+	log->fd = -1;
+	if (NULL != r)
+		free(r->buf);
+	free(r);
+	free(hb);
+
+	return -1;
+}
+
+/*
+ * Append one frame sampled at ts seconds on CLOCK_MONOTONIC. Never
+ * blocks on the disk: with the ring full the frame is dropped, counted,
+ * and -1 returned.
+ */
+int mpu_log_frame(struct mpu_log *log, const int16_t *raw, unsigned int words, double ts)
+{
+	if ((NULL == log) || (NULL == log->ring) || (NULL == raw))
+		return -1;
+
+	if ((0 == words) || (2 + 2 * words > LOG_ROOM)) /* frame won't fit a block */
+		return -1;
+
+	struct mpu_log_ring *r = log->ring;
+	uint64_t ns = (uint64_t)llround(ts * 1e9);
+	size_t need = 2 + 2 * words;
+	uint64_t step = 0;
+
+	struct mpu_log_blk *b = NULL;
+	if (r->filling) {
+		b = (struct mpu_log_blk *)(r->buf + r->head * MPU6050_LOG_BLK);
+		step = (ns > r->last_ns) ? (ns - r->last_ns + 500) / 1000 : 0;
+		if ((b->words != words) || (step > UINT16_MAX) ||
+		    ((MPU6050_LOG_CODEC_PLAIN == b->codec) && (b->bytes + need > LOG_ROOM))) {
+			mpu_log_seal(log);
+			b = NULL;
+		}
+	}
+	if (NULL == b) /* first frame of a block, always plain */
+		return mpu_log_start(log, raw, words, ns);
+
+	if (MPU6050_LOG_CODEC_PACK == b->codec) {
+		if (0 == r->staged)
+			r->stage_ns = r->last_ns + step * 1000;
+		r->step[r->staged] = (uint16_t)step;
+		memcpy(r->stage[r->staged], raw, 2 * words);
+		r->last_ns += step * 1000;
+		log->frames++;
+		if ((++r->staged == MPU6050_LOG_GROUP) && (mpu_log_pack(log) < 0))
+			return -1;
+		return 0;
+	}
+
+	/* steps accumulate as decoded, rounding never drifts */
+	uint16_t s16 = (uint16_t)step;
+	uint8_t *p = (uint8_t *)(b + 1) + b->bytes;
+	memcpy(p, &s16, sizeof(s16));
+	memcpy(p + sizeof(s16), raw, 2 * words);
+	b->bytes += need;
+	b->frames++;
+	r->last_ns += step * 1000;
+	log->frames++;
+
+	return 0;
+}
+
+int mpu_log_close(struct mpu_log *log)
+{
+	if ((NULL == log) || (NULL == log->ring))
+		return -1;
+
+	struct mpu_log_ring *r = log->ring;
+	mpu_log_seal(log);
+
+	pthread_mutex_lock(&r->lock);
+	r->stop = true;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->thread, NULL);
+
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->cond);
+	free(r->buf);
+	free(r);
+	log->ring = NULL;
+
+	int ret = log->error ? -1 : 0;
+	if (close(log->fd) < 0)
+		ret = -1;
+	log->fd = -1;
+
+	return ret;
+}
+
+/* open a block with a plain frame at ns, the reference for what follows */
+static int mpu_log_start(struct mpu_log *log, const int16_t *raw, unsigned int words, uint64_t ns)
+{
+	struct mpu_log_ring *r = log->ring;
+	struct mpu_log_blk *b = mpu_log_acquire(r);
+	if (NULL == b) { /* writer behind */
+		log->dropped++;
+		return -1;
+	}
+
+	b->t0_ns = ns;
+	b->words = (uint8_t)words;
+	if (r->pack && (words <= MPU6050_LOG_WORDS)) {
+		b->codec = MPU6050_LOG_CODEC_PACK;
+		memcpy(r->prev, raw, 2 * words);
+	}
+	uint8_t *p = (uint8_t *)(b + 1);
+	memset(p, 0, 2);
+	memcpy(p + 2, raw, 2 * words);
+	b->bytes  = 2 + 2 * words;
+	b->frames = 1;
+	r->last_ns = ns;
+	r->staged  = 0;
+	log->frames++;
+
+	return 0;
+}
+
+/* pack what is staged and hand the head block to the writer */
+static void mpu_log_seal(struct mpu_log *log)
+{
+	struct mpu_log_ring *r = log->ring;
+	if (r->staged > 0)
+		mpu_log_pack(log);
+	if (r->filling)
+		mpu_log_submit(r);
+}
+
+/*
+ * Append the staged group to the head block. When it does not fit the
+ * block is submitted and the group opens the next one, its first frame
+ * plain; when the ring is full too the group is dropped.
+ */
+static int mpu_log_pack(struct mpu_log *log)
+{
+	struct mpu_log_ring *r = log->ring;
+	struct mpu_log_blk *b = (struct mpu_log_blk *)(r->buf + r->head * MPU6050_LOG_BLK);
+	unsigned int words = b->words;
+	unsigned int n = r->staged;
+
+	size_t len = mpu_log_pack_group((uint8_t *)(b + 1) + b->bytes, LOG_ROOM - b->bytes, r, 0, words);
+	if (len > 0) {
+		b->bytes  += len;
+		b->frames += n;
+		r->staged  = 0;
+		return 0;
+	}
+
+	mpu_log_submit(r);
+	uint64_t last_ns = r->last_ns;
+	log->frames -= n; /* counted again as they land */
+	if (mpu_log_start(log, r->stage[0], words, r->stage_ns) < 0) {
+		log->dropped += n - 1;
+		r->staged = 0;
+		return -1;
+	}
+	r->staged = n;
+	b = (struct mpu_log_blk *)(r->buf + r->head * MPU6050_LOG_BLK);
+	if (n > 1) { /* an empty block always holds a group */
+		len = mpu_log_pack_group((uint8_t *)(b + 1) + b->bytes, LOG_ROOM - b->bytes, r, 1, words);
+		b->bytes  += len;
+		b->frames += n - 1;
+		log->frames += n - 1;
+	}
+	r->last_ns = last_ns;
+	r->staged  = 0;
+
+	return 0;
+}
+
+/* encode staged frames from first on, 0 if they need more than room bytes */
+static size_t mpu_log_pack_group(uint8_t *out, size_t room, struct mpu_log_ring *r,
+				 unsigned int first, unsigned int words)
+{
+	unsigned int n = r->staged - first;
+	uint32_t zz[MPU6050_LOG_GROUP][MPU6050_LOG_WORDS + 1];
+	uint32_t any[MPU6050_LOG_WORDS + 1] = { 0 };
+	int16_t prev[MPU6050_LOG_WORDS];
+	memcpy(prev, (0 == first) ? r->prev : r->stage[0], 2 * words);
+
+	uint16_t base = UINT16_MAX;
+	for (unsigned int i = 0; i < n; i++)
+		base = (r->step[first + i] < base) ? r->step[first + i] : base;
+	for (unsigned int i = 0; i < n; i++) {
+		const int16_t *x = r->stage[first + i];
+		zz[i][0] = r->step[first + i] - base;
+		any[0] |= zz[i][0];
+		for (unsigned int c = 0; c < words; c++) {
+			int32_t d = (int32_t)x[c] - prev[c];
+			zz[i][1 + c] = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+			any[1 + c] |= zz[i][1 + c];
+			prev[c] = x[c];
+		}
+	}
+
+	uint8_t w[MPU6050_LOG_WORDS + 1];
+	size_t len = 1 + 2 + 1 + words;
+	for (unsigned int c = 0; c <= words; c++) {
+		w[c] = (uint8_t)mpu_log_width(any[c]);
+		len += (n * w[c] + 7) / 8;
+	}
+	if (len > room) /* next block */
+		return 0;
+
+	*out++ = (uint8_t)n;
+	memcpy(out, &base, sizeof(base));
+	out += sizeof(base);
+	memcpy(out, w, 1 + words);
+	out += 1 + words;
+	for (unsigned int c = 0; c <= words; c++) {
+		uint64_t acc = 0;
+		unsigned int bits = 0;
+		for (unsigned int i = 0; i < n; i++) {
+			acc |= (uint64_t)zz[i][c] << bits;
+			for (bits += w[c]; bits >= 8; bits -= 8, acc >>= 8)
+				*out++ = (uint8_t)acc;
+		}
+		if (bits > 0)
+			*out++ = (uint8_t)acc;
+	}
+	memcpy(r->prev, prev, 2 * words);
+
+	return len;
+}
+
+static inline unsigned int mpu_log_width(uint32_t v)
+{
+	return (0 == v) ? 0 : 32 - (unsigned int)__builtin_clz(v);
+}
+
+/*
+ * Decode a block's payload into plain frames, step then words, in out,
+ * len bytes long: frames times 2 + 2 * words at least.
+ */
+int mpu_log_unpack(const struct mpu_log_blk *b, uint8_t *out, size_t len)
+{
+	if ((NULL == b) || (NULL == out))
+		return -1;
+
+	unsigned int words = b->words;
+	size_t stride = 2 + 2 * (size_t)words;
+	if ((0 == words) || (0 == b->frames) || (b->bytes > LOG_ROOM) ||
+	    (b->bytes < stride) || (len < b->frames * stride))
+		return -1;
+
+	const uint8_t *p = (const uint8_t *)(b + 1);
+	const uint8_t *end = p + b->bytes;
+	if (MPU6050_LOG_CODEC_PLAIN == b->codec) {
+		if (b->frames * stride > b->bytes) /* truncated */
+			return -1;
+		memcpy(out, p, b->frames * stride);
+		return 0;
+	}
+	if ((MPU6050_LOG_CODEC_PACK != b->codec) || (words > MPU6050_LOG_WORDS))
+		return -1;
+
+	int16_t prev[MPU6050_LOG_WORDS];
+	memcpy(out, p, stride);
+	memcpy(prev, p + 2, 2 * words);
+	p   += stride;
+	out += stride;
+
+	for (unsigned int k = 1; k < b->frames; ) {
+		if ((size_t)(end - p) < 4 + words) /* truncated */
+			return -1;
+		unsigned int n = *p++;
+		uint16_t base;
+		memcpy(&base, p, sizeof(base));
+		p += sizeof(base);
+		const uint8_t *w = p;
+		p += 1 + words;
+		if ((0 == n) || (n > MPU6050_LOG_GROUP) || (k + n > b->frames))
+			return -1;
+
+		for (unsigned int c = 0; c <= words; c++) {
+			size_t nb = (n * w[c] + 7) / 8;
+			if ((w[c] > 17) || ((size_t)(end - p) < nb)) /* wider than a delta */
+				return -1;
+
+			uint32_t v[MPU6050_LOG_GROUP];
+			uint32_t mask = (1U << w[c]) - 1;
+			uint64_t acc = 0;
+			unsigned int bits = 0;
+			const uint8_t *q = p;
+			for (unsigned int i = 0; i < n; i++) {
+				for (; bits < w[c]; bits += 8)
+					acc |= (uint64_t)*q++ << bits;
+				v[i] = (uint32_t)acc & mask;
+				acc >>= w[c];
+				bits -= w[c];
+			}
+			p += nb;
+
+			uint8_t *o = out + 2 * c;
+			if (0 == c) {
+				for (unsigned int i = 0; i < n; i++, o += stride) {
+					uint16_t step = (uint16_t)(base + v[i]);
+					memcpy(o, &step, sizeof(step));
+				}
+				continue;
+			}
+			int16_t x = prev[c - 1];
+			for (unsigned int i = 0; i < n; i++, o += stride) {
+				x = (int16_t)(x + (int32_t)((v[i] >> 1) ^ -(v[i] & 1)));
+				memcpy(o, &x, sizeof(x));
+			}
+			prev[c - 1] = x;
+		}
+		out += n * stride;
+		k   += n;
+	}
+
+	return 0;
+}
+
+static struct mpu_log_blk *mpu_log_acquire(struct mpu_log_ring *r)
+{
+	pthread_mutex_lock(&r->lock);
+	bool full = (MPU6050_LOG_RING == r->count);
+	pthread_mutex_unlock(&r->lock);
+	if (full)
+		return NULL;
+
+	/* head is ours until submitted, no lock needed to fill it */
+	struct mpu_log_blk *b = (struct mpu_log_blk *)(r->buf + r->head * MPU6050_LOG_BLK);
+	memset(b, 0, MPU6050_LOG_BLK);
+	b->magic = MPU6050_LOG_BLK_MAGIC;
+	b->seq   = r->seq++;
+	r->filling = true;
+
+	return b;
+}
+
+static void mpu_log_submit(struct mpu_log_ring *r)
+{
+	pthread_mutex_lock(&r->lock);
+	r->head = (r->head + 1) % MPU6050_LOG_RING;
+	r->count++;
+	r->filling = false;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+}
+
+/* write contiguous runs of queued blocks, one system call each */
+static void *mpu_log_writer(void *arg)
+{
+	struct mpu_log *log = arg;
+	struct mpu_log_ring *r = log->ring;
+
+	pthread_mutex_lock(&r->lock);
+	for (;;) {
+		while ((0 == r->count) && !r->stop)
+			pthread_cond_wait(&r->cond, &r->lock);
+		if (0 == r->count) /* stopped and drained */
+			break;
+
+		unsigned int t = r->tail;
+		unsigned int n = r->count;
+		if (t + n > MPU6050_LOG_RING) /* up to the wrap */
+			n = MPU6050_LOG_RING - t;
+		pthread_mutex_unlock(&r->lock);
+
+		int res = mpu_log_pwrite(log->fd, r->buf + t * MPU6050_LOG_BLK, n * MPU6050_LOG_BLK, r->off);
+
+		pthread_mutex_lock(&r->lock);
+		if (res < 0) {
+			if (0 == log->error)
+				log->error = errno;
+		} else {
+			log->blocks += n;
+		}
+		r->off  += (off_t)n * MPU6050_LOG_BLK;
+		r->tail  = (t + n) % MPU6050_LOG_RING;
+		r->count -= n;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	return NULL;
+}
+
+static int mpu_log_pwrite(int fd, const uint8_t *buf, size_t len, off_t off)
+{
+	errno = 0;
+	while (len > 0) {
+		ssize_t w = pwrite(fd, buf, len, off);
+		if (w < 0) {
+			if (EINTR == errno)
+				continue;
+			return -1;
+		}
+		buf += w;
+		off += w;
+		len -= (size_t)w;
+	}
+
+	return 0;
+}
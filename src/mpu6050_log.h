@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_LOG_H_
+#define _MPU6050_LOG_H_
+#include "mpu6050_core.h"
+
+#include <stddef.h>		/* for size_t */
+
+/*
+ * Binary recording of raw fifo frames
+ *
+ * File layout, little-endian, every part a multiple of BLK bytes so the
+ * writer can bypass the page cache with O_DIRECT:
+ *
+ *	struct mpu_log_hdr	device description
+ *	params			mpu_get_params() snapshot, zero padded
+ *	block 0 .. n		struct mpu_log_blk then frames, zero padded
+ *
+ * A frame is a uint16_t time step in microseconds, zero for the first
+ * frame of a block, followed by the block's words int16_t raw readings
+ * in fifo order. A block closes when full, when a step overflows or
+ * when the frame layout changes; the next one restarts the clock at t0.
+ *
+ * Frames are appended from the acquisition thread into a ring of blocks;
+ * a writer thread empties it. When the disk falls behind frames are
+ * dropped and counted rather than stalling acquisition.
+ *
+ * Packed blocks, codec MPU6050_LOG_CODEC_PACK, keep the first frame as
+ * above and store the rest in groups of up to GROUP frames:
+ *
+ *	uint8_t		frames in the group
+ *	uint16_t	smallest time step of the group
+ *	uint8_t		bit width of each of the 1 + words channels
+ *	channel 0	time steps above the smallest
+ *	channel 1 ..	zigzag deltas from the previous frame
+ *
+ * every channel bit-packed LSB first and padded to a byte. Sensor noise
+ * needs a few bits per word where plain frames spend sixteen.
+ */
+#define MPU6050_LOG_MAGIC	"MPU6050L"
+#define MPU6050_LOG_BLK_MAGIC	0x4255504dU	/* "MPUB"		*/
+#define MPU6050_LOG_VERSION	1
+#define MPU6050_LOG_BLK		4096	/* bytes per block, O_DIRECT aligned */
+#ifndef MPU6050_LOG_RING
+#define MPU6050_LOG_RING	64	/* blocks buffered for the writer */
+#endif
+
+#define MPU6050_LOG_GROUP	32	/* frames per packed group	*/
+#define MPU6050_LOG_WORDS	32	/* widest frame that is packed	*/
+
+/* flags for mpu_log_open() */
+#define MPU6050_LOG_DIRECT	0x01	/* O_DIRECT, buffered if unsupported */
+#define MPU6050_LOG_PACK	0x02	/* delta, zigzag and bit-pack frames */
+
+/* block payload encodings */
+#define MPU6050_LOG_CODEC_PLAIN	0
+#define MPU6050_LOG_CODEC_PACK	1
+
+struct mpu_log_hdr {
+	char	 magic[8];	/* MPU6050_LOG_MAGIC			*/
+	uint32_t version;	/* MPU6050_LOG_VERSION			*/
+	uint32_t blk_len;	/* MPU6050_LOG_BLK			*/
+	uint32_t data_off;	/* offset of block 0			*/
+	uint32_t params_off;	/* offset of the parameter snapshot	*/
+	uint32_t params_len;	/* bytes of the parameter snapshot	*/
+	uint32_t words;		/* words per frame at open		*/
+	uint64_t t0_ns;		/* CLOCK_MONOTONIC at open (ns)		*/
+	double	 sr;		/* sampling rate (Hz)			*/
+	double	 albs;		/* accelerometer LSB per g		*/
+	double	 glbs;		/* gyroscope LSB per degree/s		*/
+	uint8_t	 fifo_en;	/* FIFO_EN register			*/
+	uint8_t	 pad[7];
+};
+
+struct mpu_log_blk {
+	uint32_t magic;		/* MPU6050_LOG_BLK_MAGIC		*/
+	uint32_t seq;		/* block number				*/
+	uint64_t t0_ns;		/* first frame time (ns)		*/
+	uint16_t frames;	/* frames in the block			*/
+	uint16_t bytes;		/* payload bytes after this header	*/
+	uint8_t	 words;		/* words per frame			*/
+	uint8_t	 codec;		/* MPU6050_LOG_CODEC_x			*/
+	uint16_t pad;
+};
+
+struct mpu_log_ring;
+
+struct mpu_log {
+	int	fd;		/* output file				*/
+	bool	direct;		/* O_DIRECT in effect			*/
+	unsigned long long frames;  /* frames accepted			*/
+	unsigned long long dropped; /* frames lost, ring full		*/
+	unsigned long long blocks;  /* blocks written			*/
+	int	error;		/* errno of the first failed write	*/
+	struct mpu_log_ring *ring;  /* blocks and writer thread		*/
+};
+
+int mpu_log_open	(struct mpu_log *log, const char *path, struct mpu_dev *dev, int flags);
+int mpu_log_frame	(struct mpu_log *log, const int16_t *raw, unsigned int words, double ts);
+int mpu_log_close	(struct mpu_log *log);
+int mpu_log_unpack	(const struct mpu_log_blk *b, uint8_t *out, size_t len);
+
+#endif /* _MPU6050_LOG_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -224,6 +224,13 @@
 #define AFS_SEL_1		(uint8_t)(0x08u) /* ACCEL_CONFIG */
 #define AFS_SEL_2		(uint8_t)(0x10u) /* ACCEL_CONFIG */
 #define AFS_SEL_3		(uint8_t)(0x18u) /* ACCEL_CONFIG */
+#define ACCEL_HPF_BIT		(uint8_t)(0x07u) /* ACCEL_CONFIG */
+#define ACCEL_HPF_0		(uint8_t)(0x00u) /* ACCEL_CONFIG */
+#define ACCEL_HPF_1		(uint8_t)(0x01u) /* ACCEL_CONFIG */
+#define ACCEL_HPF_2		(uint8_t)(0x02u) /* ACCEL_CONFIG */
+#define ACCEL_HPF_3		(uint8_t)(0x03u) /* ACCEL_CONFIG */
+#define ACCEL_HPF_4		(uint8_t)(0x04u) /* ACCEL_CONFIG */
+#define ACCEL_HPF_7		(uint8_t)(0x07u) /* ACCEL_CONFIG */
 
 #define TEMP_FIFO_EN_BIT	(uint8_t)(0x80u) /* FIFO_EN */
 #define XG_FIFO_EN_BIT		(uint8_t)(0x40u) /* FIFO_EN */
@@ -242,14 +249,32 @@
 #define FSYNC_INT_EN_BIT	(uint8_t)(0x04u) /* INT_PIN_CFG */
 #define I2C_BYPASS_EN_BIT	(uint8_t)(0x02u) /* INT_PIN_CFG */
 
+#define FF_EN_BIT		(uint8_t)(0x80u) /* INT_ENABLE */
+#define MOT_EN_BIT		(uint8_t)(0x40u) /* INT_ENABLE */
+#define ZMOT_EN_BIT		(uint8_t)(0x20u) /* INT_ENABLE */
 #define FIFO_OFLOW_EN_BIT	(uint8_t)(0x10u) /* INT_ENABLE */
 #define I2C_MST_INT_EN_BIT	(uint8_t)(0x08u) /* INT_ENABLE */
 #define DATA_RDY_EN_BIT		(uint8_t)(0x01u) /* INT_ENABLE */
 
+#define FF_INT_BIT		(uint8_t)(0x80u) /* INT_STATUS */
+#define MOT_INT_BIT		(uint8_t)(0x40u) /* INT_STATUS */
+#define ZMOT_INT_BIT		(uint8_t)(0x20u) /* INT_STATUS */
 #define FIFO_OFLOW_INT_BIT	(uint8_t)(0x10u) /* INT_STATUS */
 #define I2C_MST_INT_BIT		(uint8_t)(0x08u) /* INT_STATUS */
 #define DATA_RDY_INT_BIT	(uint8_t)(0x01u) /* INT_STATUS */
 
+#define MOT_XNEG_BIT		(uint8_t)(0x80u) /* MOT_DETECT_STATUS */
+#define MOT_XPOS_BIT		(uint8_t)(0x40u) /* MOT_DETECT_STATUS */
+#define MOT_YNEG_BIT		(uint8_t)(0x20u) /* MOT_DETECT_STATUS */
+#define MOT_YPOS_BIT		(uint8_t)(0x10u) /* MOT_DETECT_STATUS */
+#define MOT_ZNEG_BIT		(uint8_t)(0x08u) /* MOT_DETECT_STATUS */
+#define MOT_ZPOS_BIT		(uint8_t)(0x04u) /* MOT_DETECT_STATUS */
+#define MOT_ZRMOT_BIT		(uint8_t)(0x01u) /* MOT_DETECT_STATUS */
+
+#define ACCEL_ON_DELAY_BIT	(uint8_t)(0x30u) /* MOT_DETECT_CTRL */
+#define FF_COUNT_BIT		(uint8_t)(0x0Cu) /* MOT_DETECT_CTRL */
+#define MOT_COUNT_BIT		(uint8_t)(0x03u) /* MOT_DETECT_CTRL */
+
 #define MULT_MST_EN_BIT		(uint8_t)(0x80u) /* I2C_MST_CTRL */
 #define WAIT_FOR_ES_BIT		(uint8_t)(0x40u) /* I2C_MST_CTRL */
 #define SLV3_FIFO_EN_BIT	(uint8_t)(0x20u) /* I2C_MST_CTRL */
@@ -272,5 +297,35 @@
 #define I2C_MST_CLK_14		(uint8_t)(0x0Eu) /* I2C_MST_CTRL */
 #define I2C_MST_CLK_15		(uint8_t)(0x0Fu) /* I2C_MST_CTRL */
 
+#define I2C_SLV_RW_BIT		(uint8_t)(0x80u) /* I2C_SLV0_ADDR to I2C_SLV4_ADDR */
+#define I2C_SLV_ADDR_BIT	(uint8_t)(0x7Fu) /* I2C_SLV0_ADDR to I2C_SLV4_ADDR */
+
+#define I2C_SLV_EN_BIT		(uint8_t)(0x80u) /* I2C_SLV0_CTRL to I2C_SLV3_CTRL */
+#define I2C_SLV_BYTE_SW_BIT	(uint8_t)(0x40u) /* I2C_SLV0_CTRL to I2C_SLV3_CTRL */
+#define I2C_SLV_REG_DIS_BIT	(uint8_t)(0x20u) /* I2C_SLV0_CTRL to I2C_SLV3_CTRL */
+#define I2C_SLV_GRP_BIT		(uint8_t)(0x10u) /* I2C_SLV0_CTRL to I2C_SLV3_CTRL */
+#define I2C_SLV_LEN_BIT		(uint8_t)(0x0Fu) /* I2C_SLV0_CTRL to I2C_SLV3_CTRL */
+
+#define I2C_SLV4_EN_BIT		(uint8_t)(0x80u) /* I2C_SLV4_CTRL */
+#define I2C_SLV4_INT_EN_BIT	(uint8_t)(0x40u) /* I2C_SLV4_CTRL */
+#define I2C_SLV4_REG_DIS_BIT	(uint8_t)(0x20u) /* I2C_SLV4_CTRL */
+#define I2C_MST_DLY_BIT		(uint8_t)(0x1Fu) /* I2C_SLV4_CTRL */
+
+#define PASS_THROUGH_BIT	(uint8_t)(0x80u) /* I2C_MST_STATUS */
+#define I2C_SLV4_DONE_BIT	(uint8_t)(0x40u) /* I2C_MST_STATUS */
+#define I2C_LOST_ARB_BIT	(uint8_t)(0x20u) /* I2C_MST_STATUS */
+#define I2C_SLV4_NACK_BIT	(uint8_t)(0x10u) /* I2C_MST_STATUS */
+#define I2C_SLV3_NACK_BIT	(uint8_t)(0x08u) /* I2C_MST_STATUS */
+#define I2C_SLV2_NACK_BIT	(uint8_t)(0x04u) /* I2C_MST_STATUS */
+#define I2C_SLV1_NACK_BIT	(uint8_t)(0x02u) /* I2C_MST_STATUS */
+#define I2C_SLV0_NACK_BIT	(uint8_t)(0x01u) /* I2C_MST_STATUS */
+
+#define DELAY_ES_SHADOW_BIT	(uint8_t)(0x80u) /* I2C_MST_DELAY_CTRL */
+#define I2C_SLV4_DLY_EN_BIT	(uint8_t)(0x10u) /* I2C_MST_DELAY_CTRL */
+#define I2C_SLV3_DLY_EN_BIT	(uint8_t)(0x08u) /* I2C_MST_DELAY_CTRL */
+#define I2C_SLV2_DLY_EN_BIT	(uint8_t)(0x04u) /* I2C_MST_DELAY_CTRL */
+#define I2C_SLV1_DLY_EN_BIT	(uint8_t)(0x02u) /* I2C_MST_DELAY_CTRL */
+#define I2C_SLV0_DLY_EN_BIT	(uint8_t)(0x01u) /* I2C_MST_DELAY_CTRL */
+
 #endif /* __MPU6050_CORE_REGS_H_ */
 
@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_replay.h"
+#include "mpu6050_time.h"
+
+#include <stdlib.h>		/* for malloc(), free() */
+#include <string.h>		/* for memset(), memcmp(), memcpy() */
+#include <errno.h>		/* for EINTR */
+#include <fcntl.h>		/* for open() */
+#include <unistd.h>		/* for close() */
+#include <time.h>		/* for clock_nanosleep() */
+#include <sys/mman.h>		/* for mmap(), munmap(), madvise() */
+#include <sys/stat.h>		/* for fstat() */
+
+static inline const struct mpu_log_blk *mpu_replay_blk(const struct mpu_replay *rp);
+static int mpu_replay_index(struct mpu_replay *rp);
+static int mpu_replay_load(struct mpu_replay *rp);
+static void mpu_replay_pace(struct mpu_replay *rp, double ts);
+
+int mpu_replay_open(struct mpu_replay *rp, const char *path, int flags)
+{
+	if ((NULL == rp) || (NULL == path))
+		return -1;
+
+	memset(rp, 0, sizeof(*rp));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) /* no such log */
+		return -1;
+
+	struct stat st;
+	if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(struct mpu_log_hdr))) {
+		close(fd);
+		return -1;
+	}
+
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); /* the mapping holds the file */
+	if (MAP_FAILED == map)
+		return -1;
+	rp->map = map;
+	rp->len = (size_t)st.st_size;
+	madvise(map, rp->len, MADV_SEQUENTIAL);
+
+	const struct mpu_log_hdr *h = (const struct mpu_log_hdr *)rp->map;
+	if (memcmp(h->magic, MPU6050_LOG_MAGIC, sizeof(h->magic)) ||
+	    (MPU6050_LOG_VERSION != h->version) || (MPU6050_LOG_BLK != h->blk_len) ||
+	    (h->data_off > rp->len) || (h->params_off + (size_t)h->params_len > h->data_off) ||
+	    (0 == h->words) || (2 + 2 * h->words > MPU6050_LOG_BLK - sizeof(struct mpu_log_blk)))
+		goto replay_open_error; /* not a log, or not one we can read */
+	rp->hdr   = h;
+	rp->words = h->words;
+	rp->flags = flags;
+
+	if (mpu_replay_index(rp) < 0)
+		goto replay_open_error;
+
+	if (mpu_replay_seek(rp, 0) < 0)
+		goto replay_open_error;
+
+	return 0;
+
+replay_open_error:
+	mpu_replay_close(rp);
+
+	return -1;
+}
+
+int mpu_replay_close(struct mpu_replay *rp)
+{
+	if ((NULL == rp) || (NULL == rp->map))
+		return -1;
+
+	free(rp->idx);
+	free(rp->buf);
+	int ret = munmap((void *)rp->map, rp->len);
+	memset(rp, 0, sizeof(*rp));
+
+	return ret;
+}
+
+/* position at the first frame sampled at or after ts seconds */
+int mpu_replay_seek(struct mpu_replay *rp, double ts)
+{
+	if ((NULL == rp) || (NULL == rp->map))
+		return -1;
+
+	uint64_t ns = 0;
+	if (ts >= 18e9) /* past any recording, and past uint64_t */
+		ns = UINT64_MAX;
+	else if (ts > 0)
+		ns = (uint64_t)(ts * 1e9 + 0.5);
+
+	/* last block starting at or before ns */
+	size_t lo = 0, hi = rp->blocks;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (rp->idx[mid].t0_ns <= ns)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	rp->blk   = lo;
+	rp->frame = 0;
+	rp->eof   = (0 == rp->blocks);
+	rp->gap   = true;
+	rp->pace_wall = 0;
+	if (rp->eof)
+		return 0;
+
+	/* then frame by frame, steps only */
+	const struct mpu_log_blk *b = mpu_replay_blk(rp);
+	size_t stride = 2 + 2 * (size_t)b->words;
+	rp->ns = b->t0_ns;
+	if (mpu_replay_load(rp) < 0) /* corrupt block */
+		return -1;
+	while (rp->ns < ns) {
+		if (++rp->frame == b->frames) { /* next block starts after ns */
+			rp->frame = 0;
+			if (++rp->blk == rp->blocks)
+				rp->eof = true;
+			else
+				rp->ns = mpu_replay_blk(rp)->t0_ns;
+			return rp->eof ? 0 : mpu_replay_load(rp);
+		}
+		uint16_t step;
+		memcpy(&step, rp->cur + rp->frame * stride, sizeof(step));
+		rp->ns += 1000ULL * step;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy the next frame to raw, words long, and its recorded time to ts.
+ * Fails at the end of the log, and on blocks whose layout differs.
+ */
+int mpu_replay_next(struct mpu_replay *rp, int16_t *raw, unsigned int words, double *ts)
+{
+	if ((NULL == rp) || (NULL == rp->map) || (NULL == raw) || (NULL == ts))
+		return -1;
+
+	if (rp->eof) /* nothing left */
+		return -1;
+
+	const struct mpu_log_blk *b = mpu_replay_blk(rp);
+	if (b->words != words) /* recorded with another layout */
+		return -1;
+
+	if (NULL == rp->cur) /* block failed to decode */
+		return -1;
+
+	size_t stride = 2 + 2 * (size_t)words;
+	const uint8_t *p = rp->cur + rp->frame * stride;
+	memcpy(raw, p + 2, 2 * (size_t)words);
+	*ts = rp->ns * 1e-9;
+
+	if (++rp->frame == b->frames) { /* ns follows the next frame */
+		rp->frame = 0;
+		if (++rp->blk == rp->blocks) {
+			rp->eof = true;
+		} else {
+			rp->ns = mpu_replay_blk(rp)->t0_ns;
+			mpu_replay_load(rp);
+		}
+	} else {
+		uint16_t step;
+		memcpy(&step, p + stride, sizeof(step));
+		rp->ns += 1000ULL * step;
+	}
+	rp->frames++;
+	rp->gap = false;
+
+	if (rp->flags & MPU6050_REPLAY_REALTIME)
+		mpu_replay_pace(rp, *ts);
+
+	return 0;
+}
+
+/* up to n frames, raw holds n * words values and ts n times */
+int mpu_replay_read(struct mpu_replay *rp, int16_t *raw, double *ts, size_t n, size_t *nread)
+{
+	if ((NULL == rp) || (NULL == raw) || (NULL == ts) || (NULL == nread))
+		return -1;
+
+	size_t k = 0;
+	for (; (k < n) && !rp->eof; k++, raw += rp->words) {
+		if (mpu_replay_next(rp, raw, rp->words, &ts[k]) < 0)
+			break;
+	}
+	*nread = k;
+
+	return ((0 == k) && (n > 0)) ? -1 : 0;
+}
+
+static inline const struct mpu_log_blk *mpu_replay_blk(const struct mpu_replay *rp)
+{
+	return (const struct mpu_log_blk *)(rp->map + rp->idx[rp->blk].off);
+}
+
+/* blocks a failed write left blank, or torn at the end, are skipped */
+static int mpu_replay_index(struct mpu_replay *rp)
+{
+	const struct mpu_log_hdr *h = rp->hdr;
+	size_t n = (rp->len - h->data_off) / MPU6050_LOG_BLK;
+	if (0 == n) /* empty recording */
+		return 0;
+
+	if (NULL == (rp->idx = malloc(n * sizeof(*rp->idx))))
+		return -1;
+
+	const size_t room = MPU6050_LOG_BLK - sizeof(struct mpu_log_blk);
+	bool sorted = true;
+	for (size_t i = 0; i < n; i++) {
+		size_t off = h->data_off + i * MPU6050_LOG_BLK;
+		const struct mpu_log_blk *b = (const struct mpu_log_blk *)(rp->map + off);
+		size_t plain = (size_t)b->frames * (2 + 2 * b->words);
+		if ((MPU6050_LOG_BLK_MAGIC != b->magic) || (0 == b->frames) || (0 == b->words) ||
+		    (b->bytes > room) || (b->codec > MPU6050_LOG_CODEC_PACK) ||
+		    ((MPU6050_LOG_CODEC_PLAIN == b->codec) && (plain > b->bytes)))
+			continue;
+		if ((MPU6050_LOG_CODEC_PACK == b->codec) && (plain > rp->buf_len))
+			rp->buf_len = plain;
+		if ((rp->blocks > 0) && (b->t0_ns < rp->idx[rp->blocks - 1].t0_ns))
+			sorted = false;
+		rp->idx[rp->blocks].t0_ns = b->t0_ns;
+		rp->idx[rp->blocks].off = off;
+		rp->blocks++;
+	}
+
+	if (!sorted) /* the clock went backwards, seeking can't work */
+		return -1;
+
+	if ((rp->buf_len > 0) && (NULL == (rp->buf = malloc(rp->buf_len))))
+		return -1;
+
+	return 0;
+}
+
+/* point cur at the frames of the current block, decoding packed ones */
+static int mpu_replay_load(struct mpu_replay *rp)
+{
+	const struct mpu_log_blk *b = mpu_replay_blk(rp);
+
+	rp->cur = NULL;
+	if (MPU6050_LOG_CODEC_PLAIN == b->codec) {
+		rp->cur = (const uint8_t *)(b + 1);
+		return 0;
+	}
+	if (mpu_log_unpack(b, rp->buf, rp->buf_len) < 0)
+		return -1;
+	rp->cur = rp->buf;
+
+	return 0;
+}
+
+/* sleep until ts is due, the recording clock mapped onto ours */
+static void mpu_replay_pace(struct mpu_replay *rp, double ts)
+{
+	if (0 == rp->pace_wall) { /* first frame after open or seek */
+		rp->pace_wall = mpu_clock();
+		rp->pace_ts = ts;
+		return;
+	}
+
+	double due = rp->pace_wall + (ts - rp->pace_ts);
+	struct timespec at = {
+		.tv_sec  = (time_t)due,
+		.tv_nsec = (long)((due - (time_t)due) * 1e9),
+	};
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL))
+		;
+}
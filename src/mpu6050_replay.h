@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_REPLAY_H_
+#define _MPU6050_REPLAY_H_
+#include "mpu6050_core.h"
+#include "mpu6050_log.h"
+
+#include <stddef.h>		/* for size_t */
+
+/*
+ * Replay of a binary log, see mpu6050_log.h
+ *
+ * The file is mapped read only and frames are decoded in place. Opening
+ * walks the block headers once and keeps the first frame time of every
+ * valid block, sorted, so seeking by time is a binary search followed by
+ * a scan of one block.
+ *
+ * Packed blocks are decoded whole when the replay enters them, into a
+ * buffer sized at open for the largest one.
+ *
+ * mpu_init_replay() builds a device from the recorded configuration and
+ * calibration: mpu_get_data(), the decimator, fusion and the log hooks
+ * then run on recorded frames with their recorded timestamps, either as
+ * fast as they can be decoded or paced to the recording clock.
+ */
+#define MPU6050_REPLAY_REALTIME	0x01	/* pace frames to their timestamps */
+
+struct mpu_replay_idx {
+	uint64_t t0_ns;		/* first frame time (ns)		*/
+	size_t	off;		/* block offset in the file		*/
+};
+
+struct mpu_replay {
+	const uint8_t *map;	/* the whole file, read only		*/
+	size_t	len;		/* mapped bytes				*/
+	const struct mpu_log_hdr *hdr;	/* device description		*/
+	unsigned int words;	/* words per frame			*/
+	int	flags;		/* MPU6050_REPLAY_x			*/
+	struct	mpu_replay_idx *idx; /* valid blocks in time order	*/
+	size_t	blocks;		/* entries in idx			*/
+	size_t	blk;		/* index entry being read		*/
+	const uint8_t *cur;	/* its frames, plain			*/
+	uint8_t	*buf;		/* packed blocks decoded		*/
+	size_t	buf_len;	/* bytes in buf				*/
+	unsigned int frame;	/* next frame in that block		*/
+	uint64_t ns;		/* time of the next frame (ns)		*/
+	double	pace_ts;	/* recorded time at the pacing origin	*/
+	double	pace_wall;	/* CLOCK_MONOTONIC at the pacing origin	*/
+	bool	gap;		/* seeked, time does not follow on	*/
+	bool	eof;		/* every frame returned			*/
+	unsigned long long frames; /* frames returned			*/
+};
+
+int mpu_replay_open	(struct mpu_replay *rp, const char *path, int flags);
+int mpu_replay_close	(struct mpu_replay *rp);
+int mpu_replay_seek	(struct mpu_replay *rp, double ts);
+int mpu_replay_next	(struct mpu_replay *rp, int16_t *raw, unsigned int words, double *ts);
+int mpu_replay_read	(struct mpu_replay *rp, int16_t *raw, double *ts, size_t n, size_t *nread);
+
+#endif /* _MPU6050_REPLAY_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#define _GNU_SOURCE		/* for CPU_SET(), pthread_setaffinity_np() */
+#include "mpu6050_rt.h"
+#include "mpu6050_time.h"
+
+#include <malloc.h>		/* for mallopt() */
+#include <math.h>		/* for INFINITY */
+#include <pthread.h>		/* for pthread_setschedparam() */
+#include <sched.h>		/* for cpu_set_t, SCHED_FIFO */
+#include <stdlib.h>		/* for malloc(), free() */
+#include <string.h>		/* for memset() */
+#include <sys/mman.h>		/* for mlockall(), munlockall() */
+
+#define MPU6050_RT_TRIM		(128 * 1024)	/* glibc M_TRIM_THRESHOLD */
+#define MPU6050_RT_MMAP		65536		/* glibc M_MMAP_MAX	*/
+
+static void mpu_rt_prefault_stack(void);
+static int mpu_rt_prefault_heap(struct mpu_rt *rt);
+static int mpu_rt_undo(struct mpu_rt *rt);
+
+/*
+ * Pin the calling thread to cpu, -1 leaves it where it is, raise it to
+ * SCHED_FIFO prio, 0 leaves the scheduling alone, lock and prefault the
+ * process memory, then attach rt to dev. Needs CAP_SYS_NICE for prio
+ * and CAP_IPC_LOCK, or a large enough RLIMIT_MEMLOCK, for the locking.
+ * A failure undoes what was done.
+ */
+int mpu_rt_start(struct mpu_rt *rt, struct mpu_dev *dev, int cpu, int prio)
+{
+	if ((NULL == rt) || (NULL == dev))
+		return -1;
+
+	if ((prio < 0) || ((prio > 0) && (prio < sched_get_priority_min(SCHED_FIFO))) ||
+	    (prio > sched_get_priority_max(SCHED_FIFO))) /* out of range */
+		return -1;
+
+	memset(rt, 0, sizeof(*rt));
+	rt->cpu = -1; /* each set once it took */
+	mpu_rt_reset(rt);
+
+	pthread_t self = pthread_self();
+	struct sched_param sp;
+	if (pthread_getschedparam(self, &rt->policy, &sp))
+		return -1;
+	rt->sched_prio = sp.sched_priority;
+
+	if (cpu >= 0) {
+		_Static_assert(sizeof(rt->affinity) >= sizeof(cpu_set_t), "affinity too small");
+		cpu_set_t set;
+		if (pthread_getaffinity_np(self, sizeof(set), &set))
+			return -1;
+		memcpy(rt->affinity, &set, sizeof(set));
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (pthread_setaffinity_np(self, sizeof(set), &set)) /* no such core */
+			return -1;
+		rt->pinned = true;
+		rt->cpu = cpu;
+	}
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) /* not allowed */
+		goto mpu_rt_start_error;
+	rt->locked = true;
+	if (mpu_rt_prefault_heap(rt) < 0)
+		goto mpu_rt_start_error;
+	mpu_rt_prefault_stack();
+
+	if (prio > 0) {
+		sp.sched_priority = prio;
+		if (pthread_setschedparam(self, SCHED_FIFO, &sp)) /* not allowed */
+			goto mpu_rt_start_error;
+		rt->prio = prio;
+	}
+
+	if (mpu_ctl_rt(dev, rt) < 0)
+		goto mpu_rt_start_error;
+
+	return 0;
+
+mpu_rt_start_error:
+	mpu_rt_undo(rt);
+
+	return -1;
+}
+
+/* detach, writing what configuration changed, and restore scheduling */
+int mpu_rt_stop(struct mpu_rt *rt, struct mpu_dev *dev)
+{
+	if ((NULL == rt) || (NULL == dev))
+		return -1;
+
+	int ret = mpu_ctl_rt(dev, NULL);
+	if (mpu_rt_undo(rt) < 0)
+		ret = -1;
+
+	return ret;
+}
+
+/* time the reading dev holds, mpu_get_data() calls it while attached */
+int mpu_rt_account(struct mpu_rt *rt, struct mpu_dev *dev)
+{
+	if ((NULL == rt) || (NULL == dev))
+		return -1;
+
+	double lat = mpu_clock() - dev->ts;
+	lat = (lat > 0) ? lat : 0;
+
+	rt->loops++;
+	rt->lat_sum += lat;
+	rt->lat_min  = (lat < rt->lat_min) ? lat : rt->lat_min;
+	rt->lat_max  = (lat > rt->lat_max) ? lat : rt->lat_max;
+	if (lat > dev->st)
+		rt->overruns++;
+
+	unsigned long us = (unsigned long)(lat * 1e6);
+	unsigned int bin = (us < 2) ? 0 : 63 - (unsigned int)__builtin_clzl(us);
+	rt->hist[(bin < MPU6050_RT_BINS) ? bin : MPU6050_RT_BINS - 1]++;
+
+	return 0;
+}
+
+/* clear the statistics, for instance once the loop has settled */
+int mpu_rt_reset(struct mpu_rt *rt)
+{
+	if (NULL == rt)
+		return -1;
+
+	rt->loops    = 0;
+	rt->overruns = 0;
+	rt->lat_min  = INFINITY;
+	rt->lat_max  = 0;
+	rt->lat_sum  = 0;
+	memset(rt->hist, 0, sizeof(rt->hist));
+
+	return 0;
+}
+
+/* restore what start changed, in reverse, each once */
+static int mpu_rt_undo(struct mpu_rt *rt)
+{
+	pthread_t self = pthread_self();
+	int ret = 0;
+
+	if (rt->prio > 0) {
+		struct sched_param sp = { .sched_priority = rt->sched_prio };
+		if (pthread_setschedparam(self, rt->policy, &sp))
+			ret = -1;
+		rt->prio = 0;
+	}
+	if (rt->tuned) {
+		if (!mallopt(M_TRIM_THRESHOLD, MPU6050_RT_TRIM) || !mallopt(M_MMAP_MAX, MPU6050_RT_MMAP))
+			ret = -1;
+		rt->tuned = false;
+	}
+	if (rt->locked) {
+		if (munlockall() < 0)
+			ret = -1;
+		rt->locked = false;
+	}
+	if (rt->pinned) {
+		cpu_set_t set;
+		memcpy(&set, rt->affinity, sizeof(set));
+		if (pthread_setaffinity_np(self, sizeof(set), &set))
+			ret = -1;
+		rt->pinned = false;
+	}
+
+	return ret;
+}
+
+/* touch the stack the loop may grow into, while locked it stays */
+static void mpu_rt_prefault_stack(void)
+{
+	volatile unsigned char stack[MPU6050_RT_STACK];
+
+	for (size_t i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+/*
+ * Keep freed memory in the process and out of mmap(), then fault in a
+ * reserve; later allocations of the application reuse locked pages.
+ */
+static int mpu_rt_prefault_heap(struct mpu_rt *rt)
+{
+	rt->tuned = true; /* either may have taken */
+	if (!mallopt(M_TRIM_THRESHOLD, -1) || !mallopt(M_MMAP_MAX, 0))
+		return -1;
+
+	volatile unsigned char *heap = malloc(MPU6050_RT_HEAP);
+	if (NULL == heap)
+		return -1;
+	for (size_t i = 0; i < MPU6050_RT_HEAP; i += 4096)
+		heap[i] = 0;
+	free((void *)heap);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_RT_H_
+#define _MPU6050_RT_H_
+#include "mpu6050_core.h"
+
+/*
+ * Real-time acquisition
+ *
+ * mpu_rt_start() prepares the calling thread for a bounded loop around
+ * mpu_get_data(): pinned to one core, best one isolated from the
+ * scheduler (isolcpus=), at a SCHED_FIFO priority, with every page of
+ * the process locked and its stack and a heap reserve prefaulted.
+ *
+ * While attached the device neither allocates nor touches files: the
+ * configuration file is written when mpu_rt_stop() detaches, and the
+ * controls that write reports fail. Attach decimators, filters, logs
+ * and publishers before starting, they allocate when set up.
+ *
+ * Every reading is timed from its sample time, dev->ts, to its return
+ * to the caller; readings later than a sampling period are overruns.
+ * mpu_rt_stop() undoes what mpu_rt_start() changed, and only that: the
+ * scheduling, the cores the thread ran on, the memory locking and the
+ * malloc tuning, the latter back to the glibc defaults.
+ */
+#ifndef MPU6050_RT_STACK
+#define MPU6050_RT_STACK	(256 * 1024)	/* stack prefaulted	*/
+#endif
+#ifndef MPU6050_RT_HEAP
+#define MPU6050_RT_HEAP		(1024 * 1024)	/* heap prefaulted	*/
+#endif
+#define MPU6050_RT_BINS		16	/* latency histogram, 2^i us	*/
+
+struct mpu_rt {
+	int	cpu;		/* pinned to, -1 if not			*/
+	int	prio;		/* SCHED_FIFO priority, 0 if not	*/
+	unsigned long long loops;	/* readings timed		*/
+	unsigned long long overruns;	/* later than dev->st		*/
+	double	lat_min;	/* sample to caller, best (s)		*/
+	double	lat_max;	/* sample to caller, worst (s)		*/
+	double	lat_sum;	/* sample to caller, summed (s)		*/
+	unsigned long long hist[MPU6050_RT_BINS]; /* below 2^(i+1) us	*/
+	int	policy;		/* scheduling before start		*/
+	int	sched_prio;	/* its priority				*/
+	unsigned long affinity[16]; /* cores before start, as cpu_set_t */
+	bool	pinned;		/* affinity changed			*/
+	bool	locked;		/* memory locked			*/
+	bool	tuned;		/* malloc trimming and mmap() off	*/
+};
+
+int mpu_rt_start	(struct mpu_rt *rt, struct mpu_dev *dev, int cpu, int prio);
+int mpu_rt_stop		(struct mpu_rt *rt, struct mpu_dev *dev);
+int mpu_rt_account	(struct mpu_rt *rt, struct mpu_dev *dev);
+int mpu_rt_reset	(struct mpu_rt *rt);
+
+#endif /* _MPU6050_RT_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "mpu6050_shm.h"
+#include "mpu6050_regs.h"
+
+#include <string.h>		/* for memset(), memcpy(), strlen() */
+#include <fcntl.h>		/* for O_* constants */
+#include <unistd.h>		/* for ftruncate(), close() */
+#include <sys/mman.h>		/* for shm_open(), mmap(), munmap() */
+#include <sys/stat.h>		/* for fstat() */
+
+#define SHM_ALIGN(x) (((x) + 63) / 64 * 64)
+
+static int mpu_shm_copy(struct mpu_shm *shm, uint64_t n, struct mpu_shm_frame *f);
+
+/*
+ * Create the object name, slots frames deep, 0 for MPU6050_SHM_SLOTS,
+ * and describe dev in its header. Readers attach with mpu_shm_attach().
+ */
+int mpu_shm_open(struct mpu_shm *shm, const char *name, struct mpu_dev *dev, unsigned int slots)
+{
+	if ((NULL == shm) || (NULL == name) || (NULL == dev))
+		return -1;
+
+	if (strlen(name) >= sizeof(shm->name)) /* name too long */
+		return -1;
+
+	memset(shm, 0, sizeof(*shm));
+	slots = (0 == slots) ? MPU6050_SHM_SLOTS : slots;
+
+	size_t plen = 0;
+	if (mpu_get_params(dev, NULL, &plen) < 0)
+		return -1;
+
+	size_t params_off = SHM_ALIGN(sizeof(struct mpu_shm_hdr));
+	size_t frames_off = SHM_ALIGN(params_off + plen);
+	size_t len = frames_off + (size_t)slots * sizeof(struct mpu_shm_frame);
+
+	int fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (fd < 0) /* no such namespace, or not ours */
+		return -1;
+	if (ftruncate(fd, (off_t)len) < 0) {
+		close(fd);
+		shm_unlink(name);
+		return -1;
+	}
+	void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd); /* the mapping holds the object */
+	if (MAP_FAILED == map) {
+		shm_unlink(name);
+		return -1;
+	}
+
+	shm->hdr   = map;
+	shm->ring  = (struct mpu_shm_frame *)((uint8_t *)map + frames_off);
+	shm->len   = len;
+	shm->owner = true;
+	strcpy(shm->name, name);
+
+	struct mpu_shm_hdr *h = shm->hdr;
+	h->version    = MPU6050_SHM_VERSION;
+	h->slots      = slots;
+	h->frame_len  = sizeof(struct mpu_shm_frame);
+	h->frames_off = frames_off;
+	h->params_off = params_off;
+	h->params_len = plen;
+	h->words      = (uint32_t)dev->fifosensors;
+	h->sr         = dev->sr;
+	h->albs       = dev->albs;
+	h->glbs       = dev->glbs;
+	if ((mpu_get_reg(dev, FIFO_EN, &h->fifo_en) < 0) ||
+	    (mpu_get_params(dev, (uint8_t *)map + params_off, &plen) < 0)) {
+		mpu_shm_close(shm);
+		return -1;
+	}
+
+	/* readers trust nothing before the magic */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(h->magic, MPU6050_SHM_MAGIC, sizeof(h->magic));
+
+	return 0;
+}
+
+/* publish f as the next frame, its seq is ignored */
+int mpu_shm_publish(struct mpu_shm *shm, const struct mpu_shm_frame *f)
+{
+	if ((NULL == shm) || (NULL == shm->hdr) || !shm->owner || (NULL == f))
+		return -1;
+
+	if (f->words > MPU6050_SHM_WORDS) /* frame won't fit a slot */
+		return -1;
+
+	uint64_t n = shm->hdr->head;
+	struct mpu_shm_frame *s = &shm->ring[n % shm->hdr->slots];
+
+	__atomic_store_n(&s->seq, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy((uint8_t *)s + sizeof(s->seq), (const uint8_t *)f + sizeof(f->seq),
+	       sizeof(*f) - sizeof(f->seq));
+	__atomic_store_n(&s->seq, 2 * n + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->hdr->head, n + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* map name read only, reading starts with the next frame published */
+int mpu_shm_attach(struct mpu_shm *shm, const char *name)
+{
+	if ((NULL == shm) || (NULL == name))
+		return -1;
+
+	if (strlen(name) >= sizeof(shm->name)) /* name too long */
+		return -1;
+
+	memset(shm, 0, sizeof(*shm));
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) /* no publisher */
+		return -1;
+
+	struct stat st;
+	if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(struct mpu_shm_hdr))) {
+		close(fd);
+		return -1;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+		return -1;
+	shm->hdr = map;
+	shm->len = (size_t)st.st_size;
+	strcpy(shm->name, name);
+
+	const struct mpu_shm_hdr *h = shm->hdr;
+	if (memcmp(h->magic, MPU6050_SHM_MAGIC, sizeof(h->magic))) /* not ready, or not ours */
+		goto shm_attach_error;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if ((MPU6050_SHM_VERSION != h->version) || (sizeof(struct mpu_shm_frame) != h->frame_len) ||
+	    (0 == h->slots) || (h->frames_off + (size_t)h->slots * h->frame_len > shm->len) ||
+	    ((size_t)h->params_off + h->params_len > shm->len)) /* past the mapping */
+		goto shm_attach_error;
+
+	shm->ring = (struct mpu_shm_frame *)((uint8_t *)map + h->frames_off);
+	shm->next = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+
+	return 0;
+
+shm_attach_error:
+	mpu_shm_close(shm);
+
+	return -1;
+}
+
+/*
+ * Copy up to n frames published since the previous call into f, nread
+ * receives the count, 0 when there is nothing new. Frames overwritten
+ * before they were read are counted in lost.
+ */
+int mpu_shm_read(struct mpu_shm *shm, struct mpu_shm_frame *f, size_t n, size_t *nread)
+{
+	if ((NULL == shm) || (NULL == shm->ring) || (NULL == f) || (NULL == nread))
+		return -1;
+
+	uint64_t head = __atomic_load_n(&shm->hdr->head, __ATOMIC_ACQUIRE);
+	uint64_t slots = shm->hdr->slots;
+	if (head - shm->next > slots) { /* lapped */
+		shm->lost += head - slots - shm->next;
+		shm->next  = head - slots;
+	}
+
+	size_t k = 0;
+	for (; (k < n) && (shm->next < head); shm->next++) {
+		if (mpu_shm_copy(shm, shm->next, &f[k]) < 0)
+			shm->lost++; /* overwritten while copying */
+		else
+			k++;
+	}
+	*nread = k;
+
+	return 0;
+}
+
+/* copy the newest frame, without moving the read position */
+int mpu_shm_latest(struct mpu_shm *shm, struct mpu_shm_frame *f)
+{
+	if ((NULL == shm) || (NULL == shm->ring) || (NULL == f))
+		return -1;
+
+	for (int tries = 0; tries < 4; tries++) {
+		uint64_t head = __atomic_load_n(&shm->hdr->head, __ATOMIC_ACQUIRE);
+		if (0 == head) /* nothing published yet */
+			return -1;
+		if (0 == mpu_shm_copy(shm, head - 1, f))
+			return 0;
+	}
+
+	return -1;
+}
+
+int mpu_shm_close(struct mpu_shm *shm)
+{
+	if ((NULL == shm) || (NULL == shm->hdr))
+		return -1;
+
+	int ret = munmap(shm->hdr, shm->len);
+	if (shm->owner && (shm_unlink(shm->name) < 0))
+		ret = -1;
+	memset(shm, 0, sizeof(*shm));
+
+	return ret;
+}
+
+/* seqlock read of frame n, fails if the slot holds, or gets, another */
+static int mpu_shm_copy(struct mpu_shm *shm, uint64_t n, struct mpu_shm_frame *f)
+{
+	const struct mpu_shm_frame *s = &shm->ring[n % shm->hdr->slots];
+
+	uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+	if (seq != 2 * n + 2)
+		return -1;
+	memcpy(f, s, sizeof(*f));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq)
+		return -1;
+
+	return 0;
+}
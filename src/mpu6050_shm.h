@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_SHM_H_
+#define _MPU6050_SHM_H_
+#include "mpu6050_core.h"
+
+#include <stddef.h>		/* for size_t */
+
+/*
+ * Sample publication over POSIX shared memory
+ *
+ * The process owning the device publishes every reading into a ring of
+ * slots in a shared memory object; any number of processes attach read
+ * only and copy frames out without system calls or locks.
+ *
+ *	struct mpu_shm_hdr	layout, scales and frames published
+ *	params			mpu_get_params() snapshot
+ *	struct mpu_shm_frame	slots times
+ *
+ * Each slot is a seqlock: its seq is odd while the publisher writes it
+ * and 2n + 2 once it holds frame n. A reader copies the slot between two
+ * reads of seq and keeps the copy only if both show frame n; a reader
+ * lapped by the publisher counts the frames it lost and skips ahead.
+ */
+#define MPU6050_SHM_MAGIC	"MPU6050S"
+#define MPU6050_SHM_VERSION	1
+#define MPU6050_SHM_WORDS	32	/* widest frame published	*/
+#ifndef MPU6050_SHM_SLOTS
+#define MPU6050_SHM_SLOTS	1024	/* frames kept for readers	*/
+#endif
+
+struct mpu_shm_frame {
+	uint64_t seq;		/* seqlock, 2n + 2 for frame n		*/
+	unsigned long long samples; /* dev->samples			*/
+	double	ts;		/* sample time, CLOCK_MONOTONIC (s)	*/
+	double	dt;		/* time since previous sample (s)	*/
+	uint32_t words;		/* values in raw and val		*/
+	float	q[4];		/* attitude, identity without fusion	*/
+	int16_t	raw[MPU6050_SHM_WORDS];	/* fifo words as read		*/
+	double	val[MPU6050_SHM_WORDS];	/* calibrated, fifo order	*/
+} __attribute__((aligned(64)));
+
+struct mpu_shm_hdr {
+	char	 magic[8];	/* MPU6050_SHM_MAGIC, written last	*/
+	uint32_t version;	/* MPU6050_SHM_VERSION			*/
+	uint32_t slots;		/* frames in the ring			*/
+	uint32_t frame_len;	/* sizeof(struct mpu_shm_frame)		*/
+	uint32_t frames_off;	/* offset of slot 0			*/
+	uint32_t params_off;	/* offset of the parameter snapshot	*/
+	uint32_t params_len;	/* bytes of the parameter snapshot	*/
+	uint32_t words;		/* words per frame at open		*/
+	uint8_t	 fifo_en;	/* FIFO_EN register, channel order	*/
+	uint8_t	 pad[3];
+	double	 sr;		/* sampling rate (Hz)			*/
+	double	 albs;		/* accelerometer LSB per g		*/
+	double	 glbs;		/* gyroscope LSB per degree/s		*/
+	uint64_t head __attribute__((aligned(64))); /* frames published	*/
+};
+
+struct mpu_shm {
+	struct	mpu_shm_hdr *hdr;	/* the mapped object		*/
+	struct	mpu_shm_frame *ring;	/* its slots			*/
+	size_t	len;			/* mapped bytes			*/
+	bool	owner;			/* publisher, unlinks at close	*/
+	char	name[64];		/* shared memory object name	*/
+	uint64_t next;			/* reader, next frame to copy	*/
+	unsigned long long lost;	/* reader, frames overwritten	*/
+};
+
+int mpu_shm_open	(struct mpu_shm *shm, const char *name, struct mpu_dev *dev, unsigned int slots);
+int mpu_shm_publish	(struct mpu_shm *shm, const struct mpu_shm_frame *f);
+int mpu_shm_attach	(struct mpu_shm *shm, const char *name);
+int mpu_shm_read	(struct mpu_shm *shm, struct mpu_shm_frame *f, size_t n, size_t *nread);
+int mpu_shm_latest	(struct mpu_shm *shm, struct mpu_shm_frame *f);
+int mpu_shm_close	(struct mpu_shm *shm);
+
+#endif /* _MPU6050_SHM_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#define _GNU_SOURCE		/* for accept4() */
+#include "mpu6050_srv.h"
+
+#include <errno.h>		/* for errno, EAGAIN, EINTR */
+#include <fcntl.h>		/* for fcntl(), O_NONBLOCK */
+#include <math.h>		/* for NAN */
+#include <poll.h>		/* for poll() */
+#include <stdio.h>		/* for sscanf() */
+#include <stdlib.h>		/* for calloc(), free(), strtoul() */
+#include <string.h>		/* for memset(), memcpy(), memchr(), strlen(), strcmp() */
+#include <unistd.h>		/* for read(), close(), unlink() */
+#include <sys/socket.h>		/* for socket(), bind(), listen(), sendmsg() */
+#include <sys/stat.h>		/* for lstat() */
+#include <sys/uio.h>		/* for struct iovec */
+#include <sys/un.h>		/* for struct sockaddr_un */
+
+#define SRV_REPLIES	8	/* replies pending per client		*/
+#define SRV_LINE	128	/* longest command			*/
+
+struct mpu_srv_client {
+	int		fd;
+	int		policy;		/* MPU6050_SRV_DROP or _DECIMATE	*/
+	unsigned int	batch;		/* frames that trigger a send		*/
+	unsigned int	decim;		/* DECIMATE: queue one frame in decim	*/
+	unsigned int	phase;		/* frames since the last queued		*/
+	unsigned int	tail;		/* oldest frame queued			*/
+	unsigned int	count;		/* frames queued, flight included	*/
+	unsigned int	flight;		/* frames of the batch being sent	*/
+	size_t		sent;		/* bytes of that batch sent		*/
+	struct mpu_srv_hdr hdr;		/* its header				*/
+	unsigned int	replies;	/* replies pending			*/
+	size_t		rsent;		/* bytes of them sent			*/
+	struct mpu_srv_hdr reply[SRV_REPLIES];
+	size_t		len;		/* bytes of the partial command		*/
+	char		line[SRV_LINE];
+	unsigned long long dropped;	/* frames lost				*/
+	struct mpu_srv_frame q[MPU6050_SRV_QUEUE];
+};
+
+static void mpu_srv_accept(struct mpu_srv *srv);
+static int mpu_srv_add(struct mpu_srv *srv, int fd);
+static void mpu_srv_drop(struct mpu_srv *srv, unsigned int i);
+static int mpu_srv_read(struct mpu_srv *srv, struct mpu_srv_client *c);
+static int mpu_srv_command(struct mpu_srv *srv, struct mpu_srv_client *c, char *cmd);
+static int mpu_srv_flush(struct mpu_srv *srv, struct mpu_srv_client *c, unsigned int min);
+static void mpu_srv_discard(struct mpu_srv *srv, struct mpu_srv_client *c);
+
+/*
+ * Listen for clients on path, a stale socket left there is replaced.
+ * Commands received act on dev.
+ */
+int mpu_srv_open(struct mpu_srv *srv, const char *path, struct mpu_dev *dev)
+{
+	if ((NULL == srv) || (NULL == path) || (NULL == dev))
+		return -1;
+
+	memset(srv, 0, sizeof(*srv));
+	srv->fd = -1;
+
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(sa.sun_path)) /* path too long */
+		return -1;
+	strcpy(sa.sun_path, path);
+
+	struct stat st;
+	if ((0 == lstat(path, &st)) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if ((bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) ||
+	    (listen(fd, MPU6050_SRV_CLIENTS) < 0)) {
+		close(fd);
+		return -1;
+	}
+
+	srv->fd  = fd;
+	srv->dev = dev;
+	strcpy(srv->path, path);
+
+	return 0;
+}
+
+/*
+ * Queue the reading in dev to every client, sending to those holding a
+ * full batch. Never blocks: a client whose socket is full keeps its
+ * frames queued and loses the oldest by its policy when the queue fills.
+ */
+int mpu_srv_push(struct mpu_srv *srv)
+{
+	if ((NULL == srv) || (srv->fd < 0))
+		return -1;
+
+	struct mpu_dev *dev = srv->dev;
+	struct mpu_srv_frame f = {
+		.samples = dev->samples,
+		.ts	 = dev->ts,
+		.a	 = { (NULL != dev->Ax) ? *(dev->Ax) : NAN,
+			     (NULL != dev->Ay) ? *(dev->Ay) : NAN,
+			     (NULL != dev->Az) ? *(dev->Az) : NAN },
+		.t	 = (NULL != dev->t) ? *(dev->t) : NAN,
+		.g	 = { (NULL != dev->Gx) ? *(dev->Gx) : NAN,
+			     (NULL != dev->Gy) ? *(dev->Gy) : NAN,
+			     (NULL != dev->Gz) ? *(dev->Gz) : NAN },
+	};
+
+	for (unsigned int i = 0; i < MPU6050_SRV_CLIENTS; i++) {
+		struct mpu_srv_client *c = srv->cl[i];
+		if (NULL == c)
+			continue;
+
+		if (MPU6050_SRV_DECIMATE == c->policy) {
+			if (++c->phase < c->decim)
+				continue;
+			c->phase = 0;
+		}
+		if (MPU6050_SRV_QUEUE == c->count) { /* client behind */
+			if ((MPU6050_SRV_DECIMATE == c->policy) && (c->decim < MPU6050_SRV_DECIM))
+				c->decim *= 2;
+			mpu_srv_discard(srv, c);
+		}
+		c->q[(c->tail + c->count) % MPU6050_SRV_QUEUE] = f;
+		c->count++;
+
+		if ((c->count - c->flight >= c->batch) && (mpu_srv_flush(srv, c, c->batch) < 0))
+			mpu_srv_drop(srv, i);
+	}
+
+	return 0;
+}
+
+/*
+ * Serve a socket already connected, one end of a socketpair() given to
+ * a child for instance. The server owns fd from then on, it is closed
+ * when the server is full.
+ */
+int mpu_srv_adopt(struct mpu_srv *srv, int fd)
+{
+	if ((NULL == srv) || (srv->fd < 0) || (fd < 0))
+		return -1;
+
+	int fl = fcntl(fd, F_GETFL);
+	if ((fl < 0) || (fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0)) {
+		close(fd);
+		return -1;
+	}
+
+	return mpu_srv_add(srv, fd);
+}
+
+/*
+ * Wait up to timeout milliseconds, as poll(), then accept clients, run
+ * their commands and send whatever they have queued. Calling this every
+ * few milliseconds bounds the latency of clients with long batches.
+ */
+int mpu_srv_poll(struct mpu_srv *srv, int timeout)
+{
+	if ((NULL == srv) || (srv->fd < 0))
+		return -1;
+
+	struct pollfd pfd[1 + MPU6050_SRV_CLIENTS];
+	unsigned int idx[MPU6050_SRV_CLIENTS];
+	nfds_t n = 1;
+	pfd[0] = (struct pollfd){ .fd = srv->fd, .events = POLLIN };
+	for (unsigned int i = 0; i < MPU6050_SRV_CLIENTS; i++) {
+		struct mpu_srv_client *c = srv->cl[i];
+		if (NULL == c)
+			continue;
+		pfd[n].fd = c->fd;
+		pfd[n].events = POLLIN | ((c->flight > 0) || (c->replies > 0) ? POLLOUT : 0);
+		pfd[n].revents = 0;
+		idx[n - 1] = i;
+		n++;
+	}
+
+	if (poll(pfd, n, timeout) < 0)
+		return (EINTR == errno) ? 0 : -1;
+
+	for (nfds_t k = 1; k < n; k++) {
+		unsigned int i = idx[k - 1];
+		struct mpu_srv_client *c = srv->cl[i];
+		short ev = pfd[k].revents;
+		if ((ev & (POLLIN | POLLHUP)) && (mpu_srv_read(srv, c) < 0)) {
+			mpu_srv_drop(srv, i);
+			continue;
+		}
+		if ((ev & POLLERR) || (mpu_srv_flush(srv, c, 1) < 0))
+			mpu_srv_drop(srv, i);
+	}
+	if (pfd[0].revents & POLLIN)
+		mpu_srv_accept(srv);
+
+	return 0;
+}
+
+/* disconnect every client and remove the socket */
+int mpu_srv_close(struct mpu_srv *srv)
+{
+	if ((NULL == srv) || (srv->fd < 0))
+		return -1;
+
+	for (unsigned int i = 0; i < MPU6050_SRV_CLIENTS; i++)
+		if (NULL != srv->cl[i])
+			mpu_srv_drop(srv, i);
+
+	int ret = close(srv->fd);
+	if (unlink(srv->path) < 0)
+		ret = -1;
+	srv->fd = -1;
+
+	return ret;
+}
+
+static void mpu_srv_accept(struct mpu_srv *srv)
+{
+	for (;;) {
+		int fd = accept4(srv->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) /* none left, or aborted */
+			return;
+		mpu_srv_add(srv, fd);
+	}
+}
+
+static int mpu_srv_add(struct mpu_srv *srv, int fd)
+{
+	unsigned int i = 0;
+	while ((i < MPU6050_SRV_CLIENTS) && (NULL != srv->cl[i]))
+		i++;
+	struct mpu_srv_client *c = NULL;
+	if ((i == MPU6050_SRV_CLIENTS) || (NULL == (c = calloc(1, sizeof(*c))))) {
+		close(fd); /* server full */
+		return -1;
+	}
+	c->fd	  = fd;
+	c->policy = MPU6050_SRV_DROP;
+	c->batch  = MPU6050_SRV_BATCH;
+	c->decim  = 1;
+	srv->cl[i] = c;
+	srv->clients++;
+
+	return 0;
+}
+
+static void mpu_srv_drop(struct mpu_srv *srv, unsigned int i)
+{
+	struct mpu_srv_client *c = srv->cl[i];
+
+	close(c->fd);
+	free(c);
+	srv->cl[i] = NULL;
+	srv->clients--;
+}
+
+/* take commands off the socket, -1 once the client is gone */
+static int mpu_srv_read(struct mpu_srv *srv, struct mpu_srv_client *c)
+{
+	while (c->replies < SRV_REPLIES) {
+		char *nl = memchr(c->line, '\n', c->len);
+		if (NULL != nl) {
+			*nl = '\0';
+			if (nl > c->line && '\r' == nl[-1])
+				nl[-1] = '\0';
+			struct mpu_srv_hdr *h = &c->reply[c->replies++];
+			*h = (struct mpu_srv_hdr){
+				.magic	 = MPU6050_SRV_MAGIC,
+				.type	 = MPU6050_SRV_REPLY,
+				.decim	 = (uint16_t)c->decim,
+				.status	 = mpu_srv_command(srv, c, c->line),
+				.dropped = c->dropped,
+			};
+			c->len -= (size_t)(nl + 1 - c->line);
+			memmove(c->line, nl + 1, c->len);
+			continue;
+		}
+		if (SRV_LINE == c->len) /* no command is this long */
+			return -1;
+
+		ssize_t r = read(c->fd, c->line + c->len, SRV_LINE - c->len);
+		if (0 == r) /* hung up */
+			return -1;
+		if (r < 0)
+			return ((EAGAIN == errno) || (EINTR == errno)) ? 0 : -1;
+		c->len += (size_t)r;
+	}
+
+	return 0;
+}
+
+static int mpu_srv_command(struct mpu_srv *srv, struct mpu_srv_client *c, char *cmd)
+{
+	char verb[16], arg[16], *end;
+	if (2 != sscanf(cmd, "%15s %15s", verb, arg))
+		return -1;
+
+	if (0 == strcmp(verb, "policy")) {
+		if (0 == strcmp(arg, "drop"))
+			c->policy = MPU6050_SRV_DROP;
+		else if (0 == strcmp(arg, "decimate"))
+			c->policy = MPU6050_SRV_DECIMATE;
+		else
+			return -1;
+		c->decim = 1;
+		c->phase = 0;
+		return 0;
+	}
+
+	unsigned long v = strtoul(arg, &end, 10);
+	if (('\0' != *end) || (v > UINT16_MAX))
+		return -1;
+
+	if (0 == strcmp(verb, "batch")) {
+		if ((0 == v) || (v > MPU6050_SRV_BATCH))
+			return -1;
+		c->batch = (unsigned int)v;
+		return 0;
+	}
+	if (0 == strcmp(verb, "rate"))
+		return mpu_ctl_samplerate(srv->dev, (unsigned int)v);
+	if (0 == strcmp(verb, "dlpf"))
+		return mpu_ctl_dlpf(srv->dev, (unsigned int)v);
+	if (0 == strcmp(verb, "accel"))
+		return mpu_ctl_accel_range(srv->dev, (unsigned int)v);
+	if (0 == strcmp(verb, "gyro"))
+		return mpu_ctl_gyro_range(srv->dev, (unsigned int)v);
+
+	return -1;
+}
+
+/*
+ * Send pending replies, then batches while at least min frames are
+ * queued, one sendmsg() each: the header and the frames in place, the
+ * queue wrapping at most once. Returns 0 when the socket fills, -1 on
+ * error; a batch sent in part resumes where it stopped.
+ */
+static int mpu_srv_flush(struct mpu_srv *srv, struct mpu_srv_client *c, unsigned int min)
+{
+	for (;;) {
+		struct iovec iov[3];
+		int n = 0;
+		size_t skip;
+
+		if ((0 == c->flight) && (c->replies > 0)) {
+			iov[n++] = (struct iovec){ c->reply, c->replies * sizeof(c->reply[0]) };
+			skip = c->rsent;
+		} else {
+			if (0 == c->flight) {
+				if ((0 == c->count) || (c->count < min)) /* nothing due */
+					return 0;
+				c->flight = (c->count < MPU6050_SRV_BATCH) ? c->count : MPU6050_SRV_BATCH;
+				c->sent   = 0;
+				c->hdr	  = (struct mpu_srv_hdr){
+					.magic	 = MPU6050_SRV_MAGIC,
+					.type	 = MPU6050_SRV_DATA,
+					.decim	 = (uint16_t)c->decim,
+					.frames	 = c->flight,
+					.dropped = c->dropped,
+				};
+			}
+			unsigned int first = (MPU6050_SRV_QUEUE - c->tail < c->flight)
+					   ? MPU6050_SRV_QUEUE - c->tail : c->flight;
+			iov[n++] = (struct iovec){ &c->hdr, sizeof(c->hdr) };
+			iov[n++] = (struct iovec){ &c->q[c->tail], first * sizeof(c->q[0]) };
+			if (first < c->flight)
+				iov[n++] = (struct iovec){ &c->q[0], (c->flight - first) * sizeof(c->q[0]) };
+			skip = c->sent;
+		}
+
+		/* resume a partial send */
+		size_t total = 0;
+		int k = 0;
+		for (int j = 0; j < n; j++)
+			total += iov[j].iov_len;
+		while (skip >= iov[k].iov_len) {
+			skip -= iov[k].iov_len;
+			k++;
+		}
+		iov[k].iov_base = (uint8_t *)iov[k].iov_base + skip;
+		iov[k].iov_len -= skip;
+
+		struct msghdr msg = { .msg_iov = &iov[k], .msg_iovlen = (size_t)(n - k) };
+		ssize_t r = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		srv->calls++;
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return (EAGAIN == errno) ? 0 : -1;
+		}
+
+		if (0 == c->flight) {
+			c->rsent += (size_t)r;
+			if (c->rsent < total)
+				return 0;
+			c->replies = 0;
+			c->rsent   = 0;
+			continue;
+		}
+		c->sent += (size_t)r;
+		if (c->sent < total)
+			return 0;
+		c->tail   = (c->tail + c->flight) % MPU6050_SRV_QUEUE;
+		c->count -= c->flight;
+		srv->sent += c->flight;
+		c->flight = 0;
+		if ((0 == c->count) && (c->decim > 1)) /* caught up, speed up */
+			c->decim /= 2;
+	}
+}
+
+/* lose the oldest frame queued, never one of the batch being sent */
+static void mpu_srv_discard(struct mpu_srv *srv, struct mpu_srv_client *c)
+{
+	for (unsigned int i = c->flight; i > 0; i--)
+		c->q[(c->tail + i) % MPU6050_SRV_QUEUE] = c->q[(c->tail + i - 1) % MPU6050_SRV_QUEUE];
+	c->tail = (c->tail + 1) % MPU6050_SRV_QUEUE;
+	c->count--;
+	c->dropped++;
+	srv->dropped++;
+}
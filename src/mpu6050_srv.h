@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_SRV_H_
+#define _MPU6050_SRV_H_
+#include "mpu6050_core.h"
+
+/*
+ * Streaming server over a Unix domain socket
+ *
+ * The process owning the device pushes every reading; each client gets
+ * its own queue and receives batches, a struct mpu_srv_hdr followed by
+ * its frames, gathered straight from the queue with one sendmsg().
+ * A client that falls behind loses frames by its own policy, never
+ * stalling acquisition or the other clients: DROP discards the oldest
+ * queued frames, DECIMATE first halves its rate while the queue stays
+ * full and restores it as the queue drains.
+ *
+ * Clients send text commands, one per line, each answered in order by
+ * a header of type REPLY carrying the result:
+ *
+ *	rate <hz>		mpu_ctl_samplerate()
+ *	dlpf <cfg>		mpu_ctl_dlpf()
+ *	accel <g>		mpu_ctl_accel_range()
+ *	gyro <dps>		mpu_ctl_gyro_range()
+ *	policy drop|decimate	this client's backpressure policy
+ *	batch <frames>		this client's batch length
+ *
+ * Everything is in host byte order.
+ */
+#define MPU6050_SRV_MAGIC	0x5653504dU	/* "MPSV"		*/
+#ifndef MPU6050_SRV_CLIENTS
+#define MPU6050_SRV_CLIENTS	8	/* clients served at once	*/
+#endif
+#ifndef MPU6050_SRV_QUEUE
+#define MPU6050_SRV_QUEUE	1024	/* frames queued per client	*/
+#endif
+#define MPU6050_SRV_BATCH	64	/* longest batch		*/
+#define MPU6050_SRV_DECIM	64	/* deepest decimation		*/
+
+/* message types */
+#define MPU6050_SRV_DATA	0
+#define MPU6050_SRV_REPLY	1
+
+/* backpressure policies */
+#define MPU6050_SRV_DROP	0
+#define MPU6050_SRV_DECIMATE	1
+
+struct mpu_srv_hdr {
+	uint32_t magic;		/* MPU6050_SRV_MAGIC			*/
+	uint16_t type;		/* MPU6050_SRV_DATA or _REPLY		*/
+	uint16_t decim;		/* frames per frame sent		*/
+	uint32_t frames;	/* frames following			*/
+	int32_t	 status;	/* reply: 0 or -1			*/
+	uint64_t dropped;	/* frames this client lost so far	*/
+};
+
+/* accelerometer (g), temperature (C), gyroscope (dps), NAN if unbuffered */
+struct mpu_srv_frame {
+	uint64_t samples;	/* dev->samples				*/
+	double	ts;		/* sample time, CLOCK_MONOTONIC (s)	*/
+	double	a[3];
+	double	t;
+	double	g[3];
+};
+
+struct mpu_srv_client;
+
+struct mpu_srv {
+	int	fd;		/* listening socket			*/
+	char	path[108];	/* its name				*/
+	struct	mpu_dev *dev;	/* device commands act on		*/
+	struct	mpu_srv_client *cl[MPU6050_SRV_CLIENTS];
+	unsigned int clients;	/* connected				*/
+	unsigned long long sent;   /* frames sent, every client	*/
+	unsigned long long dropped; /* frames lost, every client	*/
+	unsigned long long calls;   /* sendmsg() calls			*/
+};
+
+int mpu_srv_open	(struct mpu_srv *srv, const char *path, struct mpu_dev *dev);
+int mpu_srv_push	(struct mpu_srv *srv);
+int mpu_srv_adopt	(struct mpu_srv *srv, int fd);
+int mpu_srv_poll	(struct mpu_srv *srv, int timeout);
+int mpu_srv_close	(struct mpu_srv *srv);
+
+#endif /* _MPU6050_SRV_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifdef __cplusplus
+	extern "C" {
+#endif
+#ifndef _MPU6050_TIME_H_
+#define _MPU6050_TIME_H_
+#include <time.h>		/* for clock_gettime(), nanosleep() */
+
+/*
+ * Host clock - internal use only
+ *
+ * Seconds on CLOCK_MONOTONIC, the clock readings are stamped with, and
+ * relative sleeps in the same unit, for every module.
+ */
+
+/* this should be defined in time.h, but the linter complains */
+extern int nanosleep(const struct timespec *rqtp, struct timespec *rmtp);
+
+static inline double mpu_clock(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* sleep for s seconds, not at all for none */
+static inline void mpu_sleep(double s)
+{
+	if (!(s > 0))
+		return;
+
+	struct timespec dly = { .tv_sec = (time_t)s };
+	dly.tv_nsec = (long)(1e9 * (s - (double)dly.tv_sec));
+	nanosleep(&dly, NULL);
+}
+
+#endif /* _MPU6050_TIME_H_ */
+
+#ifdef __cplusplus
+	}
+#endif
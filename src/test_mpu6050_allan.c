@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_allan.h"
+
+#include <math.h>		/* for sqrt(), log(), fabs() */
+
+/*
+ * Synthetic records of known noise on every axis: white noise of
+ * density AL_N, a rate random walk of AL_K and a constant bias. The
+ * deviation follows sqrt(N^2 / tau + K^2 tau / 3), its floor at
+ * tau = sqrt(3) N / K; random walk, the floor read as bias instability
+ * and rate random walk come back within tolerance, and the bias
+ * changes nothing.
+ */
+#define AL_TAU0		0.01	/* s, 100 Hz */
+#define AL_SAMPLES	1000000
+#define AL_N		0.01	/* per sqrt(s) */
+#define AL_K		0.001	/* per s per sqrt(s) */
+
+static const double al_bias[MPU6050_ALLAN_AXES] = { 0.02, -0.03, 1.0, 0.5, -1.5, 3.0 };
+
+/* xorshift64*, then Box-Muller, reproducible */
+static uint64_t al_state = 0x9E3779B97F4A7C15ULL;
+
+static double uniform(void)
+{
+	al_state ^= al_state >> 12;
+	al_state ^= al_state << 25;
+	al_state ^= al_state >> 27;
+
+	return ((al_state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) + 1e-300;
+}
+
+static double gauss(void)
+{
+	return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+int main(void)
+{
+	emu_reset(); /* no bus, the model only links the library */
+	static struct mpu_allan al, ab; /* without and with the bias */
+	CHECK(mpu_allan_init(&al, AL_TAU0) == 0);
+	CHECK(mpu_allan_init(&ab, AL_TAU0) == 0);
+	CHECK(mpu_allan_eval(&al) < 0); /* nothing yet */
+
+	double walk[MPU6050_ALLAN_AXES] = { 0 };
+	for (long i = 0; i < AL_SAMPLES; i++) {
+		double y[MPU6050_ALLAN_AXES], yb[MPU6050_ALLAN_AXES];
+		for (int a = 0; a < MPU6050_ALLAN_AXES; a++) {
+			walk[a] += AL_K * sqrt(AL_TAU0) * gauss();
+			y[a]  = AL_N / sqrt(AL_TAU0) * gauss() + walk[a];
+			yb[a] = y[a] + al_bias[a];
+		}
+		CHECK(mpu_allan_add(&al, y) == 0);
+		CHECK(mpu_allan_add(&ab, yb) == 0);
+	}
+	CHECK(mpu_allan_eval(&al) == 0);
+	CHECK(mpu_allan_eval(&ab) == 0);
+	CHECK((AL_SAMPLES == al.n) && (al.levels == ab.levels) && (al.levels > 12));
+
+	const double floor_tau = sqrt(3) * AL_N / AL_K;
+	const double floor_dev = sqrt(2 * AL_N * AL_K / sqrt(3));
+	const double bi = floor_dev / sqrt(2 * log(2.0) / M_PI);
+	for (int a = 0; a < MPU6050_ALLAN_AXES; a++) {
+		for (int k = 0; k < al.levels; k++) {
+			CHECK(fabs(ab.adev[a][k] - al.adev[a][k]) <= 1e-6 * al.adev[a][k]);
+			if (al.tau[k] > floor_tau) /* the rest is the walk, fewer terms */
+				continue;
+			double t = al.tau[k], expect = sqrt(AL_N * AL_N / t + AL_K * AL_K * t / 3);
+			CHECK(fabs(al.adev[a][k] / expect - 1) < 0.1);
+		}
+
+		int kmin = 0;
+		for (int k = 1; k < al.levels; k++)
+			kmin = (al.adev[a][k] < al.adev[a][kmin]) ? k : kmin;
+		CHECK(fabs(log2(al.tau[kmin] / floor_tau)) <= 1.5); /* the floor, an octave or so */
+
+		CHECK(fabs(al.arw[a] / AL_N - 1) < 0.1);
+		CHECK(fabs(al.bi[a] / bi - 1) < 0.15);
+		CHECK(fabs(al.rrw[a] / AL_K - 1) < 0.5);
+	}
+
+	CHECK(mpu_allan_free(&al) == 0);
+	CHECK(mpu_allan_free(&ab) == 0);
+	CHECK(mpu_allan_add(&al, al_bias) < 0);
+	CHECK(mpu_allan_init(&al, 0) < 0);
+
+	printf("allan: %d levels, ARW %.4f, BI %.4f at %.0f s, RRW %.4f\n",
+	       ab.levels, ab.arw[3], ab.bi[3], floor_tau, ab.rrw[3]);
+
+	return 0;
+}
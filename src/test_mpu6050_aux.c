@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+
+#include <math.h>		/* for fabs() */
+
+/*
+ * A magnetometer on the auxiliary bus: identified and started through
+ * slave 4, read into every frame after the sensor words, its axes in uT
+ * whatever the byte order, the configuration surviving a restore. Files
+ * from another format version, or without a header, are refused.
+ */
+#define AUX_SAMPLES	50
+
+static void chip_word(uint8_t reg, int16_t v, bool le)
+{
+	emu_chip[reg]     = (uint8_t)(le ? v : (uint16_t)v >> 8);
+	emu_chip[reg + 1] = (uint8_t)(le ? (uint16_t)v >> 8 : v);
+}
+
+static int same_mag(struct mpu_dev *dev, double x, double y, double z)
+{
+	CHECK((NULL != dev->Mx) && (NULL != dev->My) && (NULL != dev->Mz));
+	for (int n = 0; n < AUX_SAMPLES; n++) {
+		CHECK(mpu_get_data(dev) == 0);
+		CHECK(fabs(*(dev->Mx) - x) < 1e-3);
+		CHECK(fabs(*(dev->My) - y) < 1e-3);
+		CHECK(fabs(*(dev->Mz) - z) < 1e-3);
+		CHECK(fabs(fabs(*(dev->Az)) - 1) < 1e-3); /* the sensor words stay in place */
+	}
+
+	return 0;
+}
+
+/* the configuration file with byte at changed, or its head cut */
+static int cfg_file(size_t at, uint8_t val, size_t cut)
+{
+	FILE *fp = fopen(MPU6050_CFGFILE, "r");
+	CHECK(NULL != fp);
+	static uint8_t buf[1 << 16];
+	size_t len = fread(buf, 1, sizeof(buf), fp);
+	fclose(fp);
+	CHECK((len > at) && (len > cut) && (len < sizeof(buf)));
+
+	buf[at] = val;
+	fp = fopen(MPU6050_CFGFILE, "w");
+	CHECK(NULL != fp);
+	CHECK(fwrite(buf + cut, 1, len - cut, fp) == len - cut);
+	fclose(fp);
+
+	return 0;
+}
+
+int main(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	int words = dev->fifosensors;
+
+	/* HMC5883L: big endian, X, Z, Y, 1090 LSB per 100 uT */
+	emu_chip_addr = 0x1E;
+	emu_chip[0x0A] = 'H';
+	chip_word(0x03, 1090, false);
+	chip_word(0x05, 2180, false);
+	chip_word(0x07, -545, false);
+	CHECK(mpu_ctl_mag(dev, 0, MPU6050_MAG_QMC5883L) < 0); /* nothing at 0x0D */
+	CHECK(mpu_ctl_mag(dev, 0, MPU6050_MAG_HMC5883L) == 0);
+	CHECK((0x18 == emu_chip[0x00]) && (0x20 == emu_chip[0x01]) && (0x00 == emu_chip[0x02]));
+	CHECK(dev->fifosensors == words + 3);
+	CHECK(same_mag(dev, 100, -50, 200) == 0);
+
+	mpu_reg_t val = 0;
+	CHECK(mpu_ctl_aux_write(dev, 0x1E, 0x20, 0x5A) == 0);
+	CHECK((mpu_ctl_aux_read(dev, 0x1E, 0x20, &val) == 0) && (0x5A == val));
+	CHECK(mpu_ctl_aux_read(dev, 0x50, 0x00, &val) < 0);
+	CHECK(mpu_ctl_aux(dev, 1, 0x1E, 0x03, 5, 0, 0) < 0); /* not whole words */
+	CHECK(mpu_ctl_aux(dev, 4, 0x1E, 0x03, 6, 0, 0) < 0); /* slave 4 is not read per frame */
+	CHECK(mpu_destroy(dev) == 0);
+
+	/* the slave comes back with the configuration */
+	dev = NULL;
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESTORE) == 0);
+	CHECK(same_mag(dev, 100, -50, 200) == 0);
+
+	/* AK8963: little endian, ST2 read along, 0.15 uT per LSB */
+	CHECK(mpu_ctl_mag(dev, 0, MPU6050_MAG_NONE) == 0);
+	CHECK(dev->fifosensors == words);
+	memset(emu_chip, 0, sizeof(emu_chip));
+	emu_chip_addr = 0x0C;
+	emu_chip[0x00] = 0x48;
+	chip_word(0x03, 200, true);
+	chip_word(0x05, -400, true);
+	chip_word(0x07, 1000, true);
+	CHECK(mpu_ctl_mag(dev, 1, MPU6050_MAG_AK8963) == 0);
+	CHECK(0x16 == emu_chip[0x0A]);
+	CHECK(dev->fifosensors == words + 4);
+	CHECK(same_mag(dev, 30, -60, 150) == 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	/* another format version, then no header at all */
+	dev = NULL;
+	CHECK(cfg_file(4, 0xFF, 0) == 0);
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESTORE) < 0);
+	CHECK(NULL == dev);
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	CHECK(mpu_destroy(dev) == 0);
+	dev = NULL;
+	CHECK(cfg_file(0, 'M', 16) == 0);
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESTORE) < 0);
+	unlink(MPU6050_CFGFILE);
+
+	printf("aux: HMC5883L and AK8963 in %d frames, restore checked\n", 3 * AUX_SAMPLES);
+
+	return 0;
+}
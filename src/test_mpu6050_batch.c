@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_batch.h"
+
+#include <math.h>		/* for fabs() */
+
+/*
+ * Drains timed at a fixed cost per byte: the batch planned is the
+ * largest whose worst reading stays within max_lat, one frame more
+ * would not, and none comes out late. Raising or lowering the sampling
+ * rate moves the batch the other way and it still holds; a loose
+ * target is capped by max and by half the fifo.
+ */
+#define BAT_LAT		0.02	/* s */
+#define BAT_BYTE	25e-6	/* s, a 400 kHz bus and some */
+
+/* the latency of a drain of n frames, as mpu_batch_done() has it */
+static double lat_of(const struct mpu_batch *bp, const struct mpu_dev *dev, unsigned int n)
+{
+	double m = (bp->consume > dev->st) ? bp->consume : dev->st;
+
+	return BAT_BYTE * (n * 2.0 * dev->fifosensors + MPU6050_BATCH_HDR) + (n - 1) * m;
+}
+
+/* drains until the batch settles, the last one planned in n */
+static int run(struct mpu_batch *bp, const struct mpu_dev *dev, unsigned int *n)
+{
+	for (int k = 0; k < 32; k++) {
+		CHECK(mpu_batch_plan(bp, dev, n) == 0);
+		CHECK((*n >= bp->min) && (*n <= bp->max));
+		double busy = BAT_BYTE * (*n * 2.0 * dev->fifosensors + MPU6050_BATCH_HDR);
+		CHECK(mpu_batch_done(bp, dev, *n, busy) == 0);
+	}
+
+	return 0;
+}
+
+/* settled on the largest batch within max_lat */
+static int check_fit(struct mpu_batch *bp, const struct mpu_dev *dev, unsigned int *n)
+{
+	unsigned long long late = bp->late;
+	CHECK(run(bp, dev, n) == 0);
+	CHECK(bp->late == late);
+	CHECK(bp->lat <= bp->max_lat);
+	CHECK(fabs(bp->lat - lat_of(bp, dev, *n)) < 1e-4);
+	CHECK((*n == bp->max) || (lat_of(bp, dev, *n + 1) > bp->max_lat));
+
+	return 0;
+}
+
+int main(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	CHECK(mpu_ctl_dlpf(dev, 1) == 0);
+
+	struct mpu_batch bp;
+	unsigned int n[3], cap;
+	CHECK(mpu_batch_init(&bp, BAT_LAT, 1, 64) == 0);
+	CHECK(mpu_ctl_batch(dev, &bp) == 0);
+
+	CHECK(mpu_ctl_samplerate(dev, 500) == 0);
+	CHECK(check_fit(&bp, dev, &n[0]) == 0);
+	CHECK(n[0] > 1);
+
+	/* slower, fewer frames fit */
+	CHECK(mpu_ctl_samplerate(dev, 100) == 0);
+	CHECK(check_fit(&bp, dev, &n[1]) == 0);
+	CHECK(n[1] < n[0]);
+
+	/* faster, more */
+	CHECK(mpu_ctl_samplerate(dev, 1000) == 0);
+	CHECK(check_fit(&bp, dev, &n[2]) == 0);
+	CHECK(n[2] > n[0]);
+
+	/* a loose target, capped */
+	CHECK(mpu_batch_init(&bp, 10, 1, 16) == 0);
+	CHECK(run(&bp, dev, &cap) == 0);
+	CHECK(16 == cap);
+	CHECK(mpu_batch_init(&bp, 10, 1, 1000) == 0);
+	CHECK(run(&bp, dev, &cap) == 0);
+	CHECK((cap > 16) && ((int)cap * 2 * dev->fifosensors <= (dev->fifomax + 1) / 2));
+	CHECK(mpu_ctl_batch(dev, NULL) == 0);
+
+	CHECK(mpu_batch_init(&bp, 0, 1, 16) < 0);
+	CHECK(mpu_batch_init(&bp, BAT_LAT, 8, 4) < 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	printf("batch: %u, %u and %u frames at 500, 100 and 1000 Hz within %.0f ms\n",
+	       n[0], n[1], n[2], BAT_LAT * 1e3);
+
+	return 0;
+}
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_batch.h"
+
+#include <math.h>		/* for lrint(), fabs(), sin(), cos() */
+
+/*
+ * Calibration on the model. mpu_ctl_calibrate() leaves the ranges and
+ * rate as it found them and is refused with a batch planner attached.
+ * A bias drifting linearly with temperature, swept over CAL_SWEEP, is
+ * fitted by mpu_ctl_calibrate_temp(): compensated readings no longer
+ * move with temperature. An accelerometer with known scale, cross-axis
+ * and offset errors is recorded in the six poses and the solution of
+ * mpu_ctl_calibrate_accel() reads true gravity, posed or tilted.
+ */
+#define CAL_T0		20.0	/* C */
+#define CAL_SWEEP	20.0	/* C */
+#define CAL_FRAMES	2000
+#define CAL_KG		0.05	/* gyro drift, dps/C */
+#define CAL_KA		0.001	/* accel drift, g/C */
+
+static struct mpu_dev *dev;
+static unsigned long cal_n;
+
+/* the die warms over CAL_FRAMES frames, the biases follow */
+static void warm(void)
+{
+	double t = CAL_T0 + CAL_SWEEP * (double)(cal_n++ % CAL_FRAMES) / CAL_FRAMES;
+	emu_temp   = (int16_t)lrint((t - 36.53) * 340);
+	emu_gyr[0] = (int16_t)lrint((1 + CAL_KG * (t - 30)) * dev->glbs);
+	emu_gyr[1] = (int16_t)lrint((-2 - CAL_KG * (t - 30)) * dev->glbs);
+	emu_gyr[2] = 0;
+	emu_acc[0] = 0;
+	emu_acc[1] = 0;
+	emu_acc[2] = (int16_t)lrint((1 + CAL_KA * (t - 30)) * dev->albs);
+}
+
+/* steady at t, the last of a few frames; mpu_get_data() negates the accelerometer */
+static int at(double t, double *g, double *a)
+{
+	for (int k = 0; k < 8; k++) {
+		cal_n = (unsigned long)lrint((t - CAL_T0) / CAL_SWEEP * CAL_FRAMES);
+		CHECK(mpu_get_data(dev) == 0);
+	}
+	*g = *(dev->Gx);
+	*a = -*(dev->Az);
+
+	return 0;
+}
+
+static int check_calibrate(void)
+{
+	CHECK(mpu_ctl_dlpf(dev, 1) == 0);
+	CHECK(mpu_ctl_samplerate(dev, 200) == 0);
+	CHECK(mpu_ctl_accel_range(dev, 4) == 0);
+	CHECK(mpu_ctl_gyro_range(dev, 500) == 0);
+	uint8_t regs[3] = { emu_reg[CONFIG], emu_reg[ACCEL_CONFIG], emu_reg[GYRO_CONFIG] };
+
+	struct mpu_batch bp;
+	CHECK(mpu_batch_init(&bp, 0.02, 1, 16) == 0);
+	CHECK(mpu_ctl_batch(dev, &bp) == 0);
+	CHECK(mpu_ctl_calibrate(dev) < 0);
+	CHECK(mpu_ctl_batch(dev, NULL) == 0);
+
+	CHECK(mpu_ctl_calibrate(dev) == 0);
+	CHECK((4 == dev->afr) && (500 == dev->gfr) && (fabs(dev->sr - 200) < 1e-9));
+	CHECK((regs[0] == emu_reg[CONFIG]) && (regs[1] == emu_reg[ACCEL_CONFIG]) &&
+	      (regs[2] == emu_reg[GYRO_CONFIG]));
+	CHECK(mpu_get_data(dev) == 0);
+
+	return 0;
+}
+
+static int check_temp(void)
+{
+	emu_hook = warm;
+	cal_n = 0;
+	CHECK(mpu_ctl_calibrate_temp(dev, 1) < 0); /* no sweep */
+	cal_n = 0;
+	CHECK(mpu_ctl_calibrate_temp(dev, CAL_FRAMES) == 0);
+
+	/* compensated, flat across the sweep */
+	double g[2], a[2];
+	CHECK(at(CAL_T0 + 4, &g[0], &a[0]) == 0);
+	CHECK(at(CAL_T0 + CAL_SWEEP - 4, &g[1], &a[1]) == 0);
+	CHECK(fabs(g[1] - g[0]) < 0.02 * CAL_KG * (CAL_SWEEP - 8) + 1.0 / dev->glbs);
+	CHECK(fabs(a[1] - a[0]) < 0.02 * CAL_KA * (CAL_SWEEP - 8) + 1.0 / dev->albs);
+
+	/* the drift it removed */
+	CHECK(mpu_ctl_tempcomp(dev, false) == 0);
+	CHECK(at(CAL_T0 + 4, &g[0], &a[0]) == 0);
+	CHECK(at(CAL_T0 + CAL_SWEEP - 4, &g[1], &a[1]) == 0);
+	CHECK(fabs(g[1] - g[0] - CAL_KG * (CAL_SWEEP - 8)) < 2.0 / dev->glbs);
+	CHECK(fabs(a[1] - a[0] - CAL_KA * (CAL_SWEEP - 8)) < 2.0 / dev->albs);
+	emu_hook = NULL;
+
+	return 0;
+}
+
+/* gravity g (in g) through the distorted accelerometer, in LSB */
+static void posed(const double *g)
+{
+	static const double m[3][3] = {
+		{ 1.02, 0.01, 0.00 },
+		{ 0.00, 0.97, -0.02 },
+		{ 0.01, 0.00, 1.01 },
+	};
+	static const double off[3] = { 0.02, -0.015, 0.03 }; /* g */
+	for (int i = 0; i < 3; i++) {
+		double v = m[i][0] * g[0] + m[i][1] * g[1] + m[i][2] * g[2] + off[i];
+		emu_acc[i] = (int16_t)lrint(v * dev->albs);
+	}
+}
+
+static int check_accel(void)
+{
+	emu_gyr[0] = emu_gyr[1] = emu_gyr[2] = 0;
+	CHECK(mpu_ctl_calibrate_accel(dev) < 0); /* no pose */
+	for (unsigned int p = MPU6050_POSE_XUP; p <= MPU6050_POSE_ZDOWN; p++) {
+		double g[3] = { 0 };
+		g[p / 2] = (p % 2) ? -1 : 1;
+		posed(g);
+		CHECK(mpu_ctl_calibrate_pose(dev, p) == 0);
+	}
+	CHECK(mpu_ctl_calibrate_accel(dev) == 0);
+
+	/* posed, then tilted by 30 and -20 degrees */
+	const double r = 30 * M_PI / 180, q = -20 * M_PI / 180;
+	const double g[2][3] = {
+		{ 0, 0, 1 },
+		{ -sin(q), sin(r) * cos(q), cos(r) * cos(q) },
+	};
+	for (int k = 0; k < 2; k++) {
+		posed(g[k]);
+		for (int n = 0; n < 8; n++)
+			CHECK(mpu_get_data(dev) == 0);
+		CHECK(fabs(-*(dev->Ax) - g[k][0]) < 2e-3);
+		CHECK(fabs(-*(dev->Ay) - g[k][1]) < 2e-3);
+		CHECK(fabs(-*(dev->Az) - g[k][2]) < 2e-3);
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	CHECK(check_calibrate() == 0);
+	CHECK(check_temp() == 0);
+	CHECK(check_accel() == 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	printf("cal: ranges and rate restored, %.0f C drift fitted, six-pose accel solved\n", CAL_SWEEP);
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+
+#include <math.h>		/* for fabs() */
+
+/*
+ * Random register images are read back through mpu_ctl_readback() and
+ * checked against a decoder written from the register map: supported
+ * images must give the same sampling rate, ranges, DLPF, channels and
+ * frame, unsupported ones must leave the device as it was. Setters on
+ * a read back image must change their field and nothing else, and the
+ * clear-on-read status registers must survive every readback.
+ */
+#define CFG_IMAGES	200000
+
+struct ref {
+	bool	ok;
+	double	sr, afr, gfr;
+	int	dlpf, words, direct;
+	unsigned int channels;
+	bool	aolpm;
+};
+
+static uint32_t lcg = 777;
+
+static uint32_t rnd(void)
+{
+	lcg = lcg * 1664525u + 1013904223u;
+	return lcg >> 8;
+}
+
+static void ref_decode(const uint8_t *r, struct ref *x)
+{
+	memset(x, 0, sizeof(*x));
+	if ((r[CONFIG] & EXT_SYNC_SET_BIT) || (r[INT_PIN_CFG] & FSYNC_INT_EN_BIT) ||
+	    (r[INT_ENABLE] & I2C_MST_INT_EN_BIT) || (r[PWR_MGMT_1] & DEVICE_RESET_BIT) ||
+	    (r[USER_CTRL] & (I2C_IF_DIS_BIT | FIFO_RESET_BIT | I2C_MST_RESET_BIT | SIG_COND_RESET_BIT)))
+		return;
+	for (int i = 0; i < 4; i++)
+		if (r[I2C_SLV0_CTRL + 3 * i] & I2C_SLV_REG_DIS_BIT)
+			return;
+	x->dlpf = r[CONFIG] & DLPF_CFG_BIT;
+	if (7 == x->dlpf) /* reserved */
+		return;
+	x->ok = true;
+
+	bool accel = r[FIFO_EN] & ACCEL_FIFO_EN_BIT, temp = r[FIFO_EN] & TEMP_FIFO_EN_BIT;
+	bool g[3] = { r[FIFO_EN] & XG_FIFO_EN_BIT, r[FIFO_EN] & YG_FIFO_EN_BIT, r[FIFO_EN] & ZG_FIFO_EN_BIT };
+	static const unsigned int ach[3] = { MPU6050_CH_XA, MPU6050_CH_YA, MPU6050_CH_ZA };
+	static const unsigned int gch[3] = { MPU6050_CH_XG, MPU6050_CH_YG, MPU6050_CH_ZG };
+	for (int i = 0; i < 3; i++) {
+		if (accel && !(r[PWR_MGMT_2] & (STDBY_XA_BIT >> i)))
+			x->channels |= ach[i];
+		if (g[i] && !(r[PWR_MGMT_2] & (STDBY_XG_BIT >> i)))
+			x->channels |= gch[i];
+	}
+	if (temp && !(r[PWR_MGMT_1] & TEMP_DIS_BIT))
+		x->channels |= MPU6050_CH_TEMP;
+	x->words = 3 * accel + temp + g[0] + g[1] + g[2];
+
+	if (r[USER_CTRL] & FIFO_EN_BIT)
+		x->direct = MPU6050_DIRECT_OFF;
+	else
+		x->direct = (r[INT_ENABLE] & DATA_RDY_EN_BIT) ? MPU6050_DIRECT_DRDY : MPU6050_DIRECT_TIMER;
+
+	static const double wake[4] = { 1.25, 5, 20, 40 };
+	bool cycle = r[PWR_MGMT_1] & CYCLE_BIT;
+	double gor = (0 == x->dlpf) ? 8000 : 1000;
+	x->sr  = cycle ? wake[r[PWR_MGMT_2] >> 6] : gor / (1 + r[SMPLRT_DIV]);
+	x->afr = 2 << ((r[ACCEL_CONFIG] & AFS_SEL_BIT) >> 3);
+	x->gfr = 250 << ((r[GYRO_CONFIG] & FS_SEL_BIT) >> 3);
+	x->aolpm = cycle && ((r[PWR_MGMT_2] & (STDBY_XG_BIT | STDBY_YG_BIT | STDBY_ZG_BIT)) ==
+			     (STDBY_XG_BIT | STDBY_YG_BIT | STDBY_ZG_BIT));
+}
+
+static int same(const struct mpu_dev *dev, const struct ref *x)
+{
+	CHECK(fabs(dev->sr - x->sr) < 1e-9 * x->sr);
+	CHECK(dev->afr == x->afr);
+	CHECK(dev->gfr == x->gfr);
+	CHECK(dev->dlpf == x->dlpf);
+	CHECK(dev->fifosensors == x->words);
+	CHECK(dev->channels == x->channels);
+	CHECK(dev->direct == x->direct);
+	CHECK(dev->aolpm == x->aolpm);
+
+	return 0;
+}
+
+/* a random image, the master and its buffered slaves off */
+static void make_image(uint8_t *r, bool clean)
+{
+	for (unsigned int i = SMPLRT_DIV; i < FIFO_R_W; i++)
+		r[i] = (uint8_t)rnd();
+	r[USER_CTRL] &= (uint8_t)~I2C_MST_EN_BIT;
+	r[FIFO_EN]   &= (uint8_t)~(SLV2_FIFO_EN_BIT | SLV1_FIFO_EN_BIT | SLV0_FIFO_EN_BIT);
+	r[I2C_MST_CTRL] &= (uint8_t)~SLV3_FIFO_EN_BIT;
+	r[INT_STATUS] = DATA_RDY_INT_BIT;
+	r[MOT_DETECT_STATUS] = MOT_ZRMOT_BIT;
+	if (!clean)
+		return;
+	r[CONFIG]      &= (uint8_t)~EXT_SYNC_SET_BIT;
+	r[INT_PIN_CFG] &= (uint8_t)~FSYNC_INT_EN_BIT;
+	r[INT_ENABLE]  &= (uint8_t)~I2C_MST_INT_EN_BIT;
+	r[PWR_MGMT_1]  &= (uint8_t)~DEVICE_RESET_BIT;
+	r[USER_CTRL]   &= (uint8_t)~(I2C_IF_DIS_BIT | FIFO_RESET_BIT | I2C_MST_RESET_BIT | SIG_COND_RESET_BIT);
+	for (int i = 0; i < 4; i++)
+		r[I2C_SLV0_CTRL + 3 * i] &= (uint8_t)~I2C_SLV_REG_DIS_BIT;
+}
+
+int main(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+
+	unsigned long adopted = 0, refused = 0;
+	for (int n = 0; n < CFG_IMAGES; n++) {
+		struct mpu_dev was = *dev;
+		make_image(emu_reg, rnd() & 1);
+		struct ref x;
+		ref_decode(emu_reg, &x);
+
+		int res = mpu_ctl_readback(dev);
+		CHECK(DATA_RDY_INT_BIT == emu_reg[INT_STATUS]);
+		CHECK(MOT_ZRMOT_BIT == emu_reg[MOT_DETECT_STATUS]);
+		if (!x.ok) {
+			CHECK(res < 0);
+			CHECK((dev->sr == was.sr) && (dev->dlpf == was.dlpf) && (dev->afr == was.afr) &&
+			      (dev->fifosensors == was.fifosensors) && (dev->channels == was.channels));
+			refused++;
+			continue;
+		}
+		CHECK(res == 0);
+		CHECK(same(dev, &x) == 0);
+		adopted++;
+
+		if (n % 16)
+			continue;
+		/* encode on top of it, one field at a time */
+		uint8_t before[128];
+		memcpy(before, emu_reg, sizeof(before));
+		unsigned int afs = rnd() % 4, fs = rnd() % 4;
+		CHECK(mpu_ctl_accel_range(dev, 2u << afs) == 0);
+		CHECK(mpu_ctl_gyro_range(dev, 250u << fs) == 0);
+		before[ACCEL_CONFIG] = (uint8_t)((before[ACCEL_CONFIG] & ~AFS_SEL_BIT) | (afs << 3));
+		before[GYRO_CONFIG]  = (uint8_t)((before[GYRO_CONFIG] & ~FS_SEL_BIT) | (fs << 3));
+		CHECK(0 == memcmp(before + SMPLRT_DIV, emu_reg + SMPLRT_DIV, FIFO_R_W - SMPLRT_DIV));
+		x.afr = 2 << afs;
+		x.gfr = 250 << fs;
+		CHECK(same(dev, &x) == 0);
+	}
+	CHECK(mpu_ctl_dlpf(dev, 7) < 0);
+	CHECK(mpu_destroy(dev) == 0);
+	CHECK((adopted > CFG_IMAGES / 8) && (refused > CFG_IMAGES / 8));
+
+	printf("cfg: %lu images adopted, %lu refused\n", adopted, refused);
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_batch.h"
+
+#include <math.h>		/* for lrint(), fabs() */
+
+/*
+ * Speculative reads on an adapter taking combined transactions and on
+ * one that refuses a read before the last message, as i2c-bcm2835 does:
+ * every drain must succeed and frames come out in order, on the second
+ * without a gap, in two transactions per drain the model predicts too.
+ * In the low-power profile the temperature and gyro readings hold their
+ * last full-power values and rate changes are refused. The fast
+ * self-test wakes the axes in standby and puts them back after, and is
+ * refused while a batch planner could change the drains under it.
+ */
+#define CORE_SAMPLES	2000
+
+static int spec_run(bool bcm2835, unsigned int step)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	emu_seq = true;
+	emu_bcm2835 = bcm2835;
+	emu_step = step;
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	CHECK(mpu_ctl_samplerate(dev, 1000) == 0);
+	CHECK(NULL != dev->Gx);
+	CHECK(mpu_ctl_speculative(dev, true) == 0);
+
+	struct mpu_busload bl = { .mode = MPU6050_BUS_SPEC, .batch = 1 };
+	CHECK(mpu_bus_model(dev, &bl) == 0);
+	CHECK(fabs(bl.xfers - (bcm2835 ? 2 : 1) * dev->sr) < 1e-6);
+
+	long prev = -1;
+	unsigned long gaps = 0;
+	for (int n = 0; n < CORE_SAMPLES; n++) {
+		CHECK(mpu_get_data(dev) == 0);
+		long seq = lrint(*(dev->Gx) * dev->glbs);
+		CHECK(seq > prev);
+		gaps += (prev >= 0) && (seq != prev + 1);
+		prev = seq;
+	}
+	if (bcm2835)
+		CHECK((0 == gaps) && (0 == dev->spec_miss));
+	CHECK(gaps <= dev->spec_miss);
+	CHECK(mpu_ctl_speculative(dev, false) == 0);
+	CHECK(mpu_get_data(dev) == 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	return 0;
+}
+
+/* big endian output registers, as the device holds them */
+static void out_word(int i, int16_t v)
+{
+	emu_reg[ACCEL_XOUT_H + 2 * i] = (uint8_t)((uint16_t)v >> 8);
+	emu_reg[ACCEL_XOUT_H + 2 * i + 1] = (uint8_t)v;
+}
+
+static int lp_run(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	emu_gyr[0] = 1310;
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	CHECK((NULL != dev->t) && (NULL != dev->Gx) && (NULL != dev->Az));
+	for (int n = 0; n < 10; n++)
+		CHECK(mpu_get_data(dev) == 0);
+	double t = *(dev->t), gx = *(dev->Gx), az = *(dev->Az);
+	CHECK(fabs(gx) > 1);
+
+	CHECK(mpu_ctl_lowpower(dev, 40) == 0);
+	CHECK(mpu_ctl_samplerate(dev, 100) < 0);
+	CHECK(mpu_ctl_dlpf(dev, 1) < 0);
+	CHECK(mpu_ctl_calibrate(dev) < 0);
+	out_word(2, 16384);
+	out_word(3, 0x7FFF); /* the sensors that are off */
+	out_word(4, -0x7FFF);
+	for (int n = 0; n < 10; n++) {
+		CHECK(mpu_get_data(dev) == 0);
+		CHECK((*(dev->t) == t) && (*(dev->Gx) == gx));
+		CHECK(fabs(*(dev->Az) - az) < 1e-3);
+	}
+
+	CHECK(mpu_ctl_lowpower(dev, 0) == 0);
+	CHECK(mpu_ctl_samplerate(dev, 100) == 0);
+	CHECK(mpu_get_data(dev) == 0);
+	CHECK(fabs(*(dev->Gx) - gx) < 1e-3);
+	CHECK(mpu_destroy(dev) == 0);
+
+	return 0;
+}
+
+static int st_run(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	CHECK(mpu_ctl_channels(dev, MPU6050_CH_ALL & ~(MPU6050_CH_YA | MPU6050_CH_ZG)) == 0);
+	mpu_reg_t pwr = emu_reg[PWR_MGMT_2];
+	int words = dev->fifosensors;
+	CHECK(pwr & (STDBY_YA_BIT | STDBY_ZG_BIT));
+
+	struct mpu_selftest_result res;
+	CHECK(mpu_ctl_selftest_result(dev, &res) == 0);
+	for (int k = 0; k < 6; k++)
+		CHECK(fabs(res.str[k] - EMU_ST) < 1e-6); /* every axis awake */
+	CHECK((pwr == emu_reg[PWR_MGMT_2]) && (words == dev->fifosensors));
+	mpu_reg_t val;
+	CHECK((mpu_get_reg(dev, PWR_MGMT_2, &val) == 0) && (val == pwr));
+	CHECK(mpu_get_data(dev) == 0);
+
+	struct mpu_batch bat;
+	CHECK(mpu_batch_init(&bat, 0.01, 1, 8) == 0);
+	CHECK(mpu_ctl_batch(dev, &bat) == 0);
+	CHECK(mpu_ctl_selftest_result(dev, &res) < 0);
+	CHECK(mpu_ctl_batch(dev, NULL) == 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	return 0;
+}
+
+int main(void)
+{
+	for (unsigned int step = 1; step <= 3; step++) {
+		CHECK(spec_run(false, step) == 0);
+		CHECK(spec_run(true, step) == 0);
+	}
+	CHECK(lp_run() == 0);
+	CHECK(st_run() == 0);
+
+	printf("core: %d speculative reads, combined and split, low power held, self-test\n", 6 * CORE_SAMPLES);
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_decim.h"
+
+#include <math.h>		/* for sin(), fabs() */
+
+/*
+ * The decimator passes DC with unity gain on every channel, a tone in
+ * the passband nearly untouched and one above the output Nyquist down
+ * to the Blackman stop band; fed in uneven chunks it gives exactly one
+ * output every factor inputs, whatever the chunk boundaries.
+ */
+#define DEC_FACTOR	8
+#define DEC_TAPS	129
+#define DEC_CH		3
+#define DEC_IN		4096
+#define DEC_STOP	1e-3	/* -60 dB */
+
+static float in[DEC_IN * DEC_CH];
+static float out[(DEC_IN / DEC_FACTOR + 1) * DEC_CH];
+
+/* a tone of f cycles per input sample on every channel, amplitude 1 */
+static void tone(double f)
+{
+	for (int i = 0; i < DEC_IN; i++)
+		for (int c = 0; c < DEC_CH; c++)
+			in[i * DEC_CH + c] = (float)sin(2 * M_PI * f * i + c);
+}
+
+/* peak of the outputs once the filter is full */
+static double peak(size_t n)
+{
+	double p = 0;
+	for (size_t k = DEC_TAPS / DEC_FACTOR + 1; k < n; k++)
+		for (int c = 0; c < DEC_CH; c++)
+			p = (fabs(out[k * DEC_CH + c]) > p) ? fabs(out[k * DEC_CH + c]) : p;
+
+	return p;
+}
+
+int main(void)
+{
+	emu_reset(); /* no bus, the model only links the library */
+	struct mpu_decim d;
+	CHECK(mpu_decim_init(&d, DEC_CH, DEC_FACTOR, DEC_TAPS, 1.0) == 0);
+
+	/* DC, primed and run */
+	const float dc[DEC_CH] = { 1.0f, -250.0f, 3.5f };
+	for (int i = 0; i < DEC_IN; i++)
+		memcpy(&in[i * DEC_CH], dc, sizeof(dc));
+	CHECK(mpu_decim_prime(&d, dc) == 0);
+	size_t n = 0;
+	CHECK(mpu_decim_run(&d, in, DEC_IN, out, &n) == 0);
+	CHECK(DEC_IN / DEC_FACTOR == n);
+	for (size_t k = 0; k < n; k++)
+		for (int c = 0; c < DEC_CH; c++)
+			CHECK(fabs(out[k * DEC_CH + c] - dc[c]) < 1e-5 * fabs(dc[c]));
+
+	/* a passband tone, a quarter of the output Nyquist */
+	CHECK(mpu_decim_reset(&d) == 0);
+	tone(0.25 / (2 * DEC_FACTOR));
+	CHECK(mpu_decim_run(&d, in, DEC_IN, out, &n) == 0);
+	CHECK(fabs(peak(n) - 1) < 0.02);
+
+	/* above the output Nyquist, past the transition band */
+	CHECK(mpu_decim_reset(&d) == 0);
+	tone(0.15);
+	CHECK(mpu_decim_run(&d, in, DEC_IN, out, &n) == 0);
+	CHECK(peak(n) < DEC_STOP);
+
+	/* uneven chunks, one output every factor inputs */
+	CHECK(mpu_decim_reset(&d) == 0);
+	size_t fed = 0, outs = 0;
+	for (size_t len = 1; fed + len <= DEC_IN; fed += len, len = len % 13 + 3) {
+		CHECK(mpu_decim_run(&d, &in[fed * DEC_CH], len, out, &n) == 0);
+		CHECK(n <= len / DEC_FACTOR + 1);
+		outs += n;
+		CHECK(outs == (fed + len) / DEC_FACTOR);
+	}
+	CHECK(fed > DEC_IN / 2);
+	CHECK(mpu_decim_free(&d) == 0);
+
+	CHECK(mpu_decim_init(&d, DEC_CH, DEC_FACTOR, DEC_TAPS, 1.5) < 0);
+	CHECK(mpu_decim_init(&d, MPU6050_DECIM_LANES + 1, DEC_FACTOR, DEC_TAPS, 1.0) < 0);
+
+	printf("decim: unity DC, stop band under %.0f dB, %zu outputs of %zu inputs\n",
+	       20 * log10(DEC_STOP), outs, fed);
+
+	return 0;
+}
@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#ifndef _TEST_MPU6050_EMU_H_
+#define _TEST_MPU6050_EMU_H_
+#include "mpu6050_core.h"
+#include "mpu6050_regs.h"
+
+#include <stdio.h>		/* for fprintf() */
+#include <stdarg.h>		/* for va_list */
+#include <errno.h>		/* for EOPNOTSUPP */
+#include <string.h>		/* for memset() */
+#include <unistd.h>		/* for syscall() */
+#include <sys/syscall.h>	/* for SYS_ioctl */
+#include <linux/i2c-dev.h>	/* for I2C_SLAVE, I2C_RDWR */
+#include <linux/i2c.h>		/* for struct i2c_msg */
+#include <i2c/smbus.h>		/* for i2c_smbus_x */
+
+/*
+ * Register level MPU-6050 for the tests
+ *
+ * The test binary defines the smbus calls and ioctl(), so the library
+ * linked into it talks to this model instead of /dev/i2c-N; bind it to
+ * any file that opens, /dev/null. Registers read back what was written,
+ * reset bits self clear, INT_STATUS and MOT_DETECT_STATUS clear when
+ * read and FIFO_R_W pops the fifo. Each FIFO_COUNT read first queues
+ * emu_step frames of the FIFO_EN sensors, from emu_acc, emu_temp and
+ * emu_gyr in LSB, the X gyro word numbering the frames with emu_seq;
+ * emu_hook, when set, runs before each to move them over time.
+ * Axes in standby give 0, an axis in self-test adds EMU_ST to its word.
+ * With emu_bcm2835 combined transactions fail as on i2c-bcm2835 when
+ * a read is not the last message.
+ *
+ * One chip sits on the auxiliary bus at emu_chip_addr: slaves 0 to 3
+ * read its registers, emu_chip, into EXT_SENS_DATA and the fifo after
+ * every frame, slave 4 transfers a byte as soon as it is enabled and
+ * reports DONE or NACK in I2C_MST_STATUS, which clears when read.
+ */
+#define EMU_FIFO_LEN	1024
+#define EMU_ST		1000	/* self-test response, LSB */
+
+static uint8_t	emu_reg[128];
+static uint8_t	emu_fifo[EMU_FIFO_LEN];
+static int	emu_head, emu_count;
+static int16_t	emu_acc[3] = { 0, 0, 16384 };
+static int16_t	emu_temp = -12420;	/* 0 C */
+static int16_t	emu_gyr[3];
+static unsigned int emu_step = 1;	/* frames queued per FIFO_COUNT read */
+static unsigned long emu_frames;	/* frames queued */
+static unsigned long emu_xfers;		/* bus transactions */
+static bool	emu_seq;		/* X gyro counts frames */
+static bool	emu_bcm2835;		/* reads end a transaction */
+static uint8_t	emu_chip[256];		/* auxiliary chip registers */
+static uint8_t	emu_chip_addr = 0x1E;	/* and its address */
+static void	(*emu_hook)(void);	/* before every frame queued */
+
+#define CHECK(x) do { if (!(x)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+static void emu_reset(void)
+{
+	memset(emu_reg, 0, sizeof(emu_reg));
+	emu_reg[PWR_MGMT_1] = SLEEP_BIT;
+	emu_reg[WHO_AM_I] = 0x68;
+	emu_head = emu_count = 0;
+	emu_frames = emu_xfers = 0;
+	emu_seq = emu_bcm2835 = false;
+	memset(emu_chip, 0, sizeof(emu_chip));
+	emu_hook = NULL;
+}
+
+static void emu_put(uint8_t v)
+{
+	if (emu_count == EMU_FIFO_LEN) { /* overflow, the oldest byte goes */
+		emu_head = (emu_head + 1) % EMU_FIFO_LEN;
+		emu_count--;
+		emu_reg[INT_STATUS] |= FIFO_OFLOW_INT_BIT;
+	}
+	emu_fifo[(emu_head + emu_count++) % EMU_FIFO_LEN] = v;
+}
+
+static void emu_push(int16_t v)
+{
+	emu_put((uint8_t)((uint16_t)v >> 8));
+	emu_put((uint8_t)v);
+}
+
+static uint8_t emu_pop(void)
+{
+	if (0 == emu_count)
+		return 0xFF;
+
+	uint8_t v = emu_fifo[emu_head];
+	emu_head = (emu_head + 1) % EMU_FIFO_LEN;
+	emu_count--;
+
+	return v;
+}
+
+/* slaves 0 to 3, in order, after the sensor words */
+static void emu_aux(void)
+{
+	if (!(emu_reg[USER_CTRL] & I2C_MST_EN_BIT)) /* master off */
+		return;
+
+	int ext = 0;
+	for (int i = 0; i < 4; i++) {
+		uint8_t addr = emu_reg[I2C_SLV0_ADDR + 3 * i], reg = emu_reg[I2C_SLV0_REG + 3 * i];
+		uint8_t ctrl = emu_reg[I2C_SLV0_CTRL + 3 * i];
+		if (!(ctrl & I2C_SLV_EN_BIT) || !(addr & I2C_SLV_RW_BIT))
+			continue;
+
+		int len = ctrl & I2C_SLV_LEN_BIT;
+		bool ack = ((addr & I2C_SLV_ADDR_BIT) == emu_chip_addr);
+		uint8_t b[16];
+		for (int k = 0; k < len; k++)
+			b[k] = ack ? emu_chip[(uint8_t)(reg + k)] : 0;
+		int grp = (ctrl & I2C_SLV_GRP_BIT) ? 1 : 0; /* pairs start at odd registers */
+		for (int k = 0; (ctrl & I2C_SLV_BYTE_SW_BIT) && (k + 1 < len); k++) {
+			if (((reg + k) & 1) != grp) /* unpaired byte */
+				continue;
+			uint8_t t = b[k];
+			b[k] = b[k + 1];
+			b[k + 1] = t;
+			k++;
+		}
+
+		bool fifo = (i < 3) ? (emu_reg[FIFO_EN] & (SLV0_FIFO_EN_BIT << i)) :
+				      (emu_reg[I2C_MST_CTRL] & SLV3_FIFO_EN_BIT);
+		for (int k = 0; k < len; k++, ext++) {
+			if (ext < 24)
+				emu_reg[EXT_SENS_DATA_00 + ext] = b[k];
+			if (fifo)
+				emu_put(b[k]);
+		}
+	}
+}
+
+/* slave 4, one byte as soon as it is enabled */
+static void emu_slv4(void)
+{
+	uint8_t addr = emu_reg[I2C_SLV4_ADDR], reg = emu_reg[I2C_SLV4_REG];
+	if ((addr & I2C_SLV_ADDR_BIT) != emu_chip_addr) {
+		emu_reg[I2C_MAST_STATUS] |= I2C_SLV4_NACK_BIT;
+		return;
+	}
+	if (addr & I2C_SLV_RW_BIT)
+		emu_reg[I2C_SLV4_DI] = emu_chip[reg];
+	else
+		emu_chip[reg] = emu_reg[I2C_SLV4_DO];
+	emu_reg[I2C_MAST_STATUS] |= I2C_SLV4_DONE_BIT;
+}
+
+static void emu_frame(void)
+{
+	uint8_t en = emu_reg[FIFO_EN];
+	if (!(emu_reg[USER_CTRL] & FIFO_EN_BIT)) /* fifo off */
+		return;
+	if (NULL != emu_hook)
+		emu_hook();
+
+	uint8_t sb = emu_reg[PWR_MGMT_2];
+	if (en & ACCEL_FIFO_EN_BIT)
+		for (int i = 0; i < 3; i++)
+			emu_push((sb & (STDBY_XA_BIT >> i)) ? 0 :
+				 emu_acc[i] + ((emu_reg[ACCEL_CONFIG] & (XA_ST_BIT >> i)) ? EMU_ST : 0));
+	if (en & TEMP_FIFO_EN_BIT)
+		emu_push(emu_temp);
+	for (int i = 0; i < 3; i++) {
+		if (!(en & (XG_FIFO_EN_BIT >> i)))
+			continue;
+		if (emu_seq && (0 == i))
+			emu_push((int16_t)emu_frames);
+		else
+			emu_push((sb & (STDBY_XG_BIT >> i)) ? 0 :
+				 emu_gyr[i] + ((emu_reg[GYRO_CONFIG] & (XG_ST_BIT >> i)) ? EMU_ST : 0));
+	}
+	emu_aux();
+	emu_frames++;
+}
+
+static void emu_tick(void)
+{
+	for (unsigned int i = 0; i < emu_step; i++)
+		emu_frame();
+}
+
+static uint8_t emu_read(uint8_t reg)
+{
+	uint8_t v;
+	switch (reg) {
+	case FIFO_COUNT_H:
+		emu_tick();
+		return (uint8_t)(emu_count >> 8);
+	case FIFO_COUNT_L:
+		return (uint8_t)emu_count;
+	case FIFO_R_W:
+		return emu_pop();
+	case INT_STATUS:
+	case MOT_DETECT_STATUS:
+	case I2C_MAST_STATUS:
+		v = emu_reg[reg];
+		emu_reg[reg] = 0;
+		return v;
+	default:
+		return emu_reg[reg & 0x7F];
+	}
+}
+
+static void emu_write(uint8_t reg, uint8_t v)
+{
+	switch (reg) {
+	case PWR_MGMT_1:
+		v &= (uint8_t)~DEVICE_RESET_BIT; /* self clears */
+		break;
+	case USER_CTRL:
+		if (v & FIFO_RESET_BIT)
+			emu_head = emu_count = 0;
+		v &= (uint8_t)~(FIFO_RESET_BIT | I2C_MST_RESET_BIT | SIG_COND_RESET_BIT);
+		break;
+	case SIGNAL_PATH_RESET:
+		v = 0;
+		break;
+	case I2C_SLV4_CTRL:
+		emu_reg[reg] = v;
+		if (v & I2C_SLV4_EN_BIT)
+			emu_slv4();
+		v &= (uint8_t)~I2C_SLV4_EN_BIT; /* self clears when done */
+		break;
+	case FIFO_R_W:
+		return;
+	}
+	emu_reg[reg & 0x7F] = v;
+}
+
+/* auto-increment except on FIFO_R_W */
+static void emu_read_run(uint8_t reg, __u8 *v, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		v[i] = emu_read((FIFO_R_W == reg) ? reg : (uint8_t)(reg + i));
+}
+
+__s32 i2c_smbus_read_byte_data(int file, __u8 command)
+{
+	(void)file;
+	emu_xfers++;
+	return emu_read(command);
+}
+
+__s32 i2c_smbus_write_byte_data(int file, __u8 command, __u8 value)
+{
+	(void)file;
+	emu_xfers++;
+	emu_write(command, value);
+	return 0;
+}
+
+/* smbus words are little endian, the device sends the high byte first */
+__s32 i2c_smbus_read_word_data(int file, __u8 command)
+{
+	__u8 v[2];
+	(void)file;
+	emu_xfers++;
+	emu_read_run(command, v, 2);
+	return v[0] | (v[1] << 8);
+}
+
+__s32 i2c_smbus_write_word_data(int file, __u8 command, __u16 value)
+{
+	(void)file;
+	emu_xfers++;
+	emu_write(command, (uint8_t)value);
+	emu_write((uint8_t)(command + 1), (uint8_t)(value >> 8));
+	return 0;
+}
+
+__s32 i2c_smbus_read_i2c_block_data(int file, __u8 command, __u8 length, __u8 *values)
+{
+	(void)file;
+	emu_xfers++;
+	emu_read_run(command, values, length);
+	return length;
+}
+
+__s32 i2c_smbus_write_i2c_block_data(int file, __u8 command, __u8 length, const __u8 *values)
+{
+	(void)file;
+	emu_xfers++;
+	for (int i = 0; i < length; i++)
+		emu_write((uint8_t)(command + i), values[i]);
+	return 0;
+}
+
+/* combined transactions: a write sets the register pointer, reads follow it */
+static int emu_rdwr(struct i2c_rdwr_ioctl_data *x)
+{
+	uint8_t reg = 0;
+	for (unsigned int i = 0; emu_bcm2835 && (i + 1 < x->nmsgs); i++) {
+		if (x->msgs[i].flags & I2C_M_RD) {
+			errno = EOPNOTSUPP;
+			return -1;
+		}
+	}
+	emu_xfers++;
+	for (unsigned int i = 0; i < x->nmsgs; i++) {
+		struct i2c_msg *m = &x->msgs[i];
+		if (m->flags & I2C_M_RD) {
+			emu_read_run(reg, m->buf, m->len);
+			continue;
+		}
+		if (0 == m->len)
+			continue;
+		reg = m->buf[0];
+		for (int k = 1; k < m->len; k++)
+			emu_write((uint8_t)(reg + k - 1), m->buf[k]);
+	}
+
+	return (int)x->nmsgs;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list ap;
+	va_start(ap, request);
+	void *arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (I2C_SLAVE == request)
+		return 0;
+	if (I2C_RDWR == request)
+		return emu_rdwr(arg);
+
+	return (int)syscall(SYS_ioctl, fd, request, arg);
+}
+
+#endif /* _TEST_MPU6050_EMU_H_ */
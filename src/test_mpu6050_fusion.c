@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_fusion.h"
+
+#include <math.h>		/* for sinf(), cosf(), fabsf() */
+
+/*
+ * Every filter, seeded level then held at a static tilt with the gyro
+ * still, must converge to the roll and pitch of the accelerometer; a
+ * constant rate about Z must integrate to the heading it sweeps, and
+ * without feedback a rate about X to the roll. A batch gives the same
+ * attitude as the frames fed one by one, to float rounding.
+ */
+#define FUS_DT		0.01f	/* 100 Hz */
+#define FUS_TOL		0.5f	/* degrees */
+
+static const struct {
+	int	filter;
+	float	gain;
+	float	ki;
+} fus_cfg[] = {
+	{ MPU6050_FUSION_COMPLEMENTARY, 0.98f, 0 },
+	{ MPU6050_FUSION_MAHONY,	1.0f,  0.01f },
+	{ MPU6050_FUSION_MADGWICK,	0.1f,  0 },
+};
+#define FUS_FILTERS	(sizeof(fus_cfg) / sizeof(fus_cfg[0]))
+
+/* specific force at rest, roll then pitch (degrees) */
+static void tilt(float *a, float roll, float pitch)
+{
+	float r = roll * (float)M_PI / 180, p = pitch * (float)M_PI / 180;
+	a[0] = -sinf(p);
+	a[1] = sinf(r) * cosf(p);
+	a[2] = cosf(r) * cosf(p);
+}
+
+static int run(struct mpu_fusion *f, const float *a, const float *g, int frames)
+{
+	for (int n = 0; n < frames; n++)
+		CHECK(mpu_fusion_update(f, a, g, FUS_DT) == 0);
+
+	return 0;
+}
+
+static int check_tilt(int k)
+{
+	struct mpu_fusion f;
+	const float g[3] = { 0 };
+	float a[3];
+	CHECK(mpu_fusion_init(&f, fus_cfg[k].filter, fus_cfg[k].gain, fus_cfg[k].ki) == 0);
+	tilt(a, 0, 0);
+	CHECK(run(&f, a, g, 10) == 0);
+	CHECK((fabsf(f.roll) < FUS_TOL) && (fabsf(f.pitch) < FUS_TOL));
+
+	tilt(a, 30, -20);
+	CHECK(run(&f, a, g, 6000) == 0);
+	CHECK(fabsf(f.roll - 30) < FUS_TOL);
+	CHECK(fabsf(f.pitch + 20) < FUS_TOL);
+
+	return 0;
+}
+
+static int check_rate(int k)
+{
+	struct mpu_fusion f;
+	float a[3];
+	tilt(a, 0, 0);
+
+	/* 10 dps about Z for 3 s, gravity says nothing of the heading */
+	const float gz[3] = { 0, 0, 10 };
+	CHECK(mpu_fusion_init(&f, fus_cfg[k].filter, fus_cfg[k].gain, fus_cfg[k].ki) == 0);
+	CHECK(run(&f, a, gz, 301) == 0); /* the first frame seeds */
+	CHECK(fabsf(f.yaw - 30) < FUS_TOL);
+	CHECK((fabsf(f.roll) < FUS_TOL) && (fabsf(f.pitch) < FUS_TOL));
+
+	if (MPU6050_FUSION_COMPLEMENTARY == fus_cfg[k].filter) /* always pulled to gravity */
+		return 0;
+
+	/* 20 dps about X for 2 s, no feedback */
+	const float gx[3] = { 20, 0, 0 };
+	CHECK(mpu_fusion_init(&f, fus_cfg[k].filter, 0, 0) == 0);
+	CHECK(run(&f, a, gx, 201) == 0);
+	CHECK(fabsf(f.roll - 40) < FUS_TOL);
+	CHECK(fabsf(f.pitch) < FUS_TOL);
+
+	return 0;
+}
+
+static int check_batch(int k)
+{
+	enum { N = 64 };
+	float acc[N][3], gyr[N][3], dt[N], q[N][4];
+	for (int i = 0; i < N; i++) {
+		tilt(acc[i], (float)i / 4, -(float)i / 8);
+		gyr[i][0] = 1;
+		gyr[i][1] = -2;
+		gyr[i][2] = 3;
+		dt[i] = FUS_DT;
+	}
+
+	struct mpu_fusion f, b;
+	CHECK(mpu_fusion_init(&f, fus_cfg[k].filter, fus_cfg[k].gain, fus_cfg[k].ki) == 0);
+	CHECK(mpu_fusion_init(&b, fus_cfg[k].filter, fus_cfg[k].gain, fus_cfg[k].ki) == 0);
+	for (int i = 0; i < N; i++)
+		CHECK(mpu_fusion_update(&f, acc[i], gyr[i], dt[i]) == 0);
+	CHECK(mpu_fusion_batch(&b, (const float (*)[3])acc, (const float (*)[3])gyr, dt, N, q) == 0);
+	for (int i = 0; i < 4; i++) /* the same steps, contracted differently */
+		CHECK((fabsf(f.q[i] - b.q[i]) < 1e-6f) && (q[N - 1][i] == b.q[i]));
+	CHECK(fabsf(f.roll - b.roll) + fabsf(f.pitch - b.pitch) + fabsf(f.yaw - b.yaw) < 1e-3f);
+
+	return 0;
+}
+
+int main(void)
+{
+	emu_reset(); /* no bus, the model only links the library */
+	for (size_t k = 0; k < FUS_FILTERS; k++) {
+		CHECK(check_tilt((int)k) == 0);
+		CHECK(check_rate((int)k) == 0);
+		CHECK(check_batch((int)k) == 0);
+	}
+	struct mpu_fusion f;
+	CHECK(mpu_fusion_init(&f, MPU6050_FUSION_COMPLEMENTARY, 1, 0) < 0);
+	CHECK(mpu_fusion_init(&f, MPU6050_FUSION_MADGWICK, -1, 0) < 0);
+
+	printf("fusion: %zu filters, tilt and rates within %.1f degrees\n", FUS_FILTERS, FUS_TOL);
+
+	return 0;
+}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_idle.h"
+
+#include <math.h>		/* for fabs() */
+
+/*
+ * Motion gating on the model: attaching programs the motion engine,
+ * zero motion raised in INT_STATUS with MOT_ZRMOT drops the sampling
+ * rate to the idle rate at the next status read, motion brings the
+ * rate left back, and detaching turns the engine off. A lost zero
+ * motion edge is replaced by the level once rearm has passed.
+ */
+#define IDLE_HZ		10
+#define RUN_HZ		200
+
+static int frames(struct mpu_dev *dev, int n)
+{
+	for (int k = 0; k < n; k++)
+		CHECK(mpu_get_data(dev) == 0);
+
+	return 0;
+}
+
+/* the status is read at the next drain */
+static int still(struct mpu_dev *dev, struct mpu_idle *ip, bool rearm)
+{
+	emu_reg[INT_STATUS] |= rearm ? 0 : ZMOT_INT_BIT;
+	emu_reg[MOT_DETECT_STATUS] = MOT_ZRMOT_BIT;
+	ip->t_poll = 0;
+	if (rearm)
+		ip->t_edge -= ip->rearm;
+	CHECK(frames(dev, 1) == 0);
+
+	return 0;
+}
+
+static int moving(struct mpu_dev *dev)
+{
+	emu_reg[INT_STATUS] |= MOT_INT_BIT;
+	CHECK(frames(dev, 1) == 0);
+
+	return 0;
+}
+
+int main(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	CHECK(mpu_ctl_dlpf(dev, 1) == 0);
+	CHECK(mpu_ctl_samplerate(dev, RUN_HZ) == 0);
+	uint8_t div = emu_reg[SMPLRT_DIV], cfg = emu_reg[CONFIG];
+
+	struct mpu_idle ip;
+	CHECK(mpu_idle_init(&ip, 0.05, 0.02, 0.128, IDLE_HZ) == 0);
+	CHECK(mpu_ctl_idle(dev, &ip) == 0);
+	CHECK((MOT_EN_BIT | ZMOT_EN_BIT) == (emu_reg[INT_ENABLE] & (MOT_EN_BIT | ZMOT_EN_BIT | FF_EN_BIT)));
+	CHECK((25 == emu_reg[MOT_THR]) && (10 == emu_reg[ZRMOT_THR]) && (2 == emu_reg[ZRMOT_DUR]));
+	CHECK(frames(dev, 10) == 0);
+	CHECK(!ip.idle && (fabs(dev->sr - RUN_HZ) < 1e-9));
+
+	/* still: the idle rate, read at every drain */
+	CHECK(still(dev, &ip, false) == 0);
+	CHECK(ip.idle && (1 == ip.enters));
+	CHECK(fabs(dev->sr - IDLE_HZ) < 1);
+	CHECK(div != emu_reg[SMPLRT_DIV]);
+	unsigned long long polls = ip.polls;
+	CHECK(frames(dev, 3) == 0);
+	CHECK((ip.polls == polls + 3) && ip.idle);
+
+	/* moving: the rate left */
+	CHECK(moving(dev) == 0);
+	CHECK(!ip.idle && (1 == ip.exits));
+	CHECK(fabs(dev->sr - RUN_HZ) < 1e-9);
+	CHECK((div == emu_reg[SMPLRT_DIV]) && (cfg == emu_reg[CONFIG]));
+
+	/* the edge lost, the level read after rearm */
+	CHECK(still(dev, &ip, true) == 0);
+	CHECK(ip.idle && (2 == ip.enters) && (1 == ip.rearms));
+	CHECK(moving(dev) == 0);
+	CHECK(!ip.idle && (fabs(dev->sr - RUN_HZ) < 1e-9));
+
+	/* detached while idle, the rate left and the engine off */
+	CHECK(still(dev, &ip, false) == 0);
+	CHECK(ip.idle);
+	CHECK(mpu_ctl_idle(dev, NULL) == 0);
+	CHECK(fabs(dev->sr - RUN_HZ) < 1e-9);
+	CHECK(0 == (emu_reg[INT_ENABLE] & (MOT_EN_BIT | ZMOT_EN_BIT | FF_EN_BIT)));
+	CHECK(frames(dev, 10) == 0);
+	unsigned long long enters = ip.enters;
+
+	/* out of the register ranges */
+	CHECK(mpu_idle_init(&ip, 1.0, 0.02, 0.128, IDLE_HZ) < 0);
+	CHECK(mpu_idle_init(&ip, 0.05, 0.02, 0.128, -1) < 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	printf("idle: %d Hz still, %d Hz moving, %llu switches\n", IDLE_HZ, RUN_HZ, enters);
+
+	return 0;
+}
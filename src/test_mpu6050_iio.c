@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_iio.h"
+
+#include <math.h>		/* for fabs() */
+#include <stdlib.h>		/* for system() */
+#include <fcntl.h>		/* for open() */
+#include <pthread.h>		/* for pthread_create() */
+#include <sys/stat.h>		/* for mkdir(), mkfifo() */
+
+/*
+ * The IIO backend on a sysfs directory laid out as inv_mpu6050 does and
+ * a pipe for /dev/iio:deviceN, fed big endian scans in odd-sized chunks:
+ * open enables the scan elements and the buffer, scans come out scaled
+ * in order with their timestamps, a scan of two gyro axes too. Controls
+ * that write registers fail and leave the mirror as it was.
+ */
+#define IIO_SYS		"iio:device0"
+#define IIO_CHR		"iio_chr"
+#define IIO_SCANS	200
+#define IIO_CHUNK	37	/* bytes per write(), across scans */
+
+static const char *iio_ch[MPU6050_IIO_CHANS] = {
+	"accel_x", "accel_y", "accel_z", "temp", "anglvel_x", "anglvel_y", "anglvel_z", "timestamp"
+};
+static const int16_t iio_val[7] = { 16384, -100, 200, 340 * 5, -131, 262, 393 };
+
+struct feed {
+	unsigned int mask;	/* words in a scan, of iio_val	*/
+	int	scans;
+};
+
+static int put(const char *name, const char *val)
+{
+	char path[256];
+	snprintf(path, sizeof(path), IIO_SYS "/%s", name);
+	FILE *fp = fopen(path, "w");
+	CHECK(NULL != fp);
+	fputs(val, fp);
+	fclose(fp);
+
+	return 0;
+}
+
+static int get(const char *name, const char *val)
+{
+	char path[256], buf[64] = { 0 };
+	snprintf(path, sizeof(path), IIO_SYS "/%s", name);
+	FILE *fp = fopen(path, "r");
+	CHECK(NULL != fp);
+	CHECK(NULL != fgets(buf, sizeof(buf), fp));
+	fclose(fp);
+	CHECK(0 == strncmp(buf, val, strlen(val)));
+
+	return 0;
+}
+
+/* the driver side: scans at 100 Hz from 5 s, timestamp 8 byte aligned */
+static void *feed(void *arg)
+{
+	const struct feed *f = arg;
+	static uint8_t buf[IIO_SCANS * 24];
+	size_t n = 0;
+	for (int s = 0; s < f->scans; s++) {
+		size_t w = 0;
+		for (int i = 0; i < 7; i++) {
+			if (!(f->mask & (1u << i)))
+				continue;
+			buf[n + w++] = (uint8_t)((uint16_t)iio_val[i] >> 8);
+			buf[n + w++] = (uint8_t)iio_val[i];
+		}
+		w = (w + 7) & ~(size_t)7;
+		int64_t ns = 5000000000LL + s * 10000000LL;
+		memcpy(buf + n + w, &ns, sizeof(ns));
+		n += w + sizeof(ns);
+	}
+
+	int fd = open(IIO_CHR, O_WRONLY);
+	for (size_t o = 0; (fd >= 0) && (o < n); o += IIO_CHUNK) {
+		size_t k = (n - o < IIO_CHUNK) ? n - o : IIO_CHUNK;
+		if (write(fd, buf + o, k) != (ssize_t)k)
+			break;
+	}
+	close(fd);
+
+	return NULL;
+}
+
+static int make_sys(void)
+{
+	CHECK((system("rm -rf '" IIO_SYS "' " IIO_CHR) == 0));
+	CHECK(mkdir(IIO_SYS, 0700) == 0);
+	CHECK(mkdir(IIO_SYS "/scan_elements", 0700) == 0);
+	CHECK(mkdir(IIO_SYS "/buffer", 0700) == 0);
+	CHECK(mkfifo(IIO_CHR, 0600) == 0);
+
+	for (int i = 0; i < MPU6050_IIO_CHANS; i++) {
+		char name[64], val[32];
+		snprintf(name, sizeof(name), "scan_elements/in_%s_en", iio_ch[i]);
+		CHECK(put(name, "0") == 0);
+		snprintf(name, sizeof(name), "scan_elements/in_%s_index", iio_ch[i]);
+		snprintf(val, sizeof(val), "%d\n", i);
+		CHECK(put(name, val) == 0);
+		snprintf(name, sizeof(name), "scan_elements/in_%s_type", iio_ch[i]);
+		CHECK(put(name, (MPU6050_IIO_CHANS - 1 == i) ? "le:s64/64>>0\n" : "be:s16/16>>0\n") == 0);
+	}
+	CHECK(put("name", "mpu6050\n") == 0);
+	CHECK(put("buffer/enable", "0") == 0);
+	CHECK(put("buffer/length", "0") == 0);
+	CHECK(put("buffer/watermark", "1") == 0);
+	CHECK(put("current_timestamp_clock", "realtime\n") == 0);
+	CHECK(put("in_accel_scale", "0.001196\n") == 0);	/* +-4 g */
+	CHECK(put("in_anglvel_scale", "0.000266181\n") == 0);	/* +-500 dps */
+	CHECK(put("sampling_frequency", "100\n") == 0);
+
+	return 0;
+}
+
+/* every register-writing control fails, the mirror keeps its values */
+static int refused(struct mpu_dev *dev)
+{
+	mpu_reg_t before[128], after[128];
+	int got[128];
+	for (int r = 0; r < 128; r++)
+		got[r] = mpu_get_reg(dev, (mpu_reg_t)r, &before[r]);
+
+	CHECK(mpu_ctl_dlpf(dev, 3) < 0);
+	CHECK(mpu_ctl_samplerate(dev, 50) < 0);
+	CHECK(mpu_ctl_accel_range(dev, 16) < 0);
+	CHECK(mpu_ctl_gyro_range(dev, 2000) < 0);
+	CHECK(mpu_ctl_clocksource(dev, CLKSEL_0) < 0);
+	CHECK(mpu_ctl_channels(dev, MPU6050_CH_ACCEL) < 0);
+	CHECK(mpu_ctl_lowpower(dev, 5) < 0);
+	CHECK(mpu_ctl_speculative(dev, true) < 0);
+	CHECK(mpu_ctl_direct(dev, MPU6050_DIRECT_TIMER) < 0);
+	CHECK(mpu_ctl_mag(dev, 0, MPU6050_MAG_HMC5883L) < 0);
+	CHECK(mpu_ctl_reset(dev) < 0);
+	CHECK(mpu_ctl_calibrate(dev) < 0);
+	CHECK(mpu_ctl_calibrate_pose(dev, MPU6050_POSE_ZDOWN) < 0);
+	CHECK(mpu_ctl_readback(dev) < 0);
+
+	for (int r = 0; r < 128; r++) {
+		CHECK(mpu_get_reg(dev, (mpu_reg_t)r, &after[r]) == got[r]);
+		CHECK((got[r] < 0) || (after[r] == before[r]));
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	emu_reset(); /* no bus, the model only links the library */
+	CHECK(make_sys() == 0);
+
+	/* every sensor */
+	struct mpu_iio io;
+	struct feed f = { .mask = 0x7F, .scans = IIO_SCANS };
+	pthread_t th;
+	CHECK(pthread_create(&th, NULL, feed, &f) == 0);
+	CHECK(mpu_iio_open(&io, IIO_SYS, IIO_CHR, MPU6050_CH_ALL, 16) == 0);
+	CHECK((7 == io.words) && (24 == io.scan) && (16 == io.ch[7].off));
+	CHECK(get("buffer/enable", "1") == 0);
+	CHECK(get("current_timestamp_clock", "monotonic") == 0);
+	CHECK(get("buffer/watermark", "16") == 0);
+
+	struct mpu_dev *dev = NULL;
+	CHECK(mpu_init_iio(&dev, &io) == 0);
+	CHECK((4 == dev->afr) && (500 == dev->gfr) && (fabs(dev->sr - 100) < 1e-9) && (7 == dev->fifosensors));
+	for (int n = 0; n < IIO_SCANS; n++) {
+		CHECK(mpu_get_data(dev) == 0);
+		CHECK(fabs(dev->ts - (5 + n * 0.01)) < 1e-6);
+	}
+	CHECK(fabs(fabs(*(dev->Ax)) - 2) < 1e-3);
+	CHECK(fabs(*(dev->t) - (5 + 36.53)) < 1e-3);
+	CHECK(fabs(fabs(*(dev->Gx)) - 2) < 1e-2);
+	CHECK(fabs(dev->dt - 0.01) < 1e-6);
+	CHECK(io.scans == IIO_SCANS);
+	unsigned long long reads = io.reads;
+	CHECK(reads < IIO_SCANS);
+	CHECK(refused(dev) == 0);
+	CHECK(mpu_get_data(dev) < 0); /* the writer is done */
+	pthread_join(th, NULL);
+	CHECK(mpu_destroy(dev) == 0);
+	CHECK(mpu_iio_close(&io) == 0);
+	CHECK(get("buffer/enable", "0") == 0);
+
+	/* gyro x and z alone */
+	f.mask = (1u << 4) | (1u << 6);
+	f.scans = 10;
+	CHECK(pthread_create(&th, NULL, feed, &f) == 0);
+	CHECK(mpu_iio_open(&io, IIO_SYS, IIO_CHR, MPU6050_CH_XG | MPU6050_CH_ZG, 4) == 0);
+	CHECK((2 == io.words) && (16 == io.scan));
+	dev = NULL;
+	CHECK(mpu_init_iio(&dev, &io) == 0);
+	CHECK((2 == dev->fifosensors) && (NULL == dev->Ax) && (NULL != dev->Gz));
+	for (int n = 0; n < f.scans; n++)
+		CHECK(mpu_get_data(dev) == 0);
+	CHECK(fabs(fabs(*(dev->Gz)) - 6) < 1e-2);
+	pthread_join(th, NULL);
+	CHECK(mpu_destroy(dev) == 0);
+	CHECK(mpu_iio_close(&io) == 0);
+
+	/* another driver */
+	CHECK(put("name", "bmi160\n") == 0);
+	CHECK(mpu_iio_open(&io, IIO_SYS, IIO_CHR, MPU6050_CH_ALL, 4) < 0);
+	CHECK(system("rm -rf '" IIO_SYS "' " IIO_CHR) == 0);
+
+	printf("iio: %d scans in %llu reads, controls refused\n", IIO_SCANS, reads);
+
+	return 0;
+}
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_log.h"
+#include "mpu6050_replay.h"
+
+#include <stdlib.h>		/* for malloc(), free() */
+#include <fcntl.h>		/* for open() */
+#include <time.h>		/* for clock_gettime() */
+#include <math.h>		/* for fabs() */
+
+/*
+ * Plain and packed logs must give back every frame written, bit exact,
+ * times within a microsecond step. Frames mix sensor noise with full
+ * scale jumps, repeated and overflowing time steps and a layout change,
+ * so every block closing rule and every delta width is crossed. The
+ * parameter snapshot must replay, and not from another format version.
+ * Replayed through mpu_get_data(), a log of many blocks, plain and
+ * packed, gives every frame back in order, and a seek lands on the
+ * first frame at or after its time: the first, the last, one inside a
+ * block, one on a block boundary, or none past the end.
+ */
+#define LOG_PATH	"test_mpu6050_log.bin"
+#define LOG_FRAMES	12000
+#define LOG_WORDS	7
+#define SEEK_FRAMES	4000
+
+struct frame {
+	unsigned int words;
+	int16_t raw[LOG_WORDS];
+	uint64_t ns;
+};
+
+static uint32_t lcg = 12345;
+
+static uint32_t rnd(void)
+{
+	lcg = lcg * 1664525u + 1013904223u;
+	return lcg >> 8;
+}
+
+static void make_frames(struct frame *f, size_t n)
+{
+	int16_t x[LOG_WORDS] = { 100, -200, 16384, -3000, 5, -7, 12 };
+	uint64_t ns = 1000000000000ULL;
+	for (size_t i = 0; i < n; i++) {
+		f[i].words = ((i / 3000) % 2) ? 4 : LOG_WORDS; /* channels switched */
+		uint32_t r = rnd();
+		if (0 == r % 997)
+			ns += 70000000;			/* step past uint16_t us */
+		else if (r % 53)
+			ns += 1000000 + r % 2000;	/* 1 kHz, jittered */
+		for (unsigned int c = 0; c < LOG_WORDS; c++) {
+			if (0 == rnd() % 701)	/* full scale swing */
+				x[c] = (x[c] < 0) ? INT16_MAX : INT16_MIN;
+			else
+				x[c] = (int16_t)(x[c] + (int)(rnd() % 33) - 16);
+			f[i].raw[c] = x[c];
+		}
+		f[i].ns = ns;
+	}
+}
+
+static int check_log(const struct frame *f, size_t n, uint8_t codec, double *rate)
+{
+	int fd = open(LOG_PATH, O_RDONLY);
+	CHECK(fd >= 0);
+	off_t size = lseek(fd, 0, SEEK_END);
+	uint8_t *file = malloc((size_t)size);
+	CHECK(NULL != file);
+	CHECK(pread(fd, file, (size_t)size, 0) == size);
+	close(fd);
+
+	const struct mpu_log_hdr *h = (const struct mpu_log_hdr *)file;
+	CHECK(0 == memcmp(h->magic, MPU6050_LOG_MAGIC, sizeof(h->magic)));
+	CHECK(MPU6050_LOG_VERSION == h->version);
+	CHECK(MPU6050_LOG_BLK == h->blk_len);
+	CHECK(0 == (size - h->data_off) % MPU6050_LOG_BLK);
+
+	static uint8_t out[MPU6050_LOG_BLK * 16];
+	size_t k = 0;
+	unsigned long long frames = 0;
+	double busy = 0;
+	for (off_t off = h->data_off; off < size; off += MPU6050_LOG_BLK) {
+		const struct mpu_log_blk *b = (const struct mpu_log_blk *)(file + off);
+		CHECK(MPU6050_LOG_BLK_MAGIC == b->magic);
+		CHECK((b->words == LOG_WORDS) || (codec == b->codec));
+
+		struct timespec t0, t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		CHECK(mpu_log_unpack(b, out, sizeof(out)) == 0);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		busy += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+		frames += b->frames;
+
+		size_t stride = 2 + 2 * (size_t)b->words;
+		uint64_t ns = b->t0_ns;
+		for (unsigned int i = 0; i < b->frames; i++, k++) {
+			const uint8_t *p = out + i * stride;
+			uint16_t step;
+			memcpy(&step, p, sizeof(step));
+			ns += step * 1000ULL;
+			CHECK(k < n);
+			CHECK(b->words == f[k].words);
+			CHECK(0 == memcmp(p + 2, f[k].raw, 2 * (size_t)b->words));
+			CHECK(llabs((long long)(ns - f[k].ns)) <= 1000);
+		}
+	}
+	CHECK(k == n);
+	*rate = (busy > 0) ? frames / busy : 0;
+	free(file);
+
+	return 0;
+}
+
+static int round_trip(struct mpu_dev *dev, const struct frame *f, size_t n, int flags, double *rate)
+{
+	struct mpu_log log;
+	CHECK(mpu_log_open(&log, LOG_PATH, dev, flags) == 0);
+	for (size_t i = 0; i < n; i++)
+		CHECK(mpu_log_frame(&log, f[i].raw, f[i].words, f[i].ns * 1e-9) == 0);
+	CHECK(mpu_log_close(&log) == 0);
+	CHECK(log.frames == n);
+	CHECK(0 == log.dropped);
+
+	uint8_t codec = (flags & MPU6050_LOG_PACK) ? MPU6050_LOG_CODEC_PACK : MPU6050_LOG_CODEC_PLAIN;
+	int res = check_log(f, n, codec, rate);
+	unlink(LOG_PATH);
+
+	return res;
+}
+
+static int check_replay(struct mpu_dev *dev, const struct frame *f)
+{
+	struct mpu_log log;
+	CHECK(mpu_log_open(&log, LOG_PATH, dev, 0) == 0);
+	CHECK(mpu_log_frame(&log, f[0].raw, f[0].words, f[0].ns * 1e-9) == 0);
+	CHECK(mpu_log_close(&log) == 0);
+
+	struct mpu_replay rp;
+	struct mpu_dev *rd = NULL;
+	uint8_t v;
+	CHECK(mpu_replay_open(&rp, LOG_PATH, 0) == 0);
+	CHECK(mpu_init_replay(&rd, &rp) == 0);
+	CHECK((rd->sr == dev->sr) && (rd->afr == dev->afr) && (rd->fifosensors == dev->fifosensors));
+	mpu_reg_t div, afs;
+	CHECK((mpu_get_reg(rd, SMPLRT_DIV, &div) == 0) && (mpu_get_reg(rd, ACCEL_CONFIG, &afs) == 0));
+	CHECK((mpu_ctl_samplerate(rd, 50) < 0) && (mpu_ctl_accel_range(rd, 16) < 0)); /* no bus */
+	CHECK((mpu_get_reg(rd, SMPLRT_DIV, &v) == 0) && (v == div));
+	CHECK((mpu_get_reg(rd, ACCEL_CONFIG, &v) == 0) && (v == afs));
+	CHECK(mpu_destroy(rd) == 0);
+	off_t version = rp.hdr->params_off + 4;
+	CHECK(mpu_replay_close(&rp) == 0);
+
+	int fd = open(LOG_PATH, O_RDWR);
+	v = 0xFF;
+	CHECK((fd >= 0) && (pwrite(fd, &v, 1, version) == 1));
+	close(fd);
+	rd = NULL;
+	CHECK(mpu_replay_open(&rp, LOG_PATH, 0) == 0);
+	CHECK(mpu_init_replay(&rd, &rp) < 0);
+	CHECK(mpu_replay_close(&rp) == 0);
+	unlink(LOG_PATH);
+
+	return 0;
+}
+
+/* the frame replayed at the seek to ns, the one expected at k or none */
+static int seek_at(struct mpu_dev *rd, struct mpu_replay *rp, const struct frame *f, uint64_t ns, long k)
+{
+	CHECK(mpu_replay_seek(rp, ns * 1e-9) == 0);
+	if (k < 0) {
+		CHECK(mpu_get_data(rd) < 0);
+		return 0;
+	}
+	CHECK(mpu_get_data(rd) == 0);
+	CHECK(fabs(rd->ts - f[k].ns * 1e-9) < 1e-6);
+	CHECK(fabs(*(rd->Gx) - f[k].raw[4] / rd->glbs) < 1e-9);
+
+	return 0;
+}
+
+static int check_seek(struct mpu_dev *dev, int flags)
+{
+	static struct frame f[SEEK_FRAMES];
+	for (size_t i = 0; i < SEEK_FRAMES; i++) {
+		f[i].words = LOG_WORDS;
+		for (unsigned int c = 0; c < LOG_WORDS; c++)
+			f[i].raw[c] = (int16_t)(rnd() % 4001) - 2000;
+		f[i].ns = 2000000000000ULL + i * 1000000ULL + ((i > 2000) ? 50000000ULL : 0);
+	}
+	struct mpu_log log;
+	CHECK(mpu_log_open(&log, LOG_PATH, dev, flags) == 0);
+	for (size_t i = 0; i < SEEK_FRAMES; i++)
+		CHECK(mpu_log_frame(&log, f[i].raw, f[i].words, f[i].ns * 1e-9) == 0);
+	CHECK(mpu_log_close(&log) == 0);
+
+	struct mpu_replay rp;
+	struct mpu_dev *rd = NULL;
+	CHECK(mpu_replay_open(&rp, LOG_PATH, 0) == 0);
+	CHECK(rp.blocks >= 3);
+	CHECK(mpu_init_replay(&rd, &rp) == 0);
+	for (size_t i = 0; i < SEEK_FRAMES; i++) {
+		CHECK(mpu_get_data(rd) == 0);
+		CHECK(fabs(rd->ts - f[i].ns * 1e-9) < 1e-6);
+		CHECK(fabs(*(rd->Gx) - f[i].raw[4] / rd->glbs) < 1e-9);
+		CHECK(fabs(*(rd->Ax) + f[i].raw[0] / rd->albs) < 1e-9);
+	}
+	CHECK(mpu_get_data(rd) < 0);
+
+	/* the frame a block starts with, and one well inside the block before */
+	uint64_t edge = rp.idx[rp.blocks / 2].t0_ns;
+	long k = 0;
+	while (f[k].ns + 1000 < edge)
+		k++;
+	CHECK(seek_at(rd, &rp, f, f[0].ns, 0) == 0);
+	CHECK(seek_at(rd, &rp, f, f[SEEK_FRAMES - 1].ns, SEEK_FRAMES - 1) == 0);
+	CHECK(seek_at(rd, &rp, f, edge, k) == 0);
+	CHECK(seek_at(rd, &rp, f, (f[k - 9].ns + f[k - 10].ns) / 2, k - 9) == 0);
+	CHECK(seek_at(rd, &rp, f, f[SEEK_FRAMES - 1].ns + 1000000, -1) == 0);
+	CHECK(seek_at(rd, &rp, f, 0, 0) == 0); /* before the recording */
+
+	CHECK(mpu_destroy(rd) == 0);
+	CHECK(mpu_replay_close(&rp) == 0);
+	unlink(LOG_PATH);
+
+	return 0;
+}
+
+int main(void)
+{
+	static struct frame f[LOG_FRAMES];
+	make_frames(f, LOG_FRAMES);
+
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+
+	double pack, rate;
+	CHECK(round_trip(dev, f, LOG_FRAMES, 0, &rate) == 0);
+	CHECK(round_trip(dev, f, LOG_FRAMES, MPU6050_LOG_PACK, &pack) == 0);
+	CHECK(round_trip(dev, f, 1, MPU6050_LOG_PACK, &rate) == 0);
+	CHECK(round_trip(dev, f, MPU6050_LOG_GROUP + 1, MPU6050_LOG_PACK, &rate) == 0);
+	CHECK(check_replay(dev, f) == 0);
+	CHECK(check_seek(dev, 0) == 0);
+	CHECK(check_seek(dev, MPU6050_LOG_PACK) == 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	/* a packed block refuses what it can't hold */
+	struct {
+		struct mpu_log_blk b;
+		uint8_t p[MPU6050_LOG_BLK - sizeof(struct mpu_log_blk)];
+	} blk = { .b = { .magic = MPU6050_LOG_BLK_MAGIC, .frames = 2, .bytes = 16 + 4 + 8,
+			 .words = LOG_WORDS, .codec = MPU6050_LOG_CODEC_PACK } };
+	uint8_t out[2 * (2 + 2 * LOG_WORDS)];
+	blk.p[16] = 1;			/* one frame, */
+	blk.p[19] = 18;			/* a delta wider than 17 bits */
+	CHECK(mpu_log_unpack(&blk.b, out, sizeof(out)) < 0);
+	CHECK(mpu_log_unpack(&blk.b, out, sizeof(out) - 1) < 0);
+
+	printf("log: %d frames round trip, unpack %.1fM frames/s packed, seeks checked\n", LOG_FRAMES, pack * 1e-6);
+
+	return 0;
+}
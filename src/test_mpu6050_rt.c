@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#define _GNU_SOURCE		/* for CPU_ISSET(), pthread_getaffinity_np(), sbrk() */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_rt.h"
+
+#include <malloc.h>		/* for mallinfo2(), mallopt() */
+#include <pthread.h>		/* for pthread_getaffinity_np() */
+#include <sched.h>		/* for cpu_set_t */
+#include <stdlib.h>		/* for malloc(), free() */
+#include <unistd.h>		/* for sbrk() */
+
+/*
+ * Real-time mode on the model: while started the process memory is
+ * locked, large allocations stay off mmap() and freed memory is kept;
+ * the reports of mpu_ctl_selftest_fast() and mpu_ctl_dump() are refused
+ * and every reading is timed. Stopping restores the cores, the locking
+ * and the malloc tuning, and the reports run again. Without the right
+ * to lock memory, a failed start must leave all of it as it was.
+ */
+#define RT_BIG	(8 * 1024 * 1024)	/* above the mmap() threshold */
+#define RT_TOP	(512 * 1024)		/* below it, above the trim one */
+
+/* VmLck of /proc/self/status, kB */
+static long locked_kb(void)
+{
+	char line[128];
+	long kb = -1;
+	FILE *fp = fopen("/proc/self/status", "r");
+	if (NULL == fp)
+		return -1;
+	while (NULL != fgets(line, sizeof(line), fp))
+		if (1 == sscanf(line, "VmLck: %ld kB", &kb))
+			break;
+	fclose(fp);
+
+	return kb;
+}
+
+/* 1 if a large block comes from mmap(), 0 if not, -1 if it failed */
+static int big_mmapped(void)
+{
+	size_t before = mallinfo2().hblks;
+	volatile char *p = malloc(RT_BIG);
+	if (NULL == p)
+		return -1;
+	p[0] = 0;
+	int mmapped = mallinfo2().hblks > before;
+	free((void *)p);
+
+	return mmapped;
+}
+
+/* 1 if freeing the top of the heap gives it back to the system */
+static int trimmed(void)
+{
+	volatile char *p = malloc(RT_TOP);
+	if (NULL == p)
+		return -1;
+	p[0] = 0;
+	char *end = sbrk(0);
+	free((void *)p);
+
+	return (char *)sbrk(0) < end;
+}
+
+static int cpus(cpu_set_t *set)
+{
+	CHECK(pthread_getaffinity_np(pthread_self(), sizeof(*set), set) == 0);
+
+	return 0;
+}
+
+int main(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+
+	/* a fixed threshold, glibc raises its own past every block freed */
+	CHECK(mallopt(M_MMAP_THRESHOLD, 2 * RT_TOP));
+	cpu_set_t set0, set;
+	CHECK(cpus(&set0) == 0);
+	long lck0 = locked_kb();
+	CHECK((lck0 >= 0) && (1 == big_mmapped()) && (1 == trimmed()));
+
+	int cpu = 0;
+	while (!CPU_ISSET(cpu, &set0))
+		cpu++;
+	struct mpu_rt rt;
+	bool started = (mpu_rt_start(&rt, dev, cpu, 0) == 0);
+	if (started) {
+		CHECK(cpus(&set) == 0);
+		CHECK((1 == CPU_COUNT(&set)) && CPU_ISSET(cpu, &set));
+		CHECK(locked_kb() > lck0);
+		CHECK(0 == big_mmapped());
+		CHECK(0 == trimmed());
+
+		CHECK(mpu_ctl_selftest_fast(dev, "rt_selftest.txt") < 0);
+		CHECK(mpu_ctl_dump(dev, "rt_dump.txt") < 0);
+		for (int n = 0; n < 100; n++)
+			CHECK(mpu_get_data(dev) == 0);
+		CHECK((100 == rt.loops) && (rt.lat_min <= rt.lat_max));
+
+		CHECK(mpu_rt_stop(&rt, dev) == 0);
+		CHECK(!rt.pinned && !rt.locked && !rt.tuned);
+	} else { /* no right to lock, attached never */
+		CHECK(!rt.pinned && !rt.locked && !rt.tuned);
+		CHECK(mpu_ctl_rt(dev, &rt) == 0);
+		CHECK(mpu_ctl_selftest_fast(dev, "rt_selftest.txt") < 0);
+		CHECK(mpu_ctl_rt(dev, NULL) == 0);
+	}
+
+	/* as before */
+	CHECK(cpus(&set) == 0);
+	CHECK(CPU_EQUAL(&set, &set0));
+	CHECK(locked_kb() == lck0);
+	CHECK(1 == trimmed());
+	CHECK(1 == big_mmapped());
+	CHECK(mpu_ctl_selftest_fast(dev, "rt_selftest.txt") >= 0);
+	CHECK(remove("rt_selftest.txt") == 0);
+
+	CHECK(mpu_rt_start(&rt, dev, cpu, 100) < 0); /* out of range */
+	CHECK(mpu_destroy(dev) == 0);
+
+	printf("rt: %s, cores, locking and malloc tuning restored, reports refused while on\n",
+	       started ? "started" : "not allowed to lock");
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_shm.h"
+
+#include <pthread.h>		/* for pthread_create() */
+
+/*
+ * A reader lapped by the publisher counts the frames it lost and goes
+ * on with the oldest still in the ring; against a publisher running in
+ * another thread no frame comes back torn, and frames read plus frames
+ * lost add up to frames published. Segments whose parameter snapshot
+ * runs past the mapping are refused.
+ */
+#define SHM_NAME	"/mpu6050_test_shm"
+#define SHM_SLOTS	16
+#define SHM_FRAMES	200000
+
+/* every field of frame n derived from n, a torn copy mixes two */
+static void frame_of(struct mpu_shm_frame *f, uint64_t n)
+{
+	memset(f, 0, sizeof(*f));
+	f->samples = n;
+	f->ts = n * 1e-3;
+	f->dt = 1e-3;
+	f->words = MPU6050_SHM_WORDS;
+	for (int i = 0; i < MPU6050_SHM_WORDS; i++) {
+		f->raw[i] = (int16_t)(n + i);
+		f->val[i] = (double)n;
+	}
+}
+
+static int whole(const struct mpu_shm_frame *f)
+{
+	struct mpu_shm_frame x;
+	frame_of(&x, f->samples);
+	CHECK(0 == memcmp((const uint8_t *)&x + sizeof(x.seq), (const uint8_t *)f + sizeof(f->seq),
+			  sizeof(x) - sizeof(x.seq)));
+
+	return 0;
+}
+
+static void *publisher(void *arg)
+{
+	struct mpu_shm *pub = arg;
+	struct mpu_shm_frame f;
+	for (uint64_t n = 0; n < SHM_FRAMES; n++) {
+		frame_of(&f, n);
+		mpu_shm_publish(pub, &f);
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+
+	struct mpu_shm pub, rd;
+	static struct mpu_shm_frame f[SHM_SLOTS];
+	size_t n = 0;
+	CHECK(mpu_shm_open(&pub, SHM_NAME, dev, SHM_SLOTS) == 0);
+	CHECK(mpu_shm_attach(&rd, SHM_NAME) == 0);
+
+	/* lapped: the oldest SHM_SLOTS of 100 remain */
+	for (uint64_t k = 0; k < 100; k++) {
+		frame_of(&f[0], k);
+		CHECK(mpu_shm_publish(&pub, &f[0]) == 0);
+	}
+	CHECK(mpu_shm_read(&rd, f, SHM_SLOTS, &n) == 0);
+	CHECK((SHM_SLOTS == n) && (100 - SHM_SLOTS == rd.lost));
+	for (size_t k = 0; k < n; k++)
+		CHECK((f[k].samples == 100 - SHM_SLOTS + k) && (whole(&f[k]) == 0));
+	CHECK((mpu_shm_read(&rd, f, SHM_SLOTS, &n) == 0) && (0 == n));
+	CHECK(mpu_shm_close(&rd) == 0);
+	CHECK(mpu_shm_close(&pub) == 0);
+
+	/* concurrent, small batches so the publisher laps the reader */
+	CHECK(mpu_shm_open(&pub, SHM_NAME, dev, SHM_SLOTS) == 0);
+	CHECK(mpu_shm_attach(&rd, SHM_NAME) == 0);
+	pthread_t th;
+	CHECK(pthread_create(&th, NULL, publisher, &pub) == 0);
+	unsigned long long got = 0;
+	uint64_t prev = 0;
+	bool first = true, done = false;
+	while (!done) {
+		done = (__atomic_load_n(&pub.hdr->head, __ATOMIC_ACQUIRE) == SHM_FRAMES);
+		CHECK(mpu_shm_read(&rd, f, 3, &n) == 0);
+		for (size_t k = 0; k < n; k++) {
+			CHECK(whole(&f[k]) == 0);
+			CHECK(first || (f[k].samples > prev));
+			prev = f[k].samples;
+			first = false;
+		}
+		got += n;
+		done = done && (0 == n);
+	}
+	pthread_join(th, NULL);
+	CHECK(got + rd.lost == SHM_FRAMES);
+	CHECK(rd.lost > 0);
+	CHECK(mpu_shm_close(&rd) == 0);
+
+	/* a snapshot past the end of the segment */
+	uint32_t plen = pub.hdr->params_len;
+	pub.hdr->params_len = (uint32_t)pub.len;
+	CHECK(mpu_shm_attach(&rd, SHM_NAME) < 0);
+	pub.hdr->params_len = plen;
+	CHECK(mpu_shm_attach(&rd, SHM_NAME) == 0);
+	CHECK(mpu_shm_close(&rd) == 0);
+	CHECK(mpu_shm_close(&pub) == 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	printf("shm: %d frames published, %llu read, %llu lost, none torn\n",
+	       SHM_FRAMES, got, SHM_FRAMES - got);
+
+	return 0;
+}
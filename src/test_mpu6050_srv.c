@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: MIT
+/* Copyright (C) 2021 Thales Antunes de Oliveira Barretto */
+#include "test_mpu6050_emu.h"
+#include "mpu6050_srv.h"
+
+#include <errno.h>		/* for errno, EAGAIN */
+#include <sys/socket.h>		/* for socketpair(), setsockopt() */
+
+/*
+ * Clients on socketpairs that stop reading: the server keeps pushing
+ * without blocking, queues at most MPU6050_SRV_QUEUE frames for each
+ * and drops the rest. DROP loses the oldest and, once read again,
+ * delivers the newest frames in order; DECIMATE halves its rate while
+ * its queue stays full, losing less, and speeds up again as it drains.
+ */
+#define SRV_PATH	"test_mpu6050_srv.sock"
+#define SRV_FRAMES	8000
+#define SRV_SNDBUF	4096
+
+struct client {
+	int	fd;
+	uint8_t	buf[1 << 16];
+	size_t	len;
+	unsigned long long frames;	/* frames received		*/
+	uint64_t last;			/* samples of the last one	*/
+	uint64_t dropped;		/* as the last header said	*/
+	unsigned int decim;		/* same				*/
+	unsigned int max_decim;
+	int	replies;
+	int	status;			/* of the last reply		*/
+};
+
+static struct client cl[2];
+
+static int connect_client(struct mpu_srv *srv, struct client *c)
+{
+	int sv[2];
+	int sz = SRV_SNDBUF;
+	memset(c, 0, sizeof(*c));
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	CHECK(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz)) == 0);
+	CHECK(mpu_srv_adopt(srv, sv[0]) == 0);
+	c->fd = sv[1];
+
+	return 0;
+}
+
+/* whatever the socket holds, messages parsed as they complete */
+static int take(struct client *c, bool *got)
+{
+	*got = false;
+	for (;;) {
+		ssize_t r = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, MSG_DONTWAIT);
+		if (r < 0) {
+			CHECK(EAGAIN == errno);
+			break;
+		}
+		CHECK(r > 0);
+		c->len += (size_t)r;
+		*got = true;
+
+		size_t off = 0;
+		while (c->len - off >= sizeof(struct mpu_srv_hdr)) {
+			struct mpu_srv_hdr h;
+			memcpy(&h, c->buf + off, sizeof(h));
+			CHECK(MPU6050_SRV_MAGIC == h.magic);
+			size_t need = sizeof(h) + h.frames * sizeof(struct mpu_srv_frame);
+			if (c->len - off < need)
+				break;
+			if (MPU6050_SRV_REPLY == h.type) {
+				c->replies++;
+				c->status = h.status;
+			}
+			for (uint32_t k = 0; k < h.frames; k++) {
+				struct mpu_srv_frame f;
+				memcpy(&f, c->buf + off + sizeof(h) + k * sizeof(f), sizeof(f));
+				CHECK((0 == c->frames) || (f.samples > c->last)); /* in order */
+				CHECK(f.ts == f.samples * 1e-3);
+				c->last = f.samples;
+				c->frames++;
+			}
+			CHECK((h.decim >= 1) && (h.decim <= MPU6050_SRV_DECIM));
+			c->dropped = h.dropped;
+			c->decim = h.decim;
+			c->max_decim = (h.decim > c->max_decim) ? h.decim : c->max_decim;
+			off += need;
+		}
+		c->len -= off;
+		memmove(c->buf, c->buf + off, c->len);
+	}
+
+	return 0;
+}
+
+/* read until the server has nothing left for the client */
+static int drain(struct mpu_srv *srv, struct client *c)
+{
+	bool got = true;
+	while (got) {
+		CHECK(mpu_srv_poll(srv, 0) == 0);
+		CHECK(take(c, &got) == 0);
+	}
+	CHECK(0 == c->len);
+
+	return 0;
+}
+
+static void push(struct mpu_srv *srv, struct mpu_dev *dev, int frames)
+{
+	for (int n = 0; n < frames; n++) {
+		dev->samples++;
+		dev->ts = dev->samples * 1e-3;
+		mpu_srv_push(srv);
+	}
+}
+
+int main(void)
+{
+	struct mpu_dev *dev = NULL;
+	emu_reset();
+	CHECK(mpu_init("/dev/null", &dev, MPU6050_RESET) == 0);
+	dev->samples = 0;
+
+	struct mpu_srv srv;
+	CHECK(mpu_srv_open(&srv, SRV_PATH, dev) == 0);
+	CHECK(connect_client(&srv, &cl[0]) == 0);
+	CHECK(connect_client(&srv, &cl[1]) == 0);
+	CHECK(2 == srv.clients);
+	CHECK(dprintf(cl[1].fd, "policy decimate\n") > 0);
+	CHECK(drain(&srv, &cl[1]) == 0);
+	CHECK((1 == cl[1].replies) && (0 == cl[1].status));
+
+	/* neither reads: push never blocks, queues stay bounded */
+	uint64_t first = dev->samples;
+	push(&srv, dev, SRV_FRAMES);
+	CHECK(2 == srv.clients);
+	CHECK(srv.sent + MPU6050_SRV_QUEUE < SRV_FRAMES);
+	unsigned long long dropped = srv.dropped, sent = srv.sent;
+
+	CHECK(drain(&srv, &cl[0]) == 0);
+	CHECK(drain(&srv, &cl[1]) == 0);
+	CHECK(srv.dropped == dropped);
+
+	/* DROP: every frame pushed received or counted lost, the newest kept */
+	CHECK(cl[0].frames + cl[0].dropped == SRV_FRAMES);
+	CHECK(cl[0].frames <= sent + MPU6050_SRV_QUEUE); /* the socket, then the queue */
+	CHECK(cl[0].last == first + SRV_FRAMES);
+	CHECK(1 == cl[0].max_decim);
+
+	/* DECIMATE: slowed down, lost less */
+	CHECK(cl[1].max_decim > 1);
+	CHECK(cl[1].dropped < cl[0].dropped);
+	CHECK(cl[1].frames + cl[1].dropped < SRV_FRAMES);
+	CHECK(srv.dropped == cl[0].dropped + cl[1].dropped);
+	uint64_t lost[2] = { cl[0].dropped, cl[1].dropped };
+
+	/* read again, DECIMATE back to every frame */
+	for (int n = 0; n < 64; n++) {
+		push(&srv, dev, MPU6050_SRV_BATCH);
+		CHECK(drain(&srv, &cl[1]) == 0);
+	}
+	CHECK(1 == cl[1].decim);
+	CHECK(drain(&srv, &cl[0]) == 0);
+	CHECK(cl[0].frames + cl[0].dropped == SRV_FRAMES + 64 * MPU6050_SRV_BATCH);
+
+	/* a client hanging up is dropped on the next poll */
+	close(cl[0].fd);
+	CHECK(mpu_srv_poll(&srv, 0) == 0);
+	CHECK(1 == srv.clients);
+	close(cl[1].fd);
+	CHECK(mpu_srv_close(&srv) == 0);
+	CHECK(mpu_srv_adopt(&srv, -1) < 0);
+	CHECK(mpu_destroy(dev) == 0);
+
+	printf("srv: %d frames pushed, drop lost %llu, decimate lost %llu at up to 1 in %u\n",
+	       SRV_FRAMES, (unsigned long long)lost[0], (unsigned long long)lost[1], cl[1].max_decim);
+
+	return 0;
+}